@@ -62,6 +62,19 @@
 #define ColorMap            320
 #define TIFFTAG_SAMPLEFORMAT        339 // data sample format
 
+// GeoTIFF tag names
+#define ModelPixelScale     33550
+#define ModelTiepoint       33922
+#define GeoKeyDirectory     34735
+
+// GeoTIFF key names and values
+#define GTModelTypeGeoKey       1024
+#define GTRasterTypeGeoKey      1025
+#define GeographicTypeGeoKey    2048
+#define ModelTypeGeographic     2
+#define RasterPixelIsArea       1
+#define GCS_WGS_84              4326
+
 #define PHOTOMETRIC_MINISBLACK  1      // min value is black
 #define SAMPLEFORMAT_UINT       1      // unsigned integer data
 
@@ -118,6 +131,19 @@ static int Write8Byte(FILE *hFileRef, long long n)
    return 0;
    }
 
+static int WriteDouble(FILE *hFileRef, double x)
+   {
+   int lCount;
+
+   lCount = fwrite(&x, sizeof(double), 1, hFileRef);
+   if (lCount != 1)
+      {
+      return -1;
+      }
+
+   return 0;
+   }
+
 static int WriteString(FILE *hFileRef, const char *str, int count)
    // count MUST include the NUL terminator
    {
@@ -130,7 +156,7 @@ static int WriteString(FILE *hFileRef, const char *str, int count)
       return -1;
       }
 
-   if (count & (1 == 0))
+   if ((count & 1) == 0)
       {
       return 0;
       }
@@ -285,6 +311,198 @@ static int WriteBitmap(FILE *hFile, int width, int height, const float *data)
    return 0;
    }
 
+static int WriteBitmap8Bit(FILE *hFile, int width, int height, const float *data)
+   {
+   int lCount;
+   int i, j;
+   float fltval;
+   const float *ptr;
+   unsigned char *buffer;
+
+   const unsigned char nodata = 0;
+
+   buffer = (unsigned char *) malloc(width);
+   if (!buffer)
+      {
+      return -2;
+      }
+
+   for (i=0, ptr=data; i<height; ++i, ptr+=width)
+      {
+      for (j=0; j<width; ++j)
+         {
+         fltval = ptr[j];
+         if (flt_isnan(fltval))
+            {
+            buffer[j] = nodata;
+            }
+         // check limits before integer conversion to avoid overflow
+         else if (fltval <= 0.0)
+            {
+            buffer[j] = 0;
+            }
+         else if (fltval >= 255.0)
+            {
+            buffer[j] = 255;
+            }
+         else
+            {
+            buffer[j] = (unsigned char) (fltval+0.5);
+            }
+         }
+
+      lCount = fwrite(buffer, 1, width, hFile);
+      if (lCount != width)
+         {
+         free(buffer);
+         return -1;
+         }
+      }
+   free(buffer);
+
+   return 0;
+   }
+
+int WriteGrayscale8BitToGeoTIFF(
+   FILE *hFile, int width, int height, const float *data,
+   double xmin, double ymax, double xdim, double ydim, int geographic,
+   const char *softwareVersion, size_t *fileSize
+)
+   {
+   size_t lWriteCount, tiffSize;
+   short sTagCount;
+   long softwarePos, scalePos, tiepointPos, keysPos, pos;
+   int err;
+   int softwareCount, softwareSpace;
+   int nKeys;
+
+   lWriteCount = (size_t) height * (size_t) width;
+
+   softwareCount = softwareVersion ? strlen(softwareVersion) : 0;
+
+   sTagCount = 14;
+   softwareSpace = 0;
+   if (softwareCount)
+      {
+      softwareCount++;  // include NUL terminator
+      softwareSpace = softwareCount + (softwareCount & 1);  // round up to word boundary
+      sTagCount++;
+      }
+
+   // geographic data is assumed to be WGS 84; projected data has no CRS keys
+   // (a .prj file may be supplied alongside)
+   nKeys = geographic ? 3 : 1;
+
+// Lay out the file: header, tags, tag data, bitmap
+   softwarePos = 8 + 2 + 12*sTagCount + 4;
+   scalePos    = softwarePos + softwareSpace;
+   tiepointPos = scalePos + 3*8;
+   keysPos     = tiepointPos + 6*8;
+   pos         = keysPos + 4*(nKeys+1)*2;
+
+   tiffSize = pos + lWriteCount;
+
+   if ((tiffSize-1)>>32)
+      {
+      return -3;   // too big for basic TIFF
+      }
+
+   if (fileSize)
+      {
+      *fileSize = tiffSize;
+      }
+
+// Write the header
+   if (am_big_endian())
+      {
+      err = WriteWord(hFile, 0x4d4d); // 'MM' is for Motorola (big-endian) number format in the file
+      }
+   else
+      {
+      err = WriteWord(hFile, 0x4949); // 'II' is for Intel (little-endian) number format in the file
+      }
+   err |= WriteWord(hFile, 42);
+   err |= WriteLong(hFile, 8);          // Offset of tags
+
+// Write the tags (in increasing order)
+   err |= WriteWord(hFile, sTagCount);
+
+   err |= WriteTIFFTag(hFile, ImageWidth, TIFFlong, 1, width);
+   err |= WriteTIFFTag(hFile, ImageLength, TIFFlong, 1, height);
+   err |= WriteTIFFTag(hFile, BitsPerSample, TIFFshort, 1, 8);
+   err |= WriteTIFFTag(hFile, Compression, TIFFshort, 1, 1);
+   err |= WriteTIFFTag(hFile, PhotometricInterp, TIFFshort, 1, PHOTOMETRIC_MINISBLACK);
+   err |= WriteTIFFTag(hFile, StripOffsets, TIFFlong, 1, pos);
+   err |= WriteTIFFTag(hFile, SamplesPerPixel, TIFFshort, 1, 1);
+   err |= WriteTIFFTag(hFile, RowsPerStrip, TIFFlong, 1, height);
+   err |= WriteTIFFTag(hFile, StripByteCounts, TIFFlong, 1, lWriteCount);
+   err |= WriteTIFFTag(hFile, PlanarConfiguration, TIFFshort, 1, 1);
+   if (softwareCount)
+      {
+      err |= WriteTIFFAsciiTag(hFile, Software, softwareVersion, softwareCount, softwarePos);
+      }
+   err |= WriteTIFFTag(hFile, TIFFTAG_SAMPLEFORMAT, TIFFshort, 1, SAMPLEFORMAT_UINT);
+   err |= WriteTIFFTag(hFile, ModelPixelScale, TIFFdouble, 3, scalePos);
+   err |= WriteTIFFTag(hFile, ModelTiepoint, TIFFdouble, 6, tiepointPos);
+   err |= WriteTIFFTag(hFile, GeoKeyDirectory, TIFFshort, 4*(nKeys+1), keysPos);
+
+   err |= WriteLong(hFile, 0);
+
+// Write the tag data
+   if (softwareCount)
+      {
+      err |= WriteString(hFile, softwareVersion, softwareCount);
+      }
+
+   err |= WriteDouble(hFile, xdim);     // pixel size
+   err |= WriteDouble(hFile, ydim);
+   err |= WriteDouble(hFile, 0.0);
+
+   err |= WriteDouble(hFile, 0.0);      // raster (0,0) is top left corner...
+   err |= WriteDouble(hFile, 0.0);
+   err |= WriteDouble(hFile, 0.0);
+   err |= WriteDouble(hFile, xmin);     // ...at these model coordinates
+   err |= WriteDouble(hFile, ymax);
+   err |= WriteDouble(hFile, 0.0);
+
+   err |= WriteWord(hFile, 1);          // key directory version 1.1.0
+   err |= WriteWord(hFile, 1);
+   err |= WriteWord(hFile, 0);
+   err |= WriteWord(hFile, nKeys);
+   if (geographic)
+      {
+      err |= WriteWord(hFile, GTModelTypeGeoKey);
+      err |= WriteWord(hFile, 0);
+      err |= WriteWord(hFile, 1);
+      err |= WriteWord(hFile, ModelTypeGeographic);
+      }
+   err |= WriteWord(hFile, GTRasterTypeGeoKey);
+   err |= WriteWord(hFile, 0);
+   err |= WriteWord(hFile, 1);
+   err |= WriteWord(hFile, RasterPixelIsArea);
+   if (geographic)
+      {
+      err |= WriteWord(hFile, GeographicTypeGeoKey);
+      err |= WriteWord(hFile, 0);
+      err |= WriteWord(hFile, 1);
+      err |= WriteWord(hFile, GCS_WGS_84);
+      }
+
+   if (err)
+      {
+      return err;
+      }
+
+   if (ftell(hFile) != pos)
+      {
+      return -1;
+      }
+
+   err = WriteBitmap8Bit(hFile, width, height, data);
+
+   return err;
+   }
+
 int WriteGrayscale16BitToTIFF(
    FILE *hFile, int width, int height, const float *data, const char *softwareVersion, size_t *fileSize
 )
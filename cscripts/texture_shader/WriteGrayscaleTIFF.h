@@ -46,6 +46,15 @@ int WriteGrayscale16BitToBigTIFF(
    FILE *hFile, int width, int height, const float *data, const char *softwareVersion, size_t *fileSize
 );
 
+// writes 8-bit image with GeoTIFF tags for the given top left corner and pixel size;
+// if geographic is nonzero, coordinates are WGS 84 longitude/latitude
+// returns -2 if a memory allocation error occurred, -3 if file size would exceed 4 GB
+int WriteGrayscale8BitToGeoTIFF(
+   FILE *hFile, int width, int height, const float *data,
+   double xmin, double ymax, double xdim, double ydim, int geographic,
+   const char *softwareVersion, size_t *fileSize
+);
+
 #ifdef __cplusplus
 }
 #endif
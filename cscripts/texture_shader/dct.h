@@ -74,6 +74,87 @@ void cleanup_dcts(
     struct Dct_Plan *plan   // from setup_dcts()
 );
 
+
+//
+// Batched single-precision DCTs. Each call transforms 2*batch vectors at once,
+// using SIMD instructions where available. Data vectors are interleaved, so
+// that element j of vector k in buffer b is in_data[b][j*batch+k]; otherwise
+// the semantics are the same as setup_dcts(), perform_dcts(), and cleanup_dcts().
+//
+
+struct Dct_Batch_Plan {
+    // This structure must be filled in by calling setup_batch_dcts() and should
+    // not be modified by the caller.
+    // Do NOT free these pointers - use cleanup_batch_dcts() instead.
+    // Note: input and output buffers may be the same.
+    void   * dct_buffer;    // internal buffer for use by perform_batch_dcts()
+    int      batch;         // number of vectors interleaved in each data buffer
+    float  * in_data[2];    // input  data buffers for perform_batch_dcts()
+    float  * out_data[2];   // output data buffers for perform_batch_dcts()
+};
+
+// Specifies a batched DCT operation to be performed one or more times and
+// allocates buffers to be used by perform_batch_dcts(). The batch size is
+// chosen at run time from the instruction sets supported by the processor.
+// On return, plan->dct_buffer will be null if a memory allocation error occurred.
+struct Dct_Batch_Plan setup_batch_dcts(
+    int dct_type,   // 1, 2, or 3 (DCT types I, II, III)
+    int nelems      // data length for each DCT
+);
+
+// Performs 2*batch DCTs, each of size nelems (see setup_batch_dcts()).
+// Input arrays are plan->in_data[.] and output arrays are plan->out_data[.].
+// Note: input buffers may be overwritten, even if output buffers are different.
+// Values in both data buffers at the same interleaved position must have similar
+// magnitude to avoid roundoff error; unused positions may be filled with zeroes.
+void perform_batch_dcts(
+    const struct Dct_Batch_Plan *plan   // from setup_batch_dcts()
+);
+
+// Frees memory allocated by setup_batch_dcts().
+void cleanup_batch_dcts(
+    struct Dct_Batch_Plan *plan // from setup_batch_dcts()
+);
+
+// Returns name of instruction set used by perform_batch_dcts() (e.g. "AVX2").
+const char *batch_dcts_isa( void );
+
+
+//
+// Single-precision DCTs performed in place on the caller's arrays, with no
+// conversion to double precision and no copying into separate buffers.
+// Otherwise the semantics are the same as setup_dcts(), perform_dcts(), and
+// cleanup_dcts().
+//
+
+struct Dct_Float_Plan {
+    // This structure must be filled in by calling setup_float_dcts() and should
+    // not be modified by the caller.
+    // Do NOT free this pointer - use cleanup_float_dcts() instead.
+    void   * dct_buffer;    // internal buffer for use by perform_float_dcts()
+};
+
+// Specifies a single-precision DCT operation to be performed one or more times.
+// On return, plan->dct_buffer will be null if a memory allocation error occurred.
+struct Dct_Float_Plan setup_float_dcts(
+    int dct_type,   // 1, 2, or 3 (DCT types I, II, III)
+    int nelems      // data length for each DCT
+);
+
+// Performs two DCTs in place, each of size nelems (see setup_float_dcts()),
+// or one DCT if data1 is null (which takes about the same time as two).
+// Values in both arrays must have similar magnitude to avoid roundoff error.
+void perform_float_dcts(
+    const struct Dct_Float_Plan *plan,  // from setup_float_dcts()
+    float *data0,   // input/output: first  array of nelems values
+    float *data1    // input/output: second array of nelems values, or null
+);
+
+// Frees memory allocated by setup_float_dcts().
+void cleanup_float_dcts(
+    struct Dct_Float_Plan *plan // from setup_float_dcts()
+);
+
 #ifdef __cplusplus
 }
 #endif
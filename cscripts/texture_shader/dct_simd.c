@@ -0,0 +1,376 @@
+/*
+ * dct_simd.c
+ *
+ * Single-precision DCT backend for the texture_shader tools.
+ * Added for tectoplot; distributed under the same terms as the other
+ * files in this directory (see LICENSE.txt).
+ */
+
+//
+// This file provides an implementation of the batched functions in dct.h,
+// using vector versions of the fftpack.c transforms (see fftpack_vec.h).
+// Each element of a vector holds the same element of a different data
+// sequence, so one pass over the data transforms a whole batch of rows.
+//
+// The scalar version also implements the in-place single-precision functions
+// (setup_float_dcts() etc.), which transform the caller's rows directly.
+//
+// The vector width is chosen at run time:
+//   x86 with GCC or Clang:  AVX-512 (16 floats), AVX2 (8 floats), or SSE2 (4 floats)
+//   other GCC or Clang:     generic 4-float vectors (e.g., NEON on ARM)
+//   other compilers:        scalar floats (batch size 1)
+//
+
+#define _CRT_SECURE_NO_DEPRECATE
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "dct.h"
+
+#include "fftpack.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#   define DCT_SIMD_VECTORS
+#   if defined(__x86_64__) || defined(__i386__)
+#       define DCT_SIMD_X86
+#   endif
+#endif
+
+static const int max_factors = 30;
+
+static const size_t vector_align = 64;  // enough for any instruction set below
+
+struct Dct_Batch_Buffer {
+    int     dct_type;   // 1 to 3 (DCT types I to III)
+    int     nelems;     // number of vectors in inout_data0 and inout_data1 buffers
+    int     batch;      // number of floats in each vector
+    void  (*perform)( const struct Dct_Batch_Buffer *buf );
+    void   *inout_data0;// input/output buffer space (nelems vectors)
+    void   *inout_data1;// input/output buffer space (nelems vectors)
+    void   *work;       // scratch space (max(nelems,3*m) vectors; see fftpack_vec.h)
+    float  *wsave;      // twiddle factors from cosqi()
+    int    *ifac;       // info on factorization of nelems
+    void   *storage;    // unaligned memory block holding all of the above
+};
+
+// Instantiate fftpack_vec.h for each instruction set:
+
+#define REAL float
+
+// scalar version, for single-precision DCTs in place and when there are no vectors
+#define VREAL       float
+#define VZERO       0.0f
+#define FFTV(name)  name##_v1
+#define FFTV_TARGET
+#include "fftpack_vec.h"
+#undef VREAL
+#undef VZERO
+#undef FFTV
+#undef FFTV_TARGET
+
+#ifdef DCT_SIMD_VECTORS
+
+typedef float Vec4f __attribute__(( vector_size(16) ));
+
+#define VREAL       Vec4f
+#define VZERO       ((Vec4f){ 0.0f, 0.0f, 0.0f, 0.0f })
+#define FFTV(name)  name##_v4
+#define FFTV_TARGET
+#include "fftpack_vec.h"
+#undef VREAL
+#undef VZERO
+#undef FFTV
+#undef FFTV_TARGET
+
+#endif
+
+#ifdef DCT_SIMD_X86
+
+typedef float Vec8f  __attribute__(( vector_size(32) ));
+typedef float Vec16f __attribute__(( vector_size(64) ));
+
+#define VREAL       Vec8f
+#define VZERO       ((Vec8f){ 0.0f })
+#define FFTV(name)  name##_avx2
+#define FFTV_TARGET __attribute__(( target("avx2") ))
+#include "fftpack_vec.h"
+#undef VREAL
+#undef VZERO
+#undef FFTV
+#undef FFTV_TARGET
+
+#define VREAL       Vec16f
+#define VZERO       ((Vec16f){ 0.0f })
+#define FFTV(name)  name##_avx512
+#define FFTV_TARGET __attribute__(( target("avx512f") ))
+#include "fftpack_vec.h"
+#undef VREAL
+#undef VZERO
+#undef FFTV
+#undef FFTV_TARGET
+
+#endif
+
+#undef REAL
+
+// Selects the widest instruction set supported by this processor.
+static void select_isa(
+    int   *batch,
+    void (**perform)( const struct Dct_Batch_Buffer *buf ),
+    const char **name
+)
+{
+#if defined(DCT_SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports( "avx512f" )) {
+        *batch   = 16;
+        *perform = perform_batch_dcts_avx512;
+        *name    = "AVX-512";
+        return;
+    }
+    if (__builtin_cpu_supports( "avx2" )) {
+        *batch   = 8;
+        *perform = perform_batch_dcts_avx2;
+        *name    = "AVX2";
+        return;
+    }
+#endif
+#if defined(DCT_SIMD_VECTORS)
+    *batch   = 4;
+    *perform = perform_batch_dcts_v4;
+#   if defined(DCT_SIMD_X86)
+    *name    = "SSE2";
+#   else
+    *name    = "4-wide vector";
+#   endif
+#else
+    *batch   = 1;
+    *perform = perform_batch_dcts_v1;
+    *name    = "scalar";
+#endif
+}
+
+const char *batch_dcts_isa( void )
+{
+    int batch;
+    void (*perform)( const struct Dct_Batch_Buffer *buf );
+    const char *name;
+
+    select_isa( &batch, &perform, &name );
+    return name;
+}
+
+static struct Dct_Batch_Buffer *new_dct_buffer(
+    int dct_type,   // 1, 2, or 3 (DCT types I, II, III)
+    int nelems,     // data length for each DCT
+    int batch,      // number of floats in each vector
+    void (*perform)( const struct Dct_Batch_Buffer *buf )
+)
+// Allocates and sets up buffer for setup_batch_dcts() or setup_float_dcts().
+// Returns null if a memory allocation error occurred.
+{
+    const int max_ifac = (int)( 1.8 * max_factors + 6.9 );
+
+    struct Dct_Batch_Buffer *buf;
+
+    double *wsave;
+    size_t vec_size, nwork, nbytes;
+    char  *ptr;
+    int    i, m;
+
+    buf = (struct Dct_Batch_Buffer *)malloc( sizeof( struct Dct_Batch_Buffer ) );
+    if (!buf) {
+        return NULL;
+    }
+
+    // twiddle factors are computed in double precision, then rounded
+    wsave = (double *)calloc( 28 * (size_t)nelems, sizeof( double ) );
+    if (!wsave) {
+        free( buf );
+        return NULL;
+    }
+
+    buf->ifac = (int *)malloc( max_ifac * sizeof( int ) );
+    if (!buf->ifac) {
+        free( wsave );
+        free( buf );
+        return NULL;
+    }
+
+    switch (dct_type) {
+    //  case 1:
+    //      break;
+        case 2: case 3:
+            cosqi( nelems, wsave, buf->ifac );
+            break;
+        default:
+            assert( 0 );    // illegal or unsupported dct_type
+    }
+
+    assert( buf->ifac[1] <= max_factors );
+
+    buf->dct_type = dct_type;
+    buf->nelems   = nelems;
+    buf->batch    = batch;
+    buf->perform  = perform;
+
+    m = nelems < 2 ? 0 : buf->ifac[ buf->ifac[1]+2 ];   // Bluestein length, or 0
+
+    vec_size = sizeof( float ) * batch;
+    nwork    = (size_t)( 3*m > nelems ? 3*m : nelems );
+    nbytes   = vec_size * (2 * (size_t)nelems + nwork) + sizeof( float ) * 28 * (size_t)nelems;
+
+    buf->storage = malloc( nbytes + vector_align );
+    if (!buf->storage) {
+        free( buf->ifac );
+        free( wsave );
+        free( buf );
+        return NULL;
+    }
+
+    ptr = (char *)buf->storage;
+    ptr += (vector_align - (size_t)ptr % vector_align) % vector_align;
+
+    buf->inout_data0 = (void *)ptr, ptr += vec_size * nelems;
+    buf->inout_data1 = (void *)ptr, ptr += vec_size * nelems;
+    buf->work        = (void *)ptr, ptr += vec_size * nwork;
+    buf->wsave       = (float *)ptr;
+
+    for (i=0; i<28*nelems; ++i) {
+        buf->wsave[i] = (float)wsave[i];
+    }
+    free( wsave );
+
+    return buf;
+}
+
+static void free_dct_buffer( struct Dct_Batch_Buffer *buf )
+{
+    free( buf->storage );
+    free( buf->ifac );
+    free( buf );
+}
+
+struct Dct_Batch_Plan setup_batch_dcts(
+    int dct_type,   // 1, 2, or 3 (DCT types I, II, III)
+    int nelems      // data length for each DCT
+)
+// Specifies a batched DCT operation to be performed one or more times and
+// allocates buffers to be used by perform_batch_dcts().
+// On return, plan->dct_buffer will be null if a memory allocation error occurred.
+{
+    struct Dct_Batch_Plan plan;
+    struct Dct_Batch_Buffer *buf;
+
+    int batch;
+    void (*perform)( const struct Dct_Batch_Buffer *buf );
+    const char *name;
+
+    plan.dct_buffer  = NULL;
+    plan.batch       = 0;
+    plan.in_data[0]  = NULL;
+    plan.in_data[1]  = NULL;
+    plan.out_data[0] = NULL;
+    plan.out_data[1] = NULL;
+
+    select_isa( &batch, &perform, &name );
+
+    buf = new_dct_buffer( dct_type, nelems, batch, perform );
+    if (!buf) {
+        return plan;
+    }
+
+    plan.dct_buffer  = (void *)buf;
+    plan.batch       = buf->batch;
+    plan.in_data[0]  = (float *)buf->inout_data0;
+    plan.in_data[1]  = (float *)buf->inout_data1;
+    plan.out_data[0] = (float *)buf->inout_data0; // in-place transforms
+    plan.out_data[1] = (float *)buf->inout_data1; // in-place transforms
+    return plan;
+}
+
+void perform_batch_dcts(
+    const struct Dct_Batch_Plan *plan   // from setup_batch_dcts()
+)
+// Performs 2*batch DCTs, each of size nelems (see setup_batch_dcts()).
+// Input arrays are plan->in_data[.] and output arrays are plan->out_data[.].
+{
+    struct Dct_Batch_Buffer *buf = (struct Dct_Batch_Buffer *)(plan->dct_buffer);
+
+    // verify that caller has not altered these pointers
+    assert( plan->in_data[0]  == buf->inout_data0 );
+    assert( plan->in_data[1]  == buf->inout_data1 );
+    assert( plan->out_data[0] == buf->inout_data0 );  // in-place transform
+    assert( plan->out_data[1] == buf->inout_data1 );  // in-place transform
+
+    buf->perform( buf );
+}
+
+void cleanup_batch_dcts(
+    struct Dct_Batch_Plan *plan // from setup_batch_dcts()
+)
+// Frees memory allocated by setup_batch_dcts().
+{
+    struct Dct_Batch_Buffer *buf = (struct Dct_Batch_Buffer *)(plan->dct_buffer);
+
+    // verify that caller has not altered these pointers
+    assert( plan->in_data[0]  == buf->inout_data0 );
+    assert( plan->in_data[1]  == buf->inout_data1 );
+    assert( plan->out_data[0] == buf->inout_data0 );
+    assert( plan->out_data[1] == buf->inout_data1 );
+
+    free_dct_buffer( buf );
+
+    plan->in_data[0]  = NULL;
+    plan->in_data[1]  = NULL;
+    plan->out_data[1] = NULL;
+    plan->out_data[0] = NULL;
+    plan->dct_buffer  = NULL;
+    plan->batch       = 0;
+}
+
+struct Dct_Float_Plan setup_float_dcts(
+    int dct_type,   // 1, 2, or 3 (DCT types I, II, III)
+    int nelems      // data length for each DCT
+)
+// Specifies a single-precision DCT operation to be performed one or more times
+// on the caller's arrays by perform_float_dcts().
+// On return, plan->dct_buffer will be null if a memory allocation error occurred.
+{
+    struct Dct_Float_Plan plan;
+
+    plan.dct_buffer = (void *)new_dct_buffer( dct_type, nelems, 1, perform_batch_dcts_v1 );
+    return plan;
+}
+
+void perform_float_dcts(
+    const struct Dct_Float_Plan *plan,  // from setup_float_dcts()
+    float *data0,   // input/output: first  array of nelems values
+    float *data1    // input/output: second array of nelems values, or null
+)
+// Performs one or two DCTs in place (see setup_float_dcts()).
+{
+    struct Dct_Batch_Buffer *buf = (struct Dct_Batch_Buffer *)(plan->dct_buffer);
+
+    if (!data1) {
+        // the transforms work in pairs; transform a copy alongside
+        data1 = (float *)buf->inout_data1;
+        memcpy( data1, data0, buf->nelems * sizeof( float ) );
+    }
+
+    transform_v1( buf, data0, data1 );
+}
+
+void cleanup_float_dcts(
+    struct Dct_Float_Plan *plan // from setup_float_dcts()
+)
+// Frees memory allocated by setup_float_dcts().
+{
+    free_dct_buffer( (struct Dct_Batch_Buffer *)(plan->dct_buffer) );
+
+    plan->dct_buffer = NULL;
+}
@@ -0,0 +1,286 @@
+/*
+ * fast_pow.c
+ *
+ * Vectorized power function for the fractional Laplacian operator.
+ * Added for tectoplot; distributed under the same terms as the other
+ * files in this directory (see LICENSE.txt).
+ */
+
+//
+// The operator stage of terrain_filter() scales each spectral coefficient by
+// pow( separablex[i] + separabley[j], power ), one libm call per coefficient.
+// This file provides a replacement that evaluates several powers at once with
+// polynomial approximations (see fast_pow_vec.h), chosen at run time:
+//   x86 with GCC or Clang:  AVX-512 (8 doubles), AVX2 (4 doubles), or SSE2 (2 doubles)
+//   other GCC or Clang:     generic 2-double vectors (e.g., NEON on ARM)
+//   other compilers:        pow() from the math library
+//
+// To build the benchmark comparing the fast and libm versions:
+//   gcc -O2 -DFAST_POW_BENCHMARK fast_pow.c -o fast_pow_benchmark -lm
+//
+
+#define _CRT_SECURE_NO_DEPRECATE
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "fast_pow.h"
+
+#include "compatibility.h"
+
+#include <string.h>
+#include <math.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#   define FAST_POW_VECTORS
+#   if defined(__x86_64__) || defined(__i386__)
+#       define FAST_POW_X86
+#   endif
+#endif
+
+void scale_pow_libm(
+    float *data, const double *y, double x, double power, double factor, int n )
+{
+    int j;
+
+    for (j=0; j<n; ++j) {
+        data[j] *= factor * pow( x + y[j], power );
+    }
+}
+
+// Instantiate fast_pow_vec.h for each instruction set:
+
+#ifdef FAST_POW_VECTORS
+
+typedef double    Vec2d __attribute__(( vector_size(16) ));
+typedef long long Vec2l __attribute__(( vector_size(16) ));
+
+#define VDOUBLE     Vec2d
+#define VINT64      Vec2l
+#define VWIDTH      2
+#define POWV(name)  name##_v2
+#define POWV_TARGET
+#include "fast_pow_vec.h"
+#undef VDOUBLE
+#undef VINT64
+#undef VWIDTH
+#undef POWV
+#undef POWV_TARGET
+
+#endif
+
+#ifdef FAST_POW_X86
+
+typedef double    Vec4d __attribute__(( vector_size(32) ));
+typedef long long Vec4l __attribute__(( vector_size(32) ));
+typedef double    Vec8d __attribute__(( vector_size(64) ));
+typedef long long Vec8l __attribute__(( vector_size(64) ));
+
+#define VDOUBLE     Vec4d
+#define VINT64      Vec4l
+#define VWIDTH      4
+#define POWV(name)  name##_avx2
+#define POWV_TARGET __attribute__(( target("avx2") ))
+#include "fast_pow_vec.h"
+#undef VDOUBLE
+#undef VINT64
+#undef VWIDTH
+#undef POWV
+#undef POWV_TARGET
+
+#define VDOUBLE     Vec8d
+#define VINT64      Vec8l
+#define VWIDTH      8
+#define POWV(name)  name##_avx512
+#define POWV_TARGET __attribute__(( target("avx512f") ))
+#include "fast_pow_vec.h"
+#undef VDOUBLE
+#undef VINT64
+#undef VWIDTH
+#undef POWV
+#undef POWV_TARGET
+
+#endif
+
+Scale_Pow_Function select_scale_pow( const char **isa )
+{
+    Scale_Pow_Function function;
+    const char *name;
+
+#if defined(FAST_POW_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports( "avx512f" )) {
+        function = scale_pow_avx512;
+        name     = "AVX-512";
+    } else if (__builtin_cpu_supports( "avx2" )) {
+        function = scale_pow_avx2;
+        name     = "AVX2";
+    } else {
+        function = scale_pow_v2;
+        name     = "SSE2";
+    }
+#elif defined(FAST_POW_VECTORS)
+    function = scale_pow_v2;
+    name     = "2-wide vector";
+#else
+    function = scale_pow_libm;
+    name     = "scalar";
+#endif
+
+    if (isa) {
+        *isa = name;
+    }
+    return function;
+}
+
+
+#ifdef FAST_POW_BENCHMARK
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Operator arguments range over squared spatial frequencies (in 1/meters^2),
+// from about 1e-14 for a large low-resolution grid to about 1 for 1-meter data.
+
+static double elapsed( clock_t start )
+{
+    return (double)( clock() - start ) / CLOCKS_PER_SEC;
+}
+
+static void check_errors(
+    const char *name,
+    void (*pow_array)( double *out, const double *in, double power, int n ),
+    const double *in, double *out, int n )
+{
+    const double powers[] = { 0.25, 1.0/3.0, 0.5, 0.75, 1.0, -0.5 };
+
+    double max_err = 0.0;
+    double err;
+    int i, j;
+
+    for (i=0; i<(int)( sizeof( powers ) / sizeof( powers[0] ) ); ++i) {
+        pow_array( out, in, powers[i], n );
+        for (j=0; j<n; ++j) {
+            double exact = pow( in[j], powers[i] );
+            err = fabs( out[j] - exact ) / exact;
+            if (err > max_err) {
+                max_err = err;
+            }
+        }
+    }
+
+    printf( "%-8s max relative error %.3g\n", name, max_err );
+}
+
+int main( int argc, const char *argv[] )
+{
+    const int    ncols  = 4000;     // columns of spectral coefficients
+    const int    nrows  = 4001;     // values per column (odd, to test partial vectors)
+    const double power  = 0.25;     // detail = 1/2
+    const double factor = 1e-3;
+
+    double *x, *y, *in, *out;
+    float  *data1, *data2;
+    clock_t start;
+    double  time_libm, time_fast;
+    long    ndiff;
+    int     i, j, n;
+
+    Scale_Pow_Function scale_pow;
+    const char *isa;
+
+    x     = (double *)malloc( ncols * sizeof( double ) );
+    y     = (double *)malloc( nrows * sizeof( double ) );
+    in    = (double *)malloc( 1000000 * sizeof( double ) );
+    out   = (double *)malloc( 1000000 * sizeof( double ) );
+    data1 = (float  *)malloc( nrows * sizeof( float ) );
+    data2 = (float  *)malloc( nrows * sizeof( float ) );
+    if (!x || !y || !in || !out || !data1 || !data2) {
+        fprintf( stderr, "Memory allocation error.\n" );
+        return EXIT_FAILURE;
+    }
+
+    // Accuracy over the full range of operator arguments:
+
+    n = 1000000;
+    for (j=0; j<n; ++j) {
+        in[j] = pow( 10.0, -15.0 + 16.0 * (double)rand() / RAND_MAX );
+    }
+
+#if defined(FAST_POW_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports( "avx512f" )) {
+        check_errors( "AVX-512", pow_array_avx512, in, out, n );
+    }
+    if (__builtin_cpu_supports( "avx2" )) {
+        check_errors( "AVX2", pow_array_avx2, in, out, n );
+    }
+#endif
+#if defined(FAST_POW_VECTORS)
+    check_errors( "2-wide", pow_array_v2, in, out, n );
+#endif
+
+    // Speed and agreement of operator results:
+
+    for (i=0; i<ncols; ++i) {
+        x[i] = 1e-8 * (double)i * (double)i / ((double)ncols * ncols);
+    }
+    for (j=0; j<nrows; ++j) {
+        y[j] = 1e-8 * (double)j * (double)j / ((double)nrows * nrows);
+    }
+
+    start = clock();
+    for (i=0; i<ncols; ++i) {
+        for (j=0; j<nrows; ++j) {
+            data1[j] = 1.0f + (float)j;
+        }
+        scale_pow_libm( data1, y, x[i], power, factor, nrows );
+    }
+    time_libm = elapsed( start );
+
+    scale_pow = select_scale_pow( &isa );
+
+    start = clock();
+    for (i=0; i<ncols; ++i) {
+        for (j=0; j<nrows; ++j) {
+            data2[j] = 1.0f + (float)j;
+        }
+        scale_pow( data2, y, x[i], power, factor, nrows );
+    }
+    time_fast = elapsed( start );
+
+    ndiff = 0;
+    for (i=0; i<ncols; ++i) {
+        for (j=0; j<nrows; ++j) {
+            data1[j] = 1.0f + (float)j;
+            data2[j] = 1.0f + (float)j;
+        }
+        scale_pow_libm( data1, y, x[i], power, factor, nrows );
+        scale_pow     ( data2, y, x[i], power, factor, nrows );
+        for (j=(i==0); j<nrows; ++j) {  // skip "DC" coefficient
+            if (data1[j] != data2[j]) {
+                if (fabs( data1[j] - data2[j] ) > 1.2e-7 * fabs( data1[j] )) {
+                    printf( "Mismatch at %d,%d: %.9g %.9g\n", i, j, data1[j], data2[j] );
+                    return EXIT_FAILURE;
+                }
+                ++ndiff;
+            }
+        }
+    }
+
+    printf( "\n%d x %d coefficients:\n", ncols, nrows );
+    printf( "libm     %7.3f sec\n", time_libm );
+    printf( "%-8s %7.3f sec  (%.1fx faster)\n", isa, time_fast, time_libm / time_fast );
+    printf( "%ld of %ld float results differ by one unit in last place\n",
+        ndiff, (long)ncols * nrows - 1 );
+
+    free( data2 );
+    free( data1 );
+    free( out );
+    free( in );
+    free( y );
+    free( x );
+
+    return EXIT_SUCCESS;
+}
+
+#endif
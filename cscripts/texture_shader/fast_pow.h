@@ -0,0 +1,41 @@
+/*
+ * fast_pow.h
+ *
+ * Vectorized power function for the fractional Laplacian operator.
+ * Added for tectoplot; distributed under the same terms as the other
+ * files in this directory (see LICENSE.txt).
+ */
+
+#ifndef FAST_POW_H
+#define FAST_POW_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Performs data[j] *= factor * pow( x + y[j], power ) for j = 0 to n-1.
+// Arguments x + y[j] must be non-negative.
+typedef void (*Scale_Pow_Function)(
+    float        *data,     // input/output: array of n values to scale
+    const double *y,        // input: array of n values added to x
+    double        x,        // input: value added to each y[j]
+    double        power,    // input: exponent
+    double        factor,   // input: constant factor
+    int           n         // input: number of values
+);
+
+// Reference version using pow() from the math library.
+void scale_pow_libm(
+    float *data, const double *y, double x, double power, double factor, int n );
+
+// Returns fastest version for this processor, using SIMD instructions where available.
+// Relative error of each scale factor is below 1e-10, so results are normally identical
+// to scale_pow_libm() and otherwise differ by one unit in the last place of the float.
+// If isa != 0, sets *isa to name of instruction set used (e.g. "AVX2").
+Scale_Pow_Function select_scale_pow( const char **isa );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
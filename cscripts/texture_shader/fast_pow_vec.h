@@ -0,0 +1,145 @@
+/*
+ * fast_pow_vec.h
+ *
+ * Vector kernel for the fractional Laplacian operator (see fast_pow.c).
+ * Added for tectoplot; distributed under the same terms as the other
+ * files in this directory (see LICENSE.txt).
+ */
+
+/*
+ * The functions below evaluate pow( x, power ) as exp2( power * log2( x ) ),
+ * several values at a time, using only vector arithmetic and bit operations:
+ *
+ *   log2:  x = 2^e * m with m in [sqrt(1/2), sqrt(2)); then with
+ *          t = (m-1)/(m+1), ln(m) = 2*atanh(t) = 2*(t + t^3/3 + ... + t^11/11).
+ *          Since |t| < 0.1716, the truncation error is below 1e-11.
+ *   exp2:  y = k + f with k integer and |f| <= 1/2; then 2^f = exp(f*ln2)
+ *          by its Taylor series to degree 10 (error below 3e-13), and 2^k
+ *          is added directly to the exponent bits.
+ *
+ * The relative error of the result is below 1e-10 for arguments in the normal
+ * double range, far less than single-precision roundoff of the output data.
+ * Zero arguments (only the "DC" coefficient) do not give exactly zero.
+ *
+ * This file is included by fast_pow.c once for each instruction set,
+ * with the following macros defined:
+ *
+ *   VDOUBLE       vector type of doubles
+ *   VINT64        vector type of 64-bit integers with the same number of elements
+ *   VWIDTH        number of elements in each vector
+ *   POWV(name)    function name for this instruction set
+ *   POWV_TARGET   function attribute selecting the instruction set (may be empty)
+ *
+ * There is deliberately no include guard.
+ */
+
+static POWV_TARGET INLINE VDOUBLE POWV(vsplat)( double a )
+// Returns vector with all elements equal to a
+{
+    VDOUBLE v;
+    int k;
+
+    for (k=0; k<VWIDTH; ++k) {
+        v[k] = a;
+    }
+    return v;
+}
+
+static POWV_TARGET INLINE VDOUBLE POWV(vblend)( VINT64 mask, VDOUBLE a, VDOUBLE b )
+// Returns a where mask is all ones, b where mask is zero
+{
+    return (VDOUBLE)( ((VINT64)a & mask) | ((VINT64)b & ~mask) );
+}
+
+static POWV_TARGET INLINE VDOUBLE POWV(vpow)( VDOUBLE x, double power )
+{
+    const double sqrt2 = 1.4142135623730951;
+    const double log2e = 1.4426950408889634;
+    const double ln2   = 0.6931471805599453;
+    const double magic = 6755399441055744.0;    // 1.5 * 2^52, for rounding to integer
+    const double two52 = 4503599627370496.0;    // 2^52
+
+    VINT64  bits, big, k;
+    VDOUBLE m, e, t, t2, y, kd, f, g, p;
+
+    // split x into exponent and mantissa in [1,2)
+    bits = (VINT64)x;
+    e = (VDOUBLE)( (bits >> 52) | 0x4330000000000000LL ) - (two52 + 1023.0);
+    m = (VDOUBLE)( (bits & 0x000FFFFFFFFFFFFFLL) | 0x3FF0000000000000LL );
+
+    // move mantissa to [sqrt(1/2), sqrt(2))
+    big = (VINT64)( m > sqrt2 );
+    m = POWV(vblend)( big, m * 0.5, m );
+    e = e + (VDOUBLE)( big & 0x3FF0000000000000LL );    // add 1.0 where big
+
+    t  = (m - 1.0) / (m + 1.0);
+    t2 = t * t;
+    p  = ((((( 1.0/11.0 ) * t2 + 1.0/9.0 ) * t2 + 1.0/7.0 ) * t2 + 1.0/5.0 ) * t2 + 1.0/3.0 ) * t2 + 1.0;
+
+    y = ( e + (2.0 * log2e) * t * p ) * power;
+
+    // limit to range of normal doubles
+    y = POWV(vblend)( (VINT64)( y >  1023.0 ), POWV(vsplat)(  1023.0 ), y );
+    y = POWV(vblend)( (VINT64)( y < -1022.0 ), POWV(vsplat)( -1022.0 ), y );
+
+    // split y into integer and fraction
+    kd = y + magic;
+    k  = (VINT64)kd - (VINT64)POWV(vsplat)( magic );
+    f  = y - ( kd - magic );
+
+    g = f * ln2;
+    p = ((((((((( 1.0/3628800.0 ) * g + 1.0/362880.0 ) * g + 1.0/40320.0 ) * g
+        + 1.0/5040.0 ) * g + 1.0/720.0 ) * g + 1.0/120.0 ) * g + 1.0/24.0 ) * g
+        + 1.0/6.0 ) * g + 0.5 ) * g;
+    p = p * g + g + 1.0;
+
+    return (VDOUBLE)( (VINT64)p + (k << 52) );
+}
+
+static POWV_TARGET void POWV(scale_pow)(
+    float *data, const double *y, double x, double power, double factor, int n )
+// Performs data[j] *= factor * pow( x + y[j], power ) for j = 0 to n-1
+{
+    VDOUBLE s, r;
+    double  buf[VWIDTH];
+    int     j, k;
+
+    for (j=0; j+VWIDTH<=n; j+=VWIDTH) {
+        memcpy( &s, y+j, sizeof( s ) );
+        r = factor * POWV(vpow)( s + x, power );
+        memcpy( buf, &r, sizeof( r ) );
+        for (k=0; k<VWIDTH; ++k) {
+            data[j+k] *= buf[k];
+        }
+    }
+
+    if (j < n) {
+        // partial vector at end, padded with ones
+        for (k=0; k<VWIDTH; ++k) {
+            buf[k] = j+k < n ? y[j+k] + x : 1.0;
+        }
+        memcpy( &s, buf, sizeof( s ) );
+        r = factor * POWV(vpow)( s, power );
+        memcpy( buf, &r, sizeof( r ) );
+        for (k=0; j+k<n; ++k) {
+            data[j+k] *= buf[k];
+        }
+    }
+}
+
+#ifdef FAST_POW_BENCHMARK
+
+static POWV_TARGET void POWV(pow_array)( double *out, const double *in, double power, int n )
+// Performs out[j] = pow( in[j], power ) for j = 0 to n-1 (n must be a multiple of VWIDTH)
+{
+    VDOUBLE s;
+    int j;
+
+    for (j=0; j<n; j+=VWIDTH) {
+        memcpy( &s, in+j, sizeof( s ) );
+        s = POWV(vpow)( s, power );
+        memcpy( out+j, &s, sizeof( s ) );
+    }
+}
+
+#endif
@@ -0,0 +1,186 @@
+/*
+ * filter_accuracy.c
+ *
+ * Accuracy report for the single-precision DCT modes of terrain_filter().
+ * Added for tectoplot; distributed under the same terms as the other
+ * files in this directory (see LICENSE.txt).
+ */
+
+//
+// Filters a DEM with each DCT mode (see enum Terrain_Dct_Mode) and compares
+// the results with the double-precision mode (TERRAIN_DCT_DOUBLE):
+//   max error    largest difference, as a fraction of the range of the result
+//   rms error    root-mean-square difference, also as a fraction of the range
+//   8-bit diffs  number of pixels that change when the result is scaled
+//                linearly to 0-255 over its range (as for an image)
+//
+// To build and run the report:
+//   gcc -O2 -DNOMAIN -DFILTER_ACCURACY_REPORT *.c -o filter_accuracy -lm -lpthread
+//   ./filter_accuracy elev.flt [detail] [threads]
+//
+
+#ifdef FILTER_ACCURACY_REPORT
+
+#define _CRT_SECURE_NO_DEPRECATE
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "read_grid_files.h"
+#include "terrain_filter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#define LONG ptrdiff_t
+
+static const char *mode_names[] = { "double", "simd", "float" };
+
+static FILE *open_input( const char *name, const char *ext )
+{
+    char *filename = (char *)malloc( strlen( name ) + 5 );
+    const char *dot = strrchr( name, '.' );
+    size_t len = dot ? (size_t)( dot - name ) : strlen( name );
+    FILE *file;
+
+    memcpy( filename, name, len );
+    sprintf( filename+len, ".%s", ext );
+
+    file = fopen( filename, "rb" );
+    if (!file) {
+        fprintf( stderr, "Could not open input file '%s'.\n", filename );
+        exit( EXIT_FAILURE );
+    }
+
+    free( filename );
+    return file;
+}
+
+static int level8( float value, float vmin, float scale )
+{
+    int level = (int)floor( ( value - vmin ) * scale + 0.5f );
+
+    return level < 0 ? 0 : level > 255 ? 255 : level;
+}
+
+int main( int argc, const char *argv[] )
+{
+    FILE  *flt_file, *hdr_file;
+    float *input, *ref, *data;
+    int    nrows, ncols, has_nulls, all_ints;
+    double xmin, xmax, ymin, ymax, xdim, ydim;
+    double detail = 0.5;
+    int    num_threads = 1;
+
+    enum Terrain_Coord_Type coord_type;
+    double center_lat;
+
+    LONG   count, k;
+    float  vmin, vmax, scale;
+    double err, max_err, sum_sq;
+    long   ndiff;
+    clock_t start;
+    double seconds;
+    int    mode;
+
+    if (argc < 2) {
+        fprintf( stderr, "USAGE: %s elev.flt [detail] [threads]\n", argv[0] );
+        return EXIT_FAILURE;
+    }
+    if (argc > 2) {
+        detail = atof( argv[2] );
+    }
+    if (argc > 3) {
+        num_threads = atoi( argv[3] );
+    }
+
+    flt_file = open_input( argv[1], "flt" );
+    hdr_file = open_input( argv[1], "hdr" );
+
+    input = read_flt_hdr_files(
+        flt_file, hdr_file, &nrows, &ncols, &xmin, &xmax, &ymin, &ymax,
+        &has_nulls, &all_ints, 0 );
+
+    fclose( flt_file );
+    fclose( hdr_file );
+
+    if (has_nulls) {
+        fprintf( stderr, "Input contains void (NODATA) points; fill them first.\n" );
+        return EXIT_FAILURE;
+    }
+
+    xdim = (xmax - xmin) / (double)ncols;
+    ydim = (ymax - ymin) / (double)nrows;
+
+    // simple test for geographic coordinates (see determine_projection() in texture.c)
+    if (xmax - xmin <= 360.0 && ymin >= -90.0 && ymax <= 90.0) {
+        coord_type = TERRAIN_DEGREES;
+        center_lat = 0.5 * (ymin + ymax);
+    } else {
+        coord_type = TERRAIN_METERS;
+        center_lat = 0.0;
+    }
+
+    count = (LONG)nrows * (LONG)ncols;
+    ref   = (float *)malloc( count * sizeof( float ) );
+    data  = (float *)malloc( count * sizeof( float ) );
+    if (!ref || !data) {
+        fprintf( stderr, "Memory allocation error.\n" );
+        return EXIT_FAILURE;
+    }
+
+    printf( "%d x %d array, detail = %g, %d thread(s)\n\n", ncols, nrows, detail, num_threads );
+    printf( "mode      time (s)   max error    rms error   8-bit diffs\n" );
+
+    for (mode=TERRAIN_DCT_DOUBLE; mode<=TERRAIN_DCT_FLOAT; ++mode) {
+        float *out = mode == TERRAIN_DCT_DOUBLE ? ref : data;
+
+        memcpy( out, input, count * sizeof( float ) );
+
+        start = clock();
+        if (terrain_filter_mt(
+                out, detail, nrows, ncols, xdim, ydim, coord_type, center_lat,
+                (enum Terrain_Dct_Mode)mode, num_threads, NULL ))
+        {
+            fprintf( stderr, "Memory allocation error.\n" );
+            return EXIT_FAILURE;
+        }
+        seconds = (double)( clock() - start ) / CLOCKS_PER_SEC;
+
+        if (mode == TERRAIN_DCT_DOUBLE) {
+            vmin = vmax = ref[0];
+            for (k=1; k<count; ++k) {
+                vmin = ref[k] < vmin ? ref[k] : vmin;
+                vmax = ref[k] > vmax ? ref[k] : vmax;
+            }
+            scale = vmax > vmin ? 255.0f / (vmax - vmin) : 0.0f;
+            printf( "%-8s %9.3f   (reference; range %g)\n", mode_names[mode], seconds, vmax - vmin );
+            continue;
+        }
+
+        max_err = 0.0;
+        sum_sq  = 0.0;
+        ndiff   = 0;
+        for (k=0; k<count; ++k) {
+            err = fabs( (double)data[k] - (double)ref[k] );
+            max_err = err > max_err ? err : max_err;
+            sum_sq += err * err;
+            ndiff  += level8( data[k], vmin, scale ) != level8( ref[k], vmin, scale );
+        }
+
+        printf( "%-8s %9.3f   %10.3g   %10.3g   %ld of %ld\n",
+            mode_names[mode], seconds,
+            max_err / (vmax - vmin), sqrt( sum_sq / (double)count ) / (vmax - vmin),
+            ndiff, (long)count );
+    }
+
+    free( data );
+    free( ref );
+    free( input );
+
+    return EXIT_SUCCESS;
+}
+
+#endif
@@ -0,0 +1,385 @@
+/*
+ * horizon.c
+ *
+ * Computes a cube of horizon angles for a set of azimuths, for relighting
+ * with the shadow and svf tools (options -horizon) without tracing rays.
+ * Added for tectoplot; distributed under the same terms as the other
+ * files in this directory (see LICENSE.txt).
+ */
+
+#define _CRT_SECURE_NO_DEPRECATE
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "read_grid_files.h"
+#include "read_geotiff.h"
+#include "terrain_filter.h"
+#include "horizon_cube.h"
+#include "thread_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h> // for ptrdiff_t
+#include <math.h>
+
+#define LONG ptrdiff_t
+
+static const char *command_name;
+
+static const char *get_command_name( const char *argv[] )
+{
+    const char *colon;
+    const char *slash;
+    const char *result;
+
+    colon = strchr( argv[0], ':' );
+    if (colon) {
+        ++colon;
+    } else {
+        colon = argv[0];
+    }
+    slash = strrchr( colon, '/' );
+    if (slash) {
+        ++slash;
+    } else {
+        slash = colon;
+    }
+    result = strrchr( slash, '\\' );
+    if (result) {
+        ++result;
+    } else {
+        result = slash;
+    }
+    return result;
+}
+
+static void prefix_error()
+{
+    fprintf( stderr, "\n*** ERROR: " );
+}
+
+static void usage_exit( const char *message )
+{
+    if (message) {
+        prefix_error();
+        fprintf( stderr, "%s\n", message );
+    }
+    fprintf( stderr, "\n" );
+    fprintf( stderr, "USAGE:    %s elev_file cube_file [-options ...]\n", command_name );
+    fprintf( stderr, "          %s rainier_elev rainier.hzn -azimuths 72\n", command_name );
+    fprintf( stderr, "\n" );
+    fprintf( stderr, "Requires both .flt and .hdr files as input  " );
+    fprintf( stderr, "(e.g., rainier_elev.flt and rainier_elev.hdr),\n" );
+    fprintf( stderr, "or a Float32 or Int16 GeoTIFF file (e.g., rainier_elev.tif).\n" );
+    fprintf( stderr, "Writes the horizon angle of every point for each azimuth to cube_file,\n" );
+    fprintf( stderr, "for use with option -horizon of shadow and svf.\n" );
+    fprintf( stderr, "NOTE: Output file will be overwritten if it already exists.\n" );
+    fprintf( stderr, "\n" );
+    fprintf( stderr, "Available options:\n" );
+    fprintf( stderr, "    -azimuths N            " );
+    fprintf( stderr, "number of azimuths, evenly spaced from north (default: 36)\n" );
+    fprintf( stderr, "    -bits N                " );
+    fprintf( stderr, "bits per stored angle, 8 or 16 (default: 16)\n" );
+    fprintf( stderr, "    -lower                 " );
+    fprintf( stderr, "also store lowest angles to the terrain (needed by svf)\n" );
+    fprintf( stderr, "    -threads N             " );
+    fprintf( stderr, "number of threads to use (default: all processors)\n" );
+    fprintf( stderr, "\n" );
+    exit( EXIT_FAILURE );
+}
+
+static void get_filenames(
+    const char *arg, char **data_name, char **hdr_name, char *ext )
+// NOTE: caller is responsible to free pointers *data_name and *hdr_name!
+{
+    const char *dot;
+
+    size_t len = strlen( arg );
+
+    *data_name = (char *)malloc( len+5 );   // add 5 for ".", extension, and null terminator
+    *hdr_name  = (char *)malloc( len+5 );   // assume these mallocs succeed
+
+    dot = strrchr( arg, '.' );
+
+    if (dot++ && !strpbrk( dot, "/\\" ) && strlen( dot ) <= 4) {
+        // filename has extension (of up to 4 characters)
+        strncpy( ext, dot, strlen( ext ) );
+        if (strcmp( dot, "flt" ) != 0 && strcmp( dot, "FLT" ) != 0 &&
+            strcmp( dot, "tif" ) != 0 && strcmp( dot, "TIF" ) != 0)
+        {
+            usage_exit( "Filenames must have .flt or .tif extension (if any)." );
+        }
+        strcpy ( *data_name, arg );
+        strncpy( *hdr_name, arg, len-3 );
+        strcpy ( *hdr_name+len-3, "hdr" );
+    } else {
+        // filename does not have extension
+        strncpy( *data_name, arg, len );
+        (*data_name)[len] = '.';
+        strncpy( *data_name+len+1, ext, 3 );    // max 3 chars default extension
+        (*data_name)[len+4] = '\0';
+        strncpy( *hdr_name, arg, len );
+        strcpy ( *hdr_name+len, ".hdr" );
+    }
+}
+
+// Returns -1 for geographic coordinates, +1 for projected coordinates, 0 if unable to determine
+static int determine_projection(
+    double xmin, double xmax, double ymin, double ymax, double xdim, double ydim )
+{
+    // Determine projection type:
+
+    if  ( (ydim <    0.02 && xdim <   0.02) &&
+          (xmin > -180.01 && xmax < 180.01) &&
+          (ymin >  -90.01 && ymax <  90.01) )
+    {
+        return -1;  // lat/lon (geographic) coordinates
+    } else if
+        ( (xmin < -181.00 || xmax > 181.00) &&
+          (ymin <  -91.00 || ymax >  91.00) )
+    {
+        return +1;  // projected into linear coordinates (easting/northing)
+    }
+
+    return 0;   // unable to determine correct projection type
+}
+
+static int read_positive_int( const char *option, const char *arg )
+{
+    char *endptr;
+    long value = strtol( arg, &endptr, 10 );
+
+    if (endptr == arg || *endptr != '\0' || value < 1 || value > 100000) {
+        prefix_error();
+        fprintf( stderr, "Option -%s must be followed by a positive integer.\n", option );
+        usage_exit( 0 );
+    }
+    return (int)value;
+}
+
+#ifndef NOMAIN
+
+int main( int argc, const char *argv[] )
+{
+    const int minargs = 3;  // including command name
+
+    int argnum;
+    int num_threads = 0;    // default unless -threads option used (0 = all processors)
+
+    const char *thisarg;
+    char extension[4];  // 3 chars plus null terminator
+
+    char *in_dat_name;
+    char *in_hdr_name;
+    const char *cube_name;
+
+    FILE *in_dat_file;
+    FILE *in_hdr_file;
+    FILE *cube_file;
+
+    int nrows;
+    int ncols;
+    double xmin;
+    double xmax;
+    double ymin;
+    double ymax;
+    double xdim;
+    double ydim;
+    double xres;
+    double yres;
+    float *data;
+    float *angles;
+
+    enum Terrain_Coord_Type coord_type;
+
+    int proj_type;
+    int has_nulls;
+    int tif_input;
+    struct Flt_Map data_map = { NULL, 0 };
+    struct Flt_Hdr_Info tif_info;
+
+    double center_lat;
+
+    struct Horizon_Cube_Info info;
+    struct Thread_Pool *pool;
+    int layer;
+    int a;
+
+    int error = 0;
+
+    command_name = get_command_name( argv );
+
+    if (argc == 1) {
+        usage_exit( 0 );
+    } else if (argc < minargs) {
+        usage_exit( "Not enough command-line parameters." );
+    }
+
+    info.nazimuths = 36;    // defaults unless options used
+    info.nlayers   = 1;
+    info.bits      = 16;
+
+    argnum = 1;
+
+    strncpy( extension, "flt", 4 );
+    get_filenames( argv[argnum++], &in_dat_name, &in_hdr_name, extension );
+    tif_input = is_geotiff_name( in_dat_name );
+
+    cube_name = argv[argnum++];
+
+    while (argnum < argc) {
+        thisarg = argv[argnum++];
+        if (*thisarg != '-') {
+            prefix_error();
+            fprintf( stderr, "Extra command-line parameter '%s' not recognized.\n", thisarg );
+            usage_exit( 0 );
+        }
+        ++thisarg;
+        if (strncmp( thisarg, "threads", 6 ) == 0) {
+            if (argnum >= argc) {
+                usage_exit( "Option -threads must be followed by a positive integer." );
+            }
+            num_threads = read_positive_int( "threads", argv[argnum++] );
+        } else if (strncmp( thisarg, "azimuths", 3 ) == 0) {
+            if (argnum >= argc) {
+                usage_exit( "Option -azimuths must be followed by a positive integer." );
+            }
+            info.nazimuths = read_positive_int( "azimuths", argv[argnum++] );
+        } else if (strcmp( thisarg, "bits" ) == 0) {
+            if (argnum >= argc) {
+                usage_exit( "Option -bits must be followed by 8 or 16." );
+            }
+            info.bits = read_positive_int( "bits", argv[argnum++] );
+            if (info.bits != 8 && info.bits != 16) {
+                usage_exit( "Option -bits must be followed by 8 or 16." );
+            }
+        } else if (strcmp( thisarg, "lower" ) == 0) {
+            info.nlayers = 2;
+        } else {
+            prefix_error();
+            fprintf( stderr, "Command-line option '-%s' not recognized.\n", thisarg );
+            usage_exit( 0 );
+        }
+    }
+
+    in_hdr_file = NULL;     // GeoTIFF input has no .hdr file
+    if (!tif_input) {
+        in_hdr_file = fopen( in_hdr_name, "rb" );   // use binary mode for compatibility
+        if (!in_hdr_file) {
+            prefix_error();
+            fprintf( stderr, "Could not open input file '%s'.\n", in_hdr_name );
+            usage_exit( 0 );
+        }
+    }
+
+    in_dat_file = fopen( in_dat_name, "rb" );
+    if (!in_dat_file) {
+        prefix_error();
+        fprintf( stderr, "Could not open input file '%s'.\n", in_dat_name );
+        usage_exit( 0 );
+    }
+
+    free( in_dat_name );
+    free( in_hdr_name );
+
+    cube_file = fopen( cube_name, "wb" );
+    if (!cube_file) {
+        prefix_error();
+        fprintf( stderr, "Could not open output file '%s'.\n", cube_name );
+        usage_exit( 0 );
+    }
+
+    // Read .flt and .hdr files:
+
+    if (tif_input) {
+        data = read_geotiff_file( in_dat_file, &tif_info, &has_nulls, NULL );
+        nrows = tif_info.nrows;
+        ncols = tif_info.ncols;
+        xmin  = tif_info.xmin;
+        xmax  = tif_info.xmax;
+        ymin  = tif_info.ymin;
+        ymax  = tif_info.ymax;
+    } else {
+        data = map_flt_hdr_files(
+            in_dat_file, in_hdr_file, &nrows, &ncols, &xmin, &xmax, &ymin, &ymax,
+            &has_nulls, NULL, num_threads, &data_map );
+        fclose( in_hdr_file );
+    }
+
+    fclose( in_dat_file );
+
+    if (has_nulls) {
+        fprintf( stderr, "*** WARNING: " );
+        fprintf( stderr, "Input .flt file contains void (NODATA) points.\n" );
+        fprintf( stderr, "***          " );
+        fprintf( stderr, "These have no horizon, and do not block the horizon of other points.\n" );
+    }
+
+    // Process data:
+
+    xdim = (xmax - xmin) / (double)ncols;
+    ydim = (ymax - ymin) / (double)nrows;
+
+    // determine projection type
+    proj_type = determine_projection( xmin, xmax, ymin, ymax, xdim, ydim );
+
+    if (proj_type < 0) {
+        coord_type = TERRAIN_DEGREES;
+        center_lat = 0.5 * (ymin + ymax);
+    } else if (proj_type > 0) {
+        coord_type = TERRAIN_METERS;
+        center_lat = 0.0;   // ignored when coord_type == TERRAIN_METERS
+    } else {
+        prefix_error();
+        fprintf( stderr, "Unable to determine projection type from info in .hdr file.\n" );
+        exit( EXIT_FAILURE );
+    }
+
+    terrain_pixel_spacing( xdim, ydim, coord_type, center_lat, &xres, &yres );
+
+    info.nrows = nrows;
+    info.ncols = ncols;
+
+    angles = (float *)malloc( (LONG)nrows * (LONG)ncols * sizeof( float ) );
+
+    pool = num_threads == 1 ? NULL : thread_pool_create( num_threads );
+    if (!angles || (num_threads != 1 && !pool)) {
+        error = TERRAIN_FILTER_MALLOC_ERROR;
+    } else if (write_horizon_header( cube_file, &info )) {
+        error = 2;
+    }
+
+    for (layer=0; layer<info.nlayers && !error; ++layer) {
+        for (a=0; a<info.nazimuths && !error; ++a) {
+            error = compute_horizons(
+                data, nrows, ncols, xres, yres, a * 360.0 / info.nazimuths,
+                layer == HORIZON_LOWER, angles, pool );
+            if (!error) {
+                error = write_horizon_slice( cube_file, &info, angles );
+            }
+        }
+    }
+
+    thread_pool_destroy( pool );
+
+    if (fclose( cube_file ) != 0 && !error) {
+        error = 2;
+    }
+
+    if (error) {
+        prefix_error();
+        if (error == TERRAIN_FILTER_MALLOC_ERROR) {
+            fprintf( stderr, "Memory allocation error occurred during processing of data.\n" );
+        } else {
+            fprintf( stderr, "Could not write output file '%s'.\n", cube_name );
+        }
+        exit( EXIT_FAILURE );
+    }
+
+    free( angles );
+    free_flt_data( data, &data_map );
+
+    return EXIT_SUCCESS;
+}
+
+#endif
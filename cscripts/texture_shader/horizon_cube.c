@@ -0,0 +1,326 @@
+/*
+ * horizon_cube.c
+ *
+ * Horizon elevation angles for a set of azimuths, computed by linear-time
+ * sweeps and stored as a quantized cube for the shadow and svf tools.
+ * Added for tectoplot; distributed under the same terms as the other
+ * files in this directory (see LICENSE.txt).
+ */
+
+//
+// The sweep follows the same scan lines as the sweep in shadow_rot.c: straight
+// lines running away from the given azimuth, each step moving one row or one
+// column and the other coordinate by a rounded fraction of a pixel, so that
+// every pixel lies on exactly one line. Along a line, the highest horizon of a
+// point is the point already passed that is seen at the steepest angle, which
+// is always on the upper convex hull of the points passed so far - and is the
+// neighbor of the new point when the new point is added to the hull. Points
+// removed from the hull can never be the horizon of a later point, so each
+// point is pushed and popped at most once (Dozier et al., 1981).
+//
+// Cube file format (native byte order, like the spectrum cache files):
+//
+//   8 bytes    magic string "TXHZN001"
+//   uint32     byte order mark 0x01020304
+//   int32 x 5  nrows, ncols, nazimuths, nlayers, bits
+//   uint8 or uint16 (bits = 8 or 16)
+//              nlayers x nazimuths slices of nrows x ncols angles, row-major;
+//              stored value q stands for the angle q * 180 / (2^bits - 1) - 90
+//
+
+#define _CRT_SECURE_NO_DEPRECATE
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "horizon_cube.h"
+#include "terrain_filter.h"     // for TERRAIN_FILTER_MALLOC_ERROR
+#include "thread_pool.h"
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <sys/types.h>  // for off_t
+#include <string.h>
+#include <math.h>
+
+#if defined(_WIN32)
+#   define fseek_64 _fseeki64
+#   define off_64   __int64
+#else
+#   define fseek_64 fseeko
+#   define off_64   off_t
+#endif
+
+#define LONG ptrdiff_t
+
+#ifndef M_PI
+#   define M_PI 3.14159265358979323846
+#endif
+
+static const char cube_magic[8] = { 'T', 'X', 'H', 'Z', 'N', '0', '0', '1' };
+
+static const unsigned int byte_order_mark = 0x01020304;
+
+static const long header_size = 32;
+
+struct Hull_Point {
+    int    step;        // step number along the scan line
+    double z;           // elevation (negated for lower horizon)
+};
+
+struct Horizon_Sweep {
+    const float *data;
+    float *angles;
+    int    nsteps;          // number of steps along each scan line
+    int    ncross;          // number of positions across the scan lines
+    LONG   first;           // offset in data of first step, at cross position 0
+    LONG   step_stride;     // offset in data from one step to the next
+    LONG   cross_stride;    // offset in data from one cross position to the next
+    const int *shift;       // per step: cross position of line 0 (plus line_offset)
+    int    line_offset;     // see shift
+    double step_len;        // meters per step
+    int    lower;
+    struct Hull_Point *hulls;   // per thread: nsteps points
+};
+
+static int sweep_horizon_lines( long first, long last, int thread, void *state )
+// Computes the horizon angles of the points on scan lines [first,last)
+{
+    const struct Horizon_Sweep *h = (const struct Horizon_Sweep *)state;
+    struct Hull_Point *hull = h->hulls + (LONG)thread * (LONG)h->nsteps;
+
+    const double to_degrees = 180.0 / M_PI;
+    const double sign = h->lower ? -1.0 : 1.0;
+
+    long k;
+    int  s, b, n;
+    LONG offset;
+    double z;
+    float angle;
+
+    for (k=first; k<last; ++k) {
+        n = 0;
+        for (s=0; s<h->nsteps; ++s) {
+            b = (int)k - h->line_offset + h->shift[s];
+            if (b < 0 || b >= h->ncross) {
+                continue;
+            }
+            offset = h->first + s * h->step_stride + b * h->cross_stride;
+            if (h->data[offset] < -1.0e+38) {
+                h->angles[offset] = HORIZON_NONE;   // void point
+                continue;
+            }
+            z = sign * h->data[offset];
+
+            // remove hull points on or below the segment from the previous
+            // hull point to this one
+            while (n >= 2 &&
+                   (hull[n-1].z - hull[n-2].z) * (double)(s - hull[n-1].step) <=
+                   (z - hull[n-1].z) * (double)(hull[n-1].step - hull[n-2].step))
+            {
+                --n;
+            }
+
+            angle = HORIZON_NONE;
+            if (n > 0) {
+                angle = (float)( sign * to_degrees *
+                    atan2( hull[n-1].z - z, (s - hull[n-1].step) * h->step_len ) );
+            }
+            h->angles[offset] = angle;
+
+            hull[n].step = s;
+            hull[n].z    = z;
+            ++n;
+        }
+    }
+    return 0;
+}
+
+int compute_horizons(
+    const float *data,  // input: array of elevations (row-major order)
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    double xres,        // input: spacing between pixel columns (in meters)
+    double yres,        // input: spacing between pixel rows    (in meters)
+    double azimuth,     // input: direction to look (degrees clockwise from north)
+    int    lower,       // input: nonzero for lowest angle instead of highest
+    float *angles,      // output: horizon angles (degrees), same layout as data
+    struct Thread_Pool *pool    // input: threads to use (may be null)
+)
+{
+    struct Horizon_Sweep h;
+    int   *shift;
+    double dc, dr;      // columns and rows per meter, moving away from the azimuth
+    double slope;
+    int    forward;
+    int    nlines;
+    int    s;
+    int    error;
+
+    dc = -sin( azimuth * M_PI / 180.0 ) / xres;
+    dr =  cos( azimuth * M_PI / 180.0 ) / yres;
+
+    h.data   = data;
+    h.angles = angles;
+    h.lower  = lower;
+    if (fabs( dr ) >= fabs( dc )) {
+        // step from row to row
+        h.nsteps = nrows;
+        h.ncross = ncols;
+        h.step_stride  = ncols;
+        h.cross_stride = 1;
+        forward    = dr > 0;
+        slope      = dc / fabs( dr );
+        h.step_len = 1.0 / fabs( dr );
+    } else {
+        // step from column to column
+        h.nsteps = ncols;
+        h.ncross = nrows;
+        h.step_stride  = 1;
+        h.cross_stride = ncols;
+        forward    = dc > 0;
+        slope      = dr / fabs( dc );
+        h.step_len = 1.0 / fabs( dc );
+    }
+    h.first = forward ? 0 : (LONG)(h.nsteps-1) * h.step_stride;
+    if (!forward) {
+        h.step_stride = -h.step_stride;
+    }
+
+    shift = (int *)malloc( h.nsteps * sizeof( int ) );
+    h.hulls = (struct Hull_Point *)malloc(
+        (size_t)thread_pool_size( pool ) * h.nsteps * sizeof( struct Hull_Point ) );
+    if (!shift || !h.hulls) {
+        free( shift );
+        free( h.hulls );
+        return TERRAIN_FILTER_MALLOC_ERROR;
+    }
+    for (s=0; s<h.nsteps; ++s) {
+        shift[s] = (int)floor( s * slope + 0.5 );
+    }
+    h.shift = shift;
+
+    // shift is monotonic, so its extremes are at the ends
+    h.line_offset = shift[h.nsteps-1] > 0 ? shift[h.nsteps-1] : 0;
+    nlines = h.ncross + abs( shift[h.nsteps-1] );
+
+    error = thread_pool_run( pool, nlines, 0, sweep_horizon_lines, &h, NULL );
+
+    free( h.hulls );
+    free( shift );
+
+    return error;
+}
+
+static LONG slice_bytes( const struct Horizon_Cube_Info *info )
+{
+    return (LONG)info->nrows * (LONG)info->ncols * (info->bits / 8);
+}
+
+int write_horizon_header( FILE *file, const struct Horizon_Cube_Info *info )
+{
+    int values[5];
+
+    values[0] = info->nrows;
+    values[1] = info->ncols;
+    values[2] = info->nazimuths;
+    values[3] = info->nlayers;
+    values[4] = info->bits;
+
+    return fwrite( cube_magic, sizeof( cube_magic ), 1, file ) != 1 ||
+           fwrite( &byte_order_mark, sizeof( byte_order_mark ), 1, file ) != 1 ||
+           fwrite( values, sizeof( values ), 1, file ) != 1;
+}
+
+int write_horizon_slice( FILE *file, const struct Horizon_Cube_Info *info, const float *angles )
+{
+    const double maxq = info->bits == 8 ? 255.0 : 65535.0;
+
+    LONG  count = (LONG)info->nrows * (LONG)info->ncols;
+    LONG  k;
+    long  q;
+    void *buffer;
+    int   error;
+
+    buffer = malloc( slice_bytes( info ) );
+    if (!buffer) {
+        return TERRAIN_FILTER_MALLOC_ERROR;
+    }
+
+    for (k=0; k<count; ++k) {
+        q = (long)floor( ( angles[k] + 90.0 ) * ( maxq / 180.0 ) + 0.5 );
+        q = q < 0 ? 0 : q > (long)maxq ? (long)maxq : q;
+        if (info->bits == 8) {
+            ((unsigned char *)buffer)[k] = (unsigned char)q;
+        } else {
+            ((unsigned short *)buffer)[k] = (unsigned short)q;
+        }
+    }
+
+    error = fwrite( buffer, slice_bytes( info ), 1, file ) != 1 ? 2 : 0;
+
+    free( buffer );
+    return error;
+}
+
+int read_horizon_header( FILE *file, struct Horizon_Cube_Info *info )
+{
+    char magic[8];
+    unsigned int order;
+    int values[5];
+
+    if (fread( magic, sizeof( magic ), 1, file ) != 1 ||
+        memcmp( magic, cube_magic, sizeof( magic ) ) != 0 ||
+        fread( &order, sizeof( order ), 1, file ) != 1 || order != byte_order_mark ||
+        fread( values, sizeof( values ), 1, file ) != 1)
+    {
+        return 1;
+    }
+
+    info->nrows     = values[0];
+    info->ncols     = values[1];
+    info->nazimuths = values[2];
+    info->nlayers   = values[3];
+    info->bits      = values[4];
+
+    if (info->nrows < 1 || info->ncols < 1 || info->nazimuths < 1 ||
+        info->nlayers < 1 || info->nlayers > 2 || (info->bits != 8 && info->bits != 16))
+    {
+        return 1;
+    }
+    return 0;
+}
+
+int read_horizon_slice(
+    FILE *file, const struct Horizon_Cube_Info *info, int layer, int azimuth, float *angles )
+{
+    const double scale = 180.0 / ( info->bits == 8 ? 255.0 : 65535.0 );
+
+    LONG  count = (LONG)info->nrows * (LONG)info->ncols;
+    LONG  k;
+    off_64 offset;
+    void *buffer;
+
+    offset = (off_64)header_size +
+             (off_64)( layer * info->nazimuths + azimuth ) * (off_64)slice_bytes( info );
+
+    buffer = malloc( slice_bytes( info ) );
+    if (!buffer) {
+        return TERRAIN_FILTER_MALLOC_ERROR;
+    }
+    if (fseek_64( file, offset, SEEK_SET ) != 0 ||
+        fread( buffer, slice_bytes( info ), 1, file ) != 1)
+    {
+        free( buffer );
+        return 2;
+    }
+
+    for (k=0; k<count; ++k) {
+        if (info->bits == 8) {
+            angles[k] = (float)( ((unsigned char *)buffer)[k] * scale - 90.0 );
+        } else {
+            angles[k] = (float)( ((unsigned short *)buffer)[k] * scale - 90.0 );
+        }
+    }
+
+    free( buffer );
+    return 0;
+}
@@ -0,0 +1,87 @@
+/*
+ * horizon_cube.h
+ *
+ * Horizon elevation angles for a set of azimuths, computed by linear-time
+ * sweeps and stored as a quantized cube for the shadow and svf tools.
+ * Added for tectoplot; distributed under the same terms as the other
+ * files in this directory (see LICENSE.txt).
+ */
+
+#ifndef HORIZON_CUBE_H
+#define HORIZON_CUBE_H
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct Thread_Pool;
+
+// Horizon angles are in degrees above the horizontal, from -90 to +90.
+// A point with no terrain in the given direction (at the edge of the array,
+// or a void point) has a horizon of -90, so it is always lit.
+#define HORIZON_NONE (-90.0f)
+
+// Layers of a horizon cube:
+enum {
+    HORIZON_UPPER = 0,  // highest angle to the terrain (sky starts above it)
+    HORIZON_LOWER = 1   // lowest angle to the terrain (optional)
+};
+
+// Description of a horizon cube file. Azimuths are evenly spaced around the
+// horizon, starting at north: azimuth a is a * 360 / nazimuths degrees
+// clockwise from north.
+struct Horizon_Cube_Info {
+    int nrows;          // rows    in each slice (same as elevation array)
+    int ncols;          // columns in each slice (same as elevation array)
+    int nazimuths;      // number of azimuths
+    int nlayers;        // 1 (upper horizon only) or 2 (upper and lower)
+    int bits;           // bits per stored angle: 8 or 16
+};
+
+// Computes the horizon angle in degrees of each point of a data array, looking
+// toward azimuth (degrees clockwise from north). Each line of points in that
+// direction is swept once, keeping the upper convex hull of the points already
+// passed, so the cost is linear in the number of points. If lower is nonzero,
+// computes the lowest angle to the terrain instead of the highest.
+// Void points (less than -1.0e+38) are skipped.
+// Returns 0 on success, nonzero if a memory allocation error occurred.
+int compute_horizons(
+    const float *data,  // input: array of elevations (row-major order)
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    double xres,        // input: spacing between pixel columns (in meters)
+    double yres,        // input: spacing between pixel rows    (in meters)
+    double azimuth,     // input: direction to look (degrees clockwise from north)
+    int    lower,       // input: nonzero for lowest angle instead of highest
+    float *angles,      // output: horizon angles (degrees), same layout as data
+    struct Thread_Pool *pool    // input: threads to use (may be null)
+);
+
+// Writes the header of a cube file; the slices must follow in order (all
+// azimuths of layer 0, then all azimuths of layer 1).
+// Returns 0 on success, nonzero if a write error occurred.
+int write_horizon_header( FILE *file, const struct Horizon_Cube_Info *info );
+
+// Quantizes and writes one slice of horizon angles.
+// Returns 0 on success, TERRAIN_FILTER_MALLOC_ERROR (1) if a memory allocation
+// error occurred, or 2 if a write error occurred.
+int write_horizon_slice( FILE *file, const struct Horizon_Cube_Info *info, const float *angles );
+
+// Reads the header of a cube file.
+// Returns 0 on success, nonzero if the file is not a valid cube file.
+int read_horizon_header( FILE *file, struct Horizon_Cube_Info *info );
+
+// Reads one slice (given layer and azimuth index) of a cube file into angles,
+// in degrees. The file may be read in any order.
+// Returns 0 on success, TERRAIN_FILTER_MALLOC_ERROR (1) if a memory allocation
+// error occurred, or 2 if a read error occurred.
+int read_horizon_slice(
+    FILE *file, const struct Horizon_Cube_Info *info, int layer, int azimuth, float *angles );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1096 @@
+/*
+ * read_geotiff.c
+ *
+ * Reads elevation data directly from a GeoTIFF file, as a companion to the
+ * GeoTIFF writer in WriteGrayscaleTIFF.c.
+ * Added for tectoplot; distributed under the same terms as the other
+ * files in this directory (see LICENSE.txt).
+ */
+
+//
+// Only what is needed for a single-band elevation grid is supported: the first
+// image of a classic TIFF or BigTIFF file, in either byte order, stored in
+// strips or tiles of 32-bit floats or 16-bit integers. Strips and tiles may be
+// uncompressed or DEFLATE-compressed (compression 8 or 32946), with horizontal
+// (2) or floating-point (3) prediction. DEFLATE is decoded here (RFC 1950/1951),
+// so that the tools need no library beyond the C runtime.
+//
+// NOTE: In this file, type "float" is assumed to be 32 bits.
+//
+
+#define _CRT_SECURE_NO_DEPRECATE
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "read_geotiff.h"
+
+#include <stddef.h>     // for ptrdiff_t
+#include <sys/types.h>  // for off_t
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(_WIN32)
+#   define fseek_64 _fseeki64
+#   define off_64   __int64
+#else
+#   define fseek_64 fseeko
+#   define off_64   off_t
+#endif
+
+#define LONG ptrdiff_t
+
+// TIFF field types
+#define TIFFbyte     1
+#define TIFFascii    2
+#define TIFFshort    3
+#define TIFFlong     4
+#define TIFFrational 5
+#define TIFFsbyte    6
+#define TIFFundefined 7
+#define TIFFsshort   8
+#define TIFFslong    9
+#define TIFFsrational 10
+#define TIFFfloat    11
+#define TIFFdouble   12
+#define TIFFlong8    16
+#define TIFFslong8   17
+#define TIFFifd8     18
+
+// TIFF tag names
+#define ImageWidth          256
+#define ImageLength         257
+#define BitsPerSample       258
+#define Compression         259
+#define StripOffsets        273
+#define SamplesPerPixel     277
+#define RowsPerStrip        278
+#define StripByteCounts     279
+#define PlanarConfiguration 284
+#define Predictor           317
+#define TileWidth           322
+#define TileLength          323
+#define TileOffsets         324
+#define TileByteCounts      325
+#define SampleFormat        339
+
+// GeoTIFF and GDAL tag names
+#define ModelPixelScale     33550
+#define ModelTiepoint       33922
+#define ModelTransformation 34264
+#define GeoKeyDirectory     34735
+#define GDALNoData          42113
+
+// GeoTIFF key names and values
+#define GTRasterTypeGeoKey  1025
+#define RasterPixelIsPoint  2
+
+#define COMPRESSION_NONE        1
+#define COMPRESSION_DEFLATE     8
+#define COMPRESSION_DEFLATE_OLD 32946
+
+#define PREDICTOR_NONE          1
+#define PREDICTOR_HORIZONTAL    2
+#define PREDICTOR_FLOATINGPOINT 3
+
+#define SAMPLEFORMAT_UINT       1
+#define SAMPLEFORMAT_INT        2
+#define SAMPLEFORMAT_IEEEFP     3
+
+static int am_big_endian()
+{
+    const int one = 1;
+    return !*(char *)&one;
+}
+
+static int flt_isnan( float x )
+{
+    volatile float y = x;
+    return y != y;
+}
+
+static void prefix_error()
+{
+    fprintf( stderr, "\n*** ERROR: " );
+}
+
+static void error_exit( const char *message )
+{
+    prefix_error();
+    fprintf( stderr, "%s\n", message );
+    exit( EXIT_FAILURE );
+}
+
+static void format_exit( const char *message )
+{
+    prefix_error();
+    fprintf( stderr, "Input .tif file is not supported: %s.\n", message );
+    exit( EXIT_FAILURE );
+}
+
+int is_geotiff_name( const char *filename )
+{
+    const char *dot = strrchr( filename, '.' );
+
+    return dot && ( strcmp( dot, ".tif" ) == 0 || strcmp( dot, ".TIF" ) == 0 );
+}
+
+/*
+ * DEFLATE decoder
+ */
+
+#define INFLATE_FAST_BITS 10    // codes up to this length are found by table lookup
+
+struct Inflate_State {
+    const unsigned char *in;
+    size_t in_len;
+    size_t in_pos;          // may run past in_len while bits are buffered
+    unsigned char *out;
+    size_t out_len;
+    size_t out_pos;
+    unsigned long bit_buf;
+    int    bit_cnt;
+};
+
+struct Huffman {
+    short count[16];        // number of codes of each length
+    short symbol[288];      // symbols ordered by code
+    short fast[1 << INFLATE_FAST_BITS]; // (symbol << 4) | length, or 0 for longer codes
+};
+
+static const short length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const short length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const short dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const short dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static void need_bits( struct Inflate_State *s, int n )
+// Fills the bit buffer with at least n bits (zeros past the end of the input)
+{
+    while (s->bit_cnt < n) {
+        if (s->in_pos < s->in_len) {
+            s->bit_buf |= (unsigned long)s->in[s->in_pos] << s->bit_cnt;
+        }
+        ++s->in_pos;
+        s->bit_cnt += 8;
+    }
+}
+
+static int get_bits( struct Inflate_State *s, int n )
+{
+    int value;
+
+    need_bits( s, n );
+    value = (int)( s->bit_buf & ( (1UL << n) - 1 ) );
+    s->bit_buf >>= n;
+    s->bit_cnt  -= n;
+    return value;
+}
+
+static int build_huffman( struct Huffman *h, const unsigned char *lengths, int n )
+// Returns 0 on success, nonzero if the code lengths are over-subscribed
+{
+    short offset[16];
+    int len, sym, left, code, rev, k, i, j;
+
+    memset( h->count, 0, sizeof( h->count ) );
+    for (sym=0; sym<n; ++sym) {
+        ++h->count[lengths[sym]];
+    }
+
+    left = 1;
+    for (len=1; len<16; ++len) {
+        left <<= 1;
+        left -= h->count[len];
+        if (left < 0) {
+            return 1;
+        }
+    }
+
+    offset[1] = 0;
+    for (len=1; len<15; ++len) {
+        offset[len+1] = offset[len] + h->count[len];
+    }
+    for (sym=0; sym<n; ++sym) {
+        if (lengths[sym]) {
+            h->symbol[offset[lengths[sym]]++] = (short)sym;
+        }
+    }
+
+    // codes are stored starting from their first bit, so the table is indexed
+    // by the bit-reversed code
+    memset( h->fast, 0, sizeof( h->fast ) );
+    code = 0;
+    k = 0;
+    for (len=1; len<=INFLATE_FAST_BITS; ++len) {
+        for (i=0; i<h->count[len]; ++i, ++k, ++code) {
+            rev = 0;
+            for (j=0; j<len; ++j) {
+                rev |= ( (code >> j) & 1 ) << (len-1-j);
+            }
+            for (j=rev; j<(1 << INFLATE_FAST_BITS); j+=1<<len) {
+                h->fast[j] = (short)( (h->symbol[k] << 4) | len );
+            }
+        }
+        code <<= 1;
+    }
+
+    return 0;
+}
+
+static int decode_symbol( struct Inflate_State *s, const struct Huffman *h )
+// Returns the next symbol, or -1 for an invalid code
+{
+    int entry, len, code, first, index, count;
+
+    need_bits( s, 15 );     // longest code
+    entry = h->fast[s->bit_buf & ( (1UL << INFLATE_FAST_BITS) - 1 )];
+    if (entry) {
+        len = entry & 15;
+        s->bit_buf >>= len;
+        s->bit_cnt  -= len;
+        return entry >> 4;
+    }
+
+    // longer code: decode one bit at a time
+    code = first = index = 0;
+    for (len=1; len<16; ++len) {
+        code |= (int)( s->bit_buf & 1 );
+        s->bit_buf >>= 1;
+        --s->bit_cnt;
+        count = h->count[len];
+        if (code - first < count) {
+            return h->symbol[index + code - first];
+        }
+        index += count;
+        first  = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+static int inflate_stored( struct Inflate_State *s )
+{
+    unsigned len, nlen;
+
+    // discard the rest of the current byte, and return whole buffered bytes
+    s->in_pos -= s->bit_cnt / 8;
+    s->bit_buf = 0;
+    s->bit_cnt = 0;
+
+    if (s->in_pos + 4 > s->in_len) {
+        return 1;
+    }
+    len  = s->in[s->in_pos]   | (s->in[s->in_pos+1] << 8);
+    nlen = s->in[s->in_pos+2] | (s->in[s->in_pos+3] << 8);
+    s->in_pos += 4;
+    if (len != (~nlen & 0xffff) ||
+        s->in_pos + len > s->in_len || s->out_pos + len > s->out_len)
+    {
+        return 1;
+    }
+    memcpy( s->out + s->out_pos, s->in + s->in_pos, len );
+    s->in_pos  += len;
+    s->out_pos += len;
+    return 0;
+}
+
+static int inflate_codes(
+    struct Inflate_State *s, const struct Huffman *lencode, const struct Huffman *distcode )
+{
+    int sym, len;
+    size_t dist;
+    unsigned char *out;
+
+    for (;;) {
+        sym = decode_symbol( s, lencode );
+        if (sym < 256) {
+            if (sym < 0 || s->out_pos >= s->out_len) {
+                return 1;
+            }
+            s->out[s->out_pos++] = (unsigned char)sym;
+        } else if (sym == 256) {
+            return 0;
+        } else {
+            sym -= 257;
+            if (sym >= 29) {
+                return 1;
+            }
+            len = length_base[sym] + get_bits( s, length_extra[sym] );
+
+            sym = decode_symbol( s, distcode );
+            if (sym < 0 || sym >= 30) {
+                return 1;
+            }
+            dist = dist_base[sym] + get_bits( s, dist_extra[sym] );
+
+            if (dist > s->out_pos || s->out_pos + len > s->out_len) {
+                return 1;
+            }
+            // the copy may overlap its own output, so go byte by byte
+            out = s->out + s->out_pos;
+            s->out_pos += len;
+            while (len--) {
+                *out = *(out - dist);
+                ++out;
+            }
+        }
+    }
+}
+
+static int inflate_fixed( struct Inflate_State *s, struct Huffman *lencode, struct Huffman *distcode )
+{
+    unsigned char lengths[288];
+    int sym;
+
+    for (sym=0; sym<144; ++sym) {
+        lengths[sym] = 8;
+    }
+    for (; sym<256; ++sym) {
+        lengths[sym] = 9;
+    }
+    for (; sym<280; ++sym) {
+        lengths[sym] = 7;
+    }
+    for (; sym<288; ++sym) {
+        lengths[sym] = 8;
+    }
+    build_huffman( lencode, lengths, 288 );
+
+    for (sym=0; sym<30; ++sym) {
+        lengths[sym] = 5;
+    }
+    build_huffman( distcode, lengths, 30 );
+
+    return inflate_codes( s, lencode, distcode );
+}
+
+static int inflate_dynamic( struct Inflate_State *s, struct Huffman *lencode, struct Huffman *distcode )
+{
+    static const unsigned char order[19] = {
+        16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    unsigned char lengths[288+30];
+    int nlen, ndist, ncode;
+    int index, sym, len, repeat;
+
+    nlen  = get_bits( s, 5 ) + 257;
+    ndist = get_bits( s, 5 ) + 1;
+    ncode = get_bits( s, 4 ) + 4;
+    if (nlen > 286 || ndist > 30) {
+        return 1;
+    }
+
+    // code length code lengths, then the code lengths themselves
+    memset( lengths, 0, 19 );
+    for (index=0; index<ncode; ++index) {
+        lengths[order[index]] = (unsigned char)get_bits( s, 3 );
+    }
+    if (build_huffman( lencode, lengths, 19 )) {
+        return 1;
+    }
+
+    index = 0;
+    while (index < nlen + ndist) {
+        sym = decode_symbol( s, lencode );
+        if (sym < 0) {
+            return 1;
+        }
+        if (sym < 16) {
+            lengths[index++] = (unsigned char)sym;
+            continue;
+        }
+        len = 0;
+        if (sym == 16) {
+            if (index == 0) {
+                return 1;
+            }
+            len = lengths[index-1];
+            repeat = 3 + get_bits( s, 2 );
+        } else if (sym == 17) {
+            repeat = 3 + get_bits( s, 3 );
+        } else {
+            repeat = 11 + get_bits( s, 7 );
+        }
+        if (index + repeat > nlen + ndist) {
+            return 1;
+        }
+        while (repeat--) {
+            lengths[index++] = (unsigned char)len;
+        }
+    }
+
+    if (lengths[256] == 0 ||
+        build_huffman( lencode, lengths, nlen ) ||
+        build_huffman( distcode, lengths + nlen, ndist ))
+    {
+        return 1;
+    }
+
+    return inflate_codes( s, lencode, distcode );
+}
+
+static int inflate_zlib(
+    const unsigned char *in, size_t in_len, unsigned char *out, size_t out_len, size_t *out_count )
+// Decodes a zlib stream (the Adler-32 check is not verified).
+// Returns 0 on success, nonzero if the data is invalid or does not fit in out.
+{
+    struct Inflate_State s;
+    struct Huffman lencode, distcode;
+    int last, type, error;
+
+    if (in_len < 2 || (in[0] & 0x0f) != 8 || (in[0] * 256 + in[1]) % 31 != 0 || (in[1] & 0x20)) {
+        return 1;
+    }
+
+    s.in      = in;
+    s.in_len  = in_len;
+    s.in_pos  = 2;
+    s.out     = out;
+    s.out_len = out_len;
+    s.out_pos = 0;
+    s.bit_buf = 0;
+    s.bit_cnt = 0;
+
+    do {
+        last = get_bits( &s, 1 );
+        type = get_bits( &s, 2 );
+        if (type == 0) {
+            error = inflate_stored( &s );
+        } else if (type == 1) {
+            error = inflate_fixed( &s, &lencode, &distcode );
+        } else if (type == 2) {
+            error = inflate_dynamic( &s, &lencode, &distcode );
+        } else {
+            error = 1;
+        }
+        if (error) {
+            return error;
+        }
+    } while (!last);
+
+    *out_count = s.out_pos;
+
+    // bytes still in the bit buffer were not used
+    return s.in_pos - s.bit_cnt / 8 > s.in_len;
+}
+
+/*
+ * TIFF structure
+ */
+
+struct Tiff_File {
+    FILE *file;
+    int   big_endian;   // file is in "MM" byte order
+    int   big_tiff;     // file is BigTIFF (64-bit offsets)
+};
+
+struct Tiff_Entry {
+    int    tag;
+    int    type;
+    off_64 count;
+    unsigned char value[8];     // value, or offset of values if they don't fit
+};
+
+static unsigned long long get_uint( const unsigned char *ptr, int size, int big_endian )
+{
+    unsigned long long value = 0;
+    int k;
+
+    for (k=0; k<size; ++k) {
+        value |= (unsigned long long)ptr[big_endian ? size-1-k : k] << (8*k);
+    }
+    return value;
+}
+
+static int type_size( int type )
+{
+    switch (type) {
+        case TIFFbyte:  case TIFFascii: case TIFFsbyte: case TIFFundefined:
+            return 1;
+        case TIFFshort: case TIFFsshort:
+            return 2;
+        case TIFFlong:  case TIFFslong: case TIFFfloat:
+            return 4;
+        case TIFFrational: case TIFFsrational: case TIFFdouble:
+        case TIFFlong8: case TIFFslong8: case TIFFifd8:
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+static void read_bytes( const struct Tiff_File *tif, off_64 offset, void *buffer, size_t size )
+{
+    if (fseek_64( tif->file, offset, SEEK_SET ) != 0 ||
+        fread( buffer, 1, size, tif->file ) != size)
+    {
+        error_exit( "Read error occurred on input .tif file." );
+    }
+}
+
+static const struct Tiff_Entry *find_tag(
+    const struct Tiff_Entry *entries, int nentries, int tag )
+{
+    int k;
+
+    for (k=0; k<nentries; ++k) {
+        if (entries[k].tag == tag) {
+            return entries + k;
+        }
+    }
+    return NULL;
+}
+
+static unsigned char *load_tag( const struct Tiff_File *tif, const struct Tiff_Entry *entry )
+// Returns allocated copy of the values of a tag, plus a null terminator
+// NOTE: caller is responsible to free this pointer!
+{
+    size_t size = (size_t)entry->count * type_size( entry->type );
+    unsigned char *values;
+
+    if (type_size( entry->type ) == 0 || entry->count < 0 ||
+        (off_64)( size / type_size( entry->type ) ) != entry->count)
+    {
+        format_exit( "invalid tag" );
+    }
+
+    values = (unsigned char *)malloc( size + 1 );
+    if (!values) {
+        error_exit( "Insufficient memory for input .tif tags." );
+    }
+    if (size <= (size_t)( tif->big_tiff ? 8 : 4 )) {
+        memcpy( values, entry->value, size );
+    } else {
+        read_bytes( tif, (off_64)get_uint( entry->value, tif->big_tiff ? 8 : 4, tif->big_endian ),
+            values, size );
+    }
+    values[size] = '\0';
+    return values;
+}
+
+static double tag_value(
+    const struct Tiff_File *tif, const struct Tiff_Entry *entry, const unsigned char *values, LONG k )
+// Returns value k of a numeric tag loaded by load_tag()
+{
+    const unsigned char *ptr = values + k * type_size( entry->type );
+
+    union {
+        unsigned int i;
+        float f;
+    } pun32;
+
+    union {
+        unsigned long long i;
+        double d;
+    } pun64;
+
+    switch (entry->type) {
+        case TIFFsbyte:
+            return (double)(signed char)ptr[0];
+        case TIFFsshort:
+            return (double)(short)get_uint( ptr, 2, tif->big_endian );
+        case TIFFslong:
+            return (double)(int)get_uint( ptr, 4, tif->big_endian );
+        case TIFFslong8:
+            return (double)(long long)get_uint( ptr, 8, tif->big_endian );
+        case TIFFrational:
+            return (double)get_uint( ptr,   4, tif->big_endian ) /
+                   (double)get_uint( ptr+4, 4, tif->big_endian );
+        case TIFFsrational:
+            return (double)(int)get_uint( ptr,   4, tif->big_endian ) /
+                   (double)(int)get_uint( ptr+4, 4, tif->big_endian );
+        case TIFFfloat:
+            pun32.i = (unsigned int)get_uint( ptr, 4, tif->big_endian );
+            return (double)pun32.f;
+        case TIFFdouble:
+            pun64.i = get_uint( ptr, 8, tif->big_endian );
+            return pun64.d;
+        default:
+            return (double)get_uint( ptr, type_size( entry->type ), tif->big_endian );
+    }
+}
+
+static off_64 get_tag_int(
+    const struct Tiff_File *tif, const struct Tiff_Entry *entries, int nentries,
+    int tag, off_64 default_value )
+// Returns the first value of a numeric tag, or default_value if the tag is missing
+{
+    const struct Tiff_Entry *entry = find_tag( entries, nentries, tag );
+    unsigned char *values;
+    off_64 value;
+
+    if (!entry || entry->count < 1) {
+        return default_value;
+    }
+    values = load_tag( tif, entry );
+    value  = (off_64)tag_value( tif, entry, values, 0 );
+    free( values );
+    return value;
+}
+
+static off_64 *get_tag_ints(
+    const struct Tiff_File *tif, const struct Tiff_Entry *entries, int nentries,
+    int tag, LONG count )
+// Returns allocated array of the first count values of a numeric tag
+// NOTE: caller is responsible to free this pointer!
+{
+    const struct Tiff_Entry *entry = find_tag( entries, nentries, tag );
+    unsigned char *values;
+    off_64 *result;
+    LONG k;
+
+    if (!entry || entry->count < count) {
+        format_exit( "missing strip or tile offsets" );
+    }
+    values = load_tag( tif, entry );
+    result = (off_64 *)malloc( count * sizeof( off_64 ) );
+    if (!result) {
+        error_exit( "Insufficient memory for input .tif tags." );
+    }
+    for (k=0; k<count; ++k) {
+        // offsets and sizes are integer types, so nothing is lost below 2^53
+        result[k] = (off_64)tag_value( tif, entry, values, k );
+    }
+    free( values );
+    return result;
+}
+
+static int get_tag_doubles(
+    const struct Tiff_File *tif, const struct Tiff_Entry *entries, int nentries,
+    int tag, double *result, int count )
+// Reads the first count values of a numeric tag.
+// Returns 0 on success, nonzero if the tag is missing or too short.
+{
+    const struct Tiff_Entry *entry = find_tag( entries, nentries, tag );
+    unsigned char *values;
+    int k;
+
+    if (!entry || entry->count < count) {
+        return 1;
+    }
+    values = load_tag( tif, entry );
+    for (k=0; k<count; ++k) {
+        result[k] = tag_value( tif, entry, values, k );
+    }
+    free( values );
+    return 0;
+}
+
+static int get_geo_key(
+    const struct Tiff_File *tif, const struct Tiff_Entry *entries, int nentries,
+    int key, int default_value )
+// Returns a short value from the GeoKeyDirectory, or default_value if not present
+{
+    const struct Tiff_Entry *entry = find_tag( entries, nentries, GeoKeyDirectory );
+    unsigned char *values;
+    int nkeys, k;
+    int value = default_value;
+
+    if (!entry || entry->count < 4) {
+        return default_value;
+    }
+    values = load_tag( tif, entry );
+    nkeys  = (int)tag_value( tif, entry, values, 3 );
+    for (k=1; k<=nkeys && 4*k+3<entry->count; ++k) {
+        // each key: id, location (0 = value in place), count, value
+        if ((int)tag_value( tif, entry, values, 4*k ) == key &&
+            (int)tag_value( tif, entry, values, 4*k+1 ) == 0)
+        {
+            value = (int)tag_value( tif, entry, values, 4*k+3 );
+        }
+    }
+    free( values );
+    return value;
+}
+
+static struct Tiff_Entry *read_first_ifd( struct Tiff_File *tif, int *nentries )
+// Reads the file header and the entries of the first image file directory
+// NOTE: caller is responsible to free the returned pointer!
+{
+    unsigned char header[16];
+    unsigned char *raw;
+    struct Tiff_Entry *entries;
+    off_64 offset;
+    int entry_size;
+    int k;
+
+    read_bytes( tif, 0, header, 8 );
+    if (header[0] == 'I' && header[1] == 'I') {
+        tif->big_endian = 0;
+    } else if (header[0] == 'M' && header[1] == 'M') {
+        tif->big_endian = 1;
+    } else {
+        error_exit( "Input .tif file is not a TIFF file." );
+    }
+
+    switch (get_uint( header+2, 2, tif->big_endian )) {
+        case 42:
+            tif->big_tiff = 0;
+            offset = (off_64)get_uint( header+4, 4, tif->big_endian );
+            break;
+        case 43:
+            tif->big_tiff = 1;
+            read_bytes( tif, 8, header+8, 8 );
+            if (get_uint( header+4, 2, tif->big_endian ) != 8) {
+                format_exit( "BigTIFF offsets are not 8 bytes" );
+            }
+            offset = (off_64)get_uint( header+8, 8, tif->big_endian );
+            break;
+        default:
+            error_exit( "Input .tif file is not a TIFF file." );
+            return NULL;
+    }
+
+    if (tif->big_tiff) {
+        read_bytes( tif, offset, header, 8 );
+        *nentries = (int)get_uint( header, 8, tif->big_endian );
+        offset += 8;
+        entry_size = 20;
+    } else {
+        read_bytes( tif, offset, header, 2 );
+        *nentries = (int)get_uint( header, 2, tif->big_endian );
+        offset += 2;
+        entry_size = 12;
+    }
+    if (*nentries < 1 || *nentries > 65535) {
+        error_exit( "Input .tif file contains an invalid image directory." );
+    }
+
+    raw     = (unsigned char *)malloc( (size_t)*nentries * entry_size );
+    entries = (struct Tiff_Entry *)malloc( *nentries * sizeof( struct Tiff_Entry ) );
+    if (!raw || !entries) {
+        error_exit( "Insufficient memory for input .tif tags." );
+    }
+    read_bytes( tif, offset, raw, (size_t)*nentries * entry_size );
+
+    for (k=0; k<*nentries; ++k) {
+        const unsigned char *ptr = raw + k * entry_size;
+
+        entries[k].tag  = (int)get_uint( ptr,   2, tif->big_endian );
+        entries[k].type = (int)get_uint( ptr+2, 2, tif->big_endian );
+        if (tif->big_tiff) {
+            entries[k].count = (off_64)get_uint( ptr+4, 8, tif->big_endian );
+            memcpy( entries[k].value, ptr+12, 8 );
+        } else {
+            entries[k].count = (off_64)get_uint( ptr+4, 4, tif->big_endian );
+            memcpy( entries[k].value, ptr+8, 4 );
+        }
+    }
+
+    free( raw );
+    return entries;
+}
+
+/*
+ * Image data
+ */
+
+struct Tiff_Layout {
+    int nrows;          // rows    in image
+    int ncols;          // columns in image
+    int chunk_rows;     // rows    in each strip or tile
+    int chunk_cols;     // columns in each strip or tile
+    int bytes;          // bytes per sample (2 or 4)
+    int format;         // SAMPLEFORMAT_INT, SAMPLEFORMAT_UINT, or SAMPLEFORMAT_IEEEFP
+    int compression;
+    int predictor;
+    int big_endian;
+};
+
+static void decode_row(
+    const struct Tiff_Layout *lay, unsigned char *src, int count, float *dst )
+// Converts the first count samples of one decoded row of a strip or tile;
+// src holds the whole row and is changed in place by the predictor
+{
+    LONG row_bytes = (LONG)lay->chunk_cols * lay->bytes;
+    LONG k;
+    int  j;
+    unsigned int value, prev;
+
+    union {
+        unsigned int i;
+        float f;
+    } pun;
+
+    if (lay->predictor == PREDICTOR_FLOATINGPOINT) {
+        // byte differences across the row, then the bytes of each sample are
+        // spread across the row in big-endian order
+        for (k=1; k<row_bytes; ++k) {
+            src[k] = (unsigned char)( src[k] + src[k-1] );
+        }
+        for (j=0; j<count; ++j) {
+            if (lay->bytes == 4) {
+                pun.i = ( (unsigned int)src[j] << 24 ) |
+                        ( (unsigned int)src[lay->chunk_cols+j] << 16 ) |
+                        ( (unsigned int)src[2*lay->chunk_cols+j] << 8 ) |
+                          (unsigned int)src[3*lay->chunk_cols+j];
+                dst[j] = pun.f;
+            } else {
+                value = ( (unsigned int)src[j] << 8 ) | (unsigned int)src[lay->chunk_cols+j];
+                dst[j] = lay->format == SAMPLEFORMAT_INT ? (float)(short)value : (float)value;
+            }
+        }
+        return;
+    }
+
+    prev = 0;
+    for (j=0; j<count; ++j) {
+        value = (unsigned int)get_uint( src + j * lay->bytes, lay->bytes, lay->big_endian );
+        if (lay->predictor == PREDICTOR_HORIZONTAL) {
+            // differences of integers of the sample size, with wraparound
+            value += prev;
+            if (lay->bytes == 2) {
+                value &= 0xffff;
+            }
+            prev = value;
+        }
+        if (lay->bytes == 4) {
+            pun.i = value;
+            dst[j] = pun.f;
+        } else {
+            dst[j] = lay->format == SAMPLEFORMAT_INT ? (float)(short)value : (float)value;
+        }
+    }
+}
+
+static void check_tif_values(
+    float *ptr, LONG count, float nodata, int *has_nulls, int *all_ints )
+{
+    LONG k;
+
+    for (k=0; k<count; ++k) {
+        if (flt_isnan( ptr[k] )) {
+            // treat voids written as NaN like any other void point
+            ptr[k] = nodata;
+            *has_nulls = 1;
+        } else if (ptr[k] == nodata || ptr[k] < -1.0e+38) {
+            *has_nulls = 1;
+        } else if (all_ints && *all_ints && ptr[k] != floor( ptr[k] )) {
+            *all_ints = 0;
+        }
+    }
+}
+
+float *read_geotiff_file(
+    FILE *in_tif_file,  // .tif file - should be opened in BINARY mode
+    struct Flt_Hdr_Info *info,  // output: size, extent and NODATA value of data
+    int *has_nulls,
+    int *all_ints       // if null, values are not checked for integers
+)
+{
+    struct Tiff_File   tif;
+    struct Tiff_Entry *entries;
+    struct Tiff_Layout lay;
+    const struct Tiff_Entry *entry;
+    int nentries;
+
+    double scale[3], tiepoint[6], transform[16];
+    double xdim, ydim;
+    unsigned char *nodata_str;
+    int tiled, planar, samples, bits;
+
+    off_64 *offsets, *byte_counts;
+    LONG nchunks, across, c;
+    LONG chunk_bytes;
+    size_t in_size, out_count;
+    unsigned char *in_buf, *out_buf;
+    float *data;
+    int row0, col0, nrows, ncols, i;
+
+    tif.file = in_tif_file;
+    entries  = read_first_ifd( &tif, &nentries );
+
+    // Image layout:
+
+    lay.ncols = (int)get_tag_int( &tif, entries, nentries, ImageWidth,  0 );
+    lay.nrows = (int)get_tag_int( &tif, entries, nentries, ImageLength, 0 );
+    samples   = (int)get_tag_int( &tif, entries, nentries, SamplesPerPixel, 1 );
+    planar    = (int)get_tag_int( &tif, entries, nentries, PlanarConfiguration, 1 );
+    bits      = (int)get_tag_int( &tif, entries, nentries, BitsPerSample, 1 );
+    lay.format      = (int)get_tag_int( &tif, entries, nentries, SampleFormat, SAMPLEFORMAT_UINT );
+    lay.compression = (int)get_tag_int( &tif, entries, nentries, Compression, COMPRESSION_NONE );
+    lay.predictor   = (int)get_tag_int( &tif, entries, nentries, Predictor, PREDICTOR_NONE );
+    lay.big_endian  = tif.big_endian;
+
+    if (lay.nrows < 1 || lay.ncols < 1) {
+        format_exit( "missing image size" );
+    }
+    if (samples != 1 && planar != 2) {
+        // with separate planes, the first band comes first
+        format_exit( "more than one band" );
+    }
+    if (bits == 32 && lay.format == SAMPLEFORMAT_IEEEFP) {
+        lay.bytes = 4;
+    } else if (bits == 16 && (lay.format == SAMPLEFORMAT_INT || lay.format == SAMPLEFORMAT_UINT)) {
+        lay.bytes = 2;
+    } else {
+        format_exit( "data type must be Float32 or Int16" );
+    }
+    if (lay.compression != COMPRESSION_NONE &&
+        lay.compression != COMPRESSION_DEFLATE && lay.compression != COMPRESSION_DEFLATE_OLD)
+    {
+        format_exit( "compression must be none or DEFLATE" );
+    }
+    if (lay.predictor != PREDICTOR_NONE && lay.predictor != PREDICTOR_HORIZONTAL &&
+        lay.predictor != PREDICTOR_FLOATINGPOINT)
+    {
+        format_exit( "unknown predictor" );
+    }
+
+    tiled = find_tag( entries, nentries, TileWidth ) != NULL;
+    if (tiled) {
+        lay.chunk_cols = (int)get_tag_int( &tif, entries, nentries, TileWidth,  0 );
+        lay.chunk_rows = (int)get_tag_int( &tif, entries, nentries, TileLength, 0 );
+    } else {
+        lay.chunk_cols = lay.ncols;
+        lay.chunk_rows = (int)get_tag_int( &tif, entries, nentries, RowsPerStrip, lay.nrows );
+        if (lay.chunk_rows > lay.nrows) {
+            lay.chunk_rows = lay.nrows;
+        }
+    }
+    if (lay.chunk_rows < 1 || lay.chunk_cols < 1) {
+        format_exit( "invalid strip or tile size" );
+    }
+
+    across  = ( lay.ncols + lay.chunk_cols - 1 ) / lay.chunk_cols;
+    nchunks = across * ( ( lay.nrows + lay.chunk_rows - 1 ) / lay.chunk_rows );
+    offsets     = get_tag_ints( &tif, entries, nentries,
+                                tiled ? TileOffsets    : StripOffsets,    nchunks );
+    byte_counts = get_tag_ints( &tif, entries, nentries,
+                                tiled ? TileByteCounts : StripByteCounts, nchunks );
+
+    // Georeferencing:
+
+    if (get_tag_doubles( &tif, entries, nentries, ModelPixelScale, scale, 3 ) == 0 &&
+        get_tag_doubles( &tif, entries, nentries, ModelTiepoint, tiepoint, 6 ) == 0)
+    {
+        xdim = scale[0];
+        ydim = scale[1];
+        info->xmin = tiepoint[3] - tiepoint[0] * xdim;
+        info->ymax = tiepoint[4] + tiepoint[1] * ydim;
+    } else if (get_tag_doubles( &tif, entries, nentries, ModelTransformation, transform, 16 ) == 0) {
+        if (transform[1] != 0.0 || transform[4] != 0.0) {
+            format_exit( "rotated grid" );
+        }
+        xdim = transform[0];
+        ydim = -transform[5];
+        info->xmin = transform[3];
+        info->ymax = transform[7];
+    } else {
+        format_exit( "missing ModelPixelScale and ModelTiepoint tags" );
+        return NULL;
+    }
+    if (!( xdim > 0.0 && ydim > 0.0 )) {
+        format_exit( "pixel size must be positive, with north up" );
+    }
+    if (get_geo_key( &tif, entries, nentries, GTRasterTypeGeoKey, 0 ) == RasterPixelIsPoint) {
+        // tie point is at the center of the pixel, not its corner
+        info->xmin -= 0.5 * xdim;
+        info->ymax += 0.5 * ydim;
+    }
+
+    info->nrows = lay.nrows;
+    info->ncols = lay.ncols;
+    info->xmax  = info->xmin + lay.ncols * xdim;
+    info->ymin  = info->ymax - lay.nrows * ydim;
+
+    // same default as a .hdr file without a NODATA line
+    info->nodata = -3.40282347e+38f;
+    entry = find_tag( entries, nentries, GDALNoData );
+    if (entry && entry->type == TIFFascii) {
+        nodata_str = load_tag( &tif, entry );
+        if (sscanf( (const char *)nodata_str, "%f", &info->nodata ) != 1 ||
+            flt_isnan( info->nodata ))
+        {
+            // "nan" - NaN values are voids anyway
+            info->nodata = -3.40282347e+38f;
+        }
+        free( nodata_str );
+    }
+
+    // the array is stored like a native .flt file
+    info->big_endian = am_big_endian();
+    info->skipbytes  = 0;
+    info->rowpad     = 0;
+
+    free( entries );
+
+    // Read strips or tiles:
+
+    data = (float *)malloc( (LONG)lay.nrows * (LONG)lay.ncols * sizeof( float ) );
+    chunk_bytes = (LONG)lay.chunk_rows * (LONG)lay.chunk_cols * lay.bytes;
+    out_buf = (unsigned char *)malloc( chunk_bytes );
+    if (!data || !out_buf) {
+        error_exit( "Insufficient memory for input .tif data." );
+    }
+    in_buf  = NULL;
+    in_size = 0;
+
+    for (c=0; c<nchunks; ++c) {
+        row0  = (int)( c / across ) * lay.chunk_rows;
+        col0  = (int)( c % across ) * lay.chunk_cols;
+        nrows = lay.nrows - row0 < lay.chunk_rows ? lay.nrows - row0 : lay.chunk_rows;
+        ncols = lay.ncols - col0 < lay.chunk_cols ? lay.ncols - col0 : lay.chunk_cols;
+
+        if (byte_counts[c] == 0) {
+            // sparse file: strip or tile was never written
+            for (i=0; i<nrows; ++i) {
+                float *dst = data + (LONG)(row0+i) * lay.ncols + col0;
+                int j;
+                for (j=0; j<ncols; ++j) {
+                    dst[j] = info->nodata;
+                }
+            }
+            continue;
+        }
+
+        if (lay.compression == COMPRESSION_NONE) {
+            // the last strip may be short
+            out_count = (size_t)( byte_counts[c] < chunk_bytes ? byte_counts[c] : chunk_bytes );
+            read_bytes( &tif, offsets[c], out_buf, out_count );
+        } else {
+            if ((size_t)byte_counts[c] > in_size) {
+                free( in_buf );
+                in_size = (size_t)byte_counts[c];
+                in_buf  = (unsigned char *)malloc( in_size );
+                if (!in_buf) {
+                    error_exit( "Insufficient memory for input .tif data." );
+                }
+            }
+            read_bytes( &tif, offsets[c], in_buf, (size_t)byte_counts[c] );
+            if (inflate_zlib( in_buf, (size_t)byte_counts[c], out_buf, chunk_bytes, &out_count )) {
+                error_exit( "Input .tif file contains invalid DEFLATE data." );
+            }
+        }
+        if (out_count < (size_t)nrows * lay.chunk_cols * lay.bytes) {
+            error_exit( "Input .tif file contains a strip or tile that is too small." );
+        }
+
+        for (i=0; i<nrows; ++i) {
+            decode_row( &lay, out_buf + (LONG)i * lay.chunk_cols * lay.bytes, ncols,
+                        data + (LONG)(row0+i) * lay.ncols + col0 );
+        }
+    }
+
+    free( in_buf );
+    free( out_buf );
+    free( offsets );
+    free( byte_counts );
+
+    // Check values:
+
+    *has_nulls = 0;
+    if (all_ints) {
+        *all_ints = 1;
+    }
+    check_tif_values( data, (LONG)lay.nrows * (LONG)lay.ncols, info->nodata, has_nulls, all_ints );
+
+    return data;
+}
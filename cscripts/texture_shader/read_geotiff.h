@@ -0,0 +1,46 @@
+/*
+ * read_geotiff.h
+ *
+ * Reads elevation data directly from a GeoTIFF file, as a companion to the
+ * GeoTIFF writer in WriteGrayscaleTIFF.c.
+ * Added for tectoplot; distributed under the same terms as the other
+ * files in this directory (see LICENSE.txt).
+ */
+
+#ifndef READ_GEOTIFF_H
+#define READ_GEOTIFF_H
+
+#include "read_grid_files.h"    // for struct Flt_Hdr_Info
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Returns nonzero if filename ends in ".tif" or ".TIF".
+int is_geotiff_name( const char *filename );
+
+// Reads the first image of a GeoTIFF (or BigTIFF) file into an allocated array,
+// in the same layout as read_flt_hdr_files(). The image must have one band of
+// 32-bit floating-point or 16-bit integer samples, in strips or tiles, either
+// uncompressed or DEFLATE-compressed (with or without a predictor), and must be
+// georeferenced by ModelPixelScale and ModelTiepoint tags (or by a
+// ModelTransformation tag without rotation).
+// info is filled in as read_flt_hdr_info() would fill it for the same data in a
+// native .flt file, with the NODATA value from the GDAL_NODATA tag, if any.
+// As in read_flt_hdr_files(), voids stored as NaN are replaced by the NODATA
+// value. Exits with an error message if the file cannot be read.
+// NOTE: caller is responsible to free the returned pointer!
+float *read_geotiff_file(
+    FILE *in_tif_file,  // .tif file - should be opened in BINARY mode
+    struct Flt_Hdr_Info *info,  // output: size, extent and NODATA value of data
+    int *has_nulls,
+    int *all_ints       // if null, values are not checked for integers
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
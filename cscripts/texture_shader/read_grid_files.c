@@ -34,13 +34,21 @@
 #define _CRT_SECURE_NO_WARNINGS
 
 #include "read_grid_files.h"
+#include "thread_pool.h"
 
 #include <stddef.h> // for ptrdiff_t
+#include <sys/types.h>  // for off_t
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <math.h>
 
+#if !defined(_WIN32)
+#   define FLT_MMAP
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#endif
+
 // For a 64-bit compile we need LONG to be 64 bits, even if the compiler uses an LLP64 model
 #define LONG ptrdiff_t
 
@@ -116,6 +124,70 @@ static void negative_exit( const char *line, int value )
     exit( EXIT_FAILURE );
 }
 
+// Sets the file position of a (possibly > 2 GB) .flt file.
+// Returns 0 on success, nonzero on error.
+static int seek_flt( FILE *in_flt_file, LONG offset )
+{
+#if defined(_WIN32)
+    return _fseeki64( in_flt_file, offset, SEEK_SET );
+#else
+    return fseeko( in_flt_file, (off_t)offset, SEEK_SET );
+#endif
+}
+
+// Swaps bytes of one row of data read from a .flt file.
+static void swap_flt_row( float *ptr, int ncols )
+{
+    union {
+        float f;
+        char c[4];
+    } pun;
+
+    int j;
+    char temp;
+
+    for (j=0; j<ncols; ++j) {
+        pun.f = ptr[j];
+        temp = pun.c[0];
+        pun.c[0] = pun.c[3];
+        pun.c[3] = temp;
+        temp = pun.c[1];
+        pun.c[1] = pun.c[2];
+        pun.c[2] = temp;
+        ptr[j] = pun.f;
+    }
+}
+
+// Swaps bytes if needed and checks one row of data read from a .flt file.
+static void check_flt_row(
+    float *ptr, int ncols, float nodata, int reverse_bytes, int *has_nulls, int *all_ints )
+{
+    int j;
+
+    if (reverse_bytes) {
+        swap_flt_row( ptr, ncols );
+    }
+
+    for (j=0; j<ncols; ++j) {
+        if (flt_isnan( ptr[j] )) {
+            // GDAL writes voids as NaN when the source NODATA value is NaN;
+            // treat them like any other void point
+            ptr[j] = nodata;
+            *has_nulls = 1;
+        } else if (ptr[j] == nodata || ptr[j] < -1.0e+38) {
+
+          // This commented line of code was original but has been changed to
+          // allow shadow.c to work underwater at the map edge. Not sure if it
+          // needs to be adjusted to allow some original functionality! KEB 2022
+          // ptr[j]=0;
+            // ptr[j] = -99999;
+            *has_nulls = 1;
+        } else if (*all_ints && ptr[j] != floor( ptr[j] )) {
+            *all_ints = 0;
+        }
+    }
+}
+
 static void read_int( const char *line, int pos, int *value )
 {
     if (sscanf( line+pos, "%d", value ) != 1) {
@@ -154,7 +226,7 @@ static void read_hdr_file(
 static float *read_flt_file(
     FILE *in_flt_file, int nrows, int ncols,
     float nodata, int big_endian, int skipbytes, int rowpad,
-    int *has_nulls, int *all_ints );
+    int check, int *has_nulls, int *all_ints );
 
 float *read_flt_hdr_files(
     // returns allocated array of data values;
@@ -189,7 +261,324 @@ float *read_flt_hdr_files(
 
     return read_flt_file(
         in_flt_file, *nrows, *ncols, nodata, big_endian, skipbytes, rowpad,
-        has_nulls, all_ints );
+        1, has_nulls, all_ints );
+}
+
+void read_flt_hdr_info(
+    FILE *in_hdr_file,  // .hdr file - should be opened in BINARY mode
+    struct Flt_Hdr_Info *info,
+    char * (*software)  // if software != 0, returns with *software either
+                        // null or pointing to a software name/version string;
+                        // caller is responsible to free *software pointer!
+)
+{
+    read_hdr_file(
+        in_hdr_file, &info->nrows, &info->ncols,
+        &info->xmin, &info->xmax, &info->ymin, &info->ymax,
+        &info->nodata, &info->big_endian, &info->skipbytes, &info->rowpad, software );
+}
+
+void read_flt_block(
+    FILE *in_flt_file,  // .flt file - should be opened in BINARY mode
+    const struct Flt_Hdr_Info *info,    // from read_flt_hdr_info()
+    int first_row,      // first row    of block to read
+    int first_col,      // first column of block to read
+    int nrows,          // number of rows in block
+    int ncols,          // number of cols in block
+    float *data,        // output array of nrows x ncols data values
+    int *has_nulls,     // set for this block only
+    int *all_ints       // set for this block only
+)
+{
+    LONG rowbytes = 4 * (LONG)info->ncols + (LONG)info->rowpad;
+    LONG offset;
+
+    float *ptr;
+    int i;
+    int count;
+    int reverse_bytes = ( am_big_endian() != info->big_endian );
+
+    *has_nulls = 0;
+    *all_ints  = 1;
+
+    if (first_row < 0 || first_col < 0 ||
+        first_row + nrows > info->nrows || first_col + ncols > info->ncols)
+    {
+        error_exit( "Block to read lies outside input .flt file." );
+    }
+
+    for (i=0, ptr=data; i<nrows; ++i, ptr+=ncols) {
+        offset = (LONG)info->skipbytes + (LONG)(first_row + i) * rowbytes + 4 * (LONG)first_col;
+        if (seek_flt( in_flt_file, offset )) {
+            error_exit( "Read error occurred on input .flt file." );
+        }
+
+        count = fread( ptr, sizeof( float ), ncols, in_flt_file );
+        if (count < ncols) {
+            if (feof( in_flt_file )) {
+                error_exit( "Input .flt file size too small - does not match .hdr info." );
+            } else {
+                error_exit( "Read error occurred on input .flt file." );
+            }
+        }
+
+        check_flt_row( ptr, ncols, info->nodata, reverse_bytes, has_nulls, all_ints );
+    }
+}
+
+// Memory-mapped input:
+//
+// A .flt file in native byte order with no row padding already holds the data
+// array exactly as the programs use it, so instead of being read into
+// allocated memory it is mapped into the address space. The mapping is private
+// (copy-on-write): its pages are shared with the file cache until a program
+// changes a value, for instance when filling voids, and the file itself is
+// never changed. The values are then checked for voids (and integers, if the
+// caller asks) by several threads, a vector of values at a time.
+
+#if defined(__GNUC__) || defined(__clang__)
+#   define FLT_CHECK_VECTORS
+#   define FLT_LANES 8
+typedef float Flt_Vec  __attribute__(( vector_size(32) ));
+typedef int   Flt_Mask __attribute__(( vector_size(32) ));
+#endif
+
+// values checked per task
+#define FLT_CHECK_BLOCK 65536
+
+struct Flt_Check {
+    float *data;
+    LONG   count;
+    float  nodata;
+    int    check_ints;
+    int   *has_nulls;   // per thread
+    int   *has_fracs;   // per thread: nonzero if any non-integer value found
+};
+
+// Checks values one at a time, as check_flt_row() does.
+static void check_flt_values(
+    float *ptr, LONG count, float nodata, int check_ints, int *has_nulls, int *has_fracs )
+{
+    LONG k;
+
+    for (k=0; k<count; ++k) {
+        if (flt_isnan( ptr[k] )) {
+            // GDAL writes voids as NaN when the source NODATA value is NaN;
+            // treat them like any other void point
+            ptr[k] = nodata;
+            *has_nulls = 1;
+        } else if (ptr[k] == nodata || ptr[k] < -1.0e+38) {
+            *has_nulls = 1;
+        } else if (check_ints && ptr[k] != floor( ptr[k] )) {
+            *has_fracs = 1;
+        }
+    }
+}
+
+static int check_flt_blocks( long first, long last, int thread, void *state )
+// Checks values in blocks [first,last) of FLT_CHECK_BLOCK values
+{
+    const struct Flt_Check *c = (const struct Flt_Check *)state;
+
+    LONG start = (LONG)first * FLT_CHECK_BLOCK;
+    LONG end   = (LONG)last  * FLT_CHECK_BLOCK;
+    LONG k = 0;
+    float *ptr;
+    int has_nulls = 0;
+    int has_fracs = 0;
+
+    if (end > c->count) {
+        end = c->count;
+    }
+    ptr = c->data + start;
+
+#ifdef FLT_CHECK_VECTORS
+    {
+        Flt_Vec v, a, r, nodata, big, tiny, round;
+        Flt_Mask nans, nulls, fracs, null, small;
+        Flt_Mask abs_bits;
+        int any_nans = 0;
+        int j;
+
+        for (j=0; j<FLT_LANES; ++j) {
+            nodata[j] = c->nodata;
+            big[j]    = 8388608.0f;     // 2^23: floats this large are all integers
+            tiny[j]   = -1.0e+38f;
+            round[j]  = 8388608.0f;
+            nans[j]   = 0;
+            nulls[j]  = 0;
+            fracs[j]  = 0;
+            abs_bits[j] = 0x7fffffff;
+        }
+
+        for (; k+FLT_LANES<=end-start; k+=FLT_LANES) {
+            memcpy( &v, ptr+k, sizeof( v ) );
+            nans  |= v != v;
+            null   = (v == nodata) | (v < tiny);
+            nulls |= null;
+            if (c->check_ints) {
+                // adding and subtracting 2^23 rounds a smaller value to an integer
+                a = (Flt_Vec)( (Flt_Mask)v & abs_bits );
+                small = (a < big) & ~null;
+                r = ( a + round ) - round;
+                fracs |= small & (r != a);
+            }
+        }
+
+        for (j=0; j<FLT_LANES; ++j) {
+            any_nans  = any_nans  || nans[j];
+            has_nulls = has_nulls || nulls[j];
+            has_fracs = has_fracs || fracs[j];
+        }
+        if (any_nans) {
+            // NaNs must be replaced; check the whole block one at a time
+            k = 0;
+            has_nulls = 0;
+            has_fracs = 0;
+        }
+    }
+#endif
+
+    check_flt_values( ptr+k, end-start-k, c->nodata, c->check_ints, &has_nulls, &has_fracs );
+
+    c->has_nulls[thread] = c->has_nulls[thread] || has_nulls;
+    c->has_fracs[thread] = c->has_fracs[thread] || has_fracs;
+
+    return 0;
+}
+
+static void check_flt_data(
+    float *data, LONG count, float nodata, int num_threads, int *has_nulls, int *all_ints )
+// Checks data values for voids, and for integers if all_ints is not null
+{
+    struct Thread_Pool *pool;
+    struct Flt_Check c;
+    int nthreads;
+    int t;
+
+    pool = num_threads == 1 ? NULL : thread_pool_create( num_threads );
+    nthreads = thread_pool_size( pool );
+
+    c.data       = data;
+    c.count      = count;
+    c.nodata     = nodata;
+    c.check_ints = all_ints != NULL;
+    c.has_nulls  = (int *)calloc( nthreads, sizeof( int ) );
+    c.has_fracs  = (int *)calloc( nthreads, sizeof( int ) );
+
+    if (!c.has_nulls || !c.has_fracs) {
+        error_exit( "Insufficient memory for input .flt data." );
+    }
+
+    thread_pool_run(
+        pool, (long)( (count + FLT_CHECK_BLOCK - 1) / FLT_CHECK_BLOCK ), 0,
+        check_flt_blocks, &c, NULL );
+
+    *has_nulls = 0;
+    if (all_ints) {
+        *all_ints = 1;
+    }
+    for (t=0; t<nthreads; ++t) {
+        *has_nulls = *has_nulls || c.has_nulls[t];
+        if (all_ints) {
+            *all_ints = *all_ints && !c.has_fracs[t];
+        }
+    }
+
+    free( c.has_nulls );
+    free( c.has_fracs );
+    thread_pool_destroy( pool );
+}
+
+float *map_flt_hdr_files(
+    FILE *in_flt_file,  // .flt file - should be opened in BINARY mode
+    FILE *in_hdr_file,  // .hdr file - should be opened in BINARY mode
+    int *nrows,         // number of rows in data array
+    int *ncols,         // number of cols in data array
+    double *xmin,       // min X coordinate (longitude or easting)
+    double *xmax,       // max X coordinate (longitude or easting)
+    double *ymin,       // min Y coordinate (latitude  or northing)
+    double *ymax,       // max Y coordinate (latitude  or northing)
+    int *has_nulls,
+    int *all_ints,      // if null, values are not checked for integers
+    int num_threads,    // number of threads for checking values (0 = all processors)
+    struct Flt_Map *map // set for free_flt_data()
+)
+{
+    float nodata;
+    int big_endian;
+    int skipbytes;
+    int rowpad;
+
+    float *data = NULL;
+    LONG count;
+
+#ifdef FLT_MMAP
+    struct stat st;
+    LONG length;
+    void *base;
+#endif
+
+    map->base   = NULL;
+    map->length = 0;
+
+    // Read and validate .hdr file:
+
+    read_hdr_file(
+        in_hdr_file, nrows, ncols, xmin, xmax, ymin, ymax,
+        &nodata, &big_endian, &skipbytes, &rowpad, 0 );
+
+    count = (LONG)*nrows * (LONG)*ncols;
+
+#ifdef FLT_MMAP
+    if (big_endian == am_big_endian() && rowpad == 0 && skipbytes % sizeof( float ) == 0 &&
+        fstat( fileno( in_flt_file ), &st ) == 0)
+    {
+        length = (LONG)skipbytes + count * (LONG)sizeof( float );
+        if ((LONG)st.st_size < length) {
+            error_exit( "Input .flt file size too small - does not match .hdr info." );
+        }
+        if ((LONG)st.st_size > length) {
+            fprintf( stderr, "*** WARNING: " );
+            fprintf( stderr, "Input .flt file size too large - does not match .hdr info.\n" );
+        }
+
+        base = mmap( NULL, (size_t)length, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                     fileno( in_flt_file ), 0 );
+        if (base != MAP_FAILED) {
+#ifdef MADV_WILLNEED
+            madvise( base, (size_t)length, MADV_WILLNEED );
+#endif
+            map->base   = base;
+            map->length = (size_t)length;
+            data = (float *)( (char *)base + skipbytes );
+        }
+    }
+#endif
+
+    if (!data) {
+        // byte order or layout does not match the data array; read a copy
+        data = read_flt_file(
+            in_flt_file, *nrows, *ncols, nodata, big_endian, skipbytes, rowpad,
+            0, NULL, NULL );
+    }
+
+    check_flt_data( data, count, nodata, num_threads, has_nulls, all_ints );
+
+    return data;
+}
+
+void free_flt_data( float *data, struct Flt_Map *map )
+{
+#ifdef FLT_MMAP
+    if (map->base) {
+        munmap( map->base, map->length );
+        map->base   = NULL;
+        map->length = 0;
+        return;
+    }
+#endif
+    free( data );
 }
 
 #define MAXLINE 80
@@ -537,24 +926,22 @@ void copy_prj_file( FILE *in_prj_file, FILE *out_prj_file )
 static float *read_flt_file(
     FILE *in_flt_file, int nrows, int ncols,
     float nodata, int big_endian, int skipbytes, int rowpad,
-    int *has_nulls, int *all_ints )
+    int check, int *has_nulls, int *all_ints )
+// Reads data from .flt file into allocated memory; checks the values for voids
+// and integers unless check is zero (bytes are swapped if needed either way).
 {
-    union {
-        float f;
-        char c[4];
-    } pun;
-
     float *data;
     float *ptr;
-    int i, j;
+    int i;
     int count;
     int error;
     char c;
     int reverse_bytes = ( am_big_endian() != big_endian );
-    char temp;
 
-    *has_nulls = 0;
-    *all_ints  = 1;
+    if (check) {
+        *has_nulls = 0;
+        *all_ints  = 1;
+    }
 
     // Read data from .flt file:
 
@@ -579,37 +966,10 @@ static float *read_flt_file(
             }
         }
 
-        if (reverse_bytes) {
-            for (j=0; j<ncols; ++j) {
-                pun.f = ptr[j];
-                temp = pun.c[0];
-                pun.c[0] = pun.c[3];
-                pun.c[3] = temp;
-                temp = pun.c[1];
-                pun.c[1] = pun.c[2];
-                pun.c[2] = temp;
-                ptr[j] = pun.f;
-            }
-        }
-
-        for (j=0; j<ncols; ++j) {
-            if (flt_isnan( ptr[j] )) {
-                prefix_error();
-                fprintf( stderr, "Input .flt file contains NaNs - probably bad data" );
-                fprintf( stderr, "(or wrong .hdr file).\n" );
-                exit( EXIT_FAILURE );
-            }
-            if (ptr[j] == nodata || ptr[j] < -1.0e+38) {
-
-              // This commented line of code was original but has been changed to
-              // allow shadow.c to work underwater at the map edge. Not sure if it
-              // needs to be adjusted to allow some original functionality! KEB 2022
-              // ptr[j]=0;
-                // ptr[j] = -99999;
-                *has_nulls = 1;
-            } else if (*all_ints && ptr[j] != floor( ptr[j] )) {
-                *all_ints = 0;
-            }
+        if (check) {
+            check_flt_row( ptr, ncols, nodata, reverse_bytes, has_nulls, all_ints );
+        } else if (reverse_bytes) {
+            swap_flt_row( ptr, ncols );
         }
 
         error = fseek( in_flt_file, rowpad, SEEK_CUR );
@@ -55,6 +55,74 @@ float *read_flt_hdr_files(
                         // caller is responsible to free *software pointer!
 );
 
+// Memory mapping made by map_flt_hdr_files(), if any
+struct Flt_Map {
+    void  *base;        // start of mapping, or null if data was read into allocated memory
+    size_t length;      // length of mapping in bytes
+};
+
+// Like read_flt_hdr_files(), but maps the .flt file into memory instead of reading
+// it when its byte order and layout match the data array (no copy is made until a
+// value is changed; the file itself is never changed). Otherwise reads the data into
+// allocated memory. The values are checked by several threads; the check for
+// integer values is skipped if all_ints is null.
+// NOTE: caller is responsible to release the data with free_flt_data()!
+float *map_flt_hdr_files(
+    FILE *in_flt_file,  // .flt file - should be opened in BINARY mode
+    FILE *in_hdr_file,  // .hdr file - should be opened in BINARY mode
+    int *nrows,         // number of rows in data array
+    int *ncols,         // number of cols in data array
+    double *xmin,       // min X coordinate (longitude or easting)  - left   edge of left   pixels
+    double *xmax,       // max X coordinate (longitude or easting)  - right  edge of right  pixels
+    double *ymin,       // min Y coordinate (latitude  or northing) - bottom edge of bottom pixels
+    double *ymax,       // max Y coordinate (latitude  or northing) - top    edge of top    pixels
+    int *has_nulls,
+    int *all_ints,      // if null, values are not checked for integers
+    int num_threads,    // number of threads for checking values (0 = all processors)
+    struct Flt_Map *map // set for free_flt_data()
+);
+
+// Releases data from map_flt_hdr_files() (null data is allowed).
+void free_flt_data( float *data, struct Flt_Map *map );
+
+// Format info from a .hdr file, as needed to read parts of the matching .flt file
+struct Flt_Hdr_Info {
+    int    nrows;       // number of rows in .flt file
+    int    ncols;       // number of cols in .flt file
+    double xmin;        // min X coordinate (longitude or easting)  - left   edge of left   pixels
+    double xmax;        // max X coordinate (longitude or easting)  - right  edge of right  pixels
+    double ymin;        // min Y coordinate (latitude  or northing) - bottom edge of bottom pixels
+    double ymax;        // max Y coordinate (latitude  or northing) - top    edge of top    pixels
+    float  nodata;      // NODATA value
+    int    big_endian;  // nonzero if .flt file is MSBFIRST
+    int    skipbytes;   // bytes to skip at start of .flt file
+    int    rowpad;      // bytes to skip at end of each row
+};
+
+// Reads and validates .hdr file only, so that a large .flt file can then be read
+// in pieces with read_flt_block().
+void read_flt_hdr_info(
+    FILE *in_hdr_file,  // .hdr file - should be opened in BINARY mode
+    struct Flt_Hdr_Info *info,
+    char * (*software)  // if software != 0, returns with *software either
+                        // null or pointing to a software name/version string;
+                        // caller is responsible to free *software pointer!
+);
+
+// Reads a rectangular block of data values from a .flt file described by info.
+// Blocks may be read in any order; the file position is set for each row read.
+void read_flt_block(
+    FILE *in_flt_file,  // .flt file - should be opened in BINARY mode
+    const struct Flt_Hdr_Info *info,    // from read_flt_hdr_info()
+    int first_row,      // first row    of block to read
+    int first_col,      // first column of block to read
+    int nrows,          // number of rows in block
+    int ncols,          // number of cols in block
+    float *data,        // output array of nrows x ncols data values
+    int *has_nulls,     // set for this block only
+    int *all_ints       // set for this block only
+);
+
 // Copies input .prj file to output .prj file, and changes any "ZUNITS" line to "ZUNITS NO"
 void copy_prj_file( FILE *in_prj_file, FILE *out_prj_file );
 
@@ -34,6 +34,7 @@
 
 #include "read_grid_files.h"
 #include "write_grid_files.h"
+#include "read_geotiff.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -43,20 +44,32 @@
 #include <math.h>
 #include <time.h>
 #include <assert.h>
+#include <limits.h>
 #include "terrain_filter.h"
+#include "thread_pool.h"
+#include "horizon_cube.h"
 
 typedef struct thread_data {
-  int thread_id;
-  int numthreads;
   int nrows;
   int ncols;
-  float* data;
+  const float* data;
   float* shadowarray2;
-  double sun_x;
-  double sun_y;
-  double sun_z;
+  int nsun;                     // number of sun directions
+  const double* sun_x;          // per sun direction: ray step in columns
+  const double* sun_y;          // per sun direction: ray step in rows
+  const double* sun_z;          // per sun direction: ray step in height
+  int sun;                      // fast mode: sun direction being swept
+  float* soft_sum;              // fast mode: running sum for several directions
+  int ambient;                  // sum shadows for all directions instead of soft shadow
   float z_max;
-  int fast_flag;
+  int periodic_boundaries;
+  unsigned long long* cells;    // fast mode with threads: ray & value per cell
+  unsigned int* sunny;          // fast mode with threads: last sunny ray per cell
+  int nlevels;                  // full mode: levels of max pyramid (0 for none)
+  float** max_level;            // full mode: per level 1 to nlevels, block maxima
+  int* level_cols;              // full mode: per level 1 to nlevels, number of columns
+  const double* row_scale;      // geographic data: per row, scale of column steps (or null)
+  const double* row_sum;        // geographic data: sums of row_scale before each row
 } tdata_t;
 
 #define LONG ptrdiff_t
@@ -119,20 +132,48 @@ static void usage_exit( const char *message )
     fprintf( stderr, "          %s 120 22 rainier_elev -mercator -32.5 45\n", command_name );
     fprintf( stderr, "\n" );
     fprintf( stderr, "Requires both .flt and .hdr files as input  " );
-    fprintf( stderr, "(e.g., rainier_elev.flt and rainier_elev.hdr).\n" );
+    fprintf( stderr, "(e.g., rainier_elev.flt and rainier_elev.hdr),\n" );
+    fprintf( stderr, "or a Float32 or Int16 GeoTIFF file (e.g., rainier_elev.tif).\n" );
     fprintf( stderr, "Writes   both .flt and .hdr files as output " );
     fprintf( stderr, "(e.g., rainier_tex.flt  and rainier_tex.hdr).\n" );
     fprintf( stderr, "Also reads & writes optional .prj file if present " );
     fprintf( stderr, "(e.g., elev.prj to tex.prj).\n" );
     fprintf( stderr, "Input and output filenames must not be the same.\n" );
     fprintf( stderr, "NOTE: Output files will be overwritten if they already exist.\n" );
+    fprintf( stderr, "Data in lat/lon (geographic) coordinates is used directly, with the\n" );
+    fprintf( stderr, "east-west pixel size in meters worked out for each row.\n" );
+    fprintf( stderr, "sun_az may be a comma-separated list (e.g., 118,119,120,121,122) to combine\n" );
+    fprintf( stderr, "shadows for several azimuths into one soft shadow: zero unless all are\n" );
+    fprintf( stderr, "shadowed, otherwise log(sum of squares + 1).\n" );
     fprintf( stderr, "\n" );
-    fprintf( stderr, "Available option:\n" );
-    fprintf( stderr, "    -mercator lat1 lat2    \n" );
-    fprintf( stderr, "    -fast    \n" );
+    fprintf( stderr, "Available options:\n" );
+    fprintf( stderr, "    -mercator lat1 lat2    " );
     fprintf( stderr, "input is in normal Mercator projection (not UTM)\n" );
     fprintf( stderr, "Values lat1 and lat2 must be in decimal degrees.\n" );
-    fprintf( stderr, "fast option reduces computation time but is less accurate\n" );
+    fprintf( stderr, "    -fast                  " );
+    fprintf( stderr, "reduces computation time but is less accurate\n" );
+    fprintf( stderr, "    -ambient N             " );
+    fprintf( stderr, "sum shadows for N azimuths spaced evenly around the horizon\n" );
+    fprintf( stderr, "                           (starting at sun_az) for an ambient shadow\n" );
+    fprintf( stderr, "    -horizon cube_file     " );
+    fprintf( stderr, "look up shadows in a cube of horizon angles made by the\n" );
+    fprintf( stderr, "                           horizon tool, instead of tracing rays\n" );
+    fprintf( stderr, "    -solar lat lon start end minutes\n" );
+    fprintf( stderr, "                           hours of direct sun at each point from start\n" );
+    fprintf( stderr, "                           (inclusive) to end (exclusive) in steps of minutes,\n" );
+    fprintf( stderr, "                           with the sun positions seen from lat lon; times\n" );
+    fprintf( stderr, "                           are UTC, YYYY-MM-DD or YYYY-MM-DDTHH:MM\n" );
+    fprintf( stderr, "                           (sun_az and sun_elev are ignored)\n" );
+    fprintf( stderr, "    -insolation            " );
+    fprintf( stderr, "with -solar: clear-sky direct-beam insolation on the\n" );
+    fprintf( stderr, "                           surface in kWh/m^2 instead of hours of sun\n" );
+    fprintf( stderr, "    -azbin D               " );
+    fprintf( stderr, "with -solar: width of azimuth bins in degrees (default: 1)\n" );
+    fprintf( stderr, "    -threads N             " );
+    fprintf( stderr, "number of threads to use (default: all processors)\n" );
+    fprintf( stderr, "    -geographic            " );
+    fprintf( stderr, "input is in lat/lon (geographic) coordinates, even if its\n" );
+    fprintf( stderr, "                           cells are too large for this to be detected\n" );
     fprintf( stderr, "\n" );
     exit( EXIT_FAILURE );
 }
@@ -154,9 +195,10 @@ static void get_filenames(
     if (dot++ && !strpbrk( dot, "/\\" ) && strlen( dot ) <= 4) {
         // filename has extension (of up to 4 characters)
         strncpy( ext, dot, strlen( ext ) );
-        if (strcmp( dot, "flt" ) != 0 && strcmp( dot, "FLT" ) != 0)
+        if (strcmp( dot, "flt" ) != 0 && strcmp( dot, "FLT" ) != 0 &&
+            strcmp( dot, "tif" ) != 0 && strcmp( dot, "TIF" ) != 0)
         {
-            usage_exit( "Filenames must have .flt extension (if any)." );
+            usage_exit( "Filenames must have .flt or .tif extension (if any)." );
         }
         strcpy ( *data_name, arg );
         strncpy( *hdr_name, arg, len-3 );
@@ -356,284 +398,531 @@ static double fix_azimuth(double az, double xdim, double ydim )
 // }
 
 
-//         int  float*  float*
-static void* shadow_row(void *threadarg) {
-  // ptr points to the topography data array
-  tdata_t *my_data;
-  int thread_id;
-  int numthreads;
-  int nrows;
-  int ncols;
-  float* data;
-  float* shadowarray2;
-  double sun_x;
-  double sun_y;
-  double sun_z;
-  float z_max;
-  int fast_flag;
-
-  my_data = (tdata_t *) threadarg;
-
-  thread_id=my_data->thread_id;
-  numthreads=my_data->numthreads;
-  nrows=my_data->nrows;
-  ncols=my_data->ncols;
-  data=my_data->data;
-  shadowarray2=my_data->shadowarray2;
-  sun_x=my_data->sun_x;
-  sun_y=my_data->sun_y;
-  sun_z=my_data->sun_z;
-  z_max=my_data->z_max;
-  fast_flag=my_data->fast_flag;
-
-  float *ptr;
-  float *ptr2;
-  float *ptr3;
+// Fast mode: each cell is set by the sun rays that cross it, and where several
+// rays cross the same cell the result depends on the order of the rays (the
+// last ray to set a value wins, and a later ray that finds the cell sunny only
+// changes an untouched cell, marked 2). With more than one thread the rays run
+// in any order, so each cell records which ray set it, in the packed form
+// (ray+1)<<32 | float bits, along with the last ray that found it sunny;
+// resolve_fast_cells() then gives the same result as running the rays in order.
+
+#define CELL_RAY(cell)   ((unsigned int)((cell) >> 32))
+
+static unsigned long long pack_cell( unsigned int ray, float value )
+{
+  unsigned int bits;
+
+  memcpy(&bits, &value, sizeof(bits));
+  return ((unsigned long long)ray << 32) | bits;
+}
+
+static float cell_value( unsigned long long cell )
+{
+  unsigned int bits=(unsigned int)cell;
+  float value;
+
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+// Sets shadow value of cell k as seen by ray (numbered from 1)
+static void set_shadow( tdata_t *t, LONG k, unsigned int ray, float value )
+{
+  unsigned long long old, cell;
+
+  if (!t->cells) {
+    t->shadowarray2[k]=value;
+    return;
+  }
+  cell=pack_cell(ray, value);
+  old=__atomic_load_n(&t->cells[k], __ATOMIC_RELAXED);
+  while (CELL_RAY(old) <= ray) {
+    if (__atomic_compare_exchange_n(&t->cells[k], &old, cell, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+      break;
+    }
+  }
+}
+
+// Marks cell k as sunny as seen by ray (numbered from 1)
+static void set_sunny( tdata_t *t, LONG k, unsigned int ray )
+{
+  unsigned long long old;
+  unsigned int last;
+
+  if (!t->cells) {
+    if (t->shadowarray2[k]==2) {
+      t->shadowarray2[k]=0;
+    }
+    return;
+  }
+  old=__atomic_load_n(&t->cells[k], __ATOMIC_RELAXED);
+  if (CELL_RAY(old) == ray) {
+    // fails only if a later ray has since set the cell, which then wins anyway
+    if (cell_value(old)==2) {
+      __atomic_compare_exchange_n(&t->cells[k], &old, pack_cell(ray, 0), 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    }
+  } else if (CELL_RAY(old) < ray) {
+    last=__atomic_load_n(&t->sunny[k], __ATOMIC_RELAXED);
+    while (last < ray) {
+      if (__atomic_compare_exchange_n(&t->sunny[k], &last, ray, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    }
+  }
+}
+
+// Follows one sun ray across the grid from the edge cell at row i, column j,
+// marking cells as lit (0) or shaded (depth below the sun line in meters)
+static void cast_fast_ray( tdata_t *t, int i, int j, unsigned int ray, int periodic_boundaries )
+{
+  int nrows=t->nrows;
+  int ncols=t->ncols;
+  const float *data=t->data;
+  double sun_x=t->sun_x[t->sun];
+  double sun_y=t->sun_y[t->sun];
+  double sun_z=t->sun_z[t->sun];
+  float z_max=t->z_max;
+
+  const float *ptr3;
   double x;
   double y;
   double zval;
-
   int x_int;
   int y_int;
-  int xp_int;
-  int yp_int;
   int lit;
-  int j;
-
-  double val;
-  double this_z;
-  double this_topoz;
-  double last_topoz;
-
-  int runcount;
-  int i_set;
-  int j_set;
-  int skipval=1;
-
-  int fromnorth;
-  int fromsouth;
-  int fromeast;
-  int fromwest;
-
-  int periodic_boundaries=1;
+  LONG k;
 
   float nodata;
   nodata = -3.40282347e+38;
 
+  float sunheight;
 
-  // Left over from multithreading - will likely only work with numthreads=1
-  // for(int i=thread_id-1;i<nrows;i+=numthreads) {
-if (fast_flag==1) {
-  for(int i=0;i<nrows;i++) {
-    // ptr2 points to the shadowarray which will be output at the end
-    ptr2 = shadowarray2 + (LONG)i * (LONG)ncols;
-    for(int j=0;j<ncols;j++) {
-      ptr2[j]=2;
+  sunheight=-9999;
+  // The float coordinates of the projected path (can't be used as index)
+  x=j;
+  y=i;
+
+  // The integer coordinates of the projected path (can be used as index)
+  x_int=j;
+  y_int=i;
+
+  int count=0;
+  // traverse the map in the forward direction
+  lit=0;
+
+  while(x_int >= 0 && x_int < ncols && y_int >= 0 && y_int < nrows &&
+        (sunheight <= z_max || periodic_boundaries==0)) {
+    ptr3 = data + (LONG)y_int * (LONG)ncols;
+    k = (LONG)y_int * (LONG)ncols + x_int;
+
+    // Get the z value of DEM at the current grid location
+    zval=ptr3[x_int];
+    if (zval == nodata || zval < -9998) {
+      // lit by default
+      set_shadow(t, k, ray, 0);
+      count=0;
+    } else {
+      // If the point is above the sunline, set it as lit and set new horizon zval
+      if (zval >= sunheight) {
+        set_sunny(t, k, ray);
+        count=0;
+        sunheight=zval;
+      } else {
+        // If the point is still below the sunline, set it as dark
+        lit=sunheight-zval;
+        count++;
+        if (count>1) {
+          set_shadow(t, k, ray, lit);
+        } else {
+          set_shadow(t, k, ray, 0);
+        }
+      }
+    }
+    // Move along the sun ray path
+    x=x-(t->row_scale ? sun_x*t->row_scale[y_int] : sun_x);
+    y=y-sun_y;
+    sunheight=sunheight-sun_z;
+    // Find the integer grid coordinates of the sun beam
+    x_int=(int) x;
+    y_int=(int) y;
+
+    if (periodic_boundaries==1) {
+      // Test whether we have gone off the edge
+      if (x_int < 0) {
+        x_int=ncols-1;
+        x=x_int;
+      } else if (x_int >= ncols) {
+        x_int=0;
+        x=0;
+      }
     }
   }
+}
 
-  if (sun_x > 0) {
-    fromeast=1;
-  } else {
-    fromwest=1;
+// Fast mode: rays [first,last) start along the northern edge (0 to ncols-1),
+// then the southern edge (ncols to 2*ncols-1), then - without periodic
+// boundaries - the western and eastern edges (nrows rays each).
+static int shadow_fast_rays( long first, long last, int thread, void *state )
+{
+  tdata_t *t = (tdata_t *)state;
+  int nrows=t->nrows;
+  int ncols=t->ncols;
+  long ray;
+  long edge_ray;
+
+  for (ray=first; ray<last; ++ray) {
+    if (ray < 2*(long)ncols) {
+      edge_ray = ray < ncols ? ray : ray-ncols;
+      cast_fast_ray(t, ray < ncols ? 0 : nrows-1, (int)edge_ray, (unsigned int)ray+1, t->periodic_boundaries);
+    } else {
+      edge_ray = ray-2*(long)ncols;
+      cast_fast_ray(t, (int)(edge_ray % nrows), edge_ray < nrows ? 0 : ncols-1, (unsigned int)ray+1, 0);
+    }
   }
+  return 0;
+}
 
-  if (sun_y > 0) {
-    fromnorth=1;
-  } else {
-    fromsouth=1;
+// Fast mode with more than one thread: converts rows [first,last) of the
+// per-cell ray records to the shadow values.
+static int resolve_fast_cells( long first, long last, int thread, void *state )
+{
+  tdata_t *t = (tdata_t *)state;
+  LONG k;
+  LONG kend = (LONG)last * (LONG)t->ncols;
+  unsigned int ray;
+  float value;
+
+  for (k=(LONG)first * (LONG)t->ncols; k<kend; ++k) {
+    ray=CELL_RAY(t->cells[k]);
+    if (ray==0) {
+      // never set: untouched (2) unless some ray found it sunny
+      value = t->sunny[k] ? 0 : 2;
+    } else {
+      value=cell_value(t->cells[k]);
+      if (value==2 && t->sunny[k] > ray) {
+        value=0;
+      }
+    }
+    t->shadowarray2[k]=value;
   }
+  return 0;
+}
 
-  int i_val;
-  int j_val;
-  // Do the forward calculation starting either on left or right side
-
-  if (sun_x > 0) {
-    j_val=ncols;
-  } else {
-    j_val=0;
-  }
+// Full mode: the max pyramid holds the maximum elevation in blocks of
+// 2x2 pixels (level 1), 4x4 pixels (level 2), and so on. A beam of light that
+// is above the maximum of a block when it enters the block stays above
+// everything in it, so it can skip to the far side of the block in one step.
 
-  if (sun_y > 0) {
-    i_val=nrows;
-  } else {
-    i_val=0;
-  }
+// Smallest block tried (level 3 = 8x8 pixels)
+#define PYRAMID_MIN_LEVEL 3
 
-  // NORTH ROW: i = 0; j = 0 to ncols
-  // SOUTH ROW: i = nrows-1; j = 0 to ncols
+// Computes the block maxima of level l from level l-1 (or the data array)
+// for rows [first,last) of level l.
+struct Max_Level_Task {
+  const tdata_t *t;
+  int l;
+};
 
-  float sunheight;
+static int build_max_rows( long first, long last, int thread, void *state )
+{
+  const struct Max_Level_Task *task = (const struct Max_Level_Task *)state;
+  const tdata_t *t = task->t;
+  int l = task->l;
+  const float *fine = l == 1 ? t->data : t->max_level[l-1];
+  int fine_rows = l == 1 ? t->nrows : (t->nrows + (1<<(l-1)) - 1) >> (l-1);
+  int fine_cols = l == 1 ? t->ncols : t->level_cols[l-1];
+  int ncols = t->level_cols[l];
+  const float *row0, *row1;
+  float *out;
+  float m;
+  int i, j, j1;
+
+  for (i=(int)first; i<last; ++i) {
+    row0 = fine + (LONG)(2*i) * (LONG)fine_cols;
+    row1 = 2*i+1 < fine_rows ? row0 + fine_cols : row0;
+    out = t->max_level[l] + (LONG)i * (LONG)ncols;
+    for (j=0; j<ncols; ++j) {
+      j1 = 2*j+1 < fine_cols ? 2*j+1 : 2*j;
+      m = row0[2*j];
+      m = row0[j1] > m ? row0[j1] : m;
+      m = row1[2*j] > m ? row1[2*j] : m;
+      m = row1[j1] > m ? row1[j1] : m;
+      out[j] = m;
+    }
+  }
+  return 0;
+}
 
-  // for each point along the northern and southern edge
-  for(int i=0;i<nrows;i=i+nrows-1) {
-    for(int j=0;j<ncols;j++) {
+// Builds the max pyramid, up to blocks covering the whole array.
+// Returns 0 on success, nonzero if a memory allocation error occurred.
+static int build_max_pyramid( tdata_t *t, struct Thread_Pool *pool )
+{
+  struct Max_Level_Task task;
+  LONG size = 0;
+  int nlevels = 0;
+  int l;
+  int error = 0;
+
+  while ((t->nrows > (1<<nlevels) || t->ncols > (1<<nlevels)) && nlevels < 30) {
+    ++nlevels;
+    size += (LONG)((t->nrows + (1<<nlevels) - 1) >> nlevels) *
+            (LONG)((t->ncols + (1<<nlevels) - 1) >> nlevels);
+  }
 
-      sunheight=-9999;
-      // The float coordinates of the projected path (can't be used as index)
-      x=j;
-      y=i;
-
-      // The integer coordinates of the projected path (can be used as index)
-      x_int=j;
-      y_int=i;
-
-      int count=0;
-      // fprintf(stderr, "\n");
-      // traverse the map in the forward direction
-      lit=0;
-
-      while(x_int >= 0 && x_int < ncols && y_int >= 0 && y_int < nrows && sunheight <= z_max) {
-        ptr3 = data + (LONG)y_int * (LONG)ncols;
-        ptr2 = shadowarray2 + (LONG)y_int * (LONG)ncols;
-
-        // fprintf(stderr, "Examining cell %d/%d... ", x_int, y_int);
-        // The x and y coordinates start at the i,j grid position
-
-        // Get the z value of DEM at the current grid location
-        zval=ptr3[x_int];
-        // fprintf(stderr, "%d ", count);
-        if (zval == nodata || zval < -9998) {
-          // lit by default
-          ptr2[x_int]=0;
-          count=0;
-        } else {
-          // If the point is above the sunline, set it as lit and set new horizon zval
-          if (zval >= sunheight) {
-            if (ptr2[x_int]==2) {
-              ptr2[x_int]=0;
-            }
-            count=0;
-            // fprintf(stderr, "zval=%g, sunheight=%g ... SUNNY\n", zval, sunheight);
-            sunheight=zval;
+  t->nlevels = 0;
+  t->max_level = (float **)malloc((nlevels+1) * sizeof(float *));
+  t->level_cols = (int *)malloc((nlevels+1) * sizeof(int));
+  if (!t->max_level || !t->level_cols || nlevels == 0 ||
+      !(t->max_level[0] = (float *)malloc(size * sizeof(float))))
+  {
+    free(t->max_level);
+    free(t->level_cols);
+    t->max_level = NULL;
+    t->level_cols = NULL;
+    return nlevels > 0 ? TERRAIN_FILTER_MALLOC_ERROR : 0;
+  }
 
-          } else {
-            // If the point is still below the sunline, set it as dark
-            lit=sunheight-zval;
-            count++;
-            if (count>1) {
-              ptr2[x_int]=lit;
-            } else {
-              ptr2[x_int]=0;
-            }
-            // fprintf(stderr, "zval=%g, sunheight=%g... DARK\n", zval, sunheight);
+  // all levels share one allocation, held in max_level[0]
+  t->level_cols[0] = t->ncols;
+  for (l=1; l<=nlevels && !error; ++l) {
+    t->level_cols[l] = (t->ncols + (1<<l) - 1) >> l;
+    t->max_level[l] = l == 1 ? t->max_level[0] :
+        t->max_level[l-1] + (LONG)((t->nrows + (1<<(l-1)) - 1) >> (l-1)) * (LONG)t->level_cols[l-1];
+    task.t = t;
+    task.l = l;
+    error = thread_pool_run(pool, (t->nrows + (1<<l) - 1) >> l, 0, build_max_rows, &task, NULL);
+  }
+  t->nlevels = nlevels;
 
-          }
-        }
-        // Move along the sun ray path
-        x=x-sun_x;
-        y=y-sun_y;
-        sunheight=sunheight-sun_z;
-        // Find the integer grid coordinates of the sun beam
-        x_int=(int) x;
-        y_int=(int) y;
-
-        if (periodic_boundaries==1) {
-          // Test whether we have gone off the edge
-          if (x_int < 0) {
-            x_int=ncols-1;
-            x=x_int;
-          } else if (x_int >= ncols) {
-            x_int=0;
-            x=0;
-          }
-        }
-      }
+  return error;
+}
 
-    }
+static void free_max_pyramid( tdata_t *t )
+{
+  if (t->max_level) {
+    free(t->max_level[0]);
   }
+  free(t->max_level);
+  free(t->level_cols);
+  t->max_level = NULL;
+  t->level_cols = NULL;
+  t->nlevels = 0;
+}
 
-  // For each point along the western and eastern edges
+// Maximum elevation in the level l block that holds column x, row y
+static float max_block( const tdata_t *t, int l, int x, int y )
+{
+  return t->max_level[l][(LONG)(y>>l) * (LONG)t->level_cols[l] + (x>>l)];
+}
 
-  if (periodic_boundaries==0) {
+// Geographic data: a degree of longitude is shorter toward the poles, so a
+// ray at a fixed azimuth moves row_scale[r] times as many columns per step in
+// row r as it does at the center latitude. Over many steps, the change in
+// column is sun_x/sun_y times the change in the integral of row_scale.
 
-    for(int j=0;j<=ncols-1;j=j+ncols-1) {
-      for(int i=0;i<nrows;i++) {
-        sunheight=-9999;
-        // The float coordinates of the projected path (can't be used as index)
-        x=j;
-        y=i;
+// Integral of row_scale from row 0 to (fractional) row y
+static double row_integral( const tdata_t *t, double y )
+{
+  int r=(int)y;
 
-        // The integer coordinates of the projected path (can be used as index)
-        x_int=j;
-        y_int=i;
+  r = r < 0 ? 0 : r >= t->nrows ? t->nrows-1 : r;
+  return t->row_sum[r] + (y-r)*t->row_scale[r];
+}
 
-        int count=0;
-        // fprintf(stderr, "\n");
-        // traverse the map in the forward direction
-        lit=0;
+// Full mode: project a beam of light from the pixel at row i, column j back
+// toward sun direction s and add up the total height of cells falling above
+// that beam of light. Stop when the beam rises above the level of the highest
+// elevation or moves off of the grid. Returns the natural logarithm of the
+// total, or 0 if the pixel is lit.
+static double back_ray_shade( const tdata_t *t, int i, int j, int s )
+{
+  int nrows=t->nrows;
+  int ncols=t->ncols;
+  const float *data=t->data;
+  double sun_x=t->sun_x[s];
+  double sun_y=t->sun_y[s];
+  double sun_z=t->sun_z[s];
+  float z_max=t->z_max;
+  int use_pyramid = t->nlevels >= PYRAMID_MIN_LEVEL && sun_z > 0;
+  double inv_x = sun_x != 0 ? 1/sun_x : 0;
+  double inv_y = sun_y != 0 ? 1/sun_y : 0;
+  const double *row_scale=t->row_scale;
+
+  const float *ptr3;
+  double x;
+  double y;
+  double z0;
+  double zval;
+  int x_int;
+  int y_int;
+  int lit;
+  long n;           // number of steps from pixel i,j
+  long nx, ny;
+  int edge;
+  int r0, r1;       // with row_scale: first and last rows of the block
+  double step_x;    // sun_x, times row_scale of scale_row if there is one
+  int scale_row;
+  int fail_x;       // a cell in the last block found to be above the beam
+  int fail_y;
+  int l;
 
-        while(x_int >= 0 && x_int < ncols && y_int >= 0 && y_int < nrows) {
-          ptr3 = data + (LONG)y_int * (LONG)ncols;
-          ptr2 = shadowarray2 + (LONG)y_int * (LONG)ncols;
+  double this_topoz;
 
-          // fprintf(stderr, "Examining cell %d/%d... ", x_int, y_int);
-          // The x and y coordinates start at the i,j grid position
+  // The x and y coordinates start at the i,j grid position
+  x=j;
+  y=i;
+
+  z0=data[(LONG)i * (LONG)ncols + j];   // access the topo value at dataarray[row][column]
+  zval=z0;
+  lit=0;
+  n=0;
+  fail_x=-1;
+  fail_y=-1;
+  scale_row=i;
+  step_x=row_scale ? sun_x*row_scale[i] : sun_x;
+
+  // The integer coordinates of the projected path (can be used as index)
+  x_int=x;
+  y_int=y;
+
+  // So long as we are still within the grid
+  while(x_int > 0 && x_int < ncols && y_int > 0 && y_int < nrows && zval <= z_max) {
+    ptr3 = data + (LONG)y_int * (LONG)ncols;
+    // zval is the elevation of the sun beam cast by the prior horizon
+
+    // (the caller skips pixels where the topography is undefined)
+    this_topoz=ptr3[x_int];
+
+    if (zval < this_topoz) {
+      // The topo is above the sun
+      lit=lit+(this_topoz-zval);  // Sum the total land height falling above the sun line
+    } else if (use_pyramid && ((x_int^fail_x) | (y_int^fail_y)) >> PYRAMID_MIN_LEVEL) {
+      // find the largest block around this cell that is entirely below the
+      // beam; blocks smaller than the minimum level would save too few steps
+      // to be worth the lookup, and a block that is not below the beam is
+      // not tried again until the beam moves to another block
+      l = PYRAMID_MIN_LEVEL;
+      if (max_block(t, l, x_int, y_int) > zval) {
+        fail_x = x_int;
+        fail_y = y_int;
+        l = 0;
+      } else {
+        while (l < t->nlevels && max_block(t, l+1, x_int, y_int) <= zval) {
+          ++l;
+        }
+      }
 
-          // Get the z value of DEM at the current grid location
-          zval=ptr3[x_int];
-          // fprintf(stderr, "%d ", count);
-          if (zval == nodata || zval < -9998) {
-            // lit by default
-            ptr2[x_int]=0;
-            count=0;
+      if (l > 0) {
+        // steps until the beam leaves the block, rounded down: go to the
+        // step before that; the steps in between add nothing
+        nx = ny = LONG_MAX;
+        if (row_scale && sun_x != 0) {
+          // the column is not linear in the step: count the steps from here
+          // at the largest scale in the block (at its first or last row, as
+          // the scale changes steadily from row to row)
+          edge = sun_x > 0 ? ((x_int>>l)+1)<<l : (x_int>>l)<<l;
+          r0 = (y_int>>l)<<l;
+          r1 = (((y_int>>l)+1)<<l) - 1;
+          r1 = r1 < nrows ? r1 : nrows-1;
+          nx = n + (long)((edge - x) * inv_x /
+                          (row_scale[r0] > row_scale[r1] ? row_scale[r0] : row_scale[r1]));
+        } else if (sun_x > 0) {
+          nx = (long)((double)((((x_int>>l)+1)<<l) - j) * inv_x);
+        } else if (sun_x < 0) {
+          nx = (long)((double)(((x_int>>l)<<l) - j) * inv_x);
+        }
+        if (sun_y > 0) {
+          ny = (long)((double)((((y_int>>l)+1)<<l) - i) * inv_y);
+        } else if (sun_y < 0) {
+          ny = (long)((double)(((y_int>>l)<<l) - i) * inv_y);
+        }
+        nx = nx < ny ? nx : ny;
+        if (nx-1 > n && row_scale) {
+          if (sun_y != 0) {
+            x=x-sun_x*inv_y*row_integral(t, y);
+            y=y+(nx-1-n)*sun_y;
+            x=x+sun_x*inv_y*row_integral(t, y);
           } else {
-            // If the point is above the sunline, set it as lit and set new horizon zval
-            if (zval >= sunheight) {
-              if (ptr2[x_int]==2) {
-                ptr2[x_int]=0;
-              }
-              count=0;
-              // fprintf(stderr, "zval=%g, sunheight=%g ... SUNNY\n", zval, sunheight);
-              sunheight=zval;
-
-            } else {
-              // If the point is still below the sunline, set it as dark
-              lit=sunheight-zval;
-              count++;
-              if (count>1) {
-                ptr2[x_int]=lit;
-              } else {
-                ptr2[x_int]=0;
-              }
-              // fprintf(stderr, "zval=%g, sunheight=%g... DARK\n", zval, sunheight);
-
-            }
+            // along a row or a column
+            x=x+(nx-1-n)*step_x;
+            y=y+(nx-1-n)*sun_y;
           }
-          // Move along the sun ray path
-          x=x-sun_x;
-          y=y-sun_y;
-          sunheight=sunheight-sun_z;
-          // Find the integer grid coordinates of the sun beam
-          x_int=(int) x;
-          y_int=(int) y;
+          n = nx-1;
+          zval=z0+n*sun_z;
+          scale_row=(int)y < nrows ? (int)y : nrows-1;
+          step_x=sun_x*row_scale[scale_row];
+        } else if (nx-1 > n) {
+          n = nx-1;
+          x=j+n*sun_x;
+          y=i+n*sun_y;
+          zval=z0+n*sun_z;
         }
-
       }
     }
+
+    // Move the grid coordinate in the direction of the sun beam
+    ++n;
+    x=x+step_x;
+    y=y+sun_y;
+    zval=zval+sun_z;
+    // Find the integer grid coordinates of the sun beam
+    x_int=(int) x;
+    y_int=(int) y;
+    if (row_scale && y_int != scale_row && y_int > 0 && y_int < nrows) {
+      scale_row=y_int;
+      step_x=sun_x*row_scale[y_int];
+    }
+  }
+  if (lit==0) {
+    // value is 0 if the cell is not lit (is shaded)
+    return 0;
+  }
+  return log(lit);  // Use the natural logarithm of the total shading volume
+}
+
+// Combined soft shadow for several sun directions: the shadow values are
+// zero unless every direction is shaded, and otherwise log(sum of squares + 1).
+// Built up from a running sum of squares that is set to -1 once any
+// direction is lit.
+static void add_soft_shade( float *sum, double value )
+{
+  if (*sum >= 0) {
+    *sum = value > 0 ? *sum + value*value : -1;
   }
-} else { // fast_flag==0
+}
+
+static float soft_shade( float sum )
+{
+  return sum > 0 ? log(sum+1) : 0;
+}
+
+// Full mode: computes the shadow value of each pixel in rows [first,last),
+// tracing the rays for all sun directions from one pixel together so that
+// they run over the same (cached) part of the data array.
+static int shadow_rows( long first, long last, int thread, void *state )
+{
+  tdata_t *t = (tdata_t *)state;
+  int ncols=t->ncols;
 
-  // For each pixel in the image, project a beam of light back toward the sun and add up
-  // the total number of cells falling above that beam of light. Stop when the beam rises
-  // above the level of the highest elevation or moves off of the grid.
+  const float *ptr;
+  float *ptr2;
+  float sum;
+  int s;
+
+  float nodata;
+  nodata = -3.40282347e+38;
 
-  for(int i=0;i<nrows;i++) {
+  for(long i=first;i<last;i++) {
     // ptr points to the data array
-    ptr = data + (LONG)i * (LONG)ncols;
+    ptr = t->data + (LONG)i * (LONG)ncols;
     // ptr2 points to the shadowarray which will be output at the end
-    ptr2 = shadowarray2 + (LONG)i * (LONG)ncols;
+    ptr2 = t->shadowarray2 + (LONG)i * (LONG)ncols;
 
-    // fprintf(stderr, "Processing row %d of %d with thread %d\n", i, nrows, thread_id);
     for(int j=0;j<ncols;j++) {
 
-      // The x and y coordinates start at the i,j grid position
-      x=j;
-      y=i;
-
       // If the data point itself is nodata, set a lit value of 1 and break
       if (ptr[j] == nodata || ptr[j] < -1.0e+38) {
-        ptr2[j]=1;
+        ptr2[j] = t->nsun == 1 ? 1 : soft_shade(t->nsun);
         break;
       }
 
@@ -642,65 +931,634 @@ if (fast_flag==1) {
         continue;
       }
 
+      if (t->nsun == 1) {
+        ptr2[j]=back_ray_shade(t, i, j, 0);
+        continue;
+      }
 
-      zval=ptr[j];   // access the topo value at dataarray[row][column]
-      lit=0;
+      // stop at the first lit direction, as the result is then 0
+      sum=0;
+      for (s=0; s<t->nsun && sum>=0; ++s) {
+        add_soft_shade(&sum, back_ray_shade(t, i, j, s));
+      }
+      ptr2[j]=soft_shade(sum);
+    }
+  }
+  return 0;
+}
 
-      // The integer coordinates of the projected path (can be used as index)
-      x_int=x;
-      y_int=y;
+// Full mode, ambient shadow: sums the shadow values of rows [first,last) for
+// all sun directions. Each row is done one direction at a time, so that rays
+// from neighboring pixels run side by side over the same part of the data.
+static int ambient_rows( long first, long last, int thread, void *state )
+{
+  tdata_t *t = (tdata_t *)state;
+  int ncols=t->ncols;
 
-      int count=0;
-      // So long as we are still within the grid
-      while(x_int > 0 && x_int < ncols && y_int > 0 && y_int < nrows && zval <= z_max) {
-        ptr3 = data + (LONG)y_int * (LONG)ncols;
-        // zval is the elevation of the sun beam cast by the prior horizon
+  const float *ptr;
+  float *ptr2;
+  int jend;
+  int s;
 
-        // // we can stop the calculation early for massive speed boost
-        // if (count++ > 10) {
-        //   break;
-        // }
+  float nodata;
+  nodata = -3.40282347e+38;
 
-        // If the topography at this point is undefined,
-        if (ptr[j] == nodata || ptr[j] < -1.0e+38) {
-          // use the last known topography value
-          this_topoz=last_topoz;
-        } else {
-          // save this topo height, use it as well
-          this_topoz=ptr3[x_int];
-          last_topoz=ptr3[x_int];
-        }
+  for(long i=first;i<last;i++) {
+    ptr = t->data + (LONG)i * (LONG)ncols;
+    ptr2 = t->shadowarray2 + (LONG)i * (LONG)ncols;
+
+    // as in shadow_rows(), the row stops at the first nodata point
+    for (jend=0; jend<ncols && !(ptr[jend] == nodata || ptr[jend] < -1.0e+38); ++jend) {
+      ptr2[jend]=0;
+    }
+    for (s=0; s<t->nsun; ++s) {
+      for(int j=0;j<jend;j++) {
+        ptr2[j]+=back_ray_shade(t, i, j, s);
+      }
+    }
+    if (jend < ncols) {
+      ptr2[jend]=t->nsun;
+    }
+  }
+  return 0;
+}
 
-        if (zval < this_topoz) {
+// Fast mode with several sun directions: adds the shadow values for one
+// direction (in shadowarray2) to the running sums for rows [first,last).
+static int add_soft_rows( long first, long last, int thread, void *state )
+{
+  tdata_t *t = (tdata_t *)state;
+  LONG k;
+  LONG kend = (LONG)last * (LONG)t->ncols;
 
-          // The topo is above the sun
-          // lit=lit+(ptr3[x_int]-zval);  // Sum the total land height falling above the sun line
-          lit=lit+(this_topoz-zval);  // Sum the total land height falling above the sun line
+  for (k=(LONG)first * (LONG)t->ncols; k<kend; ++k) {
+    add_soft_shade(&t->soft_sum[k], t->shadowarray2[k]);
+  }
+  return 0;
+}
 
-          // lit=lit+1;  // sum the number of cell positions that are above the sun line
-        }
+// Fast mode with several sun directions: turns the running sums for rows
+// [first,last) into the combined shadow values.
+static int finish_soft_rows( long first, long last, int thread, void *state )
+{
+  tdata_t *t = (tdata_t *)state;
+  LONG k;
+  LONG kend = (LONG)last * (LONG)t->ncols;
 
-        // Move the grid coordinate in the direction of the sun beam
-        x=x+sun_x;
-        y=y+sun_y;
-        zval=zval+sun_z;
-        // Find the integer grid coordinates of the sun beam
-        x_int=(int) x;
-        y_int=(int) y;
+  for (k=(LONG)first * (LONG)t->ncols; k<kend; ++k) {
+    t->soft_sum[k]=soft_shade(t->soft_sum[k]);
+  }
+  return 0;
+}
+
+// Fast mode: sweeps the rays for sun direction t->sun across the grid,
+// replacing the contents of the shadow array.
+// Returns 0 on success, nonzero if a memory allocation error occurred.
+static int fast_sweep( tdata_t *t, struct Thread_Pool *pool )
+{
+  LONG count = (LONG)t->nrows * (LONG)t->ncols;
+  LONG k;
+  long nrays;
+  int error;
+
+  nrays = 2*(long)t->ncols + (t->periodic_boundaries ? 0 : 2*(long)t->nrows);
+
+  t->cells = NULL;
+  t->sunny = NULL;
+
+  if (thread_pool_size(pool) == 1) {
+    for (k=0; k<count; ++k) {
+      t->shadowarray2[k]=2;
+    }
+    return thread_pool_run(pool, nrays, 0, shadow_fast_rays, t, NULL);
+  }
+
+  t->cells = (unsigned long long *)calloc(count, sizeof(unsigned long long));
+  t->sunny = (unsigned int *)calloc(count, sizeof(unsigned int));
+  if (!t->cells || !t->sunny) {
+    free(t->cells);
+    free(t->sunny);
+    return TERRAIN_FILTER_MALLOC_ERROR;
+  }
+
+  error = thread_pool_run(pool, nrays, 16, shadow_fast_rays, t, NULL);
+  if (!error) {
+    error = thread_pool_run(pool, t->nrows, 0, resolve_fast_cells, t, NULL);
+  }
+
+  free(t->cells);
+  free(t->sunny);
+  t->cells = NULL;
+  t->sunny = NULL;
+
+  return error;
+}
+
+// Fast mode, ambient shadow: each thread sweeps whole sun directions into
+// its own scratch array and adds them to the sum (the output array), which
+// is split into bands of rows with a lock for each band.
+struct Ambient_Sweeps {
+  const tdata_t *t;
+  float **scratch;          // per thread; allocated when first needed
+  pthread_mutex_t *locks;   // per band of rows
+  int nbands;
+  int band_rows;
+};
+
+static int ambient_directions( long first, long last, int thread, void *state )
+{
+  struct Ambient_Sweeps *a = (struct Ambient_Sweeps *)state;
+  tdata_t sweep = *a->t;
+  int ncols=sweep.ncols;
+  const float *scratch;
+  float *sum;
+  LONG k, kend;
+  long s;
+  int b, band;
+
+  if (!a->scratch[thread]) {
+    a->scratch[thread] = (float *)malloc((LONG)sweep.nrows * (LONG)ncols * sizeof(float));
+    if (!a->scratch[thread]) {
+      return TERRAIN_FILTER_MALLOC_ERROR;
+    }
+  }
+  sweep.shadowarray2 = a->scratch[thread];
+  scratch = sweep.shadowarray2;
+  sum = a->t->shadowarray2;
+
+  for (s=first; s<last; ++s) {
+    sweep.sun = (int)s;
+    fast_sweep(&sweep, NULL);   // cannot fail without a pool
+
+    // start at a different band in each thread, so threads rarely wait;
+    // the order of the additions (and so the rounding) depends on timing
+    for (b=0; b<a->nbands; ++b) {
+      band = (b + thread) % a->nbands;
+      k = (LONG)band * (LONG)a->band_rows * (LONG)ncols;
+      kend = (LONG)(band+1) * (LONG)a->band_rows;
+      kend = (kend < sweep.nrows ? kend : sweep.nrows) * (LONG)ncols;
+      pthread_mutex_lock(&a->locks[band]);
+      for (; k<kend; ++k) {
+        sum[k]+=scratch[k];
       }
-      if (lit==0) {
-        // shadowarray2 value is 0 if the cell is not lit (is shaded)
-        ptr2[j]=0;
-      } else {
-        ptr2[j]=log(lit);  // Use the natural logarithm of the total shading volume
+      pthread_mutex_unlock(&a->locks[band]);
+    }
+  }
+  return 0;
+}
+
+// Fast mode, ambient shadow: sums the shadow arrays for all sun directions,
+// running the directions in parallel.
+// Returns 0 on success, nonzero if a memory allocation error occurred.
+static int ambient_sweeps( tdata_t *t, struct Thread_Pool *pool )
+{
+  struct Ambient_Sweeps a;
+  int nthreads = thread_pool_size(pool);
+  int b;
+  int error;
+
+  a.t = t;
+  a.nbands = 4 * nthreads;
+  a.band_rows = (t->nrows + a.nbands - 1) / a.nbands;
+  a.scratch = (float **)calloc(nthreads, sizeof(float *));
+  a.locks = (pthread_mutex_t *)malloc(a.nbands * sizeof(pthread_mutex_t));
+  if (!a.scratch || !a.locks) {
+    free(a.scratch);
+    free(a.locks);
+    return TERRAIN_FILTER_MALLOC_ERROR;
+  }
+  for (b=0; b<a.nbands; ++b) {
+    pthread_mutex_init(&a.locks[b], NULL);
+  }
+
+  memset(t->shadowarray2, 0, (LONG)t->nrows * (LONG)t->ncols * sizeof(float));
+
+  error = thread_pool_run(pool, t->nsun, 1, ambient_directions, &a, NULL);
+
+  for (b=0; b<a.nbands; ++b) {
+    pthread_mutex_destroy(&a.locks[b]);
+  }
+  for (b=0; b<nthreads; ++b) {
+    free(a.scratch[b]);
+  }
+  free(a.scratch);
+  free(a.locks);
+
+  return error;
+}
+
+// Computes the shadow array using all threads in pool (which may be NULL).
+// With more than one sun direction, the result is their combined soft shadow,
+// or the sum of their shadows for an ambient shadow.
+// Returns 0 on success, nonzero if a memory allocation error occurred.
+static int cast_shadows( tdata_t *t, int fast_flag, struct Thread_Pool *pool )
+{
+  LONG count = (LONG)t->nrows * (LONG)t->ncols;
+  float *output = t->shadowarray2;
+  int error = 0;
+
+  if (!fast_flag) {
+    error = build_max_pyramid(t, pool);
+    if (!error) {
+      // rows differ in cost (rays near the sunward edges leave the grid early),
+      // so hand them out a few at a time
+      error = thread_pool_run(pool, t->nrows, 4,
+          t->ambient && t->nsun > 1 ? ambient_rows : shadow_rows, t, NULL);
+    }
+    free_max_pyramid(t);
+    return error;
+  }
+
+  if (t->nsun == 1) {
+    t->sun = 0;
+    return fast_sweep(t, pool);
+  }
+
+  if (t->ambient) {
+    return ambient_sweeps(t, pool);
+  }
+
+  // sum in the output array; sweep each direction into a scratch array
+  t->soft_sum = output;
+  t->shadowarray2 = (float *)malloc(count * sizeof(float));
+  if (!t->shadowarray2) {
+    t->shadowarray2 = output;
+    return TERRAIN_FILTER_MALLOC_ERROR;
+  }
+  memset(output, 0, count * sizeof(float));
+
+  for (t->sun=0; t->sun<t->nsun && !error; ++t->sun) {
+    error = fast_sweep(t, pool);
+    if (!error) {
+      error = thread_pool_run(pool, t->nrows, 0, add_soft_rows, t, NULL);
+    }
+  }
+  if (!error) {
+    error = thread_pool_run(pool, t->nrows, 0, finish_soft_rows, t, NULL);
+  }
+
+  free(t->shadowarray2);
+  t->shadowarray2 = output;
+
+  return error;
+}
+
+// Horizon cube mode (option -horizon): the shadow value of a pixel for one sun
+// direction depends only on how far the sun is below the horizon in that
+// direction, interpolated between the two nearest azimuths of the cube made by
+// the horizon tool: log(1 + depth in degrees), or 0 if the pixel is lit.
+// Several directions are combined as in the other modes.
+struct Horizon_Task {
+  tdata_t *t;
+  const float *h0;      // horizon angles at the cube azimuth before the sun
+  const float *h1;      // horizon angles at the cube azimuth after the sun
+  double w;             // weight of h1
+  double sun_el;
+  int first_sun;        // nonzero for the first of several directions
+  int last_sun;         // nonzero for the last of several directions
+};
+
+static int horizon_rows( long first, long last, int thread, void *state )
+{
+  const struct Horizon_Task *h = (const struct Horizon_Task *)state;
+  tdata_t *t = h->t;
+  float *out = t->shadowarray2;
+  LONG k;
+  LONG kend = (LONG)last * (LONG)t->ncols;
+  double angle;
+  double value;
+
+  for (k=(LONG)first * (LONG)t->ncols; k<kend; ++k) {
+    angle = (1-h->w)*h->h0[k] + h->w*h->h1[k];
+    value = angle > h->sun_el ? log(1 + angle - h->sun_el) : 0;
+    if (t->nsun == 1) {
+      out[k]=value;
+    } else if (t->ambient) {
+      out[k]=(h->first_sun ? 0 : out[k]) + value;
+    } else {
+      if (h->first_sun) {
+        out[k]=0;
+      }
+      add_soft_shade(&out[k], value);
+      if (h->last_sun) {
+        out[k]=soft_shade(out[k]);
       }
     }
   }
+  return 0;
+}
+
+// Returns the angles of azimuth a of the cube, reading them into whichever of
+// the two buffers does not hold azimuth keep (unless already loaded).
+static const float *horizon_slice( FILE *cube, const struct Horizon_Cube_Info *info,
+  int a, int keep, float **buffers, int *loaded, int *error )
+{
+  int b;
+
+  if (loaded[0] == a || loaded[1] == a) {
+    return buffers[loaded[1] == a];
+  }
+  b = loaded[0] == keep;
+  loaded[b] = a;
+  *error = read_horizon_slice(cube, info, HORIZON_UPPER, a, buffers[b]);
+  if (*error) {
+    loaded[b] = -1;
+  }
+  return buffers[b];
+}
+
+// Computes the shadow array from a horizon cube, using all threads in pool.
+// Returns 0 on success, TERRAIN_FILTER_MALLOC_ERROR if a memory allocation
+// error occurred, or 2 if the cube file could not be read.
+static int horizon_shadows( tdata_t *t, FILE *cube, const struct Horizon_Cube_Info *info,
+  const double *sun_az, double sun_el, struct Thread_Pool *pool )
+{
+  LONG count = (LONG)t->nrows * (LONG)t->ncols;
+  struct Horizon_Task task;
+  float *buffers[2];
+  int loaded[2] = { -1, -1 };
+  double pos;
+  int a0, a1;
+  int s;
+  int error = 0;
+
+  buffers[0] = (float *)malloc(count * sizeof(float));
+  buffers[1] = (float *)malloc(count * sizeof(float));
+  if (!buffers[0] || !buffers[1]) {
+    free(buffers[0]);
+    free(buffers[1]);
+    return TERRAIN_FILTER_MALLOC_ERROR;
+  }
+
+  task.t = t;
+  task.sun_el = sun_el;
+  for (s=0; s<t->nsun && !error; ++s) {
+    pos = fmod(sun_az[s], 360.0) / 360.0 * info->nazimuths;
+    if (pos < 0) {
+      pos += info->nazimuths;
+    }
+    a0 = (int)pos;
+    task.w = pos - a0;
+    a0 = a0 % info->nazimuths;
+    a1 = (a0 + 1) % info->nazimuths;
+
+    task.h0 = horizon_slice(cube, info, a0, a1, buffers, loaded, &error);
+    if (!error) {
+      task.h1 = horizon_slice(cube, info, a1, a0, buffers, loaded, &error);
+    }
+    if (!error) {
+      task.first_sun = s == 0;
+      task.last_sun = s == t->nsun-1;
+      error = thread_pool_run(pool, t->nrows, 0, horizon_rows, &task, NULL);
+    }
+  }
+
+  free(buffers[0]);
+  free(buffers[1]);
+
+  return error;
+}
+
+// Solar mode (option -solar): hours of direct sun, or direct-beam insolation,
+// at each pixel over a period. Sun positions are computed for each time step,
+// and the steps with the sun above the horizon are grouped into azimuth bins.
+// The terrain is swept once per bin (compute_horizons) to find the horizon of
+// every pixel in that direction; a pixel then sees the sun at every step in the
+// bin with the sun above its horizon. With the steps of a bin sorted by sun
+// elevation and summed cumulatively, that is a binary search per pixel.
+
+// Times are in days since 2000 January 1, 12:00 UTC (J2000.0).
+// Returns nonzero unless text is a UTC time "YYYY-MM-DD" or "YYYY-MM-DDTHH:MM".
+static int parse_utc_time( const char *text, double *days )
+{
+  int year, month, day, hour=0, minute=0;
+  long y, era, yoe, doy, doe;
+  char sep;
+
+  if (sscanf(text, "%d-%d-%d%c%d:%d", &year, &month, &day, &sep, &hour, &minute) != 6 &&
+      sscanf(text, "%d-%d-%d", &year, &month, &day) != 3) {
+    return 1;
+  }
+  if (month < 1 || month > 12 || day < 1 || day > 31 ||
+      hour < 0 || hour > 24 || minute < 0 || minute > 59) {
+    return 1;
+  }
+
+  // days since 1970-01-01 in the proleptic Gregorian calendar
+  y = year - (month <= 2);
+  era = (y >= 0 ? y : y-399) / 400;
+  yoe = y - era * 400;
+  doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day-1;
+  doe = yoe * 365 + yoe/4 - yoe/100 + doy;
+
+  *days = era * 146097 + doe - 719468 - 10957.5 + (hour + minute/60.0) / 24.0;
+  return 0;
+}
+
+// Sun azimuth (degrees clockwise from north) and elevation (degrees) seen from
+// latitude lat and longitude lon at the given time, from the low-precision
+// formulas of the Astronomical Almanac (good to about 0.01 degree).
+static void solar_position( double days, double lat, double lon, double *az, double *el )
+{
+  double g = deg2rad(357.529 + 0.98560028 * days);     // mean anomaly
+  double q = 280.459 + 0.98564736 * days;              // mean longitude
+  double ecl = deg2rad(q + 1.915 * sin(g) + 0.020 * sin(2*g));
+  double obl = deg2rad(23.439 - 0.00000036 * days);
+  double ra = atan2(cos(obl) * sin(ecl), cos(ecl));
+  double dec = asin(sin(obl) * sin(ecl));
+  double gmst = 18.697374558 + 24.06570982441908 * days;   // hours
+  double ha = deg2rad(fmod(gmst * 15.0, 360.0) + lon) - ra;  // local hour angle
+  double phi = deg2rad(lat);
+
+  *el = rad2deg(asin(sin(phi) * sin(dec) + cos(phi) * cos(dec) * cos(ha)));
+  *az = rad2deg(atan2(-sin(ha), tan(dec) * cos(phi) - sin(phi) * cos(ha)));
+  if (*az < 0) {
+    *az += 360.0;
+  }
+}
+
+struct Solar_Step {
+  int bin;              // azimuth bin
+  double el;            // sun elevation (degrees)
+  double e, n, u;       // direct beam per unit area facing the sun, times the
+                        // east, north and up components of the sun direction
+};
+
+// Orders steps by bin, then by decreasing sun elevation
+static int compare_steps( const void *a, const void *b )
+{
+  const struct Solar_Step *p = (const struct Solar_Step *)a;
+  const struct Solar_Step *q = (const struct Solar_Step *)b;
+
+  if (p->bin != q->bin) {
+    return p->bin < q->bin ? -1 : 1;
+  }
+  return p->el > q->el ? -1 : p->el < q->el;
 }
-  free(threadarg);
-  pthread_exit(NULL);
+
+struct Solar_Task {
+  const float *data;
+  float *out;
+  const float *horizon; // horizon angle of each pixel in the bin direction
+  int nrows;
+  int ncols;
+  int nsteps;           // steps in this bin, by decreasing sun elevation
+  const struct Solar_Step *steps;
+  const double *sum;    // cumulative sums over the steps: hours, e, n, u
+  int insolation;       // nonzero for insolation, zero for hours of sun
+  double xres;          // pixel spacing in meters (for the surface slope)
+  double yres;
+};
+
+static int solar_rows( long first, long last, int thread, void *state )
+{
+  const struct Solar_Task *s = (const struct Solar_Task *)state;
+  const float *data = s->data;
+  const double *sum;
+  double h;
+  double dzdx, dzdy;
+  double value;
+  int lo, hi, mid;
+  int i, j, jl, jr, iu, id;
+  LONG k;
+
+  for (i=(int)first; i<last; ++i) {
+    for (j=0; j<s->ncols; ++j) {
+      k = (LONG)i * (LONG)s->ncols + j;
+      if (data[k] < -1.0e+38) {
+        continue;
+      }
+      // number of steps with the sun above the horizon of this pixel
+      h = s->horizon[k];
+      lo = 0;
+      hi = s->nsteps;
+      while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (s->steps[mid].el > h) {
+          lo = mid+1;
+        } else {
+          hi = mid;
+        }
+      }
+      if (lo == 0) {
+        continue;
+      }
+      sum = s->sum + 4*(lo-1);
+      if (!s->insolation) {
+        s->out[k] += sum[0];
+        continue;
+      }
+      // the beam on the surface is linear in the sun direction, so it can
+      // be summed over the steps; a surface facing away from the sun is
+      // (almost always) below its own horizon, so is already left out
+      jl = j > 0 && data[k-1] >= -1.0e+38 ? j-1 : j;
+      jr = j+1 < s->ncols && data[k+1] >= -1.0e+38 ? j+1 : j;
+      iu = i > 0 && data[k-s->ncols] >= -1.0e+38 ? i-1 : i;
+      id = i+1 < s->nrows && data[k+s->ncols] >= -1.0e+38 ? i+1 : i;
+      dzdx = jr > jl ? (data[k+jr-j] - data[k+jl-j]) / ((jr-jl) * s->xres) : 0;
+      dzdy = id > iu ? (data[k+(LONG)(iu-i)*s->ncols] - data[k+(LONG)(id-i)*s->ncols]) /
+                       ((id-iu) * s->yres) : 0;
+      value = (sum[3] - dzdx*sum[1] - dzdy*sum[2]) / sqrt(1 + dzdx*dzdx + dzdy*dzdy);
+      if (value > 0) {
+        s->out[k] += value;
+      }
+    }
+  }
+  return 0;
 }
 
+// Computes hours of direct sun (or, if insolation is nonzero, clear-sky
+// direct-beam insolation on the surface in kWh/m^2) into out, for times
+// [start,end) in steps of step days, as seen from latitude lat and
+// longitude lon. Sun positions are grouped into azimuth bins of bin_width
+// degrees, and each bin uses the horizon in the direction of its center.
+// xres and yres are the pixel spacing in meters.
+// Returns 0 on success, nonzero if a memory allocation error occurred.
+static int solar_map( const float *data, float *out, int nrows, int ncols,
+  double xres, double yres, double lat, double lon, double start, double end,
+  double step, double bin_width, int insolation, struct Thread_Pool *pool )
+{
+  LONG count = (LONG)nrows * (LONG)ncols;
+  long nsteps = (long)ceil((end - start) / step - 1e-9);
+  int nbins = (int)ceil(360.0 / bin_width - 1e-9);
+  struct Solar_Step *steps;
+  struct Solar_Task task;
+  float *horizon;
+  double *sum;
+  double az, sun_el, air_mass, beam, hours;
+  long m, first, nsun;
+  int n;
+  int error = 0;
+
+  if (nsteps < 0) {
+    nsteps = 0;
+  }
+  memset(out, 0, count * sizeof(float));
+
+  steps = (struct Solar_Step *)malloc((nsteps+1) * sizeof(struct Solar_Step));
+  sum = (double *)malloc(4 * (nsteps+1) * sizeof(double));
+  horizon = (float *)malloc(count * sizeof(float));
+  if (!steps || !sum || !horizon) {
+    free(steps);
+    free(sum);
+    free(horizon);
+    return TERRAIN_FILTER_MALLOC_ERROR;
+  }
+
+  // sun positions with the sun up
+  hours = step * 24.0;
+  nsun = 0;
+  for (m=0; m<nsteps; ++m) {
+    solar_position(start + m * step, lat, lon, &az, &sun_el);
+    if (sun_el <= 0) {
+      continue;
+    }
+    // clear-sky direct beam (Meinel), with the air mass of Kasten and Young
+    air_mass = 1.0 / (sin(deg2rad(sun_el)) + 0.50572 * pow(sun_el + 6.07995, -1.6364));
+    beam = 1.353 * pow(0.7, pow(air_mass, 0.678)) * hours;    // kWh/m^2
+    steps[nsun].bin = (int)floor(az / bin_width + 0.5) % nbins;
+    steps[nsun].el = sun_el;
+    steps[nsun].e = beam * cos(deg2rad(sun_el)) * sin(deg2rad(az));
+    steps[nsun].n = beam * cos(deg2rad(sun_el)) * cos(deg2rad(az));
+    steps[nsun].u = beam * sin(deg2rad(sun_el));
+    ++nsun;
+  }
+  qsort(steps, nsun, sizeof(struct Solar_Step), compare_steps);
+
+  task.data = data;
+  task.out = out;
+  task.horizon = horizon;
+  task.nrows = nrows;
+  task.ncols = ncols;
+  task.sum = sum;
+  task.insolation = insolation;
+  task.xres = xres;
+  task.yres = yres;
+
+  // one sweep of the terrain per bin
+  for (first=0; first<nsun && !error; first+=n) {
+    for (n=0; first+n < nsun && steps[first+n].bin == steps[first].bin; ++n) {
+      sum[4*n+0] = (n > 0 ? sum[4*n-4] : 0) + hours;
+      sum[4*n+1] = (n > 0 ? sum[4*n-3] : 0) + steps[first+n].e;
+      sum[4*n+2] = (n > 0 ? sum[4*n-2] : 0) + steps[first+n].n;
+      sum[4*n+3] = (n > 0 ? sum[4*n-1] : 0) + steps[first+n].u;
+    }
+    task.nsteps = n;
+    task.steps = steps + first;
+
+    error = compute_horizons(data, nrows, ncols, xres, yres,
+        steps[first].bin * bin_width, 0, horizon, pool);
+    if (!error) {
+      error = thread_pool_run(pool, nrows, 0, solar_rows, &task, NULL);
+    }
+  }
+
+  free(steps);
+  free(sum);
+  free(horizon);
+
+  return error;
+}
 
 #ifndef NOMAIN
 
@@ -714,6 +1572,19 @@ int main( int argc, const char *argv[] )
 
     int argnum;
     int fast_flag=0;
+    int num_threads = 0;    // default unless -threads option used (0 = all processors)
+    int ambient = 0;        // default unless -ambient option used (0 = no ambient shadow)
+    const char *horizon_name = NULL;    // default unless -horizon option used
+    FILE *horizon_file = NULL;
+    struct Horizon_Cube_Info horizon_info;
+    int solar = 0;          // default unless -solar option used
+    int insolation = 0;     // default unless -insolation option used
+    double solar_lat = 0.0;     // set by -solar option
+    double solar_lon = 0.0;
+    double solar_start = 0.0;
+    double solar_end = 0.0;
+    double solar_step = 0.0;
+    double azbin = 1.0;     // default unless -azbin option used
 
     const char *thisarg;
     char *endptr;
@@ -751,14 +1622,23 @@ int main( int argc, const char *argv[] )
     int proj_type;
     int has_nulls;
     int all_ints;
+    int tif_input;
+    struct Flt_Map data_map = { NULL, 0 };
+    struct Flt_Hdr_Info info;
 
+    int geographic = 0; // default unless -geographic option used
     double lat1 = 0.0;  // default unless -merc option used
     double lat2 = 0.0;  // default unless -merc option used
     double center_lat;
     double temp;
+    double xres;
+    double yres;
+    double *row_scale = NULL;
 
-    double sun_az;
+    double *sun_az;
     double sun_el;
+    int nsun;
+    int s;
     // float *ptr;
 
     int error;
@@ -779,10 +1659,23 @@ int main( int argc, const char *argv[] )
     argnum = 1;
 
     thisarg = argv[argnum++];
-    // read decimal number
-    sun_az = strtod( thisarg, &endptr );
-    if (endptr == thisarg || *endptr != '\0') {
-        usage_exit( "First parameter (sun_az) must be a number." );
+    // read decimal number, or comma-separated list of numbers
+    nsun = 1;
+    for (endptr=(char *)thisarg; *endptr; ++endptr) {
+        nsun += *endptr == ',';
+    }
+    sun_az = (double *)malloc( nsun * sizeof( double ) );
+    if (!sun_az) {
+        prefix_error();
+        fprintf( stderr, "Memory allocation error occurred.\n" );
+        exit( EXIT_FAILURE );
+    }
+    for (s=0; s<nsun; ++s) {
+        sun_az[s] = strtod( thisarg, &endptr );
+        if (endptr == thisarg || *endptr != (s+1 < nsun ? ',' : '\0')) {
+            usage_exit( "First parameter (sun_az) must be a number or comma-separated list of numbers." );
+        }
+        thisarg = endptr + 1;
     }
     thisarg = argv[argnum++];
     // read decimal number
@@ -803,9 +1696,13 @@ int main( int argc, const char *argv[] )
 
     strncpy( extension, "flt", 4 );
     get_filenames( argv[argnum++], &in_dat_name, &in_hdr_name, &in_prj_name, extension );
+    tif_input = is_geotiff_name( in_dat_name );
 
     strncpy( extension, "flt", 4 );
     get_filenames( argv[argnum++], &out_dat_name, &out_hdr_name, &out_prj_name, extension );
+    if (is_geotiff_name( out_dat_name )) {
+        usage_exit( "Output filename must have .flt extension (if any)." );
+    }
 
     if (!strcmp( in_hdr_name, out_hdr_name )) {
         usage_exit( "Input and outfile filenames must not be the same." );
@@ -821,6 +1718,84 @@ int main( int argc, const char *argv[] )
         ++thisarg;
         if (strncmp( thisarg, "fast", 4 ) == 0 ) {
           fast_flag=1;
+        } else if (strncmp( thisarg, "ambient", 4 ) == 0) {
+            if (argnum >= argc) {
+                usage_exit( "Option -ambient must be followed by a positive integer." );
+            }
+            thisarg = argv[argnum++];
+            ambient = (int)strtol( thisarg, &endptr, 10 );
+            if (endptr == thisarg || *endptr != '\0' || ambient < 1) {
+                usage_exit( "Option -ambient must be followed by a positive integer." );
+            }
+            if (nsun > 1) {
+                usage_exit( "Option -ambient requires a single sun_az value." );
+            }
+            // spread the directions evenly around the horizon, starting at sun_az
+            temp = sun_az[0];
+            free( sun_az );
+            nsun = ambient;
+            sun_az = (double *)malloc( nsun * sizeof( double ) );
+            if (!sun_az) {
+                prefix_error();
+                fprintf( stderr, "Memory allocation error occurred.\n" );
+                exit( EXIT_FAILURE );
+            }
+            for (s=0; s<nsun; ++s) {
+                sun_az[s] = temp + s * 360.0 / nsun;
+            }
+        } else if (strcmp( thisarg, "solar" ) == 0) {
+            if (argnum+4 >= argc) {
+                usage_exit( "Option -solar must be followed by lat, lon, start, end and minutes." );
+            }
+            thisarg = argv[argnum++];
+            solar_lat = strtod( thisarg, &endptr );
+            if (endptr == thisarg || *endptr != '\0' || solar_lat < -90.0 || solar_lat > 90.0) {
+                usage_exit( "Option -solar latitude must be a number from -90 to +90." );
+            }
+            thisarg = argv[argnum++];
+            solar_lon = strtod( thisarg, &endptr );
+            if (endptr == thisarg || *endptr != '\0') {
+                usage_exit( "Option -solar longitude must be a number." );
+            }
+            if (parse_utc_time( argv[argnum++], &solar_start ) ||
+                parse_utc_time( argv[argnum++], &solar_end ))
+            {
+                usage_exit( "Option -solar times must be YYYY-MM-DD or YYYY-MM-DDTHH:MM." );
+            }
+            thisarg = argv[argnum++];
+            solar_step = strtod( thisarg, &endptr );
+            if (endptr == thisarg || *endptr != '\0' || solar_step <= 0) {
+                usage_exit( "Option -solar time step must be a positive number of minutes." );
+            }
+            solar_step /= 24.0 * 60.0;  // in days
+            solar = 1;
+        } else if (strcmp( thisarg, "insolation" ) == 0) {
+            insolation = 1;
+        } else if (strcmp( thisarg, "azbin" ) == 0) {
+            if (argnum >= argc) {
+                usage_exit( "Option -azbin must be followed by a positive number of degrees." );
+            }
+            thisarg = argv[argnum++];
+            azbin = strtod( thisarg, &endptr );
+            if (endptr == thisarg || *endptr != '\0' || azbin <= 0 || azbin > 360) {
+                usage_exit( "Option -azbin must be followed by a positive number of degrees." );
+            }
+        } else if (strncmp( thisarg, "horizon", 4 ) == 0) {
+            if (argnum >= argc) {
+                usage_exit( "Option -horizon must be followed by a filename." );
+            }
+            horizon_name = argv[argnum++];
+        } else if (strncmp( thisarg, "threads", 6 ) == 0) {
+            if (argnum >= argc) {
+                usage_exit( "Option -threads must be followed by a positive integer." );
+            }
+            thisarg = argv[argnum++];
+            num_threads = (int)strtol( thisarg, &endptr, 10 );
+            if (endptr == thisarg || *endptr != '\0' || num_threads < 1) {
+                usage_exit( "Option -threads must be followed by a positive integer." );
+            }
+        } else if (strncmp( thisarg, "geographic", 3 ) == 0) {
+            geographic = 1;
         } else if (strncmp( thisarg, "mercator", 4 ) == 0 || strncmp( thisarg, "Mercator", 4 ) == 0) {
             if (argnum+1 >= argc) {
                 usage_exit( "Option -mercator must be followed by two numeric latitude values." );
@@ -865,11 +1840,21 @@ int main( int argc, const char *argv[] )
         }
     }
 
-    in_hdr_file = fopen( in_hdr_name, "rb" );   // use binary mode for compatibility
-    if (!in_hdr_file) {
-        prefix_error();
-        fprintf( stderr, "Could not open input file '%s'.\n", in_hdr_name );
-        usage_exit( 0 );
+    if (solar && horizon_name) {
+        usage_exit( "Options -solar and -horizon cannot be used together." );
+    }
+    if ((insolation || azbin != 1.0) && !solar) {
+        usage_exit( "Options -insolation and -azbin require option -solar." );
+    }
+
+    in_hdr_file = NULL;     // GeoTIFF input has no .hdr file
+    if (!tif_input) {
+        in_hdr_file = fopen( in_hdr_name, "rb" );   // use binary mode for compatibility
+        if (!in_hdr_file) {
+            prefix_error();
+            fprintf( stderr, "Could not open input file '%s'.\n", in_hdr_name );
+            usage_exit( 0 );
+        }
     }
 
     in_dat_file = fopen( in_dat_name, "rb" );
@@ -904,12 +1889,24 @@ int main( int argc, const char *argv[] )
     // printf( "Reading input files...\n" );
     fflush( stdout );
 
-    data = read_flt_hdr_files(
-        in_dat_file, in_hdr_file, &nrows, &ncols, &xmin, &xmax, &ymin, &ymax,
-        &has_nulls, &all_ints, 0 );
+    // the integer check is of no use here
+    if (tif_input) {
+        data = read_geotiff_file( in_dat_file, &info, &has_nulls, NULL );
+        nrows = info.nrows;
+        ncols = info.ncols;
+        xmin  = info.xmin;
+        xmax  = info.xmax;
+        ymin  = info.ymin;
+        ymax  = info.ymax;
+    } else {
+        data = map_flt_hdr_files(
+            in_dat_file, in_hdr_file, &nrows, &ncols, &xmin, &xmax, &ymin, &ymax,
+            &has_nulls, NULL, num_threads, &data_map );
+        fclose( in_hdr_file );
+    }
+    all_ints = 0;
 
     fclose( in_dat_file );
-    fclose( in_hdr_file );
 
     if (has_nulls) {
         fprintf( stderr, "*** WARNING: " );
@@ -931,7 +1928,16 @@ int main( int argc, const char *argv[] )
     ydim = (ymax - ymin) / (double)nrows;
 
     // determine projection type
-    proj_type = determine_projection( xmin, xmax, ymin, ymax, xdim, ydim );
+    if (geographic) {
+        // coarse lat/lon grids (cells of 0.02 degrees or more) are not recognized
+        // by determine_projection(), so the caller says so
+        if (xmin < -180.01 || xmax > 360.01 || ymin < -90.01 || ymax > 90.01) {
+            usage_exit( "Option -geographic needs data within longitude -180..360 and latitude -90..90." );
+        }
+        proj_type = -1;
+    } else {
+        proj_type = determine_projection( xmin, xmax, ymin, ymax, xdim, ydim );
+    }
 
     if (proj_type < 0) {
         coord_type = TERRAIN_DEGREES;
@@ -962,12 +1968,52 @@ int main( int argc, const char *argv[] )
 
     }
 
-    // check pixel aspect ratio and size of map extent
-    check_aspect( xmin, xmax, ymin, ymax, xdim, ydim, proj_type );
+    // check pixel aspect ratio and size of map extent; rays over geographic data
+    // follow the scale of each row, except in the horizon and solar modes
+    if (proj_type >= 0 || horizon_name || solar) {
+        check_aspect( xmin, xmax, ymin, ymax, xdim, ydim, proj_type );
+    }
+
+    terrain_pixel_spacing( xdim, ydim, coord_type, center_lat, &xres, &yres );
+
+    if (proj_type < 0 && !horizon_name && !solar) {
+        // scale of each row, followed by the sums of the scales before each row
+        row_scale = (double *)malloc( (2 * (LONG)nrows + 1) * sizeof( double ) );
+        if (!row_scale) {
+            prefix_error();
+            fprintf( stderr, "Memory allocation error occurred.\n" );
+            exit( EXIT_FAILURE );
+        }
+        geographic_row_scale( nrows, ymax, ydim, center_lat, row_scale );
+        row_scale[nrows] = 0.0;
+        for (int i=0; i<nrows; ++i) {
+            row_scale[nrows+i+1] = row_scale[nrows+i] + row_scale[i];
+        }
+    }
+
+    if (horizon_name) {
+        horizon_file = fopen( horizon_name, "rb" );
+        if (!horizon_file) {
+            prefix_error();
+            fprintf( stderr, "Could not open horizon cube file '%s'.\n", horizon_name );
+            usage_exit( 0 );
+        }
+        if (read_horizon_header( horizon_file, &horizon_info )) {
+            prefix_error();
+            fprintf( stderr, "File '%s' is not a horizon cube file.\n", horizon_name );
+            exit( EXIT_FAILURE );
+        }
+        if (horizon_info.nrows != nrows || horizon_info.ncols != ncols) {
+            prefix_error();
+            fprintf( stderr, "Horizon cube file '%s' is %d x %d, but the elevation array is %d x %d.\n",
+                horizon_name, horizon_info.ncols, horizon_info.nrows, ncols, nrows );
+            exit( EXIT_FAILURE );
+        }
+    }
 
     // printf(
     //     "Processing %d column x %d row array using sun_az = %f, sun_el = %f...\n",
-    //     ncols, nrows, sun_az, sun_el );
+    //     ncols, nrows, sun_az[0], sun_el );
     fflush( stdout );
 
     float *shadowarray2 = (float *)malloc( (LONG)nrows * (LONG)ncols * sizeof( float ) );
@@ -998,19 +2044,31 @@ int main( int argc, const char *argv[] )
 
     double const_deg_m=111132;
 
-    double csa=cos(deg2rad(sun_az));
-    double ssa=sin(deg2rad(sun_az));
+    double *sun_x = (double *)malloc( 3 * nsun * sizeof( double ) );
+    double *sun_y = sun_x + nsun;
+    double *sun_z = sun_y + nsun;
+
+    if (!sun_x) {
+        prefix_error();
+        fprintf( stderr, "Memory allocation error occurred.\n" );
+        exit( EXIT_FAILURE );
+    }
 
-    double num_az= deg2rad(fix_azimuth(sun_az, xdim, ydim));
-    // fprintf(stderr, "xdim=%f, ydim=%f, sun_az=%f, fixed sun look angle=%f\n", xdim, ydim, sun_az, fix_azimuth(sun_az+180, xdim, ydim));
-    double num_el= deg2rad(sun_el);
-    double sun_x = sin(num_az)*cos(num_el);
-    double sun_y = -cos(num_az)*cos(num_el);
-    double sun_z = sin(num_el)*sqrt(ydim*ydim*csa*csa+xdim*xdim*ssa*ssa);
+    for (s=0; s<nsun; ++s) {
+        double csa=cos(deg2rad(sun_az[s]));
+        double ssa=sin(deg2rad(sun_az[s]));
+
+        double num_az= deg2rad(fix_azimuth(sun_az[s], xres, yres));
+        // fprintf(stderr, "xres=%f, yres=%f, sun_az=%f, fixed sun look angle=%f\n", xres, yres, sun_az[s], fix_azimuth(sun_az[s]+180, xres, yres));
+        double num_el= deg2rad(sun_el);
+        sun_x[s] = sin(num_az)*cos(num_el);
+        sun_y[s] = -cos(num_az)*cos(num_el);
+        sun_z[s] = sin(num_el)*sqrt(yres*yres*csa*csa+xres*xres*ssa*ssa);
+    }
     double xp;
     double yp;
 
-    // fprintf(stderr, "zmax=%f, xdim=%f, ydim=%f, sun_x=%f, sun_y=%f, sun_z=%f\n", z_max, xdim, ydim, sun_x, sun_y, sun_z);
+    // fprintf(stderr, "zmax=%f, xdim=%f, ydim=%f, sun_x=%f, sun_y=%f, sun_z=%f\n", z_max, xdim, ydim, sun_x[0], sun_y[0], sun_z[0]);
 
     float nodata;
     nodata = -3.40282347e+38;
@@ -1029,52 +2087,60 @@ int main( int argc, const char *argv[] )
     // Shadow algorithm
 
 
-    int numthreads;
-
-    numthreads=1;
-    tdata_t* this_data;
-    pthread_t* threads;
-    threads = (pthread_t *) malloc(sizeof(pthread_t)*numthreads);
-
+    tdata_t shadow_data;
+    struct Thread_Pool *pool;
+
+    shadow_data.nrows=nrows;
+    shadow_data.ncols=ncols;
+    shadow_data.data=data;
+    shadow_data.shadowarray2=shadowarray2;
+    shadow_data.nsun=nsun;
+    shadow_data.sun_x=sun_x;
+    shadow_data.sun_y=sun_y;
+    shadow_data.sun_z=sun_z;
+    shadow_data.sun=0;
+    shadow_data.soft_sum=NULL;
+    shadow_data.ambient=ambient > 0;
+    shadow_data.nlevels=0;
+    shadow_data.max_level=NULL;
+    shadow_data.level_cols=NULL;
+    shadow_data.row_scale=row_scale;
+    shadow_data.row_sum=row_scale ? row_scale + nrows : NULL;
+    shadow_data.z_max=z_max;
+    shadow_data.periodic_boundaries=1;
+    shadow_data.cells=NULL;
+    shadow_data.sunny=NULL;
 
     clock_t start, end;
     double cpu_time_used;
 
     start = clock();
 
-
-    for(int thread_id=1; thread_id<=numthreads; ++thread_id) {
-
-        this_data = (tdata_t *) malloc(sizeof(tdata_t));
-
-        this_data->thread_id=thread_id;
-        this_data->numthreads=numthreads;
-        this_data->nrows=nrows;
-        this_data->ncols=ncols;
-        this_data->data=data;
-        this_data->shadowarray2=shadowarray2;
-        this_data->sun_x=sun_x;
-        this_data->sun_y=sun_y;
-        this_data->sun_z=sun_z;
-        this_data->z_max=z_max;
-        this_data->fast_flag=fast_flag;
-
-        rc = pthread_create(&threads[thread_id], NULL, shadow_row, (void *) this_data);
-
-        if (rc) {
-            printf("ERR; pthread_create() ret = %d\n", rc);
-            exit(-1);
-        }
-    }
-    for(int thread_id=1; thread_id<=numthreads; ++thread_id) {
-      pthread_join(threads[thread_id], NULL);
+    pool = num_threads == 1 ? NULL : thread_pool_create( num_threads );
+    if (num_threads != 1 && !pool) {
+        error = TERRAIN_FILTER_MALLOC_ERROR;
+    } else if (solar) {
+        error = solar_map(
+            data, shadowarray2, nrows, ncols, xres, yres, solar_lat, solar_lon,
+            solar_start, solar_end, solar_step, azbin, insolation, pool );
+    } else if (horizon_file) {
+        error = horizon_shadows( &shadow_data, horizon_file, &horizon_info, sun_az, sun_el, pool );
+        fclose( horizon_file );
+    } else {
+        error = cast_shadows( &shadow_data, fast_flag, pool );
     }
+    thread_pool_destroy( pool );
 
     end = clock();
     cpu_time_used = ((double) (end - start)) / CLOCKS_PER_SEC;
 
-    // fprintf(stderr, "time with %d threads is %g\n", numthreads, cpu_time_used);
+    // fprintf(stderr, "time with %d threads is %g\n", num_threads, cpu_time_used);
 
+    if (error && horizon_file && error != TERRAIN_FILTER_MALLOC_ERROR) {
+        prefix_error();
+        fprintf( stderr, "Could not read horizon cube file '%s'.\n", horizon_name );
+        exit( EXIT_FAILURE );
+    }
     if (error) {
         assert( error == TERRAIN_FILTER_MALLOC_ERROR );
         prefix_error();
@@ -1097,8 +2163,11 @@ int main( int argc, const char *argv[] )
     fclose( out_dat_file );
     fclose( out_hdr_file );
 
-    free( data );
+    free_flt_data( data, &data_map );
     free( software );
+    free( sun_az );
+    free( sun_x );
+    free( row_scale );
 
     // Copy optional .prj file:
 
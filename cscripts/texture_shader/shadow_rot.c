@@ -39,32 +39,32 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stddef.h> // for ptrdiff_t
-#include <pthread.h>
 #include <math.h>
 #include <time.h>
 #include <assert.h>
 #include "terrain_filter.h"
+#include "thread_pool.h"
+
+#define LONG ptrdiff_t
 
 typedef struct thread_data {
-  int thread_id;
-  int numthreads;
-  int nrows;
-  int ncols;
-  float* data;
-  float* shadowarray2;
-  double sun_x;
-  double sun_y;
-  double sun_z;
-  float z_max;
+  float* data;          // input: elevations; output: 1 where lit, 0 where shaded
+  int nsteps;           // number of steps along each scan line
+  int ncross;           // number of positions across the scan lines
+  int nlines;           // number of scan lines
+  LONG first;           // offset in data of first step, at cross position 0
+  LONG step_stride;     // offset in data from one step to the next
+  LONG cross_stride;    // offset in data from one cross position to the next
+  const int* shift;     // per step: cross position of line 0 (plus line_offset)
+  int line_offset;      // see shift
+  double sun_z;         // drop of the sun line from one step to the next
+  double* horizon;      // per scan line: height of the sun line
 } tdata_t;
 
-#define LONG ptrdiff_t
 
 #define deg2rad(angleDegrees) ((angleDegrees) * M_PI / 180.0)
 #define rad2deg(angleRadians) ((angleRadians) * 180.0 / M_PI)
 
-static void* shadow_column();
-
 // CAUTION: This __DATE__ is only updated when THIS file is recompiled.
 // If other source files are modified but this file is not touched,
 // the version date may not be correct.
@@ -133,6 +133,8 @@ static void usage_exit( const char *message )
     fprintf( stderr, "    -mercator lat1 lat2    " );
     fprintf( stderr, "input is in normal Mercator projection (not UTM)\n" );
     fprintf( stderr, "Values lat1 and lat2 must be in decimal degrees.\n" );
+    fprintf( stderr, "    -threads N             " );
+    fprintf( stderr, "number of threads to use (default: all processors)\n" );
     fprintf( stderr, "\n" );
     exit( EXIT_FAILURE );
 }
@@ -279,6 +281,17 @@ static double fix_azimuth(double az, double xdim, double ydim )
   return val;
 }
 
+// Returns elapsed (wall clock) time in seconds from an arbitrary starting point.
+static double wall_seconds(void) {
+#if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + 1.0e-9 * (double)ts.tv_nsec;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
 
 // Main terrain_filter function:
 //
@@ -355,6 +368,139 @@ static double fix_azimuth(double az, double xdim, double ydim )
 //     return 0;
 // }
 
+// The sweep follows straight scan lines running away from the sun, keeping a
+// running horizon (the height of the sun line cast by the highest point seen
+// so far) for each line. Each step moves one row or one column, whichever
+// is nearer to the sun direction, and the other coordinate by at most one
+// pixel (slope), rounded to the nearest pixel. Neighboring lines are offset
+// by exactly one pixel at every step, so every pixel lies on exactly one line,
+// and the lines can be swept independently - each pixel is visited once.
+
+// Sweeps scan lines [first,last), replacing elevations with 1 (lit) or 0 (shaded)
+static int sweep_lines( long first, long last, int thread, void *state )
+{
+  tdata_t *t = (tdata_t *)state;
+  float *ptr;
+  double *horizon = t->horizon;
+  double sunheight;
+  float zval;
+  long k;
+  int s;
+  int b, bstart, bend;
+
+  float nodata;
+  nodata = -3.40282347e+38;
+
+  for (k=first; k<last; ++k) {
+    horizon[k] = -HUGE_VAL;
+  }
+
+  for (s=0; s<t->nsteps; ++s) {
+    // cross positions of lines first and last at this step
+    bstart = (int)first - t->line_offset + t->shift[s];
+    bend   = (int)last  - t->line_offset + t->shift[s];
+    if (bstart < 0) {
+      bstart = 0;
+    }
+    if (bend > t->ncross) {
+      bend = t->ncross;
+    }
+    ptr = t->data + t->first + s * t->step_stride;
+    for (b=bstart; b<bend; ++b) {
+      k = b + t->line_offset - t->shift[s];
+      sunheight = horizon[k];
+      zval = ptr[b * t->cross_stride];
+
+      // If the data point itself is nodata, set a lit value of 1
+      if (zval == nodata || zval < -9998) {
+        ptr[b * t->cross_stride]=1;
+      } else if (zval >= sunheight) {
+        // If the point is above the sunline, set it as lit and set new horizon zval
+        ptr[b * t->cross_stride]=1;
+        sunheight=zval;
+      } else {
+        // If the point is below the sunline, set it as dark
+        ptr[b * t->cross_stride]=0;
+      }
+      horizon[k] = sunheight - t->sun_z;
+    }
+  }
+  return 0;
+}
+
+// Replaces elevations with 1 where lit and 0 where shaded for a sun at
+// azimuth sun_az and elevation sun_el (in degrees), using all threads in pool.
+// xres and yres are the pixel spacing in meters.
+// Returns 0 on success, nonzero if a memory allocation error occurred.
+static int sweep_shadows(
+  float *data, int nrows, int ncols, double xres, double yres,
+  double sun_az, double sun_el, struct Thread_Pool *pool )
+{
+  tdata_t t;
+  int *shift;
+  double dc, dr;    // columns and rows per meter, moving away from the sun
+  double slope;
+  double step_len;  // meters per step
+  int forward;
+  int s;
+  int error;
+
+  dc = -sin(deg2rad(sun_az)) / xres;
+  dr =  cos(deg2rad(sun_az)) / yres;
+
+  t.data = data;
+  if (fabs(dr) >= fabs(dc)) {
+    // step from row to row
+    t.nsteps = nrows;
+    t.ncross = ncols;
+    t.step_stride = ncols;
+    t.cross_stride = 1;
+    forward = dr > 0;
+    slope = dc / fabs(dr);
+    step_len = 1.0 / fabs(dr);
+  } else {
+    // step from column to column
+    t.nsteps = ncols;
+    t.ncross = nrows;
+    t.step_stride = 1;
+    t.cross_stride = ncols;
+    forward = dc > 0;
+    slope = dr / fabs(dc);
+    step_len = 1.0 / fabs(dc);
+  }
+  t.first = forward ? 0 : (LONG)(t.nsteps-1) * t.step_stride;
+  if (!forward) {
+    t.step_stride = -t.step_stride;
+  }
+  t.sun_z = tan(deg2rad(sun_el)) * step_len;
+
+  shift = (int *)malloc(t.nsteps * sizeof(int));
+  if (!shift) {
+    return TERRAIN_FILTER_MALLOC_ERROR;
+  }
+  for (s=0; s<t.nsteps; ++s) {
+    shift[s] = (int)floor(s * slope + 0.5);
+  }
+  t.shift = shift;
+
+  // shift is monotonic, so its extremes are at the ends
+  t.line_offset = shift[t.nsteps-1] > 0 ? shift[t.nsteps-1] : 0;
+  t.nlines = t.ncross + abs(shift[t.nsteps-1]);
+
+  t.horizon = (double *)malloc(t.nlines * sizeof(double));
+  if (!t.horizon) {
+    free(shift);
+    return TERRAIN_FILTER_MALLOC_ERROR;
+  }
+
+  error = thread_pool_run(pool, t.nlines, 0, sweep_lines, &t, NULL);
+
+  free(t.horizon);
+  free(shift);
+
+  return error;
+}
+
 #ifndef NOMAIN
 
 int main( int argc, const char *argv[] )
@@ -366,6 +512,7 @@ int main( int argc, const char *argv[] )
     struct Terrain_Progress_Callback progress = { print_progress, &last_count };
 
     int argnum;
+    int num_threads = 0;    // default unless -threads option used (0 = all processors)
 
     const char *thisarg;
     char *endptr;
@@ -471,7 +618,16 @@ int main( int argc, const char *argv[] )
             usage_exit( 0 );
         }
         ++thisarg;
-        if (strncmp( thisarg, "mercator", 4 ) == 0 || strncmp( thisarg, "Mercator", 4 ) == 0) {
+        if (strncmp( thisarg, "threads", 6 ) == 0) {
+            if (argnum >= argc) {
+                usage_exit( "Option -threads must be followed by a positive integer." );
+            }
+            thisarg = argv[argnum++];
+            num_threads = (int)strtol( thisarg, &endptr, 10 );
+            if (endptr == thisarg || *endptr != '\0' || num_threads < 1) {
+                usage_exit( "Option -threads must be followed by a positive integer." );
+            }
+        } else if (strncmp( thisarg, "mercator", 4 ) == 0 || strncmp( thisarg, "Mercator", 4 ) == 0) {
             if (argnum+1 >= argc) {
                 usage_exit( "Option -mercator must be followed by two numeric latitude values." );
             }
@@ -620,71 +776,29 @@ int main( int argc, const char *argv[] )
     //     ncols, nrows, sun_az, sun_el );
     fflush( stdout );
 
-    // The new algorithm will just traverse columns and decide whether we
-    // are below the sun line of the last horizon. It will overwrite the
-    // original data array.
-
-
-    double num_el= deg2rad(sun_el);
-
-    double sun_z = sin(num_el)*ydim*111132;
-
-    fprintf(stderr, "ydim is %g and sunz is %g\n", ydim, sun_z);
-
-    double xp;
-    double yp;
-
-    double val;
-    double this_z;
-    double this_topoz;
-    double last_topoz;
-    float *ptr2;
-    float *ptr3;
-    int j;
-    int i;
-    int rc;
-    int runcount;
-    int i_set;
-    int j_set;
-
-    int numthreads;
-
-    numthreads=1;
-    tdata_t* this_data;
-    pthread_t* threads;
-    threads = (pthread_t *) malloc(sizeof(pthread_t)*numthreads);
-
-    clock_t start, end;
-    double cpu_time_used;
+    // The new algorithm will just traverse scan lines away from the sun and
+    // decide whether we are below the sun line of the last horizon. It will
+    // overwrite the original data array.
 
-    start = clock();
+    double xres;
+    double yres;
+    struct Thread_Pool *pool;
 
-    for(int thread_id=1; thread_id<=numthreads; ++thread_id) {
+    terrain_pixel_spacing( xdim, ydim, coord_type, center_lat, &xres, &yres );
 
-        this_data = (tdata_t *) malloc(sizeof(tdata_t));
+    double run_time;
 
-        this_data->thread_id=thread_id;
-        this_data->numthreads=numthreads;
-        this_data->nrows=nrows;
-        this_data->ncols=ncols;
-        this_data->data=data;
-        this_data->sun_z=sun_z;
+    run_time = wall_seconds();
 
-        rc = pthread_create(&threads[thread_id], NULL, shadow_column, (void *) this_data);
-
-        if (rc) {
-            printf("ERR; pthread_create() ret = %d\n", rc);
-            exit(-1);
-        }
-    }
-    for(int thread_id=1; thread_id<=numthreads; ++thread_id) {
-      pthread_join(threads[thread_id], NULL);
+    pool = num_threads == 1 ? NULL : thread_pool_create( num_threads );
+    if (num_threads != 1 && !pool) {
+        error = TERRAIN_FILTER_MALLOC_ERROR;
+    } else {
+        error = sweep_shadows( data, nrows, ncols, xres, yres, sun_az, sun_el, pool );
+        run_time = wall_seconds() - run_time;
+        fprintf( stderr, "time with %d threads is %g s\n", thread_pool_size( pool ), run_time );
     }
-
-    end = clock();
-    cpu_time_used = ((double) (end - start)) / CLOCKS_PER_SEC;
-
-    fprintf(stderr, "time with %d threads is %g\n", numthreads, cpu_time_used);
+    thread_pool_destroy( pool );
 
     if (error) {
         assert( error == TERRAIN_FILTER_MALLOC_ERROR );
@@ -738,96 +852,3 @@ int main( int argc, const char *argv[] )
 
 #endif
 
-
-//         int  float*  float*
-static void* shadow_column(void *threadarg) {
-  // ptr points to the topography data array
-  tdata_t *my_data;
-  int thread_id;
-  int numthreads;
-  int nrows;
-  int ncols;
-  float* data;
-  float* shadowarray2;
-  double sun_x;
-  double sun_y;
-  double sun_z;
-  float z_max;
-
-  my_data = (tdata_t *) threadarg;
-
-  thread_id=my_data->thread_id;
-  numthreads=my_data->numthreads;
-  nrows=my_data->nrows;
-  ncols=my_data->ncols;
-  data=my_data->data;
-  sun_z=my_data->sun_z;
-
-  float *ptr;
-  float *ptr2;
-  float *ptr3;
-  double x;
-  double y;
-  double zval;
-
-  int x_int;
-  int y_int;
-  int xp_int;
-  int yp_int;
-  int lit;
-  int j;
-
-  double val;
-  double this_z;
-  double this_topoz;
-  double last_topoz;
-
-  int runcount;
-  int i_set;
-  int j_set;
-  int skipval=1;
-  double sunheight;
-
-  float nodata;
-  nodata = -3.40282347e+38;
-
-
-  for(int j=0;j<ncols;j++) {
-    // fprintf(stderr, "srot column %d\n", j);
-    for(int i=0;i<nrows;i++) {
-      // ptr points to the data array
-      ptr = data + (LONG)i * (LONG)ncols;
-
-      // The x and y coordinates start at the i,j grid position
-      x=j;
-      y=i;
-
-      zval=ptr[j];   // access the topo value at dataarray[row][column]
-
-      if (i==0) {
-        sunheight=ptr[j];
-        continue;
-      }
-
-      // fprintf(stderr, "zval is %g, sunheight is %g\n", zval, sunheight);
-
-      // If the data point itself is nodata, set a lit value of 1
-      if (ptr[j] == nodata || ptr[j] < -9998) {
-        ptr[j]=1;
-      } else {
-        // If the point is above the sunline, set it as lit and set new horizon zval
-        if (zval >= sunheight) {
-          ptr[j]=1;
-          sunheight=zval;
-        } else {
-          // Check adjacent scan lines for points
-          // If the point is below the sunline, set it as dark
-          ptr[j]=0;
-        }
-      }
-      sunheight=sunheight-sun_z;
-    }
-  }
-  free(threadarg);
-  pthread_exit(NULL);
-}
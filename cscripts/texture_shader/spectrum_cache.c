@@ -0,0 +1,228 @@
+/*
+ * spectrum_cache.c
+ *
+ * On-disk cache of forward transforms computed by terrain_spectrum().
+ * Added for tectoplot; distributed under the same terms as the other
+ * files in this directory (see LICENSE.txt).
+ */
+
+//
+// Cache file format (native byte order; files are not portable between
+// machines of different byte order, and are rejected if moved to one):
+//
+//   8 bytes    magic string "TXSPEC01"
+//   uint32     byte order mark 0x01020304
+//   int32 x 5  nrows, ncols, registration, coord_type, dct_mode
+//   uint64     hash of input data
+//   float x 2  data_min, data_max
+//   float      nrows x ncols coefficients, transposed layout (see Terrain_Spectrum)
+//
+// There is no eviction; files may be deleted at any time and will be recreated
+// when next needed.
+//
+
+#define _CRT_SECURE_NO_DEPRECATE
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "spectrum_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#   include <process.h>     // for _getpid()
+#   define getpid _getpid
+#else
+#   include <unistd.h>      // for getpid()
+#endif
+
+static const char cache_magic[8] = { 'T', 'X', 'S', 'P', 'E', 'C', '0', '1' };
+
+static const unsigned int byte_order_mark = 0x01020304;
+
+unsigned long long hash_terrain_data(
+    const float *data,  // input: array of data to hash (row-major order)
+    int    nrows,       // input: number of rows    in data array
+    int    ncols        // input: number of columns in data array
+)
+{
+    const unsigned long long multiplier = 0x9E3779B97F4A7C15ULL;
+
+    size_t count = (size_t)nrows * (size_t)ncols;
+    size_t i;
+
+    unsigned long long hash = 0xCBF29CE484222325ULL ^ count;
+    unsigned long long word;
+    unsigned int bits;
+
+    // two values at a time, then the odd one (if any)
+    for (i=0; i+2<=count; i+=2) {
+        memcpy( &word, data+i, sizeof( word ) );
+        hash = (hash ^ word) * multiplier;
+        hash ^= hash >> 32;
+    }
+    if (i < count) {
+        memcpy( &bits, data+i, sizeof( bits ) );
+        hash = (hash ^ bits) * multiplier;
+    }
+
+    // final mixing, so that all bits depend on all input bits
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ULL;
+    hash ^= hash >> 33;
+
+    return hash;
+}
+
+char *spectrum_cache_filename(
+    const char *cache_dir,  // directory holding cache files
+    const struct Spectrum_Cache_Key *key
+)
+{
+    size_t len = strlen( cache_dir );
+    char *name = (char *)malloc( len + 80 );    // assume this malloc succeeds
+
+    const char *sep = len > 0 && cache_dir[len-1] != '/' && cache_dir[len-1] != '\\' ? "/" : "";
+
+    sprintf( name, "%s%sspectrum_%016llx_%dx%d_%s_%s_%s.dat",
+        cache_dir, sep, key->hash, key->ncols, key->nrows,
+        key->registration == TERRAIN_REG_GRID ? "grid" : "cell",
+        key->coord_type   == TERRAIN_DEGREES  ? "deg"  : "m",
+        key->dct_mode     == TERRAIN_DCT_SIMD  ? "simd"  :
+        key->dct_mode     == TERRAIN_DCT_FLOAT ? "float" : "double" );
+
+    return name;
+}
+
+static int read_int( FILE *file, int *value )
+{
+    return fread( value, sizeof( int ), 1, file ) == 1;
+}
+
+int read_spectrum_cache(
+    const char *filename,   // from spectrum_cache_filename()
+    const struct Spectrum_Cache_Key *key,
+    struct Terrain_Spectrum *spectrum
+)
+{
+    FILE *file;
+    char magic[8];
+    unsigned int order;
+    unsigned long long hash;
+    int nrows, ncols, registration, coord_type, dct_mode;
+    size_t count;
+
+    spectrum->coefs = NULL;
+
+    file = fopen( filename, "rb" );
+    if (!file) {
+        return 1;   // not in cache
+    }
+
+    if (fread( magic, sizeof( magic ), 1, file ) != 1 ||
+        memcmp( magic, cache_magic, sizeof( magic ) ) != 0 ||
+        fread( &order, sizeof( order ), 1, file ) != 1 || order != byte_order_mark ||
+        !read_int( file, &nrows ) || !read_int( file, &ncols ) ||
+        !read_int( file, &registration ) || !read_int( file, &coord_type ) ||
+        !read_int( file, &dct_mode ) ||
+        fread( &hash, sizeof( hash ), 1, file ) != 1 ||
+        fread( &spectrum->data_min, sizeof( float ), 1, file ) != 1 ||
+        fread( &spectrum->data_max, sizeof( float ), 1, file ) != 1)
+    {
+        fclose( file );
+        return 2;   // not a valid cache file
+    }
+
+    if (hash != key->hash || nrows != key->nrows || ncols != key->ncols ||
+        registration != (int)key->registration || coord_type != (int)key->coord_type ||
+        dct_mode != (int)key->dct_mode)
+    {
+        fclose( file );
+        return 3;   // file does not match key (hash collision in filename)
+    }
+
+    count = (size_t)nrows * (size_t)ncols;
+
+    spectrum->coefs = (float *)malloc( count * sizeof( float ) );
+    if (!spectrum->coefs) {
+        fclose( file );
+        return 4;
+    }
+
+    if (fread( spectrum->coefs, sizeof( float ), count, file ) != count) {
+        free( spectrum->coefs );
+        spectrum->coefs = NULL;
+        fclose( file );
+        return 2;   // truncated file
+    }
+
+    fclose( file );
+
+    spectrum->nrows    = nrows;
+    spectrum->ncols    = ncols;
+    spectrum->dct_mode = key->dct_mode;
+    spectrum->xres     = 0.0;   // caller must set
+    spectrum->yres     = 0.0;   // caller must set
+
+    return 0;
+}
+
+static int write_int( FILE *file, int value )
+{
+    return fwrite( &value, sizeof( int ), 1, file ) == 1;
+}
+
+int write_spectrum_cache(
+    const char *filename,   // from spectrum_cache_filename()
+    const struct Spectrum_Cache_Key *key,
+    const struct Terrain_Spectrum *spectrum
+)
+{
+    FILE *file;
+    char *temp_name;
+    size_t count = (size_t)spectrum->nrows * (size_t)spectrum->ncols;
+    int ok;
+
+    temp_name = (char *)malloc( strlen( filename ) + 32 );
+    if (!temp_name) {
+        return 1;
+    }
+    sprintf( temp_name, "%s.%ld.tmp", filename, (long)getpid() );
+
+    file = fopen( temp_name, "wb" );
+    if (!file) {
+        free( temp_name );
+        return 1;
+    }
+
+    ok = fwrite( cache_magic, sizeof( cache_magic ), 1, file ) == 1 &&
+         fwrite( &byte_order_mark, sizeof( byte_order_mark ), 1, file ) == 1 &&
+         write_int( file, spectrum->nrows ) && write_int( file, spectrum->ncols ) &&
+         write_int( file, (int)key->registration ) && write_int( file, (int)key->coord_type ) &&
+         write_int( file, (int)spectrum->dct_mode ) &&
+         fwrite( &key->hash, sizeof( key->hash ), 1, file ) == 1 &&
+         fwrite( &spectrum->data_min, sizeof( float ), 1, file ) == 1 &&
+         fwrite( &spectrum->data_max, sizeof( float ), 1, file ) == 1 &&
+         fwrite( spectrum->coefs, sizeof( float ), count, file ) == count;
+
+    if (fclose( file ) != 0) {
+        ok = 0;
+    }
+
+    if (ok) {
+#if defined(_WIN32)
+        remove( filename ); // rename() fails if another process already created the file
+#endif
+        ok = rename( temp_name, filename ) == 0;
+    }
+    if (!ok) {
+        remove( temp_name );
+    }
+
+    free( temp_name );
+
+    return !ok;
+}
@@ -0,0 +1,70 @@
+/*
+ * spectrum_cache.h
+ *
+ * On-disk cache of forward transforms computed by terrain_spectrum().
+ * Added for tectoplot; distributed under the same terms as the other
+ * files in this directory (see LICENSE.txt).
+ */
+
+#ifndef SPECTRUM_CACHE_H
+#define SPECTRUM_CACHE_H
+
+#include "terrain_filter.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Identifies the input to terrain_spectrum(). Pixel spacing is not part of the key,
+// since the transform does not depend on it (see terrain_pixel_spacing()).
+struct Spectrum_Cache_Key {
+    unsigned long long
+           hash;        // hash of data values, from hash_terrain_data()
+    int    nrows;       // number of rows    in data array
+    int    ncols;       // number of columns in data array
+    enum Terrain_Reg
+           registration;
+    enum Terrain_Coord_Type
+           coord_type;
+    enum Terrain_Dct_Mode
+           dct_mode;
+};
+
+// Returns 64-bit hash of all values in data array.
+unsigned long long hash_terrain_data(
+    const float *data,  // input: array of data to hash (row-major order)
+    int    nrows,       // input: number of rows    in data array
+    int    ncols        // input: number of columns in data array
+);
+
+// Returns name of cache file for given key in cache directory.
+// NOTE: caller is responsible to free the returned pointer!
+char *spectrum_cache_filename(
+    const char *cache_dir,  // directory holding cache files
+    const struct Spectrum_Cache_Key *key
+);
+
+// Reads cached transform, if the file exists and matches key.
+// Returns 0 on success, nonzero if not found or not valid.
+// Sets all fields of spectrum except xres and yres (see terrain_pixel_spacing());
+// free with free_terrain_spectrum().
+int read_spectrum_cache(
+    const char *filename,   // from spectrum_cache_filename()
+    const struct Spectrum_Cache_Key *key,
+    struct Terrain_Spectrum *spectrum
+);
+
+// Writes transform to cache file. The file is written under a temporary name and
+// then renamed, so other processes never read a partial file.
+// Returns 0 on success, nonzero if an error occurred.
+int write_spectrum_cache(
+    const char *filename,   // from spectrum_cache_filename()
+    const struct Spectrum_Cache_Key *key,
+    const struct Terrain_Spectrum *spectrum
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -34,16 +34,21 @@
 
 #include "read_grid_files.h"
 #include "write_grid_files.h"
+#include "read_geotiff.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stddef.h> // for ptrdiff_t
-#include <pthread.h>
+#include <sys/types.h>  // for off_t
+#include <time.h>
 
 #include <math.h>
 #include <assert.h>
 #include "terrain_filter.h"
+#include "void_fill.h"
+#include "horizon_cube.h"
+#include "thread_pool.h"
 
 #define LONG ptrdiff_t
 
@@ -64,21 +69,45 @@ static const char *command_name;
 
 
 // global variables and global pointers to the data arrays
-static int num_threads=4;
+static int num_threads=0;          // 0 = all processors
 static int num_angles=8;
 static int dist_step=5;
 static int dist_cutoff=45;
-
-static pthread_t *threads;
+static int near_dist=0;            // -multiscale: full resolution out to this distance (0 = off)
 
 static float *data;                // allocated upon data load
 static float *pos_open;             // allocated after data load
 static float *neg_open;             // allocated after data load
 static int nrows;                  // set upon data load
 static int ncols;                  // set upon data load
-static int size;                   // number of rows per thread, calculated after data load
-static double xdim;
-static double ydim;
+static double xdim;                // spacing in meters, at the center latitude
+static double ydim;                //     for geographic data
+static double *row_scale;          // geographic data: per row, scale of column steps
+static int first_row;              // row of data that goes in the first row of the outputs
+static double *thread_seconds;     // per thread: time spent on rows
+static long *thread_rows;          // per thread: number of rows done
+
+// Optional products, computed from the same profiles as pos_open and neg_open
+// so the elevations are only walked once however many are asked for:
+enum { PRODUCT_SKYVIEW, PRODUCT_DOMINANCE, PRODUCT_RIDGE, NUM_PRODUCTS };
+
+struct Svf_Product {
+    const char *option;     // command-line option (without the '-')
+    const char *arg;        // output file from the command line, or null if not wanted
+    float *values;          // allocated after data load
+    char *dat_name;
+    char *hdr_name;
+    char *prj_name;
+    FILE *dat_file;
+    FILE *hdr_file;
+};
+
+static struct Svf_Product products[NUM_PRODUCTS] = {
+    { "skyview" }, { "dominance" }, { "ridge" }
+};
+
+static float **cube_angles;        // -cube: per layer and cube azimuth, horizon angles in degrees
+static int want_products;          // nonzero if any of the above are wanted
 
 static const char *get_command_name( const char *argv[] )
 {
@@ -122,23 +151,52 @@ static void usage_exit( const char *message )
     fprintf( stderr, "USAGE:    %s elev_file pos_outfile neg_outfile [-options ...]\n", command_name );
     fprintf( stderr, "\n" );
     fprintf( stderr, "Requires both .flt and .hdr files as input  " );
-    fprintf( stderr, "(e.g., rainier_elev.flt and rainier_elev.hdr).\n" );
+    fprintf( stderr, "(e.g., rainier_elev.flt and rainier_elev.hdr),\n" );
+    fprintf( stderr, "or a Float32 or Int16 GeoTIFF file (e.g., rainier_elev.tif).\n" );
     fprintf( stderr, "Writes _pos.flt, _pos.hdr, _neg.flt, _neg.hdr files as output " );
     fprintf( stderr, "Also reads & writes optional .prj file if present " );
     fprintf( stderr, "Input and output filenames must not be the same.\n" );
     fprintf( stderr, "NOTE: Output files will be overwritten if they already exist.\n" );
+    fprintf( stderr, "Data in lat/lon (geographic) coordinates is used directly, with the\n" );
+    fprintf( stderr, "east-west pixel size in meters worked out for each row.\n" );
     fprintf( stderr, "\n" );
     fprintf( stderr, "Available options:\n" );
     fprintf( stderr, "  -mercator [lat1] [lat2]\n" );
-    fprintf( stderr, "  -cores [integer=%d]   : number of threads for parallel processing\n", num_threads);
+    fprintf( stderr, "  -geographic           : input is in lat/lon (geographic) coordinates, even if its\n" );
+    fprintf( stderr, "                          cells are too large for this to be detected\n" );
+    fprintf( stderr, "  -cores [integer]      : number of threads for parallel processing (default: all processors)\n" );
     fprintf( stderr, "  -angles [integer=%d]  : number of radial profiles at each point\n", num_angles);
     fprintf( stderr, "  -dist [integer=%d]    : length of radial profiles in grid cell units\n", dist_cutoff );
     fprintf( stderr, "  -skip [integer=%d]    : sample only every nth cell along each profile\n", dist_step );
+    fprintf( stderr, "  -multiscale [integer] : sample profiles beyond this many cells from coarser\n" );
+    fprintf( stderr, "                          block maxima (pos) and minima (neg), doubling the step\n" );
+    fprintf( stderr, "                          with each doubling of distance (for long -dist)\n" );
+    fprintf( stderr, "  -fill                 : fill void (NODATA) points smoothly from surrounding data\n" );
+    fprintf( stderr, "  -memory [MB]          : limit memory use; large arrays are processed in tiles of\n" );
+    fprintf( stderr, "                          whole rows (voids are then filled tile by tile)\n" );
+    fprintf( stderr, "  -skyview [file]       : also write the sky-view factor, the mean over the profiles\n" );
+    fprintf( stderr, "                          of cos^2 of the horizon angle (1 = open sky, 0 = none)\n" );
+    fprintf( stderr, "  -dominance [file]     : also write local dominance, the mean angle (degrees) at\n" );
+    fprintf( stderr, "                          which the point is seen from the full resolution samples\n" );
+    fprintf( stderr, "  -ridge [file]         : also write a ridge/valley index, minus the mean of the upper\n" );
+    fprintf( stderr, "                          and lower horizon angles (degrees; > 0 on ridges, < 0 in valleys)\n" );
+    fprintf( stderr, "  -cube [file]          : also write the upper and lower horizon angles of each profile\n" );
+    fprintf( stderr, "                          as a horizon cube (-angles must be even and divide 360)\n" );
+    fprintf( stderr, "  -horizon [cube_file]  : use the horizon angles in a cube made by the horizon tool\n" );
+    fprintf( stderr, "                          with option -lower, instead of tracing profiles\n" );
 
     fprintf( stderr, "\n" );
     exit( EXIT_FAILURE );
 }
 
+static void warn_voids()
+{
+    fprintf( stderr, "*** WARNING: " );
+    fprintf( stderr, "Input .flt file contains void (NODATA) points.\n" );
+    fprintf( stderr, "***          " );
+    fprintf( stderr, "Assuming these are ocean points - setting these elevations to 0.\n" );
+}
+
 static void get_filenames(
     const char *arg, char **data_name, char **hdr_name, char **prj_name, char *ext )
 // NOTE: caller is responsible to free pointers *data_name, *hdr_name, and *prj_name!
@@ -156,9 +214,10 @@ static void get_filenames(
     if (dot++ && !strpbrk( dot, "/\\" ) && strlen( dot ) <= 4) {
         // filename has extension (of up to 4 characters)
         strncpy( ext, dot, strlen( ext ) );
-        if (strcmp( dot, "flt" ) != 0 && strcmp( dot, "FLT" ) != 0)
+        if (strcmp( dot, "flt" ) != 0 && strcmp( dot, "FLT" ) != 0 &&
+            strcmp( dot, "tif" ) != 0 && strcmp( dot, "TIF" ) != 0)
         {
-            usage_exit( "Filenames must have .flt extension (if any)." );
+            usage_exit( "Filenames must have .flt or .tif extension (if any)." );
         }
         strcpy ( *data_name, arg );
         strncpy( *hdr_name, arg, len-3 );
@@ -278,139 +337,909 @@ static double fix_azimuth(double az, double xdim, double ydim )
   return val;
 }
 
-static void *processRow(void *threadId) {
-    int i,j;
-    
-    float z_max=-999999;
+// Returns elapsed (wall clock) time in seconds from an arbitrary starting point.
+static double wall_seconds(void) {
+#if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + 1.0e-9 * (double)ts.tv_nsec;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
 
-    float *ptr;
-    float *ptr2;
-    float *ptr3;
+// Multi-scale mode (-multiscale): beyond near_dist cells, each profile is
+// sampled from coarser levels of a pyramid of block maxima and minima, with
+// the step length doubling as the distance doubles: level 1 (2x2 blocks) out
+// to twice near_dist, level 2 (4x4 blocks) out to four times near_dist, and
+// so on. The highest point of a block stands in for the terrain there when
+// looking for the upper horizon (positive openness), and the lowest point
+// when looking for the lower horizon (negative openness). The number of
+// samples per profile then grows with the log of dist_cutoff instead of
+// linearly.
+
+static int nlevels;             // levels of the pyramid (0 for none)
+static float **max_level;       // per level 1 to nlevels: block maxima
+static float **min_level;       // per level 1 to nlevels: block minima
+static int *level_cols;         // per level 0 to nlevels: number of columns
+
+// one step of a profile beyond near_dist
+struct Far_Step {
+    const float *max_row;   // row of block maxima at the level of this step
+    const float *min_row;   // row of block minima at the level of this step
+    int col_off;            // column offset from the point (full resolution)
+    int level;
+    float inv_dist;         // 1/(distance in meters)
+};
+
+// Computes the block maxima and minima of level l from level l-1 (or the
+// data array) for rows [first,last) of level l.
+static int buildLevelRows(long first, long last, int thread, void *state) {
+    int l = *(const int *)state;
+    const float *fine_max = l == 1 ? data : max_level[l-1];
+    const float *fine_min = l == 1 ? data : min_level[l-1];
+    int fine_rows = l == 1 ? nrows : (nrows + (1<<(l-1)) - 1) >> (l-1);
+    int fine_cols = level_cols[l-1];
+    LONG r0, r1;
+    float *out_max;
+    float *out_min;
+    float m;
+    int i, j, j1;
+
+    for (i=(int)first; i<last; ++i) {
+        r0 = (LONG)(2*i) * (LONG)fine_cols;
+        r1 = 2*i+1 < fine_rows ? r0 + fine_cols : r0;
+        out_max = max_level[l] + (LONG)i * (LONG)level_cols[l];
+        out_min = min_level[l] + (LONG)i * (LONG)level_cols[l];
+        for (j=0; j<level_cols[l]; ++j) {
+            j1 = 2*j+1 < fine_cols ? 2*j+1 : 2*j;
+            m = fine_max[r0+2*j];
+            m = fine_max[r0+j1] > m ? fine_max[r0+j1] : m;
+            m = fine_max[r1+2*j] > m ? fine_max[r1+2*j] : m;
+            m = fine_max[r1+j1] > m ? fine_max[r1+j1] : m;
+            out_max[j] = m;
+            m = fine_min[r0+2*j];
+            m = fine_min[r0+j1] < m ? fine_min[r0+j1] : m;
+            m = fine_min[r1+2*j] < m ? fine_min[r1+2*j] : m;
+            m = fine_min[r1+j1] < m ? fine_min[r1+j1] : m;
+            out_min[j] = m;
+        }
+    }
+    return 0;
+}
 
-    float *ptr_tm;
+// Builds the pyramid, up to blocks covering the whole array.
+// Returns 0 on success, TERRAIN_FILTER_MALLOC_ERROR if a memory allocation error occurred.
+static int buildPyramid(struct Thread_Pool *pool) {
+    LONG size = 0;
+    int levels = 0;
+    int l;
+    int error = 0;
+
+    while ((nrows > (1<<levels) || ncols > (1<<levels)) && levels < 30) {
+        ++levels;
+        size += (LONG)((nrows + (1<<levels) - 1) >> levels) *
+                (LONG)((ncols + (1<<levels) - 1) >> levels);
+    }
+    if (levels == 0) {
+        return 0;
+    }
 
-    double zval;
-    int lit;
-    int xp_int;
-    int yp_int;
+    // all levels share one allocation each, held in max_level[0] and min_level[0]
+    max_level = (float **)calloc(levels+1, sizeof(float *));
+    min_level = (float **)calloc(levels+1, sizeof(float *));
+    level_cols = (int *)malloc((levels+1) * sizeof(int));
+    if (!max_level || !min_level || !level_cols ||
+        !(max_level[0] = (float *)malloc(size * sizeof(float))) ||
+        !(min_level[0] = (float *)malloc(size * sizeof(float))))
+    {
+        return TERRAIN_FILTER_MALLOC_ERROR;
+    }
 
-    double const_deg_m=111132;
+    level_cols[0] = ncols;
+    for (l=1; l<=levels && !error; ++l) {
+        level_cols[l] = (ncols + (1<<l) - 1) >> l;
+        if (l > 1) {
+            size = (LONG)((nrows + (1<<(l-1)) - 1) >> (l-1)) * (LONG)level_cols[l-1];
+            max_level[l] = max_level[l-1] + size;
+            min_level[l] = min_level[l-1] + size;
+        } else {
+            max_level[1] = max_level[0];
+            min_level[1] = min_level[0];
+        }
+        error = thread_pool_run(pool, (nrows + (1<<l) - 1) >> l, 0, buildLevelRows, &l, NULL);
+    }
+    nlevels = levels;
 
-    double xp;
-    double yp;
+    return error;
+}
 
-    double high_angles[num_angles];
-    double low_angles[num_angles];
-    int a;
-    double this_angle;
-    double base_zval;
-    double this_zval;
-    double last_high_el;
-    double last_low_el;
+static void freePyramid(void) {
+    if (max_level) {
+        free(max_level[0]);
+    }
+    if (min_level) {
+        free(min_level[0]);
+    }
+    free(max_level);
+    free(min_level);
+    free(level_cols);
+    max_level = NULL;
+    min_level = NULL;
+    level_cols = NULL;
+    nlevels = 0;
+}
+
+// Profiles are traced with tables made once for each row instead of for each
+// point: for each angle, the row and column offset of each step along the
+// profile, and the inverse of its distance in meters. The steps are the same
+// as stepping x and y by dist_step cells at a time from the point, so the
+// column offsets do not depend on the point, only on its row (through the
+// row scale of geographic data). The steepest and shallowest angles are found
+// by comparing tangents; only the final tangents are turned into sines.
+//
+// Points whose profiles stay inside the array are done SVF_LANES at a time:
+// the samples of adjacent points at the same step are adjacent in memory, so
+// each step is one vector load, subtract, multiply, and max/min.
+
+#if defined(__GNUC__) || defined(__clang__)
+#   define SVF_VECTORS
+#   if defined(__x86_64__) || defined(__i386__)
+#       define SVF_X86
+#   endif
+#endif
+
+#define SVF_LANES 16    // adjacent points per vector
 
-    double this_el;
+static double *ray_x;           // per angle: columns moved per step (before row scale)
+static double *ray_y;           // per angle: rows moved per step
+static double *ray_d;           // per angle: meters per cell along the profile
+static float *ray_inv_dist;     // per angle and step: 1/(distance in meters)
+static int near_cutoff;         // distance traced at full resolution
+static int max_steps;           // full resolution steps in a profile, if it stays inside the array
+static int max_far_steps;       // -multiscale: coarse steps in a profile, at most
+
+// Sets up the ray tables for all angles.
+// Returns 0 on success, TERRAIN_FILTER_MALLOC_ERROR if a memory allocation error occurred.
+static int setupRays(void) {
+    double this_angle;
     double ang_x;
     double ang_y;
-    int d_run;
-    double low_sum;
-    double high_sum;
-    double x;
-    double y;
-    int x_int;
-    int y_int;
-    int high_angle_count;
-    int low_angle_count;
     double ang_d;
+    int a;
+    int k;
+
+    LONG d;
+    int l;
+
+    near_cutoff = near_dist > 0 && near_dist < dist_cutoff ? near_dist : dist_cutoff;
+    max_steps = near_cutoff/dist_step + 1;
+
+    // coarse steps, counted as if starting right at near_dist (see farSteps())
+    max_far_steps = 0;
+    if (near_cutoff < dist_cutoff && nlevels > 0) {
+        d = near_dist;
+        l = 1;
+        while (d <= dist_cutoff) {
+            while (l < nlevels && d >= ((LONG)near_dist << l)) {
+                l++;
+            }
+            d += (LONG)dist_step << l;
+            max_far_steps++;
+        }
+    }
 
-    int start = (int)threadId*(int)size;
-    int end = (int)(threadId+1)*(int)size;    
+    ray_x = (double *)malloc(num_angles * sizeof(double));
+    ray_y = (double *)malloc(num_angles * sizeof(double));
+    ray_d = (double *)malloc(num_angles * sizeof(double));
+    ray_inv_dist = (float *)malloc((LONG)num_angles * max_steps * sizeof(float));
+    if (!ray_x || !ray_y || !ray_d || !ray_inv_dist) {
+        return TERRAIN_FILTER_MALLOC_ERROR;
+    }
 
-    if (end > nrows) {
-        end=nrows;
+    for(a=0;a<num_angles;a++) {
+        this_angle=deg2rad(fix_azimuth(a*360/num_angles, xdim, ydim)); // Fix azimuth
+        ang_x=sin(this_angle);
+        ang_y=cos(this_angle);
+        // profiles along the axes stay on their row or column: otherwise the
+        // rounding error of sin and cos, summed step by step, can put a
+        // profile on the row above near some rows (and not others, so that
+        // the result would depend on the tile a row is in)
+        if (fabs(ang_x) < 1e-12) {
+            ang_x=0;
+        }
+        if (fabs(ang_y) < 1e-12) {
+            ang_y=0;
+        }
+        ang_d=sqrt(xdim*xdim*ang_x*ang_x+ydim*ydim*ang_y*ang_y);
+        ray_x[a]=dist_step*ang_x;
+        ray_y[a]=dist_step*ang_y;
+        ray_d[a]=ang_d;
+        for(k=0;k<max_steps;k++) {
+            ray_inv_dist[a*max_steps+k]=(float)(1.0/((k+1)*dist_step*ang_d));
+        }
     }
+    return 0;
+}
 
-    for (i=start; i<end; ++i) {
-        // this is the pointer to the data array (ptr) and the output data array (ptr2)
-        ptr = data + (LONG)i * (LONG)ncols;
-        ptr2 = pos_open + (LONG)i * (LONG)ncols;
-        ptr3 = neg_open + (LONG)i * (LONG)ncols;
+static void freeRays(void) {
+    free(ray_x);
+    free(ray_y);
+    free(ray_d);
+    free(ray_inv_dist);
+    ray_x = NULL;
+    ray_y = NULL;
+    ray_d = NULL;
+    ray_inv_dist = NULL;
+}
 
-        // Required info is: ncols, num_angles, xdim, ydim, ptr (data), ptr2 (out), dist_cutoff
-        // Declare new variables ptr3, high
+#ifdef SVF_VECTORS
 
-        for(j=0;j<ncols;j++) {
-            for(a=0;a<num_angles;a++) {
-                this_angle=deg2rad(fix_azimuth(a*360/num_angles, xdim, ydim)); // Fix azimuth
-                x=j;
-                y=i;
-                base_zval=ptr[j];
-                last_low_el=deg2rad(90);
-                last_high_el=deg2rad(-90);
-                x_int=x;
-                y_int=y;
-                d_run=0;
-                ang_x=sin(this_angle);
-                ang_y=cos(this_angle);
-                ang_d=sqrt(xdim*xdim*ang_x*ang_x+ydim*ydim*ang_y*ang_y);
-
-                while(x_int > 0 && x_int < ncols && y_int > 0 && y_int < nrows && d_run <= dist_cutoff) {
-                    d_run += dist_step;
-                    x=x+dist_step*ang_x;
-                    y=y+dist_step*ang_y;
-                    x_int=(int) x;
-                    y_int=(int) y;
-                    if (x_int < 0 || y_int < 0 || x_int >= ncols | y_int >= nrows) {
+typedef float Vec16f __attribute__(( vector_size(64) ));
+typedef int   Vec16i __attribute__(( vector_size(64) ));
+
+// Replaces each lane of x by its arctangent, as pi/4 + atan((|x|-1)/(|x|+1))
+// with the polynomial of Abramowitz and Stegun 4.4.49 (error about 1e-7).
+// There are no selects, which the compiler would otherwise do lane by lane.
+// Passed by pointer, as the vector type is wider than the default instruction set.
+static inline __attribute__(( always_inline )) void atanLanes(Vec16f *x)
+{
+    const Vec16i sign=(Vec16i){0}+(int)0x80000000;
+    Vec16f a, r, z;
+    Vec16i s;
+
+    s=(Vec16i)*x & sign;
+    a=(Vec16f)((Vec16i)*x ^ s);
+    r=(a-1.0f)/(a+1.0f);
+    z=r*r;
+    a=(((((((2.8662257e-3f*z-1.61657367e-2f)*z+4.29096138e-2f)*z-7.52896400e-2f)*z
+           +1.065626393e-1f)*z-1.420889944e-1f)*z+1.999355085e-1f)*z-3.333314528e-1f)*z*r+r
+      +0.7853981633974483f;
+    *x=(Vec16f)((Vec16i)a ^ s);
+}
+
+// Finds the largest and smallest tangent along one profile of SVF_LANES
+// adjacent points, starting at center (column j); offset[k] is the offset in
+// data of step k. Then goes on with the coarse steps in far, as long as all
+// of the points are inside the array; returns the number of coarse steps done.
+// If rise is not null, also sums into it the angles (radians) at which the
+// points are seen from their full resolution steps.
+static inline __attribute__(( always_inline )) int profileLanesBody(
+    const float *center, const LONG *offset, const float *inv_dist, int nsteps,
+    int j, const struct Far_Step *far, int nfar, float *high, float *low, float *rise)
+{
+    Vec16f z0, z, t, hi, lo, sum;
+    Vec16i m;
+    int k, l, c;
+
+    memcpy(&z0, center, sizeof(z0));
+    for(k=0;k<SVF_LANES;k++) {
+        hi[k]=-HUGE_VALF;
+        lo[k]=HUGE_VALF;
+        sum[k]=0;
+    }
+    if (rise) {
+        // a separate pass, so that the usual profiles don't pay for it
+        for(k=0;k<nsteps;k++) {
+            memcpy(&z, center+offset[k], sizeof(z));
+            t=(z0-z)*inv_dist[k];
+            atanLanes(&t);
+            sum+=t;
+        }
+        memcpy(rise, &sum, sizeof(sum));
+    }
+    for(k=0;k<nsteps;k++) {
+        memcpy(&z, center+offset[k], sizeof(z));
+        t=(z-z0)*inv_dist[k];
+        // void points (NaN) compare false, so they are skipped
+        m=t>hi;
+        hi=(Vec16f)(((Vec16i)t & m) | ((Vec16i)hi & ~m));
+        m=t<lo;
+        lo=(Vec16f)(((Vec16i)t & m) | ((Vec16i)lo & ~m));
+    }
+    for(k=0;k<nfar;k++) {
+        c=j+far[k].col_off;
+        if (c < 0 || c+SVF_LANES > ncols) {
+            break;
+        }
+        for(l=0;l<SVF_LANES;l++) {
+            z[l]=far[k].max_row[(c+l)>>far[k].level];
+        }
+        t=(z-z0)*far[k].inv_dist;
+        m=t>hi;
+        hi=(Vec16f)(((Vec16i)t & m) | ((Vec16i)hi & ~m));
+        for(l=0;l<SVF_LANES;l++) {
+            z[l]=far[k].min_row[(c+l)>>far[k].level];
+        }
+        t=(z-z0)*far[k].inv_dist;
+        m=t<lo;
+        lo=(Vec16f)(((Vec16i)t & m) | ((Vec16i)lo & ~m));
+    }
+    memcpy(high, &hi, sizeof(hi));
+    memcpy(low, &lo, sizeof(lo));
+    return k;
+}
+
+static int profileLanesV16(const float *center, const LONG *offset, const float *inv_dist,
+                           int nsteps, int j, const struct Far_Step *far, int nfar,
+                           float *high, float *low, float *rise) {
+    return profileLanesBody(center, offset, inv_dist, nsteps, j, far, nfar, high, low, rise);
+}
+
+#ifdef SVF_X86
+
+static __attribute__(( target("avx2") )) int profileLanesAvx2(
+    const float *center, const LONG *offset, const float *inv_dist, int nsteps,
+    int j, const struct Far_Step *far, int nfar, float *high, float *low, float *rise)
+{
+    return profileLanesBody(center, offset, inv_dist, nsteps, j, far, nfar, high, low, rise);
+}
+
+static __attribute__(( target("avx512f") )) int profileLanesAvx512(
+    const float *center, const LONG *offset, const float *inv_dist, int nsteps,
+    int j, const struct Far_Step *far, int nfar, float *high, float *low, float *rise)
+{
+    return profileLanesBody(center, offset, inv_dist, nsteps, j, far, nfar, high, low, rise);
+}
+
+#endif
+#endif
+
+// vector kernel for this processor, or null to do every point one at a time
+static int (*profileLanes)(const float *center, const LONG *offset, const float *inv_dist,
+                           int nsteps, int j, const struct Far_Step *far, int nfar,
+                           float *high, float *low, float *rise);
+
+// Selects the widest instruction set supported by this processor.
+static const char *selectProfileLanes(void) {
+#if defined(SVF_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        profileLanes=profileLanesAvx512;
+        return "AVX-512";
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        profileLanes=profileLanesAvx2;
+        return "AVX2";
+    }
+    profileLanes=profileLanesV16;
+    return "SSE2";
+#elif defined(SVF_VECTORS)
+    profileLanes=profileLanesV16;
+    return "vector";
+#else
+    profileLanes=NULL;
+    return "scalar";
+#endif
+}
+
+// Adds the sine of the angle with tangent t to a sum, leaving out very steep
+// angles in case we have elevation outliers (such as -9999 NaNs), and the
+// infinite tangents of profiles with no samples.
+static void addAngle(double *sum, int *count, float t) {
+    const double max_tan=2.7474774194546221;    // tan(70 degrees)
+
+    if (t > -max_tan && t < max_tan) {
+        *sum+=t/sqrt(1.0+(double)t*t);
+        ++*count;
+    }
+}
+
+// Sums over the profiles of one point, for the optional products
+struct Product_Sums {
+    double sky_sum;     // -skyview: cos^2 of the upper horizon angles
+    int sky_count;
+    double rise_sum;    // -dominance: angles (radians) from the full resolution samples
+    int rise_count;
+    double ridge_sum;   // -ridge: means of the upper and lower horizon angles (degrees)
+    int ridge_count;
+};
+
+// Adds profile a of the point at offset idx to its product sums: hi and lo are
+// the largest and smallest tangents along the profile, and rise is the sum of
+// the angles at which the point is seen from its nrise full resolution samples
+// (looking down at minus their tangents). Also stores the horizon
+// angles of the profile in the cube, if any.
+static void addProducts(struct Product_Sums *p, LONG idx, int a, float hi, float lo, float rise, int nrise) {
+    int b;
+
+    if (products[PRODUCT_SKYVIEW].values && hi > -HUGE_VALF) {
+        // terrain below the horizontal hides none of the sky
+        p->sky_sum+=hi > 0 ? 1.0/(1.0+(double)hi*hi) : 1.0;
+        p->sky_count++;
+    }
+    if (products[PRODUCT_DOMINANCE].values) {
+        p->rise_sum+=rise;
+        p->rise_count+=nrise;
+    }
+    if (products[PRODUCT_RIDGE].values && hi > -HUGE_VALF) {
+        p->ridge_sum+=0.5*rad2deg(atan(hi)+atan(lo));
+        p->ridge_count++;
+    }
+    if (cube_angles) {
+        // profile a looks toward azimuth 180 - a*360/num_angles
+        b=(num_angles/2-a+num_angles)%num_angles;
+        cube_angles[b][idx]=hi > -HUGE_VALF ? (float)rad2deg(atan(hi)) : HORIZON_NONE;
+        cube_angles[num_angles+b][idx]=lo < HUGE_VALF ? (float)rad2deg(atan(lo)) : HORIZON_NONE;
+    }
+}
+
+// Continues profile a from where the full resolution steps ended (column
+// offset x, row y, distance d_run) with coarse steps out to dist_cutoff, the
+// step doubling with each level. Returns the number of steps put in far.
+static int farSteps(int a, double x, double y, int d_run, struct Far_Step *far) {
+    int y_int = (int) y;
+    int l = 1;
+    int n = 0;
+
+    while (d_run <= dist_cutoff && n < max_far_steps) {
+        while (l < nlevels && d_run >= ((LONG)near_dist << l)) {
+            l++;
+        }
+        d_run += dist_step << l;
+        x=x+ray_x[a]*(1<<l)*(row_scale ? row_scale[y_int] : 1);
+        y=y+ray_y[a]*(1<<l);
+        if (y < 0 || y >= nrows) {
+            break;
+        }
+        y_int=(int) y;
+        far[n].max_row=max_level[l] + (LONG)(y_int>>l) * (LONG)level_cols[l];
+        far[n].min_row=min_level[l] + (LONG)(y_int>>l) * (LONG)level_cols[l];
+        far[n].col_off=(int)floor(x);
+        far[n].level=l;
+        far[n].inv_dist=(float)(1.0/(d_run*ray_d[a]));
+        n++;
+    }
+    return n;
+}
+
+// Updates the largest and smallest tangents of the profile of the point in
+// column j (elevation z0) with the coarse steps of the profile.
+static void farProfile(const struct Far_Step *far, int nfar, int j, float z0, float *hi, float *lo) {
+    int col;
+    int c;
+    int k;
+    float t;
+
+    for(k=0;k<nfar;k++) {
+        col=j+far[k].col_off;
+        if (col < 0 || col >= ncols) {
+            break;
+        }
+        c=col>>far[k].level;
+        t=(far[k].max_row[c]-z0)*far[k].inv_dist;
+        if (t > *hi) {
+            *hi=t;
+        }
+        t=(far[k].min_row[c]-z0)*far[k].inv_dist;
+        if (t < *lo) {
+            *lo=t;
+        }
+    }
+}
+
+// Computes pos_open and neg_open, and any products, for rows [first,last) of
+// the outputs (rows first_row+first to first_row+last of data). Run by the
+// thread pool, which hands out small chunks of rows on demand: rows near the
+// edges of the map end their profiles early, so a fixed split would leave
+// threads idle.
+static int processRows(long first, long last, int thread, void *state) {
+    int r,i,j,k,a,l;
+
+    float *ptr;
+    float *ptr2;
+    float *ptr3;
+    float *out;
+
+    LONG *row_start;    // per angle and step: offset in data of the row
+    LONG *offset;       // per angle and step: offset from the point
+    int *col_off;       // per angle and step: column offset from the point
+    int *col_frac;      // per angle and step: nonzero if column position is not whole
+    int *nsteps;        // per angle: number of steps before leaving the rows
+    struct Far_Step *far;   // -multiscale: per angle, coarse steps
+    int *nfar;          // -multiscale: per angle, number of coarse steps
+    double *high_sum;
+    double *low_sum;
+    int *high_count;
+    int *low_count;
+    struct Product_Sums *sums;  // per column, if any products are wanted
+    float high[SVF_LANES];
+    float low[SVF_LANES];
+    float rises[SVF_LANES] = { 0 };  // stays zero unless -dominance
+
+    double x;
+    double y;
+    int y_int;
+    int d_run;
+    int col;
+    int min_off;
+    int max_off;
+    int j_lo;
+    int j_hi;
+    float z0;
+    float t;
+    float hi;
+    float lo;
+    float rise;
+    int nrise;
+    LONG idx;
+    const LONG *a_start;
+    const LONG *a_off;
+    const int *a_col;
+    const int *a_frac;
+    const float *a_inv;
+    const struct Far_Step *a_far;
+
+    double start_time = wall_seconds();
+
+    row_start = (LONG *)malloc((LONG)num_angles * max_steps * sizeof(LONG));
+    offset = (LONG *)malloc((LONG)num_angles * max_steps * sizeof(LONG));
+    col_off = (int *)malloc((LONG)num_angles * max_steps * sizeof(int));
+    col_frac = (int *)malloc((LONG)num_angles * max_steps * sizeof(int));
+    nsteps = (int *)malloc(num_angles * sizeof(int));
+    high_sum = (double *)malloc(ncols * sizeof(double));
+    low_sum = (double *)malloc(ncols * sizeof(double));
+    high_count = (int *)malloc(ncols * sizeof(int));
+    low_count = (int *)malloc(ncols * sizeof(int));
+    sums = (struct Product_Sums *)malloc(ncols * sizeof(struct Product_Sums));
+    far = (struct Far_Step *)malloc(((LONG)num_angles * max_far_steps + 1) * sizeof(struct Far_Step));
+    nfar = (int *)malloc(num_angles * sizeof(int));
+    if (!row_start || !offset || !col_off || !col_frac || !nsteps ||
+        !high_sum || !low_sum || !high_count || !low_count || !sums || !far || !nfar) {
+        free(row_start); free(offset); free(col_off); free(col_frac); free(nsteps);
+        free(high_sum); free(low_sum); free(high_count); free(low_count);
+        free(sums); free(far); free(nfar);
+        return TERRAIN_FILTER_MALLOC_ERROR;
+    }
+
+    for (r=(int)first; r<(int)last; ++r) {
+        // this is the pointer to the data array (ptr) and the output data arrays (ptr2, ptr3)
+        i = first_row + r;
+        ptr = data + (LONG)i * (LONG)ncols;
+        ptr2 = pos_open + (LONG)r * (LONG)ncols;
+        ptr3 = neg_open + (LONG)r * (LONG)ncols;
+
+        // step each profile through the rows; a profile stops after a step
+        // onto the first row or out of the array, or past dist_cutoff (or
+        // near_dist, from where it goes on with coarse steps)
+        for(a=0;a<num_angles;a++) {
+            x=0;
+            y=i;
+            y_int=i;
+            d_run=0;
+            k=0;
+            while(y_int > 0 && y_int < nrows && d_run <= near_cutoff) {
+                d_run += dist_step;
+                x=x+ray_x[a]*(row_scale ? row_scale[y_int] : 1);
+                y=y+ray_y[a];
+                y_int=(int) y;
+                if (y_int < 0 || y_int >= nrows) {
                     break;
-                    }
-                    ptr_tm = data + (LONG)y_int * (LONG)ncols;
+                }
+                row_start[a*max_steps+k]=(LONG)y_int * (LONG)ncols;
+                col_off[a*max_steps+k]=(int)floor(x);
+                col_frac[a*max_steps+k]=floor(x) != x;
+                offset[a*max_steps+k]=(LONG)(y_int-i) * (LONG)ncols + col_off[a*max_steps+k];
+                k++;
+            }
+            nsteps[a]=k;
+            nfar[a]=0;
+            if (max_far_steps > 0 && y_int > 0 && y_int < nrows && d_run > near_cutoff) {
+                nfar[a]=farSteps(a, x, y, d_run, far+a*max_far_steps);
+            }
+        }
 
-                    this_zval=ptr_tm[x_int];
+        for(j=0;j<ncols;j++) {
+            high_sum[j]=0;
+            low_sum[j]=0;
+            high_count[j]=0;
+            low_count[j]=0;
+        }
+        if (want_products) {
+            memset(sums, 0, ncols * sizeof(struct Product_Sums));
+        }
+        idx=(LONG)r * (LONG)ncols;
+
+        for(a=0;a<num_angles;a++) {
+            a_start=row_start+a*max_steps;
+            a_off=offset+a*max_steps;
+            a_col=col_off+a*max_steps;
+            a_frac=col_frac+a*max_steps;
+            a_inv=ray_inv_dist+a*max_steps;
+            a_far=far+a*max_far_steps;
+
+            // points whose profiles stay within columns 1 to ncols-1
+            min_off=0;
+            max_off=0;
+            for(k=0;k<nsteps[a];k++) {
+                if (a_col[k] < min_off) {
+                    min_off=a_col[k];
+                }
+                if (a_col[k] > max_off) {
+                    max_off=a_col[k];
+                }
+            }
+            j_lo=1-min_off;
+            j_hi=ncols-1-max_off;
+
+            j=0;
+            while(j<ncols) {
+                if (profileLanes && j >= j_lo && j+SVF_LANES-1 <= j_hi) {
+                    k=profileLanes(ptr+j, a_off, a_inv, nsteps[a], j, a_far, nfar[a], high, low,
+                                   products[PRODUCT_DOMINANCE].values ? rises : NULL);
+                    for(l=0;l<SVF_LANES;l++) {
+                        // coarse steps where some of the points leave the array
+                        if (k < nfar[a]) {
+                            farProfile(a_far+k, nfar[a]-k, j+l, ptr[j+l], &high[l], &low[l]);
+                        }
+                        addAngle(&high_sum[j+l], &high_count[j+l], high[l]);
+                        addAngle(&low_sum[j+l], &low_count[j+l], low[l]);
+                        if (want_products) {
+                            addProducts(&sums[j+l], idx+j+l, a, high[l], low[l], rises[l], nsteps[a]);
+                        }
+                    }
+                    j+=SVF_LANES;
+                    continue;
+                }
 
-                    this_el=atan((this_zval-base_zval)/(d_run*ang_d));
-                    if (this_el > last_high_el) {
-                        last_high_el = this_el;
+                // a profile stops after a step onto the first column or out
+                // of the array; positions less than a cell left of column 0
+                // round to it
+                z0=ptr[j];
+                hi=-HUGE_VALF;
+                lo=HUGE_VALF;
+                rise=0;
+                nrise=0;
+                for(k=0;k<nsteps[a] && j>0;k++) {
+                    col=j+a_col[k];
+                    if (col == -1 && a_frac[k]) {
+                        col=0;
+                    }
+                    if (col < 0 || col >= ncols) {
+                        break;
+                    }
+                    t=(data[a_start[k]+col]-z0)*a_inv[k];
+                    if (t > hi) {
+                        hi=t;
+                    }
+                    if (t < lo) {
+                        lo=t;
+                    }
+                    if (products[PRODUCT_DOMINANCE].values) {
+                        rise+=atan(-t);
                     }
-                    if (this_el < last_low_el) {
-                        last_low_el = this_el;
+                    nrise++;
+                    if (col == 0) {
+                        break;
                     }
                 }
-                high_angles[a]=last_high_el;
-                low_angles[a]=last_low_el;
+                if (nfar[a] && j > 0 && k == nsteps[a]) {
+                    farProfile(a_far, nfar[a], j, z0, &hi, &lo);
+                }
+                addAngle(&high_sum[j], &high_count[j], hi);
+                addAngle(&low_sum[j], &low_count[j], lo);
+                if (want_products) {
+                    addProducts(&sums[j], idx+j, a, hi, lo, rise, nrise);
+                }
+                j++;
             }
+        }
 
-            high_sum=0;
-            low_sum=0;
-            high_angle_count=0;
-            low_angle_count=0;
-            // Avoid very steep estimates in case we have elevation outliers (such as -9999 NaNs)
-            for(int k=0;k<num_angles;k++) {
-            if (high_angles[k] > deg2rad(-70) && high_angles[k] < deg2rad(70)) {
-                high_angle_count++;
-                high_sum=high_sum+sin(high_angles[k]);
+        for(j=0;j<ncols;j++) {
+            ptr2[j]=((high_sum[j])/high_count[j]);
+            ptr3[j]=((low_sum[j])/low_count[j]);
+        }
+        if (products[PRODUCT_SKYVIEW].values) {
+            out=products[PRODUCT_SKYVIEW].values+idx;
+            for(j=0;j<ncols;j++) {
+                out[j]=sums[j].sky_sum/sums[j].sky_count;
             }
-            if (low_angles[k] < deg2rad(70) && low_angles[k] > deg2rad(-70)) {
-                low_angle_count++;
-                low_sum=low_sum+sin(low_angles[k]);
+        }
+        if (products[PRODUCT_DOMINANCE].values) {
+            out=products[PRODUCT_DOMINANCE].values+idx;
+            for(j=0;j<ncols;j++) {
+                out[j]=rad2deg(sums[j].rise_sum/sums[j].rise_count);
             }
+        }
+        if (products[PRODUCT_RIDGE].values) {
+            out=products[PRODUCT_RIDGE].values+idx;
+            for(j=0;j<ncols;j++) {
+                out[j]=-sums[j].ridge_sum/sums[j].ridge_count;
             }
-            ptr2[j]=((high_sum)/high_angle_count);
-            ptr3[j]=((low_sum)/low_angle_count);
+        }
+    }
+
+    free(row_start); free(offset); free(col_off); free(col_frac); free(nsteps);
+    free(high_sum); free(low_sum); free(high_count); free(low_count);
+    free(sums); free(far); free(nfar);
+
+    thread_seconds[thread] += wall_seconds() - start_time;
+    thread_rows[thread] += last - first;
+
+    return 0;
+}
 
+// Computes pos_open and neg_open from the upper and lower horizons of a horizon
+// cube (option -horizon) instead of tracing radial profiles: the mean sine of
+// the horizon angles over the azimuths of the cube, leaving out angles steeper
+// than 70 degrees (and points with no horizon) as in processRow().
+// Returns 0 on success, TERRAIN_FILTER_MALLOC_ERROR if a memory allocation
+// error occurred, or 2 if the cube file could not be read.
+static int horizon_openness(FILE *cube, const struct Horizon_Cube_Info *info) {
+    LONG count = (LONG)nrows * (LONG)ncols;
+    LONG k;
+    float *angles;
+    float *sum;
+    unsigned short *nsum;
+    int layer;
+    int a;
+    int error = 0;
+
+    angles = (float *)malloc(count * sizeof(float));
+    nsum = (unsigned short *)malloc(count * sizeof(unsigned short));
+    if (!angles || !nsum) {
+        free(angles);
+        free(nsum);
+        return TERRAIN_FILTER_MALLOC_ERROR;
+    }
+
+    for (layer=HORIZON_UPPER; layer<=HORIZON_LOWER && !error; ++layer) {
+        sum = layer == HORIZON_UPPER ? pos_open : neg_open;
+        for (k=0; k<count; ++k) {
+            sum[k]=0;
+            nsum[k]=0;
+        }
+        for (a=0; a<info->nazimuths && !error; ++a) {
+            error = read_horizon_slice(cube, info, layer, a, angles);
+            for (k=0; k<count && !error; ++k) {
+                if (angles[k] > -70 && angles[k] < 70) {
+                    sum[k]+=sin(deg2rad(angles[k]));
+                    nsum[k]++;
+                }
+            }
+        }
+        for (k=0; k<count; ++k) {
+            sum[k]=sum[k]/nsum[k];
         }
     }
 
-    pthread_exit(NULL);
+    free(angles);
+    free(nsum);
+    return error;
 }
 
+// Tiled mode (-memory): when the arrays do not fit in the memory budget, the
+// data is read in tiles of whole rows, each with a halo of rows above and
+// below so that the profiles of its own rows never reach the edge of the tile
+// except at the edge of the array. The rows of each tile are shared among the
+// threads as usual, and the results are written straight to the output files
+// at the rows of the tile. With -multiscale, the tiles (with their halos) also
+// start and end on blocks of the coarsest level a profile can reach, so the
+// pyramid of each tile has the same blocks as the pyramid of the whole array;
+// the results are then the same as without tiles.
+
+// Smallest number of rows of a tile (not counting its halos) that makes sense.
+static const int min_tile_rows = 16;
+
+// Returns the number of rows of halo a tile needs on each side, and sets align
+// to the number of rows the tiles with their halos must start and end on.
+static int tileHalo(int *align) {
+    LONG last_step = dist_step;     // longest step of a profile
+    int l = 0;
+
+    if (near_dist > 0 && near_dist < dist_cutoff) {
+        while (((LONG)near_dist << l) <= dist_cutoff && l < 30) {
+            ++l;
+        }
+        last_step = (LONG)dist_step << l;
+    }
+    *align = 1 << l;
+    return (int)(dist_cutoff + last_step + 2);
+}
 
-static void rowManager() {
-    int i;
-    for(i=0; i<num_threads; ++i) {
-        if (pthread_create(&threads[i], NULL, processRow, (void *)i)) {
-            printf("ERROR; return code from pthread_create()\n");
-            exit(-1);
+// Writes rows [row,row+count) of an output file from values.
+static void writeRows(FILE *file, int row, int count, const float *values) {
+    LONG offset = (LONG)row * (LONG)ncols * (LONG)sizeof(float);
+    int error;
+
+#if defined(_WIN32)
+    error = _fseeki64(file, offset, SEEK_SET);
+#else
+    error = fseeko(file, (off_t)offset, SEEK_SET);
+#endif
+
+    if (error || (LONG)fwrite(values, sizeof(float), (LONG)count * ncols, file) < (LONG)count * ncols) {
+        prefix_error();
+        fprintf(stderr, "Write error occurred on output .flt file.\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Processes the data of in_file (described by info) in tiles of tile_rows rows
+// plus halos, and writes pos_open, neg_open and any products to their files;
+// pos_open, neg_open and the products must hold tile_rows rows. row_scale (if
+// any) is for the whole array. Voids are filled from the data of each tile,
+// including its halo, if fill is nonzero.
+// Returns 0 on success, TERRAIN_FILTER_MALLOC_ERROR if a memory allocation
+// error occurred.
+static int processTiles(FILE *in_file, const struct Flt_Hdr_Info *info, struct Thread_Pool *pool,
+                        int tile_rows, int fill, FILE *pos_file, FILE *neg_file,
+                        int *has_nulls, int *all_ints) {
+    int total_rows = nrows;
+    double *all_row_scale = row_scale;
+    float *tile;
+    int halo, align;
+    int r0, r1;     // own rows of the tile
+    int b0, b1;     // rows of the tile with its halos
+    int tile_nulls, tile_ints;
+    int ntiles, t, k;
+    long nfilled;
+    int error = 0;
+
+    halo = tileHalo(&align);
+    ntiles = (total_rows + tile_rows - 1) / tile_rows;
+
+    tile = (float *)malloc((LONG)(tile_rows + 2*halo + 2*align) * (LONG)ncols * sizeof(float));
+    if (!tile) {
+        return TERRAIN_FILTER_MALLOC_ERROR;
+    }
+
+    *has_nulls = 0;
+    *all_ints = 1;
+
+    for (t=0; t<ntiles && !error; ++t) {
+        r0 = t * tile_rows;
+        r1 = r0 + tile_rows < total_rows ? r0 + tile_rows : total_rows;
+        b0 = r0 - halo > 0 ? (r0 - halo) / align * align : 0;
+        b1 = r1 + halo < total_rows ? (r1 + halo + align - 1) / align * align : total_rows;
+        b1 = b1 < total_rows ? b1 : total_rows;
+
+        printf("Processing tile %d of %d (rows %d to %d)...\n", t+1, ntiles, r0, r1-1);
+        fflush(stdout);
+
+        read_flt_block(in_file, info, b0, 0, b1-b0, ncols, tile, &tile_nulls, &tile_ints);
+        *has_nulls = *has_nulls || tile_nulls;
+        *all_ints = *all_ints && tile_ints;
+
+        if (fill && tile_nulls) {
+            // each tile is filled from its own data, including its halo
+            error = fill_voids(tile, b1-b0, ncols, info->nodata, &nfilled);
+            if (error == FILL_VOIDS_MALLOC_ERROR) {
+                break;
+            }
+            error = 0;
+        }
+
+        data = tile;
+        nrows = b1 - b0;
+        row_scale = all_row_scale ? all_row_scale + b0 : NULL;
+        first_row = r0 - b0;
+
+        error = (near_dist > 0 && buildPyramid(pool)) || setupRays();
+        if (!error) {
+            error = thread_pool_run(pool, r1-r0, 0, processRows, NULL, NULL);
+        }
+        freeRays();
+        freePyramid();
+
+        if (!error) {
+            writeRows(pos_file, r0, r1-r0, pos_open);
+            writeRows(neg_file, r0, r1-r0, neg_open);
+            for (k=0; k<NUM_PRODUCTS; ++k) {
+                if (products[k].values) {
+                    writeRows(products[k].dat_file, r0, r1-r0, products[k].values);
+                }
+            }
         }
     }
+
+    free(tile);
+    data = NULL;
+    nrows = total_rows;
+    row_scale = all_row_scale;
+    first_row = 0;
+
+    return error ? TERRAIN_FILTER_MALLOC_ERROR : 0;
 }
 
 #ifndef NOMAIN
@@ -464,14 +1293,38 @@ int main( int argc, const char *argv[] )
     int proj_type;
     int has_nulls;
     int all_ints;
-
+    int tif_input;
+
+    int fill = 0;       // default unless -fill option used
+    const char *horizon_name = NULL;    // default unless -horizon option used
+    FILE *horizon_file = NULL;
+    struct Horizon_Cube_Info horizon_info;
+    const char *cube_name = NULL;       // default unless -cube option used
+    FILE *cube_file = NULL;
+    struct Horizon_Cube_Info cube_info;
+    struct Svf_Product *product;
+    struct Flt_Hdr_Info info;
+    struct Flt_Map data_map = { NULL, 0 };
+    long nfilled;
+
+    int geographic = 0; // default unless -geographic option used
     double lat1 = 0.0;  // default unless -merc option used
     double lat2 = 0.0;  // default unless -merc option used
     double center_lat;
     double temp;
     // float *ptr;
 
-    int error;
+    double memory_mb = 0.0; // default unless -memory option used (0 = no limit)
+    double max_pixels = 0.0;
+    double halo_factor = 1.0;
+    int tiled = 0;
+    int tile_rows = 0;
+    int halo = 0;
+    int align = 1;
+
+    struct Thread_Pool *pool;
+    double run_time;
+    int error = 0;
 
     printf( "\nSky view factor program - version %s, built %s\n", sw_version, sw_date );
 
@@ -507,13 +1360,19 @@ int main( int argc, const char *argv[] )
 
     strncpy( extension, "flt", 4 );
     get_filenames( argv[argnum++], &in_dat_name, &in_hdr_name, &in_prj_name, extension );
+    tif_input = is_geotiff_name( in_dat_name );
 
     strncpy( extension, "flt", 4 );
     get_filenames( argv[argnum++], &out_dat_name, &out_hdr_name, &out_prj_name, extension );
-
+    if (is_geotiff_name( out_dat_name )) {
+        usage_exit( "Output filenames must have .flt extension (if any)." );
+    }
 
     strncpy( extension, "flt", 4 );
     get_filenames( argv[argnum++], &out_dat_name_2, &out_hdr_name_2, &out_prj_name_2, extension );
+    if (is_geotiff_name( out_dat_name_2 )) {
+        usage_exit( "Output filenames must have .flt extension (if any)." );
+    }
 
     if (!strcmp( in_hdr_name, out_hdr_name )) {
         usage_exit( "Input and outfile filenames must not be the same." );
@@ -528,7 +1387,9 @@ int main( int argc, const char *argv[] )
         }
         // This makes no sense, incrementing a string? Oh, it chops off the first -
         ++thisarg;
-        if (strncmp( thisarg, "mercator", 4 ) == 0 || strncmp( thisarg, "Mercator", 4 ) == 0) {
+        if (strncmp( thisarg, "geographic", 3 ) == 0) {
+            geographic = 1;
+        } else if (strncmp( thisarg, "mercator", 4 ) == 0 || strncmp( thisarg, "Mercator", 4 ) == 0) {
             if (argnum+1 >= argc) {
                 usage_exit( "Option -mercator must be followed by two numeric latitude values." );
             }
@@ -555,36 +1416,83 @@ int main( int argc, const char *argv[] )
             }
         } else if (strncmp( thisarg, "angles", 6) == 0) 
         {
-            // read decimal number
-            if (argnum+1 >= argc) {
+            if (argnum >= argc) {
                 usage_exit( "Option -angles must be followed by one integer value." );
             }
             thisarg = argv[argnum++];
-            num_angles = strtod( thisarg, &endptr );
+            num_angles = (int)strtol( thisarg, &endptr, 10 );
+            if (endptr == thisarg || *endptr != '\0' || num_angles < 1) {
+                usage_exit( "Option -angles must be followed by a positive integer." );
+            }
         } else if (strncmp( thisarg, "skip", 4) == 0) 
         {
-            // read decimal number
-            if (argnum+1 >= argc) {
+            if (argnum >= argc) {
                 usage_exit( "Option -skip must be followed by one integer value." );
             }
             thisarg = argv[argnum++];
-            dist_step = strtod( thisarg, &endptr );
+            dist_step = (int)strtol( thisarg, &endptr, 10 );
+            if (endptr == thisarg || *endptr != '\0' || dist_step < 1) {
+                usage_exit( "Option -skip must be followed by a positive integer." );
+            }
         } else if (strncmp( thisarg, "dist", 4) == 0) 
         {
-            // read decimal number
-            if (argnum+1 >= argc) {
+            if (argnum >= argc) {
                 usage_exit( "Option -dist must be followed by one integer value." );
             }
             thisarg = argv[argnum++];
-            dist_cutoff = strtod( thisarg, &endptr );
+            dist_cutoff = (int)strtol( thisarg, &endptr, 10 );
+            if (endptr == thisarg || *endptr != '\0' || dist_cutoff < 1) {
+                usage_exit( "Option -dist must be followed by a positive integer." );
+            }
         } else if (strncmp( thisarg, "cores", 4 ) == 0)
         {
-            if (argnum+1 >= argc) {
+            if (argnum >= argc) {
                 usage_exit( "Option -cores must be followed by one integer value." );
             }
             thisarg = argv[argnum++];
-            num_threads = strtod( thisarg, &endptr );
-            // ignore flag - cellreg is currently assumed
+            num_threads = (int)strtol( thisarg, &endptr, 10 );
+            if (endptr == thisarg || *endptr != '\0' || num_threads < 0) {
+                usage_exit( "Option -cores must be followed by a non-negative integer (0 = all processors)." );
+            }
+        } else if (strncmp( thisarg, "multiscale", 5 ) == 0) {
+            if (argnum >= argc) {
+                usage_exit( "Option -multiscale must be followed by one integer value." );
+            }
+            thisarg = argv[argnum++];
+            near_dist = (int)strtol( thisarg, &endptr, 10 );
+            if (endptr == thisarg || *endptr != '\0' || near_dist < 1) {
+                usage_exit( "Option -multiscale must be followed by a positive integer." );
+            }
+        } else if (strcmp( thisarg, "fill" ) == 0) {
+            fill = 1;
+        } else if (strcmp( thisarg, "skyview" ) == 0 || strcmp( thisarg, "dominance" ) == 0 ||
+                   strcmp( thisarg, "ridge" ) == 0) {
+            for (product=products; strcmp( thisarg, product->option ) != 0; ++product) { }
+            if (argnum >= argc) {
+                prefix_error();
+                fprintf( stderr, "Option -%s must be followed by a filename.\n", thisarg );
+                usage_exit( 0 );
+            }
+            product->arg = argv[argnum++];
+        } else if (strcmp( thisarg, "cube" ) == 0) {
+            if (argnum >= argc) {
+                usage_exit( "Option -cube must be followed by a filename." );
+            }
+            cube_name = argv[argnum++];
+        } else if (strncmp( thisarg, "memory", 3 ) == 0) {
+            if (argnum >= argc) {
+                usage_exit( "Option -memory must be followed by a positive number of megabytes." );
+            }
+            thisarg = argv[argnum++];
+            memory_mb = strtod( thisarg, &endptr );
+            if (endptr == thisarg || *endptr != '\0' || memory_mb <= 0.0) {
+                usage_exit( "Option -memory must be followed by a positive number of megabytes." );
+            }
+        } else if (strncmp( thisarg, "horizon", 4 ) == 0) {
+            if (argnum >= argc) {
+                usage_exit( "Option -horizon must be followed by a filename." );
+            }
+            horizon_name = argv[argnum++];
         } else {
             prefix_error();
             fprintf( stderr, "Command-line option '-%s' not recognized.\n", thisarg );
@@ -592,11 +1500,54 @@ int main( int argc, const char *argv[] )
         }
     }
 
-    in_hdr_file = fopen( in_hdr_name, "rb" );   // use binary mode for compatibility
-    if (!in_hdr_file) {
-        prefix_error();
-        fprintf( stderr, "Could not open input file '%s'.\n", in_hdr_name );
-        usage_exit( 0 );
+    for (product=products; product<products+NUM_PRODUCTS; ++product) {
+        if (product->arg) {
+            strncpy( extension, "flt", 4 );
+            get_filenames( product->arg, &product->dat_name, &product->hdr_name, &product->prj_name, extension );
+            if (is_geotiff_name( product->dat_name )) {
+                usage_exit( "Output filenames must have .flt extension (if any)." );
+            }
+            if (!strcmp( in_hdr_name, product->hdr_name )) {
+                usage_exit( "Input and outfile filenames must not be the same." );
+            }
+        }
+    }
+
+    if (horizon_name) {
+        for (product=products; product<products+NUM_PRODUCTS; ++product) {
+            if (product->arg) {
+                prefix_error();
+                fprintf( stderr, "Option -%s cannot be used with option -horizon.\n", product->option );
+                usage_exit( 0 );
+            }
+        }
+        if (cube_name) {
+            usage_exit( "Option -cube cannot be used with option -horizon." );
+        }
+    }
+
+    if (memory_mb > 0.0 && horizon_name) {
+        usage_exit( "Option -memory cannot be used with option -horizon." );
+    }
+    if (memory_mb > 0.0 && cube_name) {
+        usage_exit( "Option -memory cannot be used with option -cube." );
+    }
+    if (memory_mb > 0.0 && tif_input) {
+        usage_exit( "Option -memory requires .flt input." );
+    }
+
+    if (cube_name && (num_angles % 2 != 0 || 360 % num_angles != 0)) {
+        usage_exit( "Option -cube needs a number of -angles that is even and divides 360." );
+    }
+
+    in_hdr_file = NULL;     // GeoTIFF input has no .hdr file
+    if (!tif_input) {
+        in_hdr_file = fopen( in_hdr_name, "rb" );   // use binary mode for compatibility
+        if (!in_hdr_file) {
+            prefix_error();
+            fprintf( stderr, "Could not open input file '%s'.\n", in_hdr_name );
+            usage_exit( 0 );
+        }
     }
 
     in_dat_file = fopen( in_dat_name, "rb" );
@@ -609,6 +1560,37 @@ int main( int argc, const char *argv[] )
     free( in_dat_name );
     free( in_hdr_name );
 
+    if (!tif_input && (memory_mb > 0.0 || fill)) {
+        // read header first to see whether arrays fit in memory budget (before
+        // any output file is created), and for NODATA value to fill
+        read_flt_hdr_info( in_hdr_file, &info, 0 );
+        if (memory_mb > 0.0) {
+            // the elevations and the max and min pyramids (a third of the
+            // elevations each) hold the halos; pos_open, neg_open and the
+            // products hold only the rows of a tile
+            max_pixels = memory_mb * 1048576.0 / sizeof( float );
+            halo_factor = 1.0 + (near_dist > 0 ? 2.0 / 3.0 : 0.0);
+            temp = halo_factor + 2.0;
+            for (product=products; product<products+NUM_PRODUCTS; ++product) {
+                temp += product->arg ? 1.0 : 0.0;
+            }
+            tiled = (double)info.nrows * (double)info.ncols * temp > max_pixels;
+        }
+        if (tiled) {
+            // tiles of whole rows, as many as the memory budget allows
+            halo = tileHalo( &align );
+            tile_rows = (int)( ( max_pixels / (double)info.ncols -
+                                 halo_factor * (double)( 2 * halo + 2 * align ) ) / temp );
+            if (tile_rows < min_tile_rows) {
+                prefix_error();
+                fprintf( stderr, "Memory limit of %g MB is too small for tiles of %d columns with %d rows of halo.\n",
+                    memory_mb, info.ncols, halo );
+                exit( EXIT_FAILURE );
+            }
+        }
+        rewind( in_hdr_file );
+    }
+
     out_hdr_file = fopen( out_hdr_name, "wb" ); // use binary mode for compatibility
     if (!out_hdr_file) {
         prefix_error();
@@ -616,7 +1598,7 @@ int main( int argc, const char *argv[] )
         usage_exit( 0 );
     }
 
-    out_dat_file = fopen( out_dat_name, "wb" );
+    out_dat_file = fopen( out_dat_name, "w+b" );  // tiled mode rereads output
     if (!out_dat_file) {
         prefix_error();
         fprintf( stderr, "Could not open output file '%s'.\n", out_dat_name );
@@ -630,7 +1612,7 @@ int main( int argc, const char *argv[] )
         usage_exit( 0 );
     }
 
-    out_dat_file_2 = fopen( out_dat_name_2, "wb" );
+    out_dat_file_2 = fopen( out_dat_name_2, "w+b" );  // tiled mode rereads output
     if (!out_dat_file_2) {
         prefix_error();
         fprintf( stderr, "Could not open output file '%s'.\n", out_dat_name_2 );
@@ -638,6 +1620,34 @@ int main( int argc, const char *argv[] )
     }
 
 
+    for (product=products; product<products+NUM_PRODUCTS; ++product) {
+        if (product->arg) {
+            product->hdr_file = fopen( product->hdr_name, "wb" ); // use binary mode for compatibility
+            if (!product->hdr_file) {
+                prefix_error();
+                fprintf( stderr, "Could not open output file '%s'.\n", product->hdr_name );
+                usage_exit( 0 );
+            }
+            product->dat_file = fopen( product->dat_name, "w+b" );  // tiled mode rereads output
+            if (!product->dat_file) {
+                prefix_error();
+                fprintf( stderr, "Could not open output file '%s'.\n", product->dat_name );
+                usage_exit( 0 );
+            }
+            free( product->dat_name );
+            free( product->hdr_name );
+        }
+    }
+
+    if (cube_name) {
+        cube_file = fopen( cube_name, "wb" );
+        if (!cube_file) {
+            prefix_error();
+            fprintf( stderr, "Could not open output file '%s'.\n", cube_name );
+            usage_exit( 0 );
+        }
+    }
+
     free( out_dat_name );
     free( out_hdr_name );
     free( out_dat_name_2 );
@@ -648,18 +1658,59 @@ int main( int argc, const char *argv[] )
     printf( "Reading input files...\n" );
     fflush( stdout );
 
-    data = read_flt_hdr_files(
-        in_dat_file, in_hdr_file, &nrows, &ncols, &xmin, &xmax, &ymin, &ymax,
-        &has_nulls, &all_ints, 0 );
+    if (tif_input) {
+        // header info comes from the GeoTIFF tags
+        data = read_geotiff_file( in_dat_file, &info, &has_nulls, NULL );
+        nrows = info.nrows;
+        ncols = info.ncols;
+        xmin  = info.xmin;
+        xmax  = info.xmax;
+        ymin  = info.ymin;
+        ymax  = info.ymax;
+        all_ints = 0;
+
+        fclose( in_dat_file );
+    }
 
-    fclose( in_dat_file );
-    fclose( in_hdr_file );
+    if (tiled) {
+        // data will be read one tile at a time
+        nrows = info.nrows;
+        ncols = info.ncols;
+        xmin  = info.xmin;
+        xmax  = info.xmax;
+        ymin  = info.ymin;
+        ymax  = info.ymax;
+        data  = NULL;
+        has_nulls = 0;
+        all_ints  = 0;
+
+        fclose( in_hdr_file );
+    } else if (!tif_input) {
+        // the integer check is of no use here
+        data = map_flt_hdr_files(
+            in_dat_file, in_hdr_file, &nrows, &ncols, &xmin, &xmax, &ymin, &ymax,
+            &has_nulls, NULL, num_threads, &data_map );
+        all_ints = 0;
+
+        fclose( in_dat_file );
+        fclose( in_hdr_file );
+    }
+
+    if (fill && has_nulls) {
+        error = fill_voids( data, nrows, ncols, info.nodata, &nfilled );
+        if (error == FILL_VOIDS_MALLOC_ERROR) {
+            prefix_error();
+            fprintf( stderr, "Memory allocation error occurred during filling of voids.\n" );
+            exit( EXIT_FAILURE );
+        }
+        if (error == 0) {
+            printf( "Filled %ld void points.\n", nfilled );
+            has_nulls = 0;
+        }
+    }
 
     if (has_nulls) {
-        fprintf( stderr, "*** WARNING: " );
-        fprintf( stderr, "Input .flt file contains void (NODATA) points.\n" );
-        fprintf( stderr, "***          " );
-        fprintf( stderr, "Assuming these are ocean points - setting these elevations to 0.\n" );
+        warn_voids();
     }
 
     if (all_ints && detail > 0.0) {
@@ -675,7 +1726,16 @@ int main( int argc, const char *argv[] )
     ydim = (ymax - ymin) / (double)nrows;
 
     // determine projection type
-    proj_type = determine_projection( xmin, xmax, ymin, ymax, xdim, ydim );
+    if (geographic) {
+        // coarse lat/lon grids (cells of 0.02 degrees or more) are not recognized
+        // by determine_projection(), so the caller says so
+        if (xmin < -180.01 || xmax > 360.01 || ymin < -90.01 || ymax > 90.01) {
+            usage_exit( "Option -geographic needs data within longitude -180..360 and latitude -90..90." );
+        }
+        proj_type = -1;
+    } else {
+        proj_type = determine_projection( xmin, xmax, ymin, ymax, xdim, ydim );
+    }
 
     if (proj_type < 0) {
         coord_type = TERRAIN_DEGREES;
@@ -709,21 +1769,128 @@ int main( int argc, const char *argv[] )
 
     }
 
-    // check pixel aspect ratio and size of map extent
-    check_aspect( xmin, xmax, ymin, ymax, xdim, ydim, proj_type );
+    // check pixel aspect ratio and size of map extent; profiles over geographic
+    // data follow the scale of each row, except with a horizon cube
+    if (proj_type >= 0 || horizon_name) {
+        check_aspect( xmin, xmax, ymin, ymax, xdim, ydim, proj_type );
+    }
+
+    if (proj_type < 0 && !horizon_name) {
+        row_scale = (double *)malloc( nrows * sizeof( double ) );
+        if (!row_scale) {
+            prefix_error();
+            fprintf( stderr, "Memory allocation error occurred.\n" );
+            exit( EXIT_FAILURE );
+        }
+        geographic_row_scale( nrows, ymax, ydim, center_lat, row_scale );
+    }
+
+    // profiles measure distance in meters
+    terrain_pixel_spacing( xdim, ydim, coord_type, center_lat, &xdim, &ydim );
 
-    pos_open = (float *)malloc( (LONG)nrows * (LONG)ncols * sizeof( float ) );
-    neg_open = (float *)malloc( (LONG)nrows * (LONG)ncols * sizeof( float ) );
+    if (!tiled) {
+        tile_rows = nrows;
+    } else {
+        printf( "Using tiles of %d rows (plus %d rows of halo) to stay within %g MB.\n",
+            tile_rows, halo, memory_mb );
+        fflush( stdout );
+    }
 
-    threads = (pthread_t *)malloc(num_threads*sizeof(pthread_t));
+    pos_open = (float *)malloc( (LONG)tile_rows * (LONG)ncols * sizeof( float ) );
+    neg_open = (float *)malloc( (LONG)tile_rows * (LONG)ncols * sizeof( float ) );
 
-    size=nrows/num_threads;
+    if (horizon_name) {
+        horizon_file = fopen( horizon_name, "rb" );
+        if (!horizon_file) {
+            prefix_error();
+            fprintf( stderr, "Could not open horizon cube file '%s'.\n", horizon_name );
+            usage_exit( 0 );
+        }
+        if (read_horizon_header( horizon_file, &horizon_info )) {
+            prefix_error();
+            fprintf( stderr, "File '%s' is not a horizon cube file.\n", horizon_name );
+            exit( EXIT_FAILURE );
+        }
+        if (horizon_info.nrows != nrows || horizon_info.ncols != ncols) {
+            prefix_error();
+            fprintf( stderr, "Horizon cube file '%s' is %d x %d, but the elevation array is %d x %d.\n",
+                horizon_name, horizon_info.ncols, horizon_info.nrows, ncols, nrows );
+            exit( EXIT_FAILURE );
+        }
+        if (horizon_info.nlayers < 2) {
+            prefix_error();
+            fprintf( stderr, "Horizon cube file '%s' has no lower horizons (use horizon -lower).\n", horizon_name );
+            exit( EXIT_FAILURE );
+        }
 
+        error = horizon_openness( horizon_file, &horizon_info );
+        fclose( horizon_file );
+        if (error == 2) {
+            prefix_error();
+            fprintf( stderr, "Could not read horizon cube file '%s'.\n", horizon_name );
+            exit( EXIT_FAILURE );
+        }
+    } else {
+        for (product=products; product<products+NUM_PRODUCTS; ++product) {
+            if (product->arg) {
+                want_products = 1;
+                product->values = (float *)malloc( (LONG)tile_rows * (LONG)ncols * sizeof( float ) );
+                if (!product->values) {
+                    error = TERRAIN_FILTER_MALLOC_ERROR;
+                }
+            }
+        }
+        if (cube_name) {
+            want_products = 1;
+            cube_angles = (float **)calloc( 2 * num_angles, sizeof( float * ) );
+            for (i=0; cube_angles && i<2*num_angles && !error; ++i) {
+                cube_angles[i] = (float *)malloc( (LONG)nrows * (LONG)ncols * sizeof( float ) );
+                if (!cube_angles[i]) {
+                    error = TERRAIN_FILTER_MALLOC_ERROR;
+                }
+            }
+            if (!cube_angles) {
+                error = TERRAIN_FILTER_MALLOC_ERROR;
+            }
+        }
 
-    rowManager();
+        pool = num_threads == 1 ? NULL : thread_pool_create( num_threads );
+        thread_seconds = (double *)calloc( thread_pool_size( pool ), sizeof( double ) );
+        thread_rows = (long *)calloc( thread_pool_size( pool ), sizeof( long ) );
+        if (error || (num_threads != 1 && !pool) || !thread_seconds || !thread_rows ||
+            (!tiled && ((near_dist > 0 && buildPyramid( pool )) || setupRays())))
+        {
+            error = TERRAIN_FILTER_MALLOC_ERROR;
+        } else {
+            if (max_far_steps > 0) {
+                printf( "Sampling profiles beyond %d cells from coarser levels (at most %d coarse steps).\n",
+                    near_cutoff, max_far_steps );
+            }
+            printf( "Using %s instructions.\n", selectProfileLanes() );
+            printf( "Processing %d rows with %d threads...\n", nrows, thread_pool_size( pool ) );
+            fflush( stdout );
+
+            run_time = wall_seconds();
+            if (tiled) {
+                error = processTiles( in_dat_file, &info, pool, tile_rows, fill,
+                    out_dat_file, out_dat_file_2, &has_nulls, &all_ints );
+                fclose( in_dat_file );
+            } else {
+                error = thread_pool_run( pool, nrows, 0, processRows, NULL, NULL );
+            }
+            run_time = wall_seconds() - run_time;
 
-    for (i=0; i<nrows; i++) {
-        pthread_join(threads[i], NULL);
+            for (i=0; i<thread_pool_size( pool ); ++i) {
+                printf( "  thread %2d: %6ld rows in %8.2f s\n", i, thread_rows[i], thread_seconds[i] );
+            }
+            printf( "Elapsed time %.2f s.\n", run_time );
+            fflush( stdout );
+        }
+        thread_pool_destroy( pool );
+        free( thread_seconds );
+        free( thread_rows );
+        freeRays();
+        freePyramid();
     }
 
 
@@ -734,6 +1901,10 @@ int main( int argc, const char *argv[] )
         exit( EXIT_FAILURE );
     }
 
+    if (tiled && has_nulls && !fill) {
+        warn_voids();
+    }
+
     // if (lat1 != lat2) {
     //     fix_mercator( data, detail, nrows, ncols, lat1, lat2 );
     // }
@@ -743,11 +1914,20 @@ int main( int argc, const char *argv[] )
     printf( "Writing output files...\n" );
     fflush( stdout );
 
-    write_flt_hdr_files(
-        out_dat_file, out_hdr_file, nrows, ncols, xmin, xmax, ymin, ymax, pos_open, software );
+    if (tiled) {
+        // .flt files already written by processTiles()
+        write_hdr_for_flt_file(
+            out_dat_file, out_hdr_file, nrows, ncols, xmin, xmax, ymin, ymax, software );
+
+        write_hdr_for_flt_file(
+            out_dat_file_2, out_hdr_file_2, nrows, ncols, xmin, xmax, ymin, ymax, software );
+    } else {
+        write_flt_hdr_files(
+            out_dat_file, out_hdr_file, nrows, ncols, xmin, xmax, ymin, ymax, pos_open, software );
 
-    write_flt_hdr_files(
-        out_dat_file_2, out_hdr_file_2, nrows, ncols, xmin, xmax, ymin, ymax, neg_open, software );
+        write_flt_hdr_files(
+            out_dat_file_2, out_hdr_file_2, nrows, ncols, xmin, xmax, ymin, ymax, neg_open, software );
+    }
 
     fclose( out_dat_file );
     fclose( out_hdr_file );    
@@ -755,8 +1935,50 @@ int main( int argc, const char *argv[] )
     fclose( out_dat_file_2 );
     fclose( out_hdr_file_2 );
 
-    free( data );
+    for (product=products; product<products+NUM_PRODUCTS; ++product) {
+        if (product->arg && tiled) {
+            write_hdr_for_flt_file(
+                product->dat_file, product->hdr_file, nrows, ncols, xmin, xmax, ymin, ymax,
+                software );
+        } else if (product->arg) {
+            write_flt_hdr_files(
+                product->dat_file, product->hdr_file, nrows, ncols, xmin, xmax, ymin, ymax,
+                product->values, software );
+        }
+        if (product->arg) {
+            fclose( product->dat_file );
+            fclose( product->hdr_file );
+            free( product->values );
+        }
+    }
+
+    if (cube_name) {
+        cube_info.nrows = nrows;
+        cube_info.ncols = ncols;
+        cube_info.nazimuths = num_angles;
+        cube_info.nlayers = 2;
+        cube_info.bits = 16;
+        error = write_horizon_header( cube_file, &cube_info );
+        for (i=0; i<2*num_angles; ++i) {
+            if (!error) {
+                error = write_horizon_slice( cube_file, &cube_info, cube_angles[i] );
+            }
+            free( cube_angles[i] );
+        }
+        free( cube_angles );
+        if (fclose( cube_file ) != 0 && !error) {
+            error = 2;
+        }
+        if (error) {
+            prefix_error();
+            fprintf( stderr, "Could not write horizon cube file '%s'.\n", cube_name );
+            exit( EXIT_FAILURE );
+        }
+    }
+
+    free_flt_data( data, &data_map );
     free( software );
+    free( row_scale );
 
     // Copy optional .prj file:
 
@@ -791,6 +2013,25 @@ int main( int argc, const char *argv[] )
     }
 
 
+    for (product=products; product<products+NUM_PRODUCTS; ++product) {
+        if (product->arg) {
+            in_prj_file = fopen( in_prj_name, "rb" );   // use binary mode for compatibility
+            if (in_prj_file) {
+                out_prj_file = fopen( product->prj_name, "wb" ); // use binary mode for compatibility
+                if (!out_prj_file) {
+                    fprintf( stderr, "*** WARNING: " );
+                    fprintf( stderr, "Could not open output file '%s'.\n", product->prj_name );
+                } else {
+                    copy_prj_file( in_prj_file, out_prj_file );
+
+                    fclose( out_prj_file );
+                }
+                fclose( in_prj_file );
+            }
+            free( product->prj_name );
+        }
+    }
+
     free( in_prj_name );
     free( out_prj_name );
     free( out_prj_name_2 );
@@ -35,12 +35,15 @@
 #include "terrain_filter.h"
 
 #include "transpose_inplace.h"
+#include "thread_pool.h"
 #include "dct.h"
+#include "fast_pow.h"
 
 #include "compatibility.h"
 
 #include <stddef.h> // for ptrdiff_t
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 // For a 64-bit compile we need LONG to be 64 bits, even if the compiler uses an LLP64 model
@@ -213,6 +216,65 @@ double geographic_aspect( double latdeg )
     return xsize / ysize;
 }
 
+void terrain_pixel_spacing(
+    double  xdim,       // input:  spacing between pixel columns (in degrees or meters)
+    double  ydim,       // input:  spacing between pixel rows    (in degrees or meters)
+    enum Terrain_Coord_Type
+            coord_type, // input:  coordinate type for xdim & ydim (degrees or meters)
+    double  center_lat, // input:  latitude in degrees at center of data array
+    double *xres,       // output: spacing between pixel columns in meters
+    double *yres        // output: spacing between pixel rows    in meters
+)
+// Converts pixel spacing to meters (approximately, for geographic coordinates).
+{
+    double xsize, ysize;
+
+    if (coord_type == TERRAIN_DEGREES) {
+        geographic_scale( center_lat, &xsize, &ysize );
+
+        // convert degrees to meters (approximately)
+        *xres = xdim * xsize;
+        *yres = ydim * ysize;
+    } else {
+        *xres = xdim;
+        *yres = ydim;
+    }
+}
+
+void geographic_row_scale(
+    int     nrows,      // input:  number of rows in data array
+    double  ymax,       // input:  latitude in degrees at top edge of top pixels
+    double  ydim,       // input:  spacing between pixel rows (in degrees)
+    double  center_lat, // input:  latitude in degrees at which the scale is 1
+    double *scale       // output: scale factor for each row (nrows values)
+)
+// Determines relative east-west scale of each row of a geographic data array
+{
+    const double max_lat = 89.999;
+
+    double center_xsize, xsize, ysize;
+    double lat;
+    int i;
+
+    geographic_scale( center_lat, &center_xsize, &ysize );
+
+    for (i=0; i<nrows; ++i) {
+        lat = ymax - (i + 0.5) * ydim;     // center of row i
+        lat = lat > max_lat ? max_lat : lat < -max_lat ? -max_lat : lat;
+        geographic_scale( lat, &xsize, &ysize );
+        scale[i] = center_xsize / xsize;
+    }
+}
+
+double mercator_northing( double latdeg )
+// Determines northing in meters at given latitude for normal-aspect Mercator projection
+// with scale true at the equator
+{
+    double lat = (M_PI/180.0) * latdeg;
+
+    return equatorial_radius * isometric_lat( lat );
+}
+
 void fix_mercator(
     float *data,    // input/output: array of data to process (row-major order)
     double detail,  // input: "detail" exponent to be applied
@@ -224,6 +286,21 @@ void fix_mercator(
 )
 // Corrects output of terrain_filter() for scale variation of Mercator-projected data.
 // Assumes scale is true at the equator.
+{
+    fix_mercator_rows( data, detail, 0, nrows, ncols, nrows, lat1deg, lat2deg );
+}
+
+void fix_mercator_rows(
+    float *data,    // input/output: block of data to process (row-major order)
+    double detail,  // input: "detail" exponent to be applied
+    int    first_row,   // input: row of full array corresponding to first row of block
+    int    nrows,   // input: number of rows    in block
+    int    ncols,   // input: number of columns in block
+    int    total_rows,  // input: number of rows in full array
+    double lat1deg, // input: latitude at bottom edge (or center) of bottom pixels, degrees
+    double lat2deg  // input: latitude at top    edge (or center) of top    pixels, degrees
+)
+// Same as fix_mercator(), but for a block of rows out of a larger array.
 {
     enum Terrain_Reg registration = TERRAIN_REG_CELL;
 
@@ -246,12 +323,12 @@ void fix_mercator(
 
     switch (registration) {
         case TERRAIN_REG_GRID:
-            ypix1 = (double)(nrows - 1);    // center of bottom row of pixels
-            ypix2 = 0.0;                    // center of top    row of pixels
+            ypix1 = (double)(total_rows - 1);   // center of bottom row of pixels
+            ypix2 = 0.0;                        // center of top    row of pixels
             break;
         case TERRAIN_REG_CELL:
-            ypix1 = (double)nrows - 0.5;    // bottom edge of bottom row of pixels
-            ypix2 = -0.5;                   // top    edge of top    row of pixels
+            ypix1 = (double)total_rows - 0.5;   // bottom edge of bottom row of pixels
+            ypix2 = -0.5;                       // top    edge of top    row of pixels
             break;
         default:
             // invalid data registration type
@@ -265,7 +342,7 @@ void fix_mercator(
 
     for (i=0, ptr=data; i<nrows; ++i, ptr+=ncols) {
         //float *ptr = data + (LONG)i * (LONG)ncols;
-        double ypix = (double)i;
+        double ypix = (double)(first_row + i);
         double isolat = isolat0 + (ypix - ypix0) * pix2merc;
         double tan_lat = tan_lat_from_isometric( isolat );
         double relscale = mercator_relscale_from_tan_lat( tan_lat );
@@ -277,6 +354,96 @@ void fix_mercator(
     }
 }
 
+int resample_mercator_rows(
+    float *data,    // input/output: array of data to resample (row-major order)
+    int    nrows,   // input: number of rows    in data array
+    int    ncols,   // input: number of columns in data array
+    double lat1deg, // input: latitude at bottom edge of bottom pixels, degrees
+    double lat2deg, // input: latitude at top    edge of top    pixels, degrees
+    int    to_mercator  // input: nonzero for geographic to Mercator, 0 for the reverse
+)
+// Resamples rows between geographic and Mercator spacing, using linear interpolation.
+// Allows the geographic case to be filtered with uniform scale in each direction
+// (except for the Mercator scale variation handled by fix_mercator()).
+{
+    // cell registration, as in fix_mercator_rows()
+    const double ypix1 = (double)nrows - 0.5;   // bottom edge of bottom row of pixels
+    const double ypix2 = -0.5;                  // top    edge of top    row of pixels
+
+    double pix2merc, pix2geo;
+    double isolat0, lat0;
+    double ypix0;
+
+    float *temp;
+    float *ptr;
+    int i, j;
+
+    // convert latitudes from degrees to radians
+    double lat1 = (M_PI/180.0) * lat1deg;
+    double lat2 = (M_PI/180.0) * lat2deg;
+
+    double isolat1 = isometric_lat( lat1 );
+    double isolat2 = isometric_lat( lat2 );
+
+    temp = (float *)malloc( (size_t)nrows * (size_t)ncols * sizeof( float ) );
+    if (!temp) {
+        return TERRAIN_FILTER_MALLOC_ERROR;
+    }
+
+    for (i=0; i<nrows*(LONG)ncols; ++i) {
+        temp[i] = data[i];
+    }
+
+    pix2merc = (isolat2 - isolat1) / (ypix2 - ypix1);
+    pix2geo  = (lat2    - lat1)    / (ypix2 - ypix1);
+    isolat0  = (isolat1 + isolat2) / 2;
+    lat0     = (lat1    + lat2)    / 2;
+    ypix0    = (ypix1   + ypix2)   / 2;
+
+    for (i=0, ptr=data; i<nrows; ++i, ptr+=ncols) {
+        double ypix = (double)i;
+        double ysrc;
+        double frac;
+        const float *src0, *src1;
+        int k;
+
+        if (to_mercator) {
+            // output row is in Mercator; find its latitude in the geographic input
+            double isolat = isolat0 + (ypix - ypix0) * pix2merc;
+            double lat = atan( tan_lat_from_isometric( isolat ) );
+            ysrc = ypix0 + (lat - lat0) / pix2geo;
+        } else {
+            // output row is geographic; find its isometric latitude in the Mercator input
+            double lat = lat0 + (ypix - ypix0) * pix2geo;
+            double isolat = isometric_lat( lat );
+            ysrc = ypix0 + (isolat - isolat0) / pix2merc;
+        }
+
+        if (ysrc < 0.0) {
+            ysrc = 0.0;
+        } else if (ysrc > (double)(nrows-1)) {
+            ysrc = (double)(nrows-1);
+        }
+
+        k = (int)ysrc;
+        if (k > nrows-2) {
+            k = nrows > 1 ? nrows-2 : 0;
+        }
+        frac = ysrc - (double)k;
+
+        src0 = temp + (LONG)k * (LONG)ncols;
+        src1 = nrows > 1 ? src0 + ncols : src0;
+
+        for (j=0; j<ncols; ++j) {
+            ptr[j] = (float)( src0[j] + frac * (src1[j] - src0[j]) );
+        }
+    }
+
+    free( temp );
+
+    return 0;
+}
+
 void fix_polar_stereographic(
     float *data,        // input/output: array of data to process (row-major order)
     double detail,      // input: "detail" exponent to be applied
@@ -452,6 +619,8 @@ struct Terrain_Operator_Info {
     double *yy;
     double  power;
     double  factor;
+    Scale_Pow_Function
+            scale_pow;  // fast vectorized version, or null to call pow()
 };
 
 static int setup_operator(
@@ -498,6 +667,8 @@ static int setup_operator(
 
     info->power = detail * 0.5;
 
+    info->scale_pow = 0;    // caller may select fast version
+
     xfactor = 1.0 / (double)m2;
     yfactor = 1.0 / (double)n2;
 
@@ -568,8 +739,12 @@ static void apply_operator(
             ptr[j] *= info.factor * exp( ( (log1 + log4) + (log2 + log3) ) * info.power );
         }
     #else
-        for (j=0; j<nrows; ++j) {
-            ptr[j] *= info.factor * pow( info.separablex[i] + info.separabley[j], info.power );
+        if (info.scale_pow) {
+            info.scale_pow( ptr, info.separabley, info.separablex[i], info.power, info.factor, nrows );
+        } else {
+            for (j=0; j<nrows; ++j) {
+                ptr[j] *= info.factor * pow( info.separablex[i] + info.separabley[j], info.power );
+            }
         }
     #endif
 
@@ -742,8 +917,344 @@ static int relay_progress(
 }
 
 
+// Performs DCTs on count consecutive vectors (1 to 2*plan->batch) starting at ptr.
+// Vectors are interleaved into the plan's buffers; unused positions are zero.
+static void batch_dcts(
+    float *ptr,
+    int    count,
+    int    length,
+    const struct Dct_Batch_Plan *plan
+)
+{
+    int batch = plan->batch;
+    int b, j, k, v;
+
+    for (b=0; b<2; ++b) {
+        float *buf = plan->in_data[b];
+        for (k=0; k<batch; ++k) {
+            v = b * batch + k;
+            if (v < count) {
+                const float *src = ptr + (LONG)v * (LONG)length;
+                for (j=0; j<length; ++j) {
+                    buf[(LONG)j * batch + k] = src[j];
+                }
+            } else {
+                for (j=0; j<length; ++j) {
+                    buf[(LONG)j * batch + k] = 0.0f;
+                }
+            }
+        }
+    }
+
+    perform_batch_dcts( plan );
+
+    for (b=0; b<2; ++b) {
+        const float *buf = plan->out_data[b];
+        for (k=0; k<batch; ++k) {
+            v = b * batch + k;
+            if (v < count) {
+                float *dst = ptr + (LONG)v * (LONG)length;
+                for (j=0; j<length; ++j) {
+                    dst[j] = buf[(LONG)j * batch + k];
+                }
+            }
+        }
+    }
+}
+
+
+// Parallel DCT passes:
+
+// DCT plans for one pass, one per pool thread (since plans hold their own buffers).
+struct Dct_Thread_Plans {
+    enum Terrain_Dct_Mode
+           mode;        // which kind of plans below is used
+    int    nplans;      // number of threads
+    int    group;       // number of vectors transformed together
+    struct Dct_Plan
+          *plans;       // for TERRAIN_DCT_DOUBLE
+    struct Dct_Batch_Plan
+          *batch_plans; // for TERRAIN_DCT_SIMD
+    struct Dct_Float_Plan
+          *float_plans; // for TERRAIN_DCT_FLOAT
+};
+
+static void cleanup_thread_dcts(
+    struct Dct_Thread_Plans *tp
+)
+{
+    int k;
+
+    if (tp->plans) {
+        for (k=0; k<tp->nplans; ++k) {
+            if (tp->plans[k].dct_buffer) {
+                cleanup_dcts( &tp->plans[k] );
+            }
+        }
+        free( tp->plans );
+        tp->plans = NULL;
+    }
+    if (tp->batch_plans) {
+        for (k=0; k<tp->nplans; ++k) {
+            if (tp->batch_plans[k].dct_buffer) {
+                cleanup_batch_dcts( &tp->batch_plans[k] );
+            }
+        }
+        free( tp->batch_plans );
+        tp->batch_plans = NULL;
+    }
+    if (tp->float_plans) {
+        for (k=0; k<tp->nplans; ++k) {
+            if (tp->float_plans[k].dct_buffer) {
+                cleanup_float_dcts( &tp->float_plans[k] );
+            }
+        }
+        free( tp->float_plans );
+        tp->float_plans = NULL;
+    }
+}
+
+// Returns TERRAIN_FILTER_SUCCESS or TERRAIN_FILTER_MALLOC_ERROR.
+static int setup_thread_dcts(
+    struct Dct_Thread_Plans
+          *tp,          // output: plans for each thread
+    enum Terrain_Dct_Mode
+           mode,
+    int    dct_type,    // 1, 2, or 3 (DCT types I, II, III)
+    int    nelems,      // data length for each DCT
+    int    nplans       // number of threads
+)
+{
+    int k;
+
+    tp->mode        = mode;
+    tp->nplans      = nplans;
+    tp->group       = 2;
+    tp->plans       = NULL;
+    tp->batch_plans = NULL;
+    tp->float_plans = NULL;
+
+    if (mode == TERRAIN_DCT_FLOAT) {
+        tp->float_plans = (struct Dct_Float_Plan *)calloc( nplans, sizeof( struct Dct_Float_Plan ) );
+        if (!tp->float_plans) {
+            return TERRAIN_FILTER_MALLOC_ERROR;
+        }
+        for (k=0; k<nplans; ++k) {
+            tp->float_plans[k] = setup_float_dcts( dct_type, nelems );
+            if (!tp->float_plans[k].dct_buffer) {
+                cleanup_thread_dcts( tp );
+                return TERRAIN_FILTER_MALLOC_ERROR;
+            }
+        }
+    } else if (mode == TERRAIN_DCT_SIMD) {
+        tp->batch_plans = (struct Dct_Batch_Plan *)calloc( nplans, sizeof( struct Dct_Batch_Plan ) );
+        if (!tp->batch_plans) {
+            return TERRAIN_FILTER_MALLOC_ERROR;
+        }
+        for (k=0; k<nplans; ++k) {
+            tp->batch_plans[k] = setup_batch_dcts( dct_type, nelems );
+            if (!tp->batch_plans[k].dct_buffer) {
+                cleanup_thread_dcts( tp );
+                return TERRAIN_FILTER_MALLOC_ERROR;
+            }
+        }
+        tp->group = 2 * tp->batch_plans[0].batch;
+    } else {
+        tp->plans = (struct Dct_Plan *)calloc( nplans, sizeof( struct Dct_Plan ) );
+        if (!tp->plans) {
+            return TERRAIN_FILTER_MALLOC_ERROR;
+        }
+        for (k=0; k<nplans; ++k) {
+            tp->plans[k] = setup_dcts( dct_type, nelems );
+            if (!tp->plans[k].dct_buffer) {
+                cleanup_thread_dcts( tp );
+                return TERRAIN_FILTER_MALLOC_ERROR;
+            }
+        }
+    }
+
+    return TERRAIN_FILTER_SUCCESS;
+}
+
+// Performs DCTs on count consecutive vectors (1 to tp->group) starting at ptr.
+static void thread_dcts(
+    float *ptr,
+    int    count,
+    int    length,
+    const struct Dct_Thread_Plans *tp,
+    int    thread
+)
+{
+    if (tp->mode == TERRAIN_DCT_SIMD) {
+        batch_dcts( ptr, count, length, &tp->batch_plans[thread] );
+    } else if (tp->mode == TERRAIN_DCT_FLOAT) {
+        perform_float_dcts( &tp->float_plans[thread], ptr, count == 2 ? ptr + length : NULL );
+    } else if (count == 2) {
+        two_dcts( ptr, length, &tp->plans[thread] );
+    } else {
+        single_dct( ptr, length, &tp->plans[thread] );
+    }
+}
+
+struct Dct_Pass_State {
+    float *data;        // array of vectors to transform (each stored contiguously)
+    int    length;      // length of each vector
+    int    nvecs;       // number of vectors
+    const struct Dct_Thread_Plans
+          *fwd;         // plans for DCT of each vector
+    const struct Dct_Thread_Plans
+          *bwd;         // plans for inverse DCT (operator pass only)
+    const struct Terrain_Operator_Info
+          *info;        // operator to apply between DCTs (operator pass only)
+};
+
+// Thread pool task: task k transforms vectors k*group to (k+1)*group-1.
+static int dct_pass_task( long first, long last, int thread, void *state )
+{
+    const struct Dct_Pass_State *pass = (const struct Dct_Pass_State *)state;
+    int  group = pass->fwd->group;
+    long k;
+
+    for (k=first; k<last; ++k) {
+        int    i     = (int)(k * group);
+        int    count = pass->nvecs - i < group ? pass->nvecs - i : group;
+        float *ptr   = pass->data + (LONG)i * (LONG)pass->length;
+
+        thread_dcts( ptr, count, pass->length, pass->fwd, thread );
+    }
+    return 0;
+}
+
+// Thread pool task: forward DCT (if any), operator, and inverse DCT on a group of columns
+// (data in transposed layout); task k is columns k*group to (k+1)*group-1.
+static int operator_pass_task( long first, long last, int thread, void *state )
+{
+    const struct Dct_Pass_State *pass = (const struct Dct_Pass_State *)state;
+    int  group = pass->bwd->group;
+    long k;
+    int  n;
+
+    for (k=first; k<last; ++k) {
+        int    i     = (int)(k * group);
+        int    count = pass->nvecs - i < group ? pass->nvecs - i : group;
+        float *ptr   = pass->data + (LONG)i * (LONG)pass->length;
+
+        if (pass->fwd) {
+            thread_dcts( ptr, count, pass->length, pass->fwd, thread );
+        }
+        for (n=0; n<count; ++n) {
+            apply_operator( pass->data, i+n, pass->length, *pass->info );
+        }
+        thread_dcts( ptr, count, pass->length, pass->bwd, thread );
+    }
+    return 0;
+}
+
+// Performs a DCT on each row of a row-major nrows x ncols array, in parallel.
+// Returns TERRAIN_FILTER_SUCCESS, TERRAIN_FILTER_MALLOC_ERROR, or TERRAIN_FILTER_CANCELED.
+static int dct_rows(
+    struct Thread_Pool *pool,
+    float *data,
+    int    nrows,
+    int    ncols,
+    int    dct_type,
+    enum Terrain_Dct_Mode
+           dct_mode,
+    const struct Thread_Pool_Progress_Callback
+          *progress
+)
+{
+    struct Dct_Thread_Plans plans;
+    struct Dct_Pass_State pass;
+    int error;
+
+    error = setup_thread_dcts( &plans, dct_mode, dct_type, ncols, thread_pool_size( pool ) );
+    if (error) {
+        return error;
+    }
+
+    pass.data   = data;
+    pass.length = ncols;
+    pass.nvecs  = nrows;
+    pass.fwd    = &plans;
+    pass.bwd    = NULL;
+    pass.info   = NULL;
+
+    error = thread_pool_run(
+        pool, (nrows + plans.group - 1) / plans.group, 0, dct_pass_task, &pass, progress );
+
+    cleanup_thread_dcts( &plans );
+
+    return error ? TERRAIN_FILTER_CANCELED : TERRAIN_FILTER_SUCCESS;
+}
+
+// Applies forward DCT, fractional Laplacian operator, and inverse DCT to each
+// column of transposed data array (ncols x nrows), in parallel.
+// If type_fwd is 0, data is already transformed and the forward DCTs are skipped.
+// Returns TERRAIN_FILTER_SUCCESS, TERRAIN_FILTER_MALLOC_ERROR, or TERRAIN_FILTER_CANCELED.
+static int operator_columns(
+    struct Thread_Pool *pool,
+    float *data,
+    int    nrows,
+    int    ncols,
+    int    type_fwd,
+    int    type_bwd,
+    enum Terrain_Dct_Mode
+           dct_mode,
+    const struct Terrain_Operator_Info
+          *info,
+    const struct Thread_Pool_Progress_Callback
+          *progress
+)
+{
+    int nthreads = thread_pool_size( pool );
+    int error;
+
+    struct Dct_Thread_Plans fwd_plans, bwd_plans;
+    struct Dct_Pass_State pass;
+
+    if (type_fwd) {
+        error = setup_thread_dcts( &fwd_plans, dct_mode, type_fwd, nrows, nthreads );
+        if (error) {
+            return error;
+        }
+    }
+    error = setup_thread_dcts( &bwd_plans, dct_mode, type_bwd, nrows, nthreads );
+    if (error) {
+        if (type_fwd) {
+            cleanup_thread_dcts( &fwd_plans );
+        }
+        return error;
+    }
+
+    pass.data   = data;
+    pass.length = nrows;
+    pass.nvecs  = ncols;
+    pass.fwd    = type_fwd ? &fwd_plans : NULL;
+    pass.bwd    = &bwd_plans;
+    pass.info   = info;
+
+    error = thread_pool_run(
+        pool, (ncols + bwd_plans.group - 1) / bwd_plans.group, 0, operator_pass_task, &pass,
+        progress );
+
+    cleanup_thread_dcts( &bwd_plans );
+    if (type_fwd) {
+        cleanup_thread_dcts( &fwd_plans );
+    }
+
+    return error ? TERRAIN_FILTER_CANCELED : TERRAIN_FILTER_SUCCESS;
+}
+
+
 // Main terrain_filter function:
 
+static int terrain_filter_pool(
+    float *data, double detail, int nrows, int ncols, double xdim, double ydim,
+    enum Terrain_Coord_Type coord_type, double center_lat, enum Terrain_Reg registration,
+    enum Terrain_Dct_Mode dct_mode, struct Thread_Pool *pool,
+    const struct Terrain_Progress_Callback *progress );
+
 int terrain_filter(
     float *data,        // input/output: array of data to process (row-major order)
     double detail,      // input: "detail" exponent to be applied
@@ -763,10 +1274,83 @@ int terrain_filter(
 // Returns 0 on success, nonzero if an error occurred (see enum Terrain_Filter_Errors).
 // Mean of data array is always (approximately) zero on output.
 // On input, vertical units (data array values) should be in meters.
+{
+    return terrain_filter_mt(
+        data, detail, nrows, ncols, xdim, ydim, coord_type, center_lat,
+        TERRAIN_DCT_DOUBLE, 1, progress );
+}
+
+int terrain_filter_mt(
+    float *data,        // input/output: array of data to process (row-major order)
+    double detail,      // input: "detail" exponent to be applied
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    double xdim,        // input: spacing between pixel columns (in degrees or meters)
+    double ydim,        // input: spacing between pixel rows    (in degrees or meters)
+    enum Terrain_Coord_Type
+           coord_type,  // input: coordinate type for xdim & ydim (degrees or meters)
+    double center_lat,  // input: latitude in degrees at center of data array
+                        //        (ignored if coord_type == TERRAIN_METERS)
+    enum Terrain_Dct_Mode
+           dct_mode,    // input: DCT implementation to use (see enum Terrain_Dct_Mode)
+    int    num_threads, // input: number of threads for DCT passes (<= 0 for all processors)
+    const struct Terrain_Progress_Callback
+          *progress     // optional callback functor for status; NULL for none
+//  enum Terrain_Reg registration   // feature not yet implemented
+)
+// Same as terrain_filter(), but runs the three DCT passes on multiple threads,
+// optionally using batched single-precision DCTs.
 {
     enum Terrain_Reg registration = TERRAIN_REG_CELL;
 
-    int num_threads = 1;    // number of threads used to parallelize the three DCT loops
+    struct Thread_Pool *pool;
+
+    int error;
+
+    pool = num_threads == 1 ? NULL : thread_pool_create( num_threads );
+
+    if (num_threads != 1 && !pool) {
+        return TERRAIN_FILTER_MALLOC_ERROR;
+    }
+
+    error = terrain_filter_pool(
+        data, detail, nrows, ncols, xdim, ydim, coord_type, center_lat, registration,
+        dct_mode, pool, progress );
+
+    thread_pool_destroy( pool );
+
+    return error;
+}
+
+// Frees transposed copy of data array, if one was allocated.
+static void free_transposed( float *data, float *tdata )
+{
+    if (tdata != data) {
+        free( tdata );
+    }
+}
+
+static int terrain_filter_pool(
+    float *data,
+    double detail,
+    int    nrows,
+    int    ncols,
+    double xdim,
+    double ydim,
+    enum Terrain_Coord_Type
+           coord_type,
+    double center_lat,
+    enum Terrain_Reg
+           registration,
+    enum Terrain_Dct_Mode
+           dct_mode,
+    struct Thread_Pool
+          *pool,        // worker threads for the DCT loops; NULL for serial
+    const struct Terrain_Progress_Callback
+          *progress
+)
+{
+    int num_threads = thread_pool_size( pool );
 
     // approximate relative amount of time spent in each step
     // (actual times vary with data array size, memory size, and DCT algorithms chosen):
@@ -781,6 +1365,9 @@ int terrain_filter(
     struct Transpose_Progress_Callback
         sub_progress = { relay_progress, &progress_info };
 
+    struct Thread_Pool_Progress_Callback
+        pass_progress = { relay_progress, &progress_info };
+
     const double steepness = 2.0;
 
     int error;
@@ -791,27 +1378,18 @@ int terrain_filter(
     float *ptr;
 
     float data_min, data_max;
+    float *tdata;   // transposed data (separate array if enough memory)
 
     double normalizer;
 
     double xres,   yres;
     double xscale, yscale;
-    double xsize,  ysize;
 
     struct Terrain_Operator_Info info;
 
     // Determine pixel dimensions:
 
-    if (coord_type == TERRAIN_DEGREES) {
-        geographic_scale( center_lat, &xsize, &ysize );
-
-        // convert degrees to meters (approximately)
-        xres = xdim * xsize;
-        yres = ydim * ysize;
-    } else {
-        xres = xdim;
-        yres = ydim;
-    }
+    terrain_pixel_spacing( xdim, ydim, coord_type, center_lat, &xres, &yres );
 
     xscale = fabs( 1.0 / xres );
     yscale = fabs( 1.0 / yres );
@@ -862,36 +1440,24 @@ int terrain_filter(
         return error;
     }
 
+    if (dct_mode != TERRAIN_DCT_DOUBLE) {
+        // single-precision modes can use approximate powers (error << float roundoff)
+        info.scale_pow = select_scale_pow( 0 );
+    }
+
     set_progress( &progress_info, 1 );
 
     if (progress && report_progress( &progress_info )) {
         return TERRAIN_FILTER_CANCELED;
     }
 
-    // CONCURRENCY NOTE: The iterations of the loop below will be
-    // independent and can be executed in parallel, if each thread has
-    // its own dct_plan with separate calls to setup_dcts() and cleanup_dcts().
-    {
-        struct Dct_Plan dct_plan = setup_dcts( type_fwd, ncols );
-
-        if (!dct_plan.dct_buffer) {
-            return TERRAIN_FILTER_MALLOC_ERROR;
-        }
-
-        for (i=0; i<nrows-1; i+=2) {
-            float *ptr = data + (LONG)i * (LONG)ncols;
-            two_dcts( ptr, ncols, &dct_plan );
-            if (progress && update_progress( &progress_info, i+2, nrows ))
-            {
-                return TERRAIN_FILTER_CANCELED;
-            }
-        }
-        if (nrows & 1) {
-            float *ptr = data + (LONG)(nrows - 1) * (LONG)ncols;
-            single_dct( ptr, ncols, &dct_plan );
-        }
-
-        cleanup_dcts( &dct_plan );
+    // The iterations of the row DCT loop are independent; each thread
+    // of the pool has its own DCT plan.
+    error = dct_rows( pool, data, nrows, ncols, type_fwd, dct_mode,
+        progress ? &pass_progress : NULL );
+    if (error) {
+        cleanup_operator( info );
+        return error;
     }
 
     set_progress( &progress_info, 2 );
@@ -900,8 +1466,19 @@ int terrain_filter(
         return TERRAIN_FILTER_CANCELED;
     }
 
-    error = transpose_inplace( data, nrows, ncols, progress ? &sub_progress : NULL );
+    // Transpose into a separate array if memory allows (fast cache-blocked
+    // algorithm, split among the threads of the pool); otherwise in place.
+    tdata = (float *)malloc( (LONG)nrows * (LONG)ncols * sizeof( float ) );
+    if (tdata) {
+        error = transpose_outplace_mt(
+            data, tdata, nrows, ncols, pool, progress ? &sub_progress : NULL );
+    } else {
+        tdata = data;
+        error = transpose_inplace( data, nrows, ncols, progress ? &sub_progress : NULL );
+    }
     if (error) {
+        free_transposed( data, tdata );
+        cleanup_operator( info );
         if (error > 0) {
             return TERRAIN_FILTER_MALLOC_ERROR;
         } else {
@@ -912,59 +1489,45 @@ int terrain_filter(
     set_progress( &progress_info, 3 );
 
     if (progress && report_progress( &progress_info )) {
+        free_transposed( data, tdata );
+        cleanup_operator( info );
         return TERRAIN_FILTER_CANCELED;
     }
 
-    // CONCURRENCY NOTE: The iterations of the loop below will be
-    // independent and can be executed in parallel, if each thread has
-    // its own fwd_plan and bwd_plan with separate calls to setup_dcts()
-    // and cleanup_dcts().
-    {
-        struct Dct_Plan fwd_plan = setup_dcts( type_fwd, nrows );
-        struct Dct_Plan bwd_plan = setup_dcts( type_bwd, nrows );
-
-        if (!fwd_plan.dct_buffer || !bwd_plan.dct_buffer) {
-            return TERRAIN_FILTER_MALLOC_ERROR;
-        }
-
-        for (i=0; i<ncols-1; i+=2) {
-            float *ptr = data + (LONG)i * (LONG)nrows;
-
-            two_dcts( ptr, nrows, &fwd_plan );
-            apply_operator( data, i,   nrows, info );
-            apply_operator( data, i+1, nrows, info );
-            two_dcts( ptr, nrows, &bwd_plan );
-
-            if (progress && update_progress( &progress_info, i+2, ncols ))
-            {
-                return TERRAIN_FILTER_CANCELED;
-            }
-        }
-
-        if (ncols & 1) {
-            float *ptr = data + (LONG)(ncols - 1) * (LONG)nrows;
-
-            single_dct( ptr, nrows, &fwd_plan );
-            apply_operator( data, ncols-1, nrows, info );
-            single_dct( ptr, nrows, &bwd_plan );
-        }
-
-        cleanup_dcts( &bwd_plan );
-        cleanup_dcts( &fwd_plan );
+    // The iterations of the column loop are independent; each thread
+    // of the pool has its own forward and inverse DCT plans.
+    error = operator_columns(
+        pool, tdata, nrows, ncols, type_fwd, type_bwd, dct_mode, &info,
+        progress ? &pass_progress : NULL );
+    if (error) {
+        free_transposed( data, tdata );
+        cleanup_operator( info );
+        return error;
     }
 
-    if (flt_isnan( data[0] )) {
+    if (flt_isnan( tdata[0] )) {
+        free_transposed( data, tdata );
+        cleanup_operator( info );
         return TERRAIN_FILTER_NULL_VALUES;
     }
 
     set_progress( &progress_info, 4 );
 
     if (progress && report_progress( &progress_info )) {
+        free_transposed( data, tdata );
+        cleanup_operator( info );
         return TERRAIN_FILTER_CANCELED;
     }
 
-    error = transpose_inplace( data, ncols, nrows, progress ? &sub_progress : NULL );
+    if (tdata != data) {
+        error = transpose_outplace_mt(
+            tdata, data, ncols, nrows, pool, progress ? &sub_progress : NULL );
+        free( tdata );
+    } else {
+        error = transpose_inplace( data, ncols, nrows, progress ? &sub_progress : NULL );
+    }
     if (error) {
+        cleanup_operator( info );
         if (error > 0) {
             return TERRAIN_FILTER_MALLOC_ERROR;
         } else {
@@ -978,40 +1541,267 @@ int terrain_filter(
         return TERRAIN_FILTER_CANCELED;
     }
 
-    // CONCURRENCY NOTE: The iterations of the loop below will be
-    // independent and can be executed in parallel, if each thread has
-    // its own dct_plan with separate calls to setup_dcts() and cleanup_dcts().
-    {
-        struct Dct_Plan dct_plan = setup_dcts( type_bwd, ncols );
+    // The iterations of the row DCT loop are independent; each thread
+    // of the pool has its own DCT plan.
+    error = dct_rows( pool, data, nrows, ncols, type_bwd, dct_mode,
+        progress ? &pass_progress : NULL );
+    if (error) {
+        cleanup_operator( info );
+        return error;
+    }
 
-        if (!dct_plan.dct_buffer) {
-            return TERRAIN_FILTER_MALLOC_ERROR;
+    cleanup_operator( info );
+
+    set_progress( &progress_info, 6 );
+
+    if (progress) {
+        // report final progress; ignore any cancel request at this point
+        report_progress( &progress_info );
+    }
+
+    return TERRAIN_FILTER_SUCCESS;
+}
+
+
+// Multiple detail values from one forward transform:
+
+// The normalization applied by terrain_filter_pool() is linear, so here it is folded
+// into the operator's constant factor instead; the forward spectrum is then the same
+// for every detail value.
+
+int terrain_spectrum(
+    float *data,        // input: array of data to process (row-major order); overwritten
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    double xdim,        // input: spacing between pixel columns (in degrees or meters)
+    double ydim,        // input: spacing between pixel rows    (in degrees or meters)
+    enum Terrain_Coord_Type
+           coord_type,  // input: coordinate type for xdim & ydim (degrees or meters)
+    double center_lat,  // input: latitude in degrees at center of data array
+                        //        (ignored if coord_type == TERRAIN_METERS)
+    enum Terrain_Dct_Mode
+           dct_mode,    // input: DCT implementation to use (see enum Terrain_Dct_Mode)
+    int    num_threads, // input: number of threads for DCT passes (<= 0 for all processors)
+    struct Terrain_Spectrum
+          *spectrum,    // output: forward transform of data
+    const struct Terrain_Progress_Callback
+          *progress     // optional callback functor for status; NULL for none
+)
+// Computes forward transform of data array, for use by terrain_filter_spectrum().
+{
+    const int type_fwd = 2;     // DCT-II for TERRAIN_REG_CELL
+
+    struct Thread_Pool *pool;
+
+    int num_pool_threads;
+
+    int error;
+
+    int i, j;
+    float *ptr;
+
+    spectrum->coefs    = NULL;
+    spectrum->nrows    = nrows;
+    spectrum->ncols    = ncols;
+    spectrum->dct_mode = dct_mode;
+
+    terrain_pixel_spacing( xdim, ydim, coord_type, center_lat, &spectrum->xres, &spectrum->yres );
+
+    spectrum->data_min = data[0];
+    spectrum->data_max = data[0];
+
+    for (i=0, ptr=data; i<nrows; ++i, ptr+=ncols) {
+        for (j=0; j<ncols; ++j) {
+            if (ptr[j] < spectrum->data_min) {
+                spectrum->data_min = ptr[j];
+            } else if (ptr[j] > spectrum->data_max) {
+                spectrum->data_max = ptr[j];
+            }
         }
+    }
+
+    spectrum->coefs = (float *)malloc( (LONG)nrows * (LONG)ncols * sizeof( float ) );
+    if (!spectrum->coefs) {
+        return TERRAIN_FILTER_MALLOC_ERROR;
+    }
 
-        for (i=0; i<nrows-1; i+=2) {
-            float *ptr = data + (LONG)i * (LONG)ncols;
-            two_dcts( ptr, ncols, &dct_plan );
-            if (progress && update_progress( &progress_info, i+2, nrows ))
-            {
-                return TERRAIN_FILTER_CANCELED;
+    pool = num_threads == 1 ? NULL : thread_pool_create( num_threads );
+
+    if (num_threads != 1 && !pool) {
+        free_terrain_spectrum( spectrum );
+        return TERRAIN_FILTER_MALLOC_ERROR;
+    }
+
+    num_pool_threads = thread_pool_size( pool );
+
+    {
+        // approximate relative amount of time spent in each step
+        const float step_times[3] = { 2.0f/num_pool_threads, 1.0f, 2.0f/num_pool_threads };
+
+        struct Terrain_Progress_Info
+            progress_info = init_progress( progress, step_times, 3 );
+
+        struct Transpose_Progress_Callback
+            sub_progress = { relay_progress, &progress_info };
+
+        struct Thread_Pool_Progress_Callback
+            pass_progress = { relay_progress, &progress_info };
+
+        error = dct_rows( pool, data, nrows, ncols, type_fwd, dct_mode,
+            progress ? &pass_progress : NULL );
+
+        if (!error) {
+            set_progress( &progress_info, 1 );
+            error = transpose_outplace_mt(
+                data, spectrum->coefs, nrows, ncols, pool, progress ? &sub_progress : NULL );
+            if (error) {
+                error = error > 0 ? TERRAIN_FILTER_MALLOC_ERROR : TERRAIN_FILTER_CANCELED;
             }
         }
-        if (nrows & 1) {
-            float *ptr = data + (LONG)(nrows - 1) * (LONG)ncols;
-            single_dct( ptr, ncols, &dct_plan );
+
+        if (!error) {
+            // forward DCT of each column (row of transposed array)
+            set_progress( &progress_info, 2 );
+            error = dct_rows( pool, spectrum->coefs, ncols, nrows, type_fwd, dct_mode,
+                progress ? &pass_progress : NULL );
         }
 
-        cleanup_dcts( &dct_plan );
+        if (!error && flt_isnan( spectrum->coefs[0] )) {
+            error = TERRAIN_FILTER_NULL_VALUES;
+        }
+
+        if (!error && progress) {
+            // report final progress; ignore any cancel request at this point
+            set_progress( &progress_info, 3 );
+            report_progress( &progress_info );
+        }
     }
 
-    cleanup_operator( info );
+    thread_pool_destroy( pool );
 
-    set_progress( &progress_info, 6 );
+    if (error) {
+        free_terrain_spectrum( spectrum );
+    }
 
-    if (progress) {
-        // report final progress; ignore any cancel request at this point
-        report_progress( &progress_info );
+    return error;
+}
+
+int terrain_filter_spectrum(
+    const struct Terrain_Spectrum
+          *spectrum,    // input: forward transform from terrain_spectrum()
+    double detail,      // input: "detail" exponent to be applied
+    float *data,        // output: array of nrows x ncols results (row-major order)
+    int    num_threads, // input: number of threads for DCT passes (<= 0 for all processors)
+    const struct Terrain_Progress_Callback
+          *progress     // optional callback functor for status; NULL for none
+)
+// Computes result of terrain_filter_mt() for one detail value from a forward transform.
+{
+    const enum Terrain_Reg registration = TERRAIN_REG_CELL;
+    const int type_bwd = 3;     // DCT-III for TERRAIN_REG_CELL
+
+    const double steepness = 2.0;
+
+    int nrows = spectrum->nrows;
+    int ncols = spectrum->ncols;
+
+    struct Thread_Pool *pool;
+
+    struct Terrain_Operator_Info info;
+
+    int num_pool_threads;
+
+    float *tdata;   // transposed working copy of spectrum
+
+    int error;
+
+    error = setup_operator(
+        detail, ncols, nrows, fabs( 1.0 / spectrum->xres ), fabs( 1.0 / spectrum->yres ),
+        registration, &info );
+    if (error) {
+        return error;
     }
 
-    return TERRAIN_FILTER_SUCCESS;
+    // normalization (see terrain_filter_pool)
+    info.factor *= pow( 2.0 / (spectrum->data_max - spectrum->data_min), 1.0 - detail );
+    info.factor *= pow( steepness, -detail );
+
+    if (spectrum->dct_mode != TERRAIN_DCT_DOUBLE) {
+        // single-precision modes can use approximate powers (error << float roundoff)
+        info.scale_pow = select_scale_pow( 0 );
+    }
+
+    tdata = (float *)malloc( (LONG)nrows * (LONG)ncols * sizeof( float ) );
+    if (!tdata) {
+        cleanup_operator( info );
+        return TERRAIN_FILTER_MALLOC_ERROR;
+    }
+
+    memcpy( tdata, spectrum->coefs, (LONG)nrows * (LONG)ncols * sizeof( float ) );
+
+    pool = num_threads == 1 ? NULL : thread_pool_create( num_threads );
+
+    if (num_threads != 1 && !pool) {
+        free( tdata );
+        cleanup_operator( info );
+        return TERRAIN_FILTER_MALLOC_ERROR;
+    }
+
+    num_pool_threads = thread_pool_size( pool );
+
+    {
+        // approximate relative amount of time spent in each step
+        const float step_times[3] = { 2.0f/num_pool_threads, 1.0f, 2.0f/num_pool_threads };
+
+        struct Terrain_Progress_Info
+            progress_info = init_progress( progress, step_times, 3 );
+
+        struct Transpose_Progress_Callback
+            sub_progress = { relay_progress, &progress_info };
+
+        struct Thread_Pool_Progress_Callback
+            pass_progress = { relay_progress, &progress_info };
+
+        // operator and inverse DCT of each column (forward DCTs already done)
+        error = operator_columns(
+            pool, tdata, nrows, ncols, 0, type_bwd, spectrum->dct_mode, &info,
+            progress ? &pass_progress : NULL );
+
+        if (!error) {
+            set_progress( &progress_info, 1 );
+            error = transpose_outplace_mt(
+                tdata, data, ncols, nrows, pool, progress ? &sub_progress : NULL );
+            if (error) {
+                error = error > 0 ? TERRAIN_FILTER_MALLOC_ERROR : TERRAIN_FILTER_CANCELED;
+            }
+        }
+
+        if (!error) {
+            set_progress( &progress_info, 2 );
+            error = dct_rows( pool, data, nrows, ncols, type_bwd, spectrum->dct_mode,
+                progress ? &pass_progress : NULL );
+        }
+
+        if (!error && progress) {
+            // report final progress; ignore any cancel request at this point
+            set_progress( &progress_info, 3 );
+            report_progress( &progress_info );
+        }
+    }
+
+    thread_pool_destroy( pool );
+    free( tdata );
+    cleanup_operator( info );
+
+    return error;
+}
+
+void free_terrain_spectrum(
+    struct Terrain_Spectrum
+          *spectrum     // input/output: forward transform from terrain_spectrum()
+)
+// Frees memory allocated by terrain_spectrum().
+{
+    free( spectrum->coefs );
+    spectrum->coefs = NULL;
 }
@@ -48,6 +48,14 @@ enum Terrain_Reg {
     TERRAIN_REG_CELL = 2    // pixels - pixel edges   on grid (adjacent regions don't overlap)
 };
 
+enum Terrain_Dct_Mode {
+    TERRAIN_DCT_DOUBLE = 0, // scalar DCTs in double precision, two rows at a time
+    TERRAIN_DCT_SIMD   = 1, // batched DCTs in single precision, using SIMD instructions
+                            // (operator powers are also vectorized; see fast_pow.h)
+    TERRAIN_DCT_FLOAT  = 2  // scalar DCTs in single precision, in place on each pair of rows
+                            // (operator powers are vectorized as for TERRAIN_DCT_SIMD)
+};
+
 enum Terrain_Filter_Errors {
     TERRAIN_FILTER_SUCCESS       = 0,
     TERRAIN_FILTER_MALLOC_ERROR  = 1,   // memory allocation error occurred
@@ -99,6 +107,88 @@ int terrain_filter(
 //  enum Terrain_Reg registration   // feature not yet implemented
 );
 
+// Same as terrain_filter(), but runs the DCT passes on a pool of worker threads.
+// Results are identical for any number of threads. With TERRAIN_DCT_SIMD or
+// TERRAIN_DCT_FLOAT, results differ from TERRAIN_DCT_DOUBLE by single-precision roundoff.
+int terrain_filter_mt(
+    float *data,        // input/output: array of data to process (row-major order)
+    double detail,      // input: "detail" exponent to be applied
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    double xdim,        // input: spacing between pixel columns (in degrees or meters)
+    double ydim,        // input: spacing between pixel rows    (in degrees or meters)
+    enum Terrain_Coord_Type
+           coord_type,  // input: coordinate type for xdim & ydim (degrees or meters)
+    double center_lat,  // input: latitude in degrees at center of data array
+                        //        (ignored if coord_type == TERRAIN_METERS)
+    enum Terrain_Dct_Mode
+           dct_mode,    // input: DCT implementation to use
+    int    num_threads, // input: number of threads to use (<= 0 for all processors)
+    const struct Terrain_Progress_Callback
+          *progress     // optional callback functor for status; NULL for none
+//  enum Terrain_Reg registration   // feature not yet implemented
+);
+
+
+// MULTIPLE DETAIL VALUES:
+// ======================
+
+// Forward transform of a data array, from which terrain_filter_spectrum() computes
+// the result for any detail value without repeating the forward DCTs.
+// Do NOT free coefs directly - use free_terrain_spectrum() instead.
+struct Terrain_Spectrum {
+    float *coefs;       // DCT coefficients in transposed layout (ncols x nrows)
+    int    nrows;       // number of rows    in data array
+    int    ncols;       // number of columns in data array
+    double xres;        // spacing between pixel columns in meters
+    double yres;        // spacing between pixel rows    in meters
+    float  data_min;    // minimum input data value (for normalization)
+    float  data_max;    // maximum input data value (for normalization)
+    enum Terrain_Dct_Mode
+           dct_mode;    // DCT implementation used
+};
+
+// Computes forward transform of data array, for use by terrain_filter_spectrum().
+// Returns 0 on success, nonzero if an error occurred (see enum Terrain_Filter_Errors).
+// Allocates one array the same size as data; data array is overwritten.
+int terrain_spectrum(
+    float *data,        // input: array of data to process (row-major order); overwritten
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    double xdim,        // input: spacing between pixel columns (in degrees or meters)
+    double ydim,        // input: spacing between pixel rows    (in degrees or meters)
+    enum Terrain_Coord_Type
+           coord_type,  // input: coordinate type for xdim & ydim (degrees or meters)
+    double center_lat,  // input: latitude in degrees at center of data array
+                        //        (ignored if coord_type == TERRAIN_METERS)
+    enum Terrain_Dct_Mode
+           dct_mode,    // input: DCT implementation to use
+    int    num_threads, // input: number of threads to use (<= 0 for all processors)
+    struct Terrain_Spectrum
+          *spectrum,    // output: forward transform of data
+    const struct Terrain_Progress_Callback
+          *progress     // optional callback functor for status; NULL for none
+);
+
+// Computes the result of terrain_filter_mt() for one detail value from a forward
+// transform, which is not modified (so it may be reused for other detail values).
+// Results agree with terrain_filter_mt() to within single-precision roundoff.
+// Returns 0 on success, nonzero if an error occurred (see enum Terrain_Filter_Errors).
+int terrain_filter_spectrum(
+    const struct Terrain_Spectrum
+          *spectrum,    // input: forward transform from terrain_spectrum()
+    double detail,      // input: "detail" exponent to be applied
+    float *data,        // output: array of nrows x ncols results (row-major order)
+    int    num_threads, // input: number of threads to use (<= 0 for all processors)
+    const struct Terrain_Progress_Callback
+          *progress     // optional callback functor for status; NULL for none
+);
+
+// Frees memory allocated by terrain_spectrum().
+void free_terrain_spectrum(
+    struct Terrain_Spectrum
+          *spectrum     // input/output: forward transform from terrain_spectrum()
+);
 
 // AUXILIARY FUNCTIONS FOR TEXTURE SHADING:
 // =======================================
@@ -115,6 +205,32 @@ void fix_mercator(
 //  enum Terrain_Reg registration   // feature not yet implemented
 );
 
+// Same as fix_mercator(), but for a block of rows out of a larger Mercator-projected
+// array (e.g., one tile of an array too large to process all at once).
+void fix_mercator_rows(
+    float *data,    // input/output: block of texture shading data (row-major order)
+    double detail,  // input: "detail" exponent used to create texture shading
+    int    first_row,   // input: row of full array corresponding to first row of block
+    int    nrows,   // input: number of rows    in block
+    int    ncols,   // input: number of columns in block
+    int    total_rows,  // input: number of rows in full array
+    double lat1deg, // input: latitude at bottom edge of bottom pixels of full array, degrees
+    double lat2deg  // input: latitude at top    edge of top    pixels of full array, degrees
+);
+
+// Resamples data between geographic (lat/lon) coordinates and normal-aspect Mercator
+// projection covering the same area with the same number of rows and columns. Only the
+// rows move, since longitude maps linearly to Mercator easting. Uses linear interpolation.
+// Returns 0 on success, nonzero if an error occurred (see enum Terrain_Filter_Errors).
+int resample_mercator_rows(
+    float *data,    // input/output: array of data to resample (row-major order)
+    int    nrows,   // input: number of rows    in data array
+    int    ncols,   // input: number of columns in data array
+    double lat1deg, // input: latitude at bottom edge of bottom pixels, degrees
+    double lat2deg, // input: latitude at top    edge of top    pixels, degrees
+    int    to_mercator  // input: nonzero for geographic to Mercator, 0 for the reverse
+);
+
 // Corrects output of terrain_filter() for scale variation of polar stereographic projection
 // (either North or South Pole). Assumes scale is true at the pole.
 void fix_polar_stereographic(
@@ -184,6 +300,36 @@ void geographic_scale(
 // Determines graticule aspect ratio at given latitude
 double geographic_aspect( double latdeg );
 
+// Converts pixel spacing to meters as used by terrain_filter() (approximately, for
+// geographic coordinates); e.g., to set xres and yres of a Terrain_Spectrum read from a file.
+void terrain_pixel_spacing(
+    double  xdim,       // input:  spacing between pixel columns (in degrees or meters)
+    double  ydim,       // input:  spacing between pixel rows    (in degrees or meters)
+    enum Terrain_Coord_Type
+            coord_type, // input:  coordinate type for xdim & ydim (degrees or meters)
+    double  center_lat, // input:  latitude in degrees at center of data array
+                        //         (ignored if coord_type == TERRAIN_METERS)
+    double *xres,       // output: spacing between pixel columns in meters
+    double *yres        // output: spacing between pixel rows    in meters
+);
+
+// For data in geographic coordinates, sets scale[i] to the width in meters of a pixel at
+// center_lat divided by the width in meters of a pixel in row i, so that a step of dx
+// columns at the center latitude covers the same ground distance as a step of dx*scale[i]
+// columns in row i. Latitudes within 0.001 degree of a pole are treated as 0.001 degree
+// away from it.
+void geographic_row_scale(
+    int     nrows,      // input:  number of rows in data array
+    double  ymax,       // input:  latitude in degrees at top edge of top pixels
+    double  ydim,       // input:  spacing between pixel rows (in degrees)
+    double  center_lat, // input:  latitude in degrees at which the scale is 1
+    double *scale       // output: scale factor for each row (nrows values)
+);
+
+// Determines northing in meters at given latitude for normal-aspect Mercator projection
+// (with scale true at the equator)
+double mercator_northing( double latdeg );
+
 #ifdef __cplusplus
 }
 #endif
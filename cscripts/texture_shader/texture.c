@@ -33,14 +33,23 @@
 
 #include "read_grid_files.h"
 #include "write_grid_files.h"
+#include "read_geotiff.h"
 #include "terrain_filter.h"
+#include "spectrum_cache.h"
+#include "void_fill.h"
+#include "dct.h"
 
 #include <stdio.h>
+#include <stddef.h>     // for ptrdiff_t
+#include <sys/types.h>  // for off_t
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <assert.h>
 
+// For a 64-bit compile we need LONG to be 64 bits, even if the compiler uses an LLP64 model
+#define LONG ptrdiff_t
+
 // CAUTION: This __DATE__ is only updated when THIS file is recompiled.
 // If other source files are modified but this file is not touched,
 // the version date may not be correct.
@@ -52,6 +61,8 @@ static const char sw_format[] = "%s v%s %s";
 
 static const char *command_name;
 
+enum { max_details = 16 };  // maximum number of detail values in list
+
 static const char *get_command_name( const char *argv[] )
 {
     const char *colon;
@@ -95,13 +106,18 @@ static void usage_exit( const char *message )
     fprintf( stderr, "Examples: %s 0.5 rainier_elev.flt rainier_tex.flt\n",         command_name );
     fprintf( stderr, "          %s 1/2 rainier_elev rainier_tex\n",                 command_name );
     fprintf( stderr, "          %s 2/3 rainier_elev rainier_tex -mercator -32.5 45\n", command_name );
+    fprintf( stderr, "          %s 1/2,2/3,1 rainier_elev rainier_tex\n",           command_name );
     fprintf( stderr, "\n" );
     fprintf( stderr, "Normal range for detail is 0.0 to 2.0.\n" );
     fprintf( stderr, "Typical values are 1/2 and 2/3.\n" );
     fprintf( stderr, "(Either decimal or fraction is accepted.)\n" );
+    fprintf( stderr, "A comma-separated list of up to %d detail values writes one output for each,\n",
+        max_details );
+    fprintf( stderr, "named with the detail value appended (e.g., rainier_tex_2-3.flt for 2/3).\n" );
     fprintf( stderr, "\n" );
     fprintf( stderr, "Requires both .flt and .hdr files as input  " );
-    fprintf( stderr, "(e.g., rainier_elev.flt and rainier_elev.hdr).\n" );
+    fprintf( stderr, "(e.g., rainier_elev.flt and rainier_elev.hdr),\n" );
+    fprintf( stderr, "or a Float32 or Int16 GeoTIFF file (e.g., rainier_elev.tif).\n" );
     fprintf( stderr, "Writes   both .flt and .hdr files as output " );
     fprintf( stderr, "(e.g., rainier_tex.flt  and rainier_tex.hdr).\n" );
     fprintf( stderr, "Also reads & writes optional .prj file if present " );
@@ -109,10 +125,30 @@ static void usage_exit( const char *message )
     fprintf( stderr, "Input and output filenames must not be the same.\n" );
     fprintf( stderr, "NOTE: Output files will be overwritten if they already exist.\n" );
     fprintf( stderr, "\n" );
-    fprintf( stderr, "Available option:\n" );
+    fprintf( stderr, "Available options:\n" );
     fprintf( stderr, "    -mercator lat1 lat2    " );
     fprintf( stderr, "input is in normal Mercator projection (not UTM)\n" );
     fprintf( stderr, "Values lat1 and lat2 must be in decimal degrees.\n" );
+    fprintf( stderr, "    -threads N             " );
+    fprintf( stderr, "number of threads to use (default: all processors)\n" );
+    fprintf( stderr, "    -simd                  " );
+    fprintf( stderr, "use faster single-precision SIMD transforms\n" );
+    fprintf( stderr, "    -float                 " );
+    fprintf( stderr, "use single-precision transforms in place (less memory traffic)\n" );
+    fprintf( stderr, "    -memory MB             " );
+    fprintf( stderr, "limit memory use; large arrays are processed in tiles\n" );
+    fprintf( stderr, "    -image contrast        " );
+    fprintf( stderr, "write 8-bit GeoTIFF image (.tif) instead of .flt/.hdr\n" );
+    fprintf( stderr, "Contrast is applied as in texture_image program (typical 0.0 to 10.0).\n" );
+    fprintf( stderr, "    -via_mercator          " );
+    fprintf( stderr, "filter geographic data in Mercator projection\n" );
+    fprintf( stderr, "(more accurate for large lat ranges; requires -image option).\n" );
+    fprintf( stderr, "    -cache dir             " );
+    fprintf( stderr, "reuse forward transform of same DEM from earlier runs\n" );
+    fprintf( stderr, "Cache files in dir are as large as the DEM .flt file; delete when no longer needed.\n" );
+    fprintf( stderr, "    -fill                  " );
+    fprintf( stderr, "fill void (NODATA) points smoothly from surrounding data\n" );
+    fprintf( stderr, "(otherwise voids are left in the input and disturb the result around them).\n" );
     fprintf( stderr, "\n" );
     exit( EXIT_FAILURE );
 }
@@ -134,9 +170,10 @@ static void get_filenames(
     if (dot++ && !strpbrk( dot, "/\\" ) && strlen( dot ) <= 4) {
         // filename has extension (of up to 4 characters)
         strncpy( ext, dot, strlen( ext ) );
-        if (strcmp( dot, "flt" ) != 0 && strcmp( dot, "FLT" ) != 0)
+        if (strcmp( dot, "flt" ) != 0 && strcmp( dot, "FLT" ) != 0 &&
+            strcmp( dot, "tif" ) != 0 && strcmp( dot, "TIF" ) != 0)
         {
-            usage_exit( "Filenames must have .flt extension (if any)." );
+            usage_exit( "Filenames must have .flt or .tif extension (if any)." );
         }
         strcpy ( *data_name, arg );
         strncpy( *hdr_name, arg, len-3 );
@@ -243,6 +280,398 @@ static void check_aspect(
     }
 }
 
+// Tiled processing for arrays too large to process in memory all at once:
+//
+// The texture filter is a fractional Laplacian, whose kernel falls off as
+// r^-(2+detail); the portion of the kernel outside radius r is proportional
+// to r^-detail. Each tile is processed with a halo wide enough that this
+// ignored portion is less than halo_tolerance. Adjacent tiles overlap by more
+// than two halos, and the results are cross-faded with linear ramps in the
+// middle of each overlap (the weights of all tiles always sum to 1), then
+// accumulated into the output .flt file.
+
+// Memory used by terrain_filter() relative to the size of its data array
+// (allows for the transposed copy it makes when memory allows, and for
+// transform buffers).
+static const double filter_memory_factor = 3.0;
+
+// Relative size of the kernel tail ignored beyond the halo.
+static const double halo_tolerance = 1.0 / 16.0;
+
+// Smallest tile (rows or columns) that makes sense to process.
+static const int min_tile_size = 64;
+
+struct Tile_Axis {
+    int size;       // number of pixels in full array along this axis
+    int length;     // number of pixels in each tile, including halos
+    int halo;       // number of pixels discarded at each interior edge of a tile
+    int ntiles;     // number of tiles along this axis
+};
+
+static void setup_tile_axis( struct Tile_Axis *axis, int size, int length, int halo )
+{
+    int step;
+
+    axis->size = size;
+
+    if (length >= size) {
+        axis->length = size;
+        axis->halo   = 0;
+        axis->ntiles = 1;
+        return;
+    }
+
+    // need length >= 5*halo so adjacent blend windows cannot overlap
+    if (halo > length / 5) {
+        halo = length / 5;
+    }
+
+    step = length - 3 * halo;   // max step: halo on each side plus a blend window
+
+    axis->length = length;
+    axis->halo   = halo;
+    axis->ntiles = 1 + (size - length + step - 1) / step;
+}
+
+static int tile_start( const struct Tile_Axis *axis, int k )
+// Returns first pixel of tile k; tiles are spread evenly from 0 to size-length.
+{
+    if (axis->ntiles <= 1) {
+        return 0;
+    }
+    return (int)( (double)k * (double)(axis->size - axis->length) / (double)(axis->ntiles - 1) );
+}
+
+static void blend_window( const struct Tile_Axis *axis, int k, int *start, int *width )
+// Finds the blend window between tiles k and k+1, centered in the part of their
+// overlap outside both halos.
+{
+    int lo = tile_start( axis, k+1 ) + axis->halo;
+    int hi = tile_start( axis, k ) + axis->length - axis->halo;
+
+    *width = axis->halo > 1 ? axis->halo : 1;
+    if (*width > hi - lo) {
+        *width = hi - lo;
+    }
+    *start = (lo + hi - *width) / 2;
+}
+
+static void tile_weights(
+    const struct Tile_Axis *axis, int k, float *weights, int *first, int *last )
+// Computes blend weights for each pixel of tile k, and the range [first,last)
+// of pixels (relative to start of tile) with nonzero weight.
+{
+    int start = tile_start( axis, k );
+    int wstart, width;
+    int i, x;
+    double w;
+
+    *first = 0;
+    *last  = axis->length;
+
+    for (i=0; i<axis->length; ++i) {
+        weights[i] = 1.0f;
+    }
+
+    if (k > 0) {
+        blend_window( axis, k-1, &wstart, &width );
+        *first = wstart - start;
+        for (i=0; i<axis->length; ++i) {
+            x = start + i;
+            if (x < wstart) {
+                weights[i] = 0.0f;
+            } else if (x < wstart + width) {
+                weights[i] = (float)( ((double)(x - wstart) + 0.5) / (double)width );
+            }
+        }
+    }
+
+    if (k < axis->ntiles - 1) {
+        blend_window( axis, k, &wstart, &width );
+        *last = wstart + width - start;
+        for (i=0; i<axis->length; ++i) {
+            x = start + i;
+            if (x >= wstart + width) {
+                weights[i] = 0.0f;
+            } else if (x >= wstart) {
+                w = 1.0 - ((double)(x - wstart) + 0.5) / (double)width;
+                weights[i] *= (float)w;
+            }
+        }
+    }
+}
+
+static void seek_output( FILE *out_dat_file, int ncols, int row, int col )
+{
+    LONG offset = ( (LONG)row * (LONG)ncols + (LONG)col ) * (LONG)sizeof( float );
+    int error;
+
+#if defined(_WIN32)
+    error = _fseeki64( out_dat_file, offset, SEEK_SET );
+#else
+    error = fseeko( out_dat_file, (off_t)offset, SEEK_SET );
+#endif
+
+    if (error) {
+        prefix_error();
+        fprintf( stderr, "Seek error occurred on output .flt file.\n" );
+        exit( EXIT_FAILURE );
+    }
+}
+
+static void fill_input( float *data, int nrows, int ncols, float nodata )
+// Fills void points of input data for -fill option
+{
+    long nfilled;
+    int  error;
+
+    error = fill_voids( data, nrows, ncols, nodata, &nfilled );
+
+    if (error == FILL_VOIDS_MALLOC_ERROR) {
+        prefix_error();
+        fprintf( stderr, "Memory allocation error occurred during filling of voids.\n" );
+        exit( EXIT_FAILURE );
+    } else if (error == FILL_VOIDS_NO_DATA) {
+        fprintf( stderr, "*** WARNING: " );
+        fprintf( stderr, "Input data contains only void (NODATA) points - setting elevations to 0.\n" );
+        memset( data, 0, (LONG)nrows * (LONG)ncols * sizeof( float ) );
+    } else if (nfilled > 0) {
+        printf( "Filled %ld void points.\n", nfilled );
+        fflush( stdout );
+    }
+}
+
+static void process_tiles(
+    FILE *in_dat_file,
+    const struct Flt_Hdr_Info *info,
+    FILE *out_dat_file,
+    const struct Tile_Axis *rows,
+    const struct Tile_Axis *cols,
+    double detail,
+    double xdim,
+    double ydim,
+    enum Terrain_Coord_Type coord_type,
+    double lat1,
+    double lat2,
+    enum Terrain_Dct_Mode dct_mode,
+    int    num_threads,
+    int    fill,
+    int   *has_nulls,
+    int   *all_ints
+)
+// Filters input .flt file one tile at a time and accumulates the blended results
+// into output .flt file, which must be opened for update.
+{
+    int nrows = info->nrows;
+    int ncols = info->ncols;
+
+    float *tile;
+    float *row_weights;
+    float *col_weights;
+    float *buffer;
+
+    int tile_nulls, tile_ints;
+    int ti, tj, ntile;
+    int r0, c0;
+    int rfirst, rlast, cfirst, clast;
+    int i, j, n;
+    LONG count, remaining;
+    double center_lat;
+    float *ptr;
+    float wr;
+    int error;
+
+    tile        = (float *)malloc( (LONG)rows->length * (LONG)cols->length * sizeof( float ) );
+    row_weights = (float *)malloc( rows->length * sizeof( float ) );
+    col_weights = (float *)malloc( cols->length * sizeof( float ) );
+    buffer      = (float *)calloc( cols->length, sizeof( float ) );
+
+    if (!tile || !row_weights || !col_weights || !buffer) {
+        prefix_error();
+        fprintf( stderr, "Memory allocation error occurred during processing of data.\n" );
+        exit( EXIT_FAILURE );
+    }
+
+    *has_nulls = 0;
+    *all_ints  = 1;
+
+    // Fill output file with zeros to accumulate into:
+
+    for (remaining = (LONG)nrows * (LONG)ncols; remaining > 0; remaining -= count) {
+        count = remaining < cols->length ? remaining : cols->length;
+        if ((LONG)fwrite( buffer, sizeof( float ), count, out_dat_file ) < count) {
+            prefix_error();
+            fprintf( stderr, "Write error occurred on output .flt file.\n" );
+            exit( EXIT_FAILURE );
+        }
+    }
+
+    // Process tiles in row-major order:
+
+    for (ti=0, ntile=0; ti<rows->ntiles; ++ti) {
+        r0 = tile_start( rows, ti );
+        tile_weights( rows, ti, row_weights, &rfirst, &rlast );
+
+        for (tj=0; tj<cols->ntiles; ++tj) {
+            c0 = tile_start( cols, tj );
+            tile_weights( cols, tj, col_weights, &cfirst, &clast );
+
+            printf( "Processing tile %d of %d...\n", ++ntile, rows->ntiles * cols->ntiles );
+            fflush( stdout );
+
+            read_flt_block(
+                in_dat_file, info, r0, c0, rows->length, cols->length, tile,
+                &tile_nulls, &tile_ints );
+
+            *has_nulls = *has_nulls || tile_nulls;
+            *all_ints  = *all_ints  && tile_ints;
+
+            if (fill && tile_nulls) {
+                // each tile is filled from its own data, including its halo
+                fill_input( tile, rows->length, cols->length, info->nodata );
+            }
+
+            if (coord_type == TERRAIN_DEGREES) {
+                // aspect ratio for this tile's own latitude range
+                center_lat = info->ymax - ((double)r0 + 0.5 * (double)rows->length) * ydim;
+            } else {
+                center_lat = 0.0;
+            }
+
+            error = terrain_filter_mt(
+                tile, detail, rows->length, cols->length, xdim, ydim, coord_type, center_lat,
+                dct_mode, num_threads, NULL );
+
+            if (error) {
+                assert( error == TERRAIN_FILTER_MALLOC_ERROR );
+                prefix_error();
+                fprintf( stderr, "Memory allocation error occurred during processing of data.\n" );
+                exit( EXIT_FAILURE );
+            }
+
+            if (lat1 != lat2) {
+                fix_mercator_rows( tile, detail, r0, rows->length, cols->length, nrows, lat1, lat2 );
+            }
+
+            // Add weighted tile into output file:
+
+            n = clast - cfirst;
+
+            for (i=rfirst; i<rlast; ++i) {
+                ptr = tile + (LONG)i * (LONG)cols->length;
+                wr  = row_weights[i];
+
+                seek_output( out_dat_file, ncols, r0 + i, c0 + cfirst );
+                if ((int)fread( buffer, sizeof( float ), n, out_dat_file ) < n) {
+                    prefix_error();
+                    fprintf( stderr, "Read error occurred on output .flt file.\n" );
+                    exit( EXIT_FAILURE );
+                }
+
+                for (j=0; j<n; ++j) {
+                    buffer[j] += wr * col_weights[cfirst+j] * ptr[cfirst+j];
+                }
+
+                seek_output( out_dat_file, ncols, r0 + i, c0 + cfirst );
+                if ((int)fwrite( buffer, sizeof( float ), n, out_dat_file ) < n) {
+                    prefix_error();
+                    fprintf( stderr, "Write error occurred on output .flt file.\n" );
+                    exit( EXIT_FAILURE );
+                }
+            }
+        }
+    }
+
+    free( buffer );
+    free( col_weights );
+    free( row_weights );
+    free( tile );
+}
+
+// Multiple detail values (from a comma-separated list):
+
+struct Texture_Output {
+    double detail;      // detail exponent for this output
+    const char *label;  // detail value as given on command line (not null terminated)
+    size_t label_len;
+    char  *dat_name;    // .flt or .tif filename
+    char  *hdr_name;
+    char  *prj_name;
+    FILE  *dat_file;
+    FILE  *hdr_file;    // null for .tif output
+};
+
+// Reads one detail value (decimal or fraction) ending at a comma or end of string.
+// Returns nonzero if successful.
+static int read_detail( const char *str, double *detail, const char **end )
+{
+    char *endptr;
+
+    if ( strchr( str, '/' ) && strchr( str, '/' ) < str + strcspn( str, "," ) ) {
+        // read fraction: integer/integer
+        *detail = (double)strtol( str, &endptr, 10 );
+        if (endptr == str || *endptr != '/' || endptr[1] < '1' || endptr[1] > '9') {
+            return 0;
+        }
+        *detail /= (double)strtol( endptr+1, &endptr, 10 );
+    } else {
+        // read decimal number
+        *detail = strtod( str, &endptr );
+    }
+
+    *end = endptr;
+    return endptr != str && (*endptr == '\0' || *endptr == ',');
+}
+
+// Returns output filename for one of several detail values; label is the detail value
+// as given on the command line, appended to the base filename with '/' changed to '-'.
+// NOTE: caller is responsible to free the returned pointer!
+static char *detail_filename(
+    const char *arg, const char *label, size_t label_len, const char *default_ext )
+{
+    const char *dot;
+    const char *ext = default_ext;
+
+    size_t len = strlen( arg );
+    size_t k;
+
+    char *name = (char *)malloc( len + label_len + 6 );     // assume this malloc succeeds
+
+    dot = strrchr( arg, '.' );
+    if (dot && !strpbrk( dot+1, "/\\" ) && strlen( dot+1 ) <= 4) {
+        // filename has extension
+        ext = dot+1;
+        len = dot - arg;
+    }
+
+    strncpy( name, arg, len );
+    name[len++] = '_';
+    for (k=0; k<label_len; ++k) {
+        name[len++] = label[k] == '/' ? '-' : label[k];
+    }
+    name[len++] = '.';
+    strcpy( name+len, ext );
+
+    return name;
+}
+
+static void warn_input( int has_nulls, int all_ints, double detail )
+{
+    if (has_nulls) {
+        fprintf( stderr, "*** WARNING: " );
+        fprintf( stderr, "Input .flt file contains void (NODATA) points.\n" );
+        fprintf( stderr, "***          " );
+        fprintf( stderr, "Assuming these are ocean points - setting these elevations to 0.\n" );
+    }
+
+    if (all_ints && detail > 0.0) {
+        fprintf( stderr, "*** WARNING: " );
+        fprintf( stderr, "Input .flt file appears to contain only integer values.\n" );
+        fprintf( stderr, "***          " );
+        fprintf( stderr, "This may degrade the quality of the result.\n" );
+    }
+}
+
 #ifndef NOMAIN
 
 int main( int argc, const char *argv[] )
@@ -256,23 +685,33 @@ int main( int argc, const char *argv[] )
     int argnum;
 
     const char *thisarg;
+    const char *out_arg;
     char *endptr;
     char extension[4];  // 3 chars plus null terminator
 
     char *in_dat_name;
     char *in_hdr_name;
     char *in_prj_name;
-    char *out_dat_name;
-    char *out_hdr_name;
-    char *out_prj_name;
 
     double detail;
+    double max_detail;
+    int ndetails;
+    const char *detail_end;
+
+    struct Texture_Output outputs[max_details];
+    struct Terrain_Spectrum spectrum;
+    int use_spectrum;
+
+    const char *cache_dir = NULL;   // default unless -cache option used
+    int fill = 0;           // default unless -fill option used
+    struct Spectrum_Cache_Key cache_key;
+    char *cache_name;
+    char *name;
+    int k;
 
     FILE *in_dat_file;
     FILE *in_hdr_file;
     FILE *in_prj_file;
-    FILE *out_dat_file;
-    FILE *out_hdr_file;
     FILE *out_prj_file;
 
     int nrows;
@@ -291,12 +730,40 @@ int main( int argc, const char *argv[] )
     int proj_type;
     int has_nulls;
     int all_ints;
+    int tif_input;
 
     double lat1 = 0.0;  // default unless -merc option used
     double lat2 = 0.0;  // default unless -merc option used
     double center_lat;
     double temp;
 
+    int num_threads = 0;    // default unless -threads option used (0 = all processors)
+
+    int image = 0;          // default unless -image option used
+    double contrast = 0.0;
+    int via_mercator = 0;   // default unless -via_mercator option used
+    double geo_xmin;
+    double geo_xmax;
+    double geo_ymin;
+    double geo_ymax;
+    double xsize;
+    double ysize;
+
+    double memory_mb = 0.0; // default unless -memory option used (0 = no limit)
+    double max_pixels = 0.0;
+    double halo = 0.0;
+    int tiled = 0;
+    int tile_rows = 0;
+    int tile_cols = 0;
+    int need_rows;
+    int need_cols;
+
+    struct Flt_Hdr_Info info;
+    struct Tile_Axis row_tiles;
+    struct Tile_Axis col_tiles;
+
+    enum Terrain_Dct_Mode dct_mode = TERRAIN_DCT_DOUBLE;    // default unless -simd or -float used
+
     int error;
 
     printf( "\nTerrain texture shading program - version %s, built %s\n", sw_version, sw_date );
@@ -315,19 +782,28 @@ int main( int argc, const char *argv[] )
     argnum = 1;
 
     thisarg = argv[argnum++];
-    if ( strchr( thisarg, '/' ) ) {
-        // read fraction: integer/integer
-        detail = (double)strtol( thisarg, &endptr, 10 );
-        if (endptr == thisarg || *endptr != '/' || endptr[1] < '1' || endptr[1] > '9') {
-            usage_exit( "First parameter (detail) must be a number or fraction." );
+    for (ndetails=0; ; ++ndetails) {
+        if (ndetails == max_details) {
+            usage_exit( "Too many detail values in list." );
         }
-        detail /= (double)strtol( endptr+1, &endptr, 10 );
-    } else {
-        // read decimal number
-        detail = strtod( thisarg, &endptr );
+        if (!read_detail( thisarg, &outputs[ndetails].detail, &detail_end )) {
+            usage_exit( "First parameter (detail) must be a number or fraction (or a list)." );
+        }
+        outputs[ndetails].label     = thisarg;
+        outputs[ndetails].label_len = detail_end - thisarg;
+        if (*detail_end == '\0') {
+            break;
+        }
+        thisarg = detail_end + 1;
     }
-    if (endptr == thisarg || *endptr != '\0') {
-        usage_exit( "First parameter (detail) must be a number or fraction." );
+    ++ndetails;
+
+    detail = outputs[0].detail;
+    max_detail = detail;
+    for (k=1; k<ndetails; ++k) {
+        if (outputs[k].detail > max_detail) {
+            max_detail = outputs[k].detail;
+        }
     }
 
     software = (char *)malloc( strlen(sw_format) + strlen(sw_name) + strlen(sw_version) + strlen(sw_date) );
@@ -342,13 +818,9 @@ int main( int argc, const char *argv[] )
 
     strncpy( extension, "flt", 4 );
     get_filenames( argv[argnum++], &in_dat_name, &in_hdr_name, &in_prj_name, extension );
+    tif_input = is_geotiff_name( in_dat_name );
 
-    strncpy( extension, "flt", 4 );
-    get_filenames( argv[argnum++], &out_dat_name, &out_hdr_name, &out_prj_name, extension );
-
-    if (!strcmp( in_hdr_name, out_hdr_name )) {
-        usage_exit( "Input and outfile filenames must not be the same." );
-    }
+    out_arg = argv[argnum++];   // output filename depends on -image option
 
     while (argnum < argc) {
         thisarg = argv[argnum++];
@@ -383,6 +855,47 @@ int main( int argc, const char *argv[] )
             if (lat1 <= -90.0 || lat2 >= 90.0) {
                 usage_exit( "Mercator latitude limits must be between -90 and +90 (exclusive)." );
             }
+        } else if (strncmp( thisarg, "threads", 6 ) == 0) {
+            if (argnum >= argc) {
+                usage_exit( "Option -threads must be followed by a positive integer." );
+            }
+            thisarg = argv[argnum++];
+            num_threads = (int)strtol( thisarg, &endptr, 10 );
+            if (endptr == thisarg || *endptr != '\0' || num_threads < 1) {
+                usage_exit( "Option -threads must be followed by a positive integer." );
+            }
+        } else if (strcmp( thisarg, "simd" ) == 0) {
+            dct_mode = TERRAIN_DCT_SIMD;
+        } else if (strcmp( thisarg, "float" ) == 0) {
+            dct_mode = TERRAIN_DCT_FLOAT;
+        } else if (strncmp( thisarg, "memory", 3 ) == 0) {
+            if (argnum >= argc) {
+                usage_exit( "Option -memory must be followed by a positive number of megabytes." );
+            }
+            thisarg = argv[argnum++];
+            memory_mb = strtod( thisarg, &endptr );
+            if (endptr == thisarg || *endptr != '\0' || memory_mb <= 0.0) {
+                usage_exit( "Option -memory must be followed by a positive number of megabytes." );
+            }
+        } else if (strcmp( thisarg, "image" ) == 0) {
+            if (argnum >= argc) {
+                usage_exit( "Option -image must be followed by a numeric contrast value." );
+            }
+            thisarg = argv[argnum++];
+            contrast = strtod( thisarg, &endptr );
+            if (endptr == thisarg || *endptr != '\0') {
+                usage_exit( "Option -image must be followed by a numeric contrast value." );
+            }
+            image = 1;
+        } else if (strcmp( thisarg, "via_mercator" ) == 0) {
+            via_mercator = 1;
+        } else if (strcmp( thisarg, "cache" ) == 0) {
+            if (argnum >= argc) {
+                usage_exit( "Option -cache must be followed by a directory name." );
+            }
+            cache_dir = argv[argnum++];
+        } else if (strcmp( thisarg, "fill" ) == 0) {
+            fill = 1;
         } else if (strncmp( thisarg, "cellreg", 4 ) == 0 ||
                    strncmp( thisarg, "corner",  6 ) == 0)
         {
@@ -402,11 +915,60 @@ int main( int argc, const char *argv[] )
         }
     }
 
-    in_hdr_file = fopen( in_hdr_name, "rb" );   // use binary mode for compatibility
-    if (!in_hdr_file) {
-        prefix_error();
-        fprintf( stderr, "Could not open input file '%s'.\n", in_hdr_name );
-        usage_exit( 0 );
+    for (k=0; k<ndetails; ++k) {
+        strncpy( extension, image ? "tif" : "flt", 4 );
+        if (ndetails > 1) {
+            name = detail_filename( out_arg, outputs[k].label, outputs[k].label_len, extension );
+            get_filenames( name, &outputs[k].dat_name, &outputs[k].hdr_name, &outputs[k].prj_name,
+                extension );
+            free( name );
+        } else {
+            get_filenames( out_arg, &outputs[k].dat_name, &outputs[k].hdr_name, &outputs[k].prj_name,
+                extension );
+        }
+        if (image ? strcmp( extension, "tif" ) != 0 && strcmp( extension, "TIF" ) != 0
+                  : strcmp( extension, "flt" ) != 0 && strcmp( extension, "FLT" ) != 0)
+        {
+            usage_exit( image ? "Output filename must have .tif extension with -image option."
+                              : "Output filename must have .flt extension (if any)." );
+        }
+
+        if (!strcmp( in_hdr_name, outputs[k].hdr_name )) {
+            usage_exit( "Input and outfile filenames must not be the same." );
+        }
+    }
+
+    if (ndetails > 1 && memory_mb > 0.0) {
+        usage_exit( "A list of detail values cannot be used with -memory option." );
+    }
+    if (cache_dir && memory_mb > 0.0) {
+        usage_exit( "Option -cache cannot be used with -memory option." );
+    }
+
+    // several detail values, or a cached transform, use terrain_spectrum()
+    use_spectrum = ndetails > 1 || cache_dir;
+
+    if (via_mercator && !image) {
+        usage_exit( "Option -via_mercator requires -image option." );
+    }
+    if (via_mercator && lat1 != lat2) {
+        usage_exit( "Options -via_mercator and -mercator cannot be used together." );
+    }
+    if (image && memory_mb > 0.0) {
+        usage_exit( "Option -image cannot be used with -memory option." );
+    }
+    if (tif_input && memory_mb > 0.0) {
+        usage_exit( "Option -memory requires .flt input." );
+    }
+
+    in_hdr_file = NULL;     // GeoTIFF input has no .hdr file
+    if (!tif_input) {
+        in_hdr_file = fopen( in_hdr_name, "rb" );   // use binary mode for compatibility
+        if (!in_hdr_file) {
+            prefix_error();
+            fprintf( stderr, "Could not open input file '%s'.\n", in_hdr_name );
+            usage_exit( 0 );
+        }
     }
 
     in_dat_file = fopen( in_dat_name, "rb" );
@@ -419,47 +981,128 @@ int main( int argc, const char *argv[] )
     free( in_dat_name );
     free( in_hdr_name );
 
-    out_hdr_file = fopen( out_hdr_name, "wb" ); // use binary mode for compatibility
-    if (!out_hdr_file) {
-        prefix_error();
-        fprintf( stderr, "Could not open output file '%s'.\n", out_hdr_name );
-        usage_exit( 0 );
-    }
+    if (!tif_input && (memory_mb > 0.0 || fill)) {
+        // read header first to see whether array fits in memory budget (before
+        // any output file is created), and for NODATA value to fill
+        read_flt_hdr_info( in_hdr_file, &info, 0 );
+        if (memory_mb > 0.0) {
+            max_pixels = memory_mb * 1048576.0 / ( sizeof( float ) * filter_memory_factor );
+            tiled = (double)info.nrows * (double)info.ncols > max_pixels;
+        }
+        if (tiled) {
+            halo = detail > 0.0 ? ceil( pow( halo_tolerance, -1.0 / detail ) )
+                                : (double)info.nrows + info.ncols;
+            if (halo > (double)info.nrows + info.ncols) {
+                halo = (double)info.nrows + info.ncols;
+            }
 
-    out_dat_file = fopen( out_dat_name, "wb" );
-    if (!out_dat_file) {
-        prefix_error();
-        fprintf( stderr, "Could not open output file '%s'.\n", out_dat_name );
-        usage_exit( 0 );
+            // a tiled axis needs tiles of at least 5 halos (see setup_tile_axis()),
+            // or the tiles would not match the untiled result
+            need_rows = 5.0 * halo < (double)info.nrows ? (int)( 5.0 * halo ) : info.nrows;
+            need_cols = 5.0 * halo < (double)info.ncols ? (int)( 5.0 * halo ) : info.ncols;
+            if ((double)need_rows * (double)need_cols > max_pixels) {
+                prefix_error();
+                fprintf( stderr, "Memory limit of %g MB is too small for tiles with the overlap of %d pixels\n",
+                    memory_mb, (int)halo );
+                fprintf( stderr, "needed for detail = %f (at least %.1f MB needed).\n", detail,
+                    (double)need_rows * (double)need_cols * sizeof( float ) * filter_memory_factor / 1048576.0 );
+                exit( EXIT_FAILURE );
+            }
+
+            // choose tiles as large as memory budget allows
+            tile_rows = (int)sqrt( max_pixels );
+            tile_cols = tile_rows;
+            if (tile_cols >= info.ncols) {
+                tile_cols = info.ncols;
+                tile_rows = (int)( max_pixels / (double)info.ncols );
+            } else if (tile_rows >= info.nrows) {
+                tile_rows = info.nrows;
+                tile_cols = (int)( max_pixels / (double)info.nrows );
+            }
+            // otherwise make them long enough along one axis for the overlap, and
+            // as wide as the budget allows along the other
+            if (tile_rows < need_rows) {
+                tile_rows = need_rows;
+                tile_cols = (int)( max_pixels / (double)tile_rows );
+                tile_cols = tile_cols < info.ncols ? tile_cols : info.ncols;
+            } else if (tile_cols < need_cols) {
+                tile_cols = need_cols;
+                tile_rows = (int)( max_pixels / (double)tile_cols );
+                tile_rows = tile_rows < info.nrows ? tile_rows : info.nrows;
+            }
+            if (tile_rows < min_tile_size || tile_cols < min_tile_size) {
+                prefix_error();
+                fprintf( stderr, "Memory limit of %g MB is too small for tiled processing.\n", memory_mb );
+                exit( EXIT_FAILURE );
+            }
+        }
+        rewind( in_hdr_file );
     }
 
-    free( out_dat_name );
-    free( out_hdr_name );
+    for (k=0; k<ndetails; ++k) {
+        if (image) {
+            outputs[k].hdr_file = NULL; // GeoTIFF output has no .hdr file
+        } else {
+            // use binary mode for compatibility
+            outputs[k].hdr_file = fopen( outputs[k].hdr_name, "wb" );
+            if (!outputs[k].hdr_file) {
+                prefix_error();
+                fprintf( stderr, "Could not open output file '%s'.\n", outputs[k].hdr_name );
+                usage_exit( 0 );
+            }
+        }
+
+        outputs[k].dat_file = fopen( outputs[k].dat_name, "w+b" ); // tiled mode rereads output
+        if (!outputs[k].dat_file) {
+            prefix_error();
+            fprintf( stderr, "Could not open output file '%s'.\n", outputs[k].dat_name );
+            usage_exit( 0 );
+        }
+
+        free( outputs[k].dat_name );
+        free( outputs[k].hdr_name );
+    }
 
     // Read .flt and .hdr files:
 
     printf( "Reading input files...\n" );
     fflush( stdout );
 
-    data = read_flt_hdr_files(
-        in_dat_file, in_hdr_file, &nrows, &ncols, &xmin, &xmax, &ymin, &ymax,
-        &has_nulls, &all_ints, 0 );
+    if (tiled) {
+        // data will be read one tile at a time
+        nrows = info.nrows;
+        ncols = info.ncols;
+        xmin  = info.xmin;
+        xmax  = info.xmax;
+        ymin  = info.ymin;
+        ymax  = info.ymax;
+        data  = NULL;
+
+        fclose( in_hdr_file );
+    } else {
+        if (tif_input) {
+            // header info comes from the GeoTIFF tags
+            data = read_geotiff_file( in_dat_file, &info, &has_nulls, &all_ints );
+            nrows = info.nrows;
+            ncols = info.ncols;
+            xmin  = info.xmin;
+            xmax  = info.xmax;
+            ymin  = info.ymin;
+            ymax  = info.ymax;
+        } else {
+            data = read_flt_hdr_files(
+                in_dat_file, in_hdr_file, &nrows, &ncols, &xmin, &xmax, &ymin, &ymax,
+                &has_nulls, &all_ints, 0 );
+            fclose( in_hdr_file );
+        }
 
-    fclose( in_dat_file );
-    fclose( in_hdr_file );
+        fclose( in_dat_file );
 
-    if (has_nulls) {
-        fprintf( stderr, "*** WARNING: " );
-        fprintf( stderr, "Input .flt file contains void (NODATA) points.\n" );
-        fprintf( stderr, "***          " );
-        fprintf( stderr, "Assuming these are ocean points - setting these elevations to 0.\n" );
-    }
+        warn_input( has_nulls && !fill, all_ints, max_detail );
 
-    if (all_ints && detail > 0.0) {
-        fprintf( stderr, "*** WARNING: " );
-        fprintf( stderr, "Input .flt file appears to contain only integer values.\n" );
-        fprintf( stderr, "***          " );
-        fprintf( stderr, "This may degrade the quality of the result.\n" );
+        if (fill && has_nulls) {
+            fill_input( data, nrows, ncols, info.nodata );
+        }
     }
 
     // Process data:
@@ -502,66 +1145,243 @@ int main( int argc, const char *argv[] )
 
     }
 
+    geo_xmin = xmin;
+    geo_xmax = xmax;
+    geo_ymin = ymin;
+    geo_ymax = ymax;
+
+    if (via_mercator) {
+        if (proj_type > 0) {
+            usage_exit( "Option -via_mercator is only valid for data in geographic coordinates." );
+        }
+
+        // resample rows to Mercator spacing and filter as projected data
+        lat1 = ymin > -89.999 ? ymin : -89.999;
+        lat2 = ymax <  89.999 ? ymax :  89.999;
+
+        printf( "Resampling to normal-aspect Mercator projection for processing.\n" );
+        printf( "Latitude range %.3f deg %c to %.3f deg %c.\n\n",
+            fabs(lat1), lat1>=0.0 ? 'N' : 'S', fabs(lat2), lat2>=0.0 ? 'N' : 'S' );
+        fflush( stdout );
+
+        error = resample_mercator_rows( data, nrows, ncols, lat1, lat2, 1 );
+        if (error) {
+            prefix_error();
+            fprintf( stderr, "Memory allocation error occurred during processing of data.\n" );
+            exit( EXIT_FAILURE );
+        }
+
+        // Mercator extent in meters, with scale true at the equator
+        geographic_scale( 0.0, &xsize, &ysize );
+        xmin *= xsize;
+        xmax *= xsize;
+        ymin = mercator_northing( lat1 );
+        ymax = mercator_northing( lat2 );
+        xdim = (xmax - xmin) / (double)ncols;
+        ydim = (ymax - ymin) / (double)nrows;
+
+        coord_type = TERRAIN_METERS;
+        proj_type = 2;  // indicate Mercator projection
+    }
+
     // check pixel aspect ratio and size of map extent
     check_aspect( xmin, xmax, ymin, ymax, xdim, ydim, proj_type );
 
-    if (detail <= 0.0 || detail > 2.0) {
-        fprintf( stderr, "*** WARNING: " );
-        fprintf( stderr, "Unusual value for detail exponent. Is this correct?\n" );
+    for (k=0; k<ndetails; ++k) {
+        if (outputs[k].detail <= 0.0 || outputs[k].detail > 2.0) {
+            fprintf( stderr, "*** WARNING: " );
+            fprintf( stderr, "Unusual value for detail exponent. Is this correct?\n" );
+            break;
+        }
     }
 
-    printf(
-        "Processing %d column x %d row array using detail = %f...\n",
-        ncols, nrows, detail );
+    if (ndetails > 1) {
+        printf(
+            "Processing %d column x %d row array using %d detail values...\n",
+            ncols, nrows, ndetails );
+    } else {
+        printf(
+            "Processing %d column x %d row array using detail = %f...\n",
+            ncols, nrows, detail );
+    }
+    if (dct_mode == TERRAIN_DCT_SIMD) {
+        printf( "Using single-precision %s transforms.\n", batch_dcts_isa() );
+    } else if (dct_mode == TERRAIN_DCT_FLOAT) {
+        printf( "Using single-precision transforms.\n" );
+    }
     fflush( stdout );
 
-    error = terrain_filter(
-        data, detail, nrows, ncols, xdim, ydim, coord_type, center_lat, &progress );
+    if (tiled) {
+        setup_tile_axis( &row_tiles, nrows, tile_rows, (int)halo );
+        setup_tile_axis( &col_tiles, ncols, tile_cols, (int)halo );
 
-    if (error) {
-        assert( error == TERRAIN_FILTER_MALLOC_ERROR );
-        prefix_error();
-        fprintf( stderr, "Memory allocation error occurred during processing of data.\n" );
-        exit( EXIT_FAILURE );
-    }
+        printf( "Using %d x %d tiles of %d columns x %d rows to stay within %g MB.\n",
+            col_tiles.ntiles, row_tiles.ntiles, col_tiles.length, row_tiles.length, memory_mb );
+        fflush( stdout );
 
-    if (lat1 != lat2) {
-        fix_mercator( data, detail, nrows, ncols, lat1, lat2 );
+        process_tiles(
+            in_dat_file, &info, outputs[0].dat_file, &row_tiles, &col_tiles,
+            detail, xdim, ydim, coord_type, lat1, lat2, dct_mode, num_threads, fill,
+            &has_nulls, &all_ints );
+
+        fclose( in_dat_file );
+
+        warn_input( has_nulls && !fill, all_ints, max_detail );
+    } else if (!use_spectrum) {
+        error = terrain_filter_mt(
+            data, detail, nrows, ncols, xdim, ydim, coord_type, center_lat,
+            dct_mode, num_threads, &progress );
+
+        if (error) {
+            assert( error == TERRAIN_FILTER_MALLOC_ERROR );
+            prefix_error();
+            fprintf( stderr, "Memory allocation error occurred during processing of data.\n" );
+            exit( EXIT_FAILURE );
+        }
+    } else {
+        // forward transforms are the same for every detail value
+        error = 1;
+
+        if (cache_dir) {
+            cache_key.hash         = hash_terrain_data( data, nrows, ncols );
+            cache_key.nrows        = nrows;
+            cache_key.ncols        = ncols;
+            cache_key.registration = TERRAIN_REG_CELL;
+            cache_key.coord_type   = coord_type;
+            cache_key.dct_mode     = dct_mode;
+
+            cache_name = spectrum_cache_filename( cache_dir, &cache_key );
+
+            error = read_spectrum_cache( cache_name, &cache_key, &spectrum );
+            if (!error) {
+                printf( "Using cached transform '%s'.\n", cache_name );
+                fflush( stdout );
+
+                terrain_pixel_spacing(
+                    xdim, ydim, coord_type, center_lat, &spectrum.xres, &spectrum.yres );
+            }
+        }
+
+        if (error) {
+            error = terrain_spectrum(
+                data, nrows, ncols, xdim, ydim, coord_type, center_lat,
+                dct_mode, num_threads, &spectrum, &progress );
+
+            if (error) {
+                assert( error == TERRAIN_FILTER_MALLOC_ERROR );
+                prefix_error();
+                fprintf( stderr, "Memory allocation error occurred during processing of data.\n" );
+                exit( EXIT_FAILURE );
+            }
+
+            if (cache_dir && write_spectrum_cache( cache_name, &cache_key, &spectrum )) {
+                fprintf( stderr, "*** WARNING: " );
+                fprintf( stderr, "Could not write cache file '%s'.\n", cache_name );
+            }
+        }
+
+        if (cache_dir) {
+            free( cache_name );
+        }
     }
 
-    // Write .flt and .hdr files:
+    for (k=0; k<ndetails; ++k) {
+        detail = outputs[k].detail;
 
-    printf( "Writing output files...\n" );
-    fflush( stdout );
+        if (use_spectrum) {
+            printf( "Applying detail = %f...\n", detail );
+            fflush( stdout );
 
-    write_flt_hdr_files(
-        out_dat_file, out_hdr_file, nrows, ncols, xmin, xmax, ymin, ymax, data, software );
+            last_count = -1;
 
-    fclose( out_dat_file );
-    fclose( out_hdr_file );
+            error = terrain_filter_spectrum( &spectrum, detail, data, num_threads, &progress );
 
-    free( data );
-    free( software );
+            if (error) {
+                assert( error == TERRAIN_FILTER_MALLOC_ERROR );
+                prefix_error();
+                fprintf( stderr, "Memory allocation error occurred during processing of data.\n" );
+                exit( EXIT_FAILURE );
+            }
+        }
 
-    // Copy optional .prj file:
+        if (!tiled && lat1 != lat2) {
+            fix_mercator( data, detail, nrows, ncols, lat1, lat2 );
+        }
 
-    in_prj_file = fopen( in_prj_name, "rb" );   // use binary mode for compatibility
-    if (in_prj_file) {
-        out_prj_file = fopen( out_prj_name, "wb" ); // use binary mode for compatibility
-        if (!out_prj_file) {
-            fprintf( stderr, "*** WARNING: " );
-            fprintf( stderr, "Could not open output file '%s'.\n", out_prj_name );
+        if (image) {
+            // Adjust contrast:
+
+            terrain_image_data( data, nrows, ncols, contrast, 0.0, 255.0 );
+
+            if (via_mercator) {
+                error = resample_mercator_rows( data, nrows, ncols, lat1, lat2, 0 );
+                if (error) {
+                    prefix_error();
+                    fprintf( stderr, "Memory allocation error occurred during processing of data.\n" );
+                    exit( EXIT_FAILURE );
+                }
+            }
+        }
+
+        // Write .flt and .hdr files:
+
+        printf( "Writing output files...\n" );
+        fflush( stdout );
+
+        if (image) {
+            if (via_mercator) {
+                write_geotiff8_file(
+                    outputs[k].dat_file, nrows, ncols, geo_xmin, geo_xmax, geo_ymin, geo_ymax, 1,
+                    data, software );
+            } else {
+                write_geotiff8_file(
+                    outputs[k].dat_file, nrows, ncols, xmin, xmax, ymin, ymax, proj_type < 0,
+                    data, software );
+            }
+        } else if (tiled) {
+            // .flt file already written by process_tiles()
+            write_hdr_for_flt_file(
+                outputs[k].dat_file, outputs[k].hdr_file, nrows, ncols, xmin, xmax, ymin, ymax,
+                software );
         } else {
-            // copy file and change any "ZUNITS" line to "ZUNITS NO"
-            copy_prj_file( in_prj_file, out_prj_file );
+            write_flt_hdr_files(
+                outputs[k].dat_file, outputs[k].hdr_file, nrows, ncols, xmin, xmax, ymin, ymax,
+                data, software );
+        }
+
+        fclose( outputs[k].dat_file );
+        if (outputs[k].hdr_file) {
+            fclose( outputs[k].hdr_file );
+        }
 
-            fclose( out_prj_file );
+        // Copy optional .prj file:
+
+        in_prj_file = fopen( in_prj_name, "rb" );   // use binary mode for compatibility
+        if (in_prj_file) {
+            // use binary mode for compatibility
+            out_prj_file = fopen( outputs[k].prj_name, "wb" );
+            if (!out_prj_file) {
+                fprintf( stderr, "*** WARNING: " );
+                fprintf( stderr, "Could not open output file '%s'.\n", outputs[k].prj_name );
+            } else {
+                // copy file and change any "ZUNITS" line to "ZUNITS NO"
+                copy_prj_file( in_prj_file, out_prj_file );
+
+                fclose( out_prj_file );
+            }
+            fclose( in_prj_file );
         }
-        fclose( in_prj_file );
+
+        free( outputs[k].prj_name );
     }
 
+    if (use_spectrum) {
+        free_terrain_spectrum( &spectrum );
+    }
+
+    free( data );
+    free( software );
     free( in_prj_name );
-    free( out_prj_name );
 
     printf( "DONE.\n" );
 
@@ -0,0 +1,326 @@
+/*
+ * thread_pool.c
+ *
+ * Worker thread pool shared by the texture_shader tools.
+ * Added for tectoplot; distributed under the same terms as the other
+ * files in this directory (see LICENSE.txt).
+ */
+
+#define _CRT_SECURE_NO_DEPRECATE
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "thread_pool.h"
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#ifndef _WIN32
+#   include <unistd.h>      // sysconf()
+#endif
+
+// Tasks are handed out in chunks small enough to balance uneven rows
+// but large enough that the shared counter is not contended.
+static const long chunks_per_thread = 16;
+
+struct Thread_Pool_Worker {
+    struct Thread_Pool *pool;
+    int    thread;          // thread index (1 to nthreads-1)
+};
+
+struct Thread_Pool {
+    int    nthreads;        // total threads including the calling thread
+    pthread_t *threads;     // nthreads-1 worker threads
+    struct Thread_Pool_Worker
+          *workers;         // argument for each worker thread
+
+    pthread_mutex_t lock;   // protects everything below
+    pthread_cond_t  start;  // signaled when a new run is posted or on shutdown
+    pthread_cond_t  done;   // signaled when a chunk completes or a worker goes idle
+
+    unsigned long generation;   // incremented for each run
+    int    shutdown;
+    int    busy;            // number of worker threads still in current run
+
+    // current run:
+    Thread_Pool_Task func;
+    void  *state;
+    long   ntasks;
+    long   chunk;
+    long   next;            // next task to hand out
+    long   completed;       // number of tasks finished
+    int    cancel;
+    int    error;
+};
+
+int thread_pool_num_cores( void )
+{
+    long ncores = 1;
+#if defined(_SC_NPROCESSORS_ONLN)
+    ncores = sysconf( _SC_NPROCESSORS_ONLN );
+#endif
+    return ncores > 0 ? (int)ncores : 1;
+}
+
+// Claims and runs chunks until no tasks remain, the run is canceled, or a task fails.
+static void run_chunks( struct Thread_Pool *pool, int thread )
+{
+    long first, last;
+    int  error;
+
+    for (;;) {
+        pthread_mutex_lock( &pool->lock );
+        if (pool->cancel || pool->error || pool->next >= pool->ntasks) {
+            pthread_mutex_unlock( &pool->lock );
+            return;
+        }
+        first = pool->next;
+        last  = first + pool->chunk;
+        if (last > pool->ntasks) {
+            last = pool->ntasks;
+        }
+        pool->next = last;
+        pthread_mutex_unlock( &pool->lock );
+
+        error = pool->func( first, last, thread, pool->state );
+
+        pthread_mutex_lock( &pool->lock );
+        pool->completed += last - first;
+        if (error && !pool->error) {
+            pool->error = error;
+        }
+        pthread_cond_signal( &pool->done );
+        pthread_mutex_unlock( &pool->lock );
+    }
+}
+
+static void *worker_main( void *arg )
+{
+    struct Thread_Pool_Worker *worker = (struct Thread_Pool_Worker *)arg;
+    struct Thread_Pool *pool = worker->pool;
+
+    unsigned long seen = 0;
+
+    pthread_mutex_lock( &pool->lock );
+    for (;;) {
+        while (!pool->shutdown && pool->generation == seen) {
+            pthread_cond_wait( &pool->start, &pool->lock );
+        }
+        if (pool->shutdown) {
+            break;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock( &pool->lock );
+
+        run_chunks( pool, worker->thread );
+
+        pthread_mutex_lock( &pool->lock );
+        --pool->busy;
+        pthread_cond_signal( &pool->done );
+    }
+    pthread_mutex_unlock( &pool->lock );
+
+    return NULL;
+}
+
+struct Thread_Pool *thread_pool_create( int num_threads )
+{
+    struct Thread_Pool *pool;
+    int i;
+
+    if (num_threads <= 0) {
+        num_threads = thread_pool_num_cores();
+    }
+
+    pool = (struct Thread_Pool *)malloc( sizeof( struct Thread_Pool ) );
+    if (!pool) {
+        return NULL;
+    }
+
+    pool->threads = (pthread_t *)malloc( sizeof( pthread_t ) * num_threads );
+    pool->workers = (struct Thread_Pool_Worker *)malloc(
+        sizeof( struct Thread_Pool_Worker ) * num_threads );
+    if (!pool->threads || !pool->workers) {
+        free( pool->threads );
+        free( pool->workers );
+        free( pool );
+        return NULL;
+    }
+
+    pthread_mutex_init( &pool->lock,  NULL );
+    pthread_cond_init ( &pool->start, NULL );
+    pthread_cond_init ( &pool->done,  NULL );
+
+    pool->generation = 0;
+    pool->shutdown   = 0;
+    pool->busy       = 0;
+    pool->func       = NULL;
+    pool->state      = NULL;
+    pool->ntasks     = 0;
+    pool->chunk      = 1;
+    pool->next       = 0;
+    pool->completed  = 0;
+    pool->cancel     = 0;
+    pool->error      = 0;
+
+    // thread index 0 is the caller; start workers 1..num_threads-1
+    pool->nthreads = 1;
+    for (i=1; i<num_threads; ++i) {
+        pool->workers[i].pool   = pool;
+        pool->workers[i].thread = i;
+        if (pthread_create( &pool->threads[i], NULL, worker_main, &pool->workers[i] )) {
+            break;  // continue with the threads we have
+        }
+        pool->nthreads = i + 1;
+    }
+
+    return pool;
+}
+
+int thread_pool_size( const struct Thread_Pool *pool )
+{
+    return pool ? pool->nthreads : 1;
+}
+
+int thread_pool_run(
+    struct Thread_Pool *pool,
+    long   ntasks,
+    long   chunk,
+    Thread_Pool_Task func,
+    void  *state,
+    const struct Thread_Pool_Progress_Callback
+          *progress     // optional callback functor for status; NULL for none
+)
+{
+    int  nthreads = thread_pool_size( pool );
+    long first, last;
+    long completed;
+    int  result;
+
+    if (ntasks <= 0) {
+        return 0;
+    }
+
+    if (chunk <= 0) {
+        chunk = ntasks / (chunks_per_thread * nthreads);
+        if (chunk < 1) {
+            chunk = 1;
+        }
+    }
+
+    if (nthreads <= 1) {
+        // serial run in calling thread
+        for (first=0; first<ntasks; first=last) {
+            last = first + chunk;
+            if (last > ntasks) {
+                last = ntasks;
+            }
+            result = func( first, last, 0, state );
+            if (result) {
+                return result;
+            }
+            if (progress && progress->callback( (float)last / (float)ntasks, progress->state )) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    pthread_mutex_lock( &pool->lock );
+    pool->func      = func;
+    pool->state     = state;
+    pool->ntasks    = ntasks;
+    pool->chunk     = chunk;
+    pool->next      = 0;
+    pool->completed = 0;
+    pool->cancel    = 0;
+    pool->error     = 0;
+    pool->busy      = nthreads - 1;
+    ++pool->generation;
+    pthread_cond_broadcast( &pool->start );
+    pthread_mutex_unlock( &pool->lock );
+
+    if (!progress) {
+        run_chunks( pool, 0 );
+    } else {
+        // calling thread works one chunk at a time so it can report progress in between
+        for (;;) {
+            pthread_mutex_lock( &pool->lock );
+            if (pool->cancel || pool->error || pool->next >= pool->ntasks) {
+                pthread_mutex_unlock( &pool->lock );
+                break;
+            }
+            first = pool->next;
+            last  = first + pool->chunk;
+            if (last > pool->ntasks) {
+                last = pool->ntasks;
+            }
+            pool->next = last;
+            pthread_mutex_unlock( &pool->lock );
+
+            result = func( first, last, 0, state );
+
+            pthread_mutex_lock( &pool->lock );
+            pool->completed += last - first;
+            if (result && !pool->error) {
+                pool->error = result;
+            }
+            completed = pool->completed;
+            pthread_mutex_unlock( &pool->lock );
+
+            if (progress->callback( (float)completed / (float)ntasks, progress->state )) {
+                pthread_mutex_lock( &pool->lock );
+                pool->cancel = 1;
+                pthread_mutex_unlock( &pool->lock );
+            }
+        }
+    }
+
+    // wait for workers, reporting progress as their chunks complete
+    pthread_mutex_lock( &pool->lock );
+    while (pool->busy > 0) {
+        pthread_cond_wait( &pool->done, &pool->lock );
+        if (progress && !pool->cancel) {
+            completed = pool->completed;
+            pthread_mutex_unlock( &pool->lock );
+            result = progress->callback( (float)completed / (float)ntasks, progress->state );
+            pthread_mutex_lock( &pool->lock );
+            if (result) {
+                pool->cancel = 1;
+            }
+        }
+    }
+    if (pool->cancel) {
+        result = -1;
+    } else {
+        result = pool->error;
+    }
+    pthread_mutex_unlock( &pool->lock );
+
+    return result;
+}
+
+void thread_pool_destroy( struct Thread_Pool *pool )
+{
+    int i;
+
+    if (!pool) {
+        return;
+    }
+
+    pthread_mutex_lock( &pool->lock );
+    pool->shutdown = 1;
+    pthread_cond_broadcast( &pool->start );
+    pthread_mutex_unlock( &pool->lock );
+
+    for (i=1; i<pool->nthreads; ++i) {
+        pthread_join( pool->threads[i], NULL );
+    }
+
+    pthread_cond_destroy ( &pool->done  );
+    pthread_cond_destroy ( &pool->start );
+    pthread_mutex_destroy( &pool->lock  );
+
+    free( pool->workers );
+    free( pool->threads );
+    free( pool );
+}
@@ -0,0 +1,71 @@
+/*
+ * thread_pool.h
+ *
+ * Worker thread pool shared by the texture_shader tools.
+ * Added for tectoplot; distributed under the same terms as the other
+ * files in this directory (see LICENSE.txt).
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct Thread_Pool;     // opaque - see thread_pool.c
+
+struct Thread_Pool_Progress_Callback {
+    // callback function - return nonzero value to cancel operation:
+    int (*callback)(
+        float portion_complete, // portion of operation completed so far (0.00 to 1.00)
+        void *state);           // copy of state information pointer
+    // pointer to optional state information for use by callback() function:
+    void *state;
+};
+
+// Task function run by each pool thread on a half-open range [first,last) of task indices.
+// The thread index (0 to thread_pool_size()-1) can be used to select per-thread buffers;
+// index 0 is always the calling thread. Return nonzero to abort the whole run.
+typedef int (*Thread_Pool_Task)(
+    long  first,    // first task index in this chunk
+    long  last,     // one past last task index in this chunk
+    int   thread,   // index of thread running this chunk
+    void *state     // copy of state pointer passed to thread_pool_run()
+);
+
+// Returns number of processors currently online (at least 1).
+int thread_pool_num_cores( void );
+
+// Creates a pool using num_threads threads in total, including the calling thread.
+// If num_threads <= 0, uses thread_pool_num_cores().
+// Returns NULL if a memory allocation error occurred. If some worker threads
+// cannot be started the pool is still usable with fewer threads.
+struct Thread_Pool *thread_pool_create( int num_threads );
+
+// Returns total number of threads in pool (including the calling thread); 1 if pool is NULL.
+int thread_pool_size( const struct Thread_Pool *pool );
+
+// Runs func on all tasks 0..ntasks-1, handing out chunks of tasks to threads on demand.
+// If chunk <= 0 a chunk size is chosen automatically. A NULL pool runs serially.
+// The progress callback (if any) is only ever called from the calling thread.
+// Returns 0 on success, -1 if canceled via progress callback, or else the first
+// nonzero value returned by func.
+int thread_pool_run(
+    struct Thread_Pool *pool,
+    long   ntasks,
+    long   chunk,
+    Thread_Pool_Task func,
+    void  *state,
+    const struct Thread_Pool_Progress_Callback
+          *progress     // optional callback functor for status; NULL for none
+);
+
+// Stops all worker threads and frees the pool. NULL is allowed.
+void thread_pool_destroy( struct Thread_Pool *pool );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
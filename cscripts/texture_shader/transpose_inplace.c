@@ -33,6 +33,8 @@
 
 #include "transpose_inplace.h"
 
+#include "thread_pool.h"
+
 #include "compatibility.h"
 
 #include <stddef.h> // for ptrdiff_t
@@ -234,6 +236,87 @@ static int transpose_inplace_small( float *a, long nrows, long ncols )
     return 0;
 }
 
+// Block size (in elements) for the cache-blocked transpose: the source cache lines
+// touched by one block (transpose_block of them) stay in L1 cache while the block
+// is written out row by row.
+static const long transpose_block = 64;
+
+struct Transpose_Pass {
+    const float *src;   // source matrix (nrows x ncols)
+    float *dst;         // destination matrix (ncols x nrows)
+    long   nrows;
+    long   ncols;
+};
+
+// Thread pool task: task k transposes source columns k*transpose_block to
+// (k+1)*transpose_block-1 into the corresponding destination rows.
+static int transpose_block_task( long first, long last, int thread, void *state )
+{
+    const struct Transpose_Pass *pass = (const struct Transpose_Pass *)state;
+
+    const long nrows = pass->nrows;
+    const long ncols = pass->ncols;
+
+    long k, i, j;
+    long i0, i1, j0, j1;
+
+    for (k=first; k<last; ++k) {
+        j0 = k * transpose_block;
+        j1 = j0 + transpose_block < ncols ? j0 + transpose_block : ncols;
+        for (i0=0; i0<nrows; i0=i1) {
+            i1 = i0 + transpose_block < nrows ? i0 + transpose_block : nrows;
+            for (j=j0; j<j1; ++j) {
+                const float *RESTRICT fromcol = pass->src + (LONG)i0 * (LONG)ncols + j;
+                      float *RESTRICT toaddr  = pass->dst + (LONG)j  * (LONG)nrows + i0;
+                for (i=i0; i<i1; ++i) {
+                    *toaddr++ = *fromcol;
+                    fromcol  += ncols;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+int transpose_outplace_mt(
+    const float *a,     // matrix to transpose (row-major order)
+    float *b,           // output: transposed matrix (must not overlap a)
+    long   nrows,       // number of rows    in matrix a
+    long   ncols,       // number of columns in matrix a
+    struct Thread_Pool
+          *pool,        // optional worker threads; NULL for none
+    const struct Transpose_Progress_Callback
+          *progress     // optional callback functor for status; NULL for none
+)
+// Transposes matrix a of nrows x ncols elements to matrix b of ncols x nrows.
+// Returns 0 on success, or -1 if canceled via progress callback (leaving b incomplete).
+{
+    struct Transpose_Pass pass;
+
+    struct Thread_Pool_Progress_Callback pass_progress;
+
+    pass.src   = a;
+    pass.dst   = b;
+    pass.nrows = nrows;
+    pass.ncols = ncols;
+
+    if (progress) {
+        pass_progress.callback = progress->callback;
+        pass_progress.state    = progress->state;
+    }
+
+    // tasks cannot fail, so any nonzero result is a cancel
+    if (thread_pool_run(
+            pool, (ncols + transpose_block - 1) / transpose_block, 1,
+            transpose_block_task, &pass, progress ? &pass_progress : NULL ))
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
 static int choose_bands_inplace( long nrows, long ncols )
 // returns 0 if nrows <= 1 or ncols <= 1
 {
@@ -55,6 +55,24 @@ int transpose_inplace(
           *progress     // optional callback functor for status; NULL for none
 );
 
+struct Thread_Pool;     // see thread_pool.h
+
+// Transposes matrix a of nrows x ncols elements to separate matrix b of ncols x nrows,
+// using a cache-blocked algorithm with the work split among the threads of pool
+// (NULL to use the calling thread only). Much faster than transpose_inplace() when
+// there is enough memory for both matrices.
+// Returns 0 on success, or -1 if canceled via progress callback (leaving b incomplete).
+int transpose_outplace_mt(
+    const float *a,     // matrix to transpose (row-major order)
+    float *b,           // output: transposed matrix (must not overlap a)
+    long   nrows,       // number of rows    in matrix a
+    long   ncols,       // number of columns in matrix a
+    struct Thread_Pool
+          *pool,        // optional worker threads; NULL for none
+    const struct Transpose_Progress_Callback
+          *progress     // optional callback functor for status; NULL for none
+);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,399 @@
+/*
+ * void_fill.c
+ *
+ * Harmonic interpolation of void (NODATA) points in elevation data.
+ * Added for tectoplot; distributed under the same terms as the other
+ * files in this directory (see LICENSE.txt).
+ */
+
+//
+// The fill solves Laplace's equation over the void points, with the valid points
+// held fixed, by multigrid:
+//
+//   1. Initial guess: build a pyramid of grids, each half the size of the one
+//      below, in which each cell is the mean of the valid cells it covers (or
+//      void if none are valid), up to the first level with no voids. Then,
+//      working down the pyramid, set the void cells of each level by bilinear
+//      interpolation of the level above and relax them with a few red-black
+//      Gauss-Seidel sweeps ("push-pull" or cascadic multigrid).
+//   2. Refinement: a few multigrid V-cycles on the remaining error, with coarse
+//      grids in which a cell is void (unknown) if any cell it covers is void.
+//
+// Relaxation alone needs on the order of d^2 sweeps to fill a void d pixels
+// across; here the coarse levels supply the long-wavelength part of the
+// solution, so the total work is a small multiple of the number of void points.
+//
+// All levels use the unscaled 5-point Laplacian, A z = count * z - (sum of
+// neighbors), where count is 4 except at the edges of the array (the zero-slope
+// boundary condition). Since this omits the 1/h^2 factor, the residuals of four
+// fine cells simply add to give the right-hand side of the coarse cell.
+//
+
+#define _CRT_SECURE_NO_DEPRECATE
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "void_fill.h"
+
+#include "compatibility.h"
+
+#include <stdlib.h>
+#include <stddef.h>
+
+#define LONG ptrdiff_t
+
+#define MAX_LEVELS 64
+
+static const int init_sweeps     = 4;   // sweeps per level for initial guess
+static const int num_cycles      = 8;   // V-cycles (each reduces error about 3x)
+static const int cycle_sweeps    = 2;   // sweeps before and after each coarse correction
+static const int coarsest_sweeps = 400; // sweeps on coarsest grid of V-cycle
+static const LONG coarsest_voids = 256; // stop coarsening at this many void cells
+
+struct Fill_Level {
+    float *z;           // cell values (level 0) or corrections (other V-cycle levels)
+    float *rhs;         // right-hand side of equations (null for zero)
+    unsigned char *valid;   // nonzero where z is fixed
+    LONG  *voids;       // indices of void cells, red cells first then black cells
+    LONG   nvoid;       // number of void cells
+    int    nrows;
+    int    ncols;
+};
+
+int is_void_value( float value, float nodata )
+{
+    return value != value || value == nodata || value < -1.0e+38;
+}
+
+static int list_voids( struct Fill_Level *level )
+// Counts void cells and allocates and fills level->voids from level->valid
+{
+    LONG n = 0;
+    LONG k, size;
+    int i, j, color;
+
+    size = (LONG)level->nrows * (LONG)level->ncols;
+    for (k=0; k<size; ++k) {
+        n += !level->valid[k];
+    }
+    level->nvoid = n;
+
+    level->voids = (LONG *)malloc( ( n > 0 ? n : 1 ) * sizeof( LONG ) );
+    if (!level->voids) {
+        return FILL_VOIDS_MALLOC_ERROR;
+    }
+
+    n = 0;
+    for (color=0; color<2; ++color) {
+        for (i=0; i<level->nrows; ++i) {
+            k = (LONG)i * (LONG)level->ncols;
+            for (j=(i+color)&1; j<level->ncols; j+=2) {
+                if (!level->valid[k+j]) {
+                    level->voids[n++] = k+j;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int alloc_coarse( const struct Fill_Level *fine, struct Fill_Level *coarse, int with_rhs )
+// Allocates arrays of coarse level (except voids list) and sets size
+{
+    LONG size;
+
+    coarse->nrows = ( fine->nrows + 1 ) / 2;
+    coarse->ncols = ( fine->ncols + 1 ) / 2;
+    coarse->nvoid = 0;
+    coarse->voids = NULL;
+
+    size = (LONG)coarse->nrows * (LONG)coarse->ncols;
+
+    coarse->z     = (float *)calloc( size, sizeof( float ) );
+    coarse->rhs   = with_rhs ? (float *)calloc( size, sizeof( float ) ) : NULL;
+    coarse->valid = (unsigned char *)malloc( size );
+
+    if (!coarse->z || ( with_rhs && !coarse->rhs ) || !coarse->valid) {
+        return FILL_VOIDS_MALLOC_ERROR;
+    }
+    return 0;
+}
+
+static int coarsen( const struct Fill_Level *fine, struct Fill_Level *coarse, int for_cycle )
+// Allocates coarse level, in which a cell is void only if all fine cells it covers are void.
+// Sets each valid cell to mean of valid fine cells it covers, or to zero if for_cycle != 0
+{
+    double sum;
+    int count;
+    int i, j, fi, fj;
+    LONG k, fk;
+
+    if (alloc_coarse( fine, coarse, for_cycle )) {
+        return FILL_VOIDS_MALLOC_ERROR;
+    }
+
+    for (i=0, k=0; i<coarse->nrows; ++i) {
+        for (j=0; j<coarse->ncols; ++j, ++k) {
+            sum   = 0.0;
+            count = 0;
+            for (fi=2*i; fi<2*i+2 && fi<fine->nrows; ++fi) {
+                for (fj=2*j; fj<2*j+2 && fj<fine->ncols; ++fj) {
+                    fk = (LONG)fi * (LONG)fine->ncols + (LONG)fj;
+                    if (fine->valid[fk]) {
+                        sum += fine->z[fk];
+                        ++count;
+                    }
+                }
+            }
+            if (count > 0 && !for_cycle) {
+                coarse->z[k] = (float)( sum / (double)count );
+            }
+            coarse->valid[k] = count > 0;
+        }
+    }
+
+    return list_voids( coarse );
+}
+
+static void coarse_position( int i, int coarse_n, int *i0, int *i1, float *t )
+// Finds cells of coarse level on either side of center of fine cell i,
+// and weight of second cell for linear interpolation
+{
+    // fine cells 2*i0 and 2*i0+1 are covered by coarse cell i0,
+    // so fine cell i is centered at coarse coordinate (i - 0.5) / 2
+    double pos = 0.5 * ( (double)i - 0.5 );
+
+    if (pos <= 0.0) {
+        *i0 = *i1 = 0;
+        *t  = 0.0f;
+    } else if (pos >= (double)( coarse_n - 1 )) {
+        *i0 = *i1 = coarse_n - 1;
+        *t  = 0.0f;
+    } else {
+        *i0 = (int)pos;
+        *i1 = *i0 + 1;
+        *t  = (float)( pos - (double)*i0 );
+    }
+}
+
+static void interpolate( struct Fill_Level *fine, const struct Fill_Level *coarse, int add )
+// Sets (or if add != 0, adds to) void cells of fine level by bilinear interpolation of coarse level
+{
+    const float *z = coarse->z;
+    LONG ncols = coarse->ncols;
+    LONG n, k;
+    int i0, i1, j0, j1;
+    float ti, tj, a, b;
+
+    for (n=0; n<fine->nvoid; ++n) {
+        k = fine->voids[n];
+
+        coarse_position( (int)( k / fine->ncols ), coarse->nrows, &i0, &i1, &ti );
+        coarse_position( (int)( k % fine->ncols ), coarse->ncols, &j0, &j1, &tj );
+
+        a = z[i0*ncols+j0] + tj * ( z[i0*ncols+j1] - z[i0*ncols+j0] );
+        b = z[i1*ncols+j0] + tj * ( z[i1*ncols+j1] - z[i1*ncols+j0] );
+
+        if (add) {
+            fine->z[k] += a + ti * ( b - a );
+        } else {
+            fine->z[k]  = a + ti * ( b - a );
+        }
+    }
+}
+
+static INLINE float neighbor_sum( const float *z, LONG k, LONG ncols, LONG last, float *count )
+// Returns sum of neighbors of cell k and sets *count to number of neighbors
+{
+    LONG col = k % ncols;
+    float sum = 0.0f;
+
+    *count = 0.0f;
+    if (k >= ncols) {
+        sum += z[k-ncols];
+        *count += 1.0f;
+    }
+    if (k < last) {
+        sum += z[k+ncols];
+        *count += 1.0f;
+    }
+    if (col > 0) {
+        sum += z[k-1];
+        *count += 1.0f;
+    }
+    if (col < ncols-1) {
+        sum += z[k+1];
+        *count += 1.0f;
+    }
+    return sum;
+}
+
+static void relax( struct Fill_Level *level, int sweeps )
+// Red-black Gauss-Seidel sweeps: solves equation at each void cell in turn
+{
+    float *RESTRICT z = level->z;
+    const float *rhs  = level->rhs;
+    LONG ncols = level->ncols;
+    LONG last  = (LONG)( level->nrows - 1 ) * ncols;
+    LONG n, k;
+    int sweep;
+    float sum, count;
+
+    for (sweep=0; sweep<sweeps; ++sweep) {
+        for (n=0; n<level->nvoid; ++n) {
+            k   = level->voids[n];
+            sum = neighbor_sum( z, k, ncols, last, &count );
+            if (rhs) {
+                sum += rhs[k];
+            }
+            if (count > 0.0f) {
+                z[k] = sum / count;
+            }
+        }
+    }
+}
+
+static void restrict_residual( const struct Fill_Level *fine, struct Fill_Level *coarse )
+// Sets right-hand side of coarse level to sum of residuals of fine cells it covers,
+// and zeroes coarse corrections
+{
+    const float *z = fine->z;
+    LONG ncols = fine->ncols;
+    LONG last  = (LONG)( fine->nrows - 1 ) * ncols;
+    LONG n, k, ck;
+    float sum, count;
+
+    for (n=0; n<coarse->nvoid; ++n) {
+        ck = coarse->voids[n];
+        coarse->z  [ck] = 0.0f;
+        coarse->rhs[ck] = 0.0f;
+    }
+
+    for (n=0; n<fine->nvoid; ++n) {
+        k   = fine->voids[n];
+        sum = neighbor_sum( z, k, ncols, last, &count );
+        if (fine->rhs) {
+            sum += fine->rhs[k];
+        }
+        ck = (k / ncols / 2) * (LONG)coarse->ncols + (k % ncols / 2);
+        coarse->rhs[ck] += sum - count * z[k];
+    }
+}
+
+static void v_cycle( struct Fill_Level *levels, int nlevels )
+{
+    if (nlevels == 1) {
+        relax( levels, coarsest_sweeps );
+        return;
+    }
+
+    relax( levels, cycle_sweeps );
+    restrict_residual( levels, levels+1 );
+    v_cycle( levels+1, nlevels-1 );
+    interpolate( levels, levels+1, 1 );
+    relax( levels, cycle_sweeps );
+}
+
+static void free_levels( struct Fill_Level *levels, int first, int last )
+{
+    int n;
+
+    for (n=first; n<=last; ++n) {
+        free( levels[n].z );
+        free( levels[n].rhs );
+        free( levels[n].valid );
+        free( levels[n].voids );
+    }
+}
+
+int fill_voids(
+    float *data,        // input/output: array of data values (row-major order)
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    float  nodata,      // input: NODATA value from .hdr file
+    long  *nfilled      // output: number of points filled (may be null)
+)
+{
+    struct Fill_Level levels[MAX_LEVELS];
+    struct Fill_Level *level;
+
+    LONG size = (LONG)nrows * (LONG)ncols;
+    LONG k;
+    int nlevels;
+    int n;
+    int error = 0;
+
+    if (nfilled) {
+        *nfilled = 0;
+    }
+
+    // Find void points in input data:
+
+    level = &levels[0];
+    level->z     = data;
+    level->rhs   = NULL;
+    level->nrows = nrows;
+    level->ncols = ncols;
+    level->voids = NULL;
+    level->valid = (unsigned char *)malloc( size > 0 ? size : 1 );
+    if (!level->valid) {
+        return FILL_VOIDS_MALLOC_ERROR;
+    }
+
+    for (k=0; k<size; ++k) {
+        level->valid[k] = !is_void_value( data[k], nodata );
+    }
+
+    if (list_voids( level ) || level->nvoid == 0) {
+        error = level->voids ? 0 : FILL_VOIDS_MALLOC_ERROR;
+        free( level->valid );
+        free( level->voids );
+        return error;
+    }
+
+    // Initial guess - build pyramid of means until a level has no voids:
+
+    nlevels = 1;
+    while (!error && levels[nlevels-1].nvoid > 0) {
+        if (levels[nlevels-1].nrows == 1 && levels[nlevels-1].ncols == 1) {
+            error = FILL_VOIDS_NO_DATA;
+        } else {
+            error = coarsen( &levels[nlevels-1], &levels[nlevels], 0 );
+            ++nlevels;
+        }
+    }
+
+    if (!error) {
+        for (n=nlevels-2; n>=0; --n) {
+            interpolate( &levels[n], &levels[n+1], 0 );
+            relax( &levels[n], init_sweeps );
+        }
+    }
+
+    free_levels( levels, 1, nlevels-1 );
+
+    // Refine with V-cycles:
+
+    nlevels = 1;
+    while (!error && levels[nlevels-1].nvoid > coarsest_voids &&
+        levels[nlevels-1].nrows > 1 && levels[nlevels-1].ncols > 1)
+    {
+        error = coarsen( &levels[nlevels-1], &levels[nlevels], 1 );
+        ++nlevels;
+    }
+
+    for (n=0; n<num_cycles && !error; ++n) {
+        v_cycle( levels, nlevels );
+    }
+
+    free_levels( levels, 1, nlevels-1 );
+
+    if (!error && nfilled) {
+        *nfilled = (long)levels[0].nvoid;
+    }
+
+    free( levels[0].valid );
+    free( levels[0].voids );
+
+    return error;
+}
@@ -0,0 +1,44 @@
+/*
+ * void_fill.h
+ *
+ * Harmonic interpolation of void (NODATA) points in elevation data.
+ * Added for tectoplot; distributed under the same terms as the other
+ * files in this directory (see LICENSE.txt).
+ */
+
+#ifndef VOID_FILL_H
+#define VOID_FILL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Return values from fill_voids():
+enum {
+    FILL_VOIDS_MALLOC_ERROR = 1,    // memory allocation failed; data unchanged
+    FILL_VOIDS_NO_DATA      = 2     // every point is void; data unchanged
+};
+
+// Returns nonzero if value marks a void point: equal to nodata, NaN, or less
+// than -1.0e+38 (the same test used when reading .flt files).
+int is_void_value( float value, float nodata );
+
+// Replaces every void point with a smooth surface that matches the surrounding
+// valid data - the solution of Laplace's equation over each void region, with
+// the valid points as boundary values. Voids at the edge of the array are
+// extended with zero slope across the edge. Distances are in pixels, so the
+// fill ignores any difference between x and y pixel spacing.
+// Returns 0 on success, or one of the error codes above.
+int fill_voids(
+    float *data,        // input/output: array of data values (row-major order)
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    float  nodata,      // input: NODATA value from .hdr file
+    long  *nfilled      // output: number of points filled (may be null)
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
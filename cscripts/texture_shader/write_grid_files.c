@@ -189,6 +189,155 @@ void write_tif_tfw_files(
     write_tfw_file( out_tfw_file, nrows, ncols, xmin, xmax, ymin, ymax );
 }
 
+void write_geotiff8_file(
+    FILE *out_tif_file, // .tif file - should be opened in BINARY mode
+    int nrows,          // number of rows in data array
+    int ncols,          // number of cols in data array
+    double xmin,        // min X coordinate (longitude or easting)
+    double xmax,        // max X coordinate (longitude or easting)
+    double ymin,        // min Y coordinate (latitude  or northing)
+    double ymax,        // max Y coordinate (latitude  or northing)
+    int geographic,     // nonzero if coordinates are longitude/latitude
+    const float *data,  // array of data values
+    const char *software // software name and version number (optional)
+)
+{
+    int error;
+    size_t fileSize;
+
+    double xdim = (xmax - xmin) / (double)ncols;
+    double ydim = (ymax - ymin) / (double)nrows;
+
+    // Write .tif file:
+
+    error = WriteGrayscale8BitToGeoTIFF(
+        out_tif_file, ncols, nrows, data, xmin, ymax, xdim, ydim, geographic,
+        software, &fileSize );
+    if (error == -2) {
+        error_exit( "Memory allocation error occurred during file output." );
+    }
+    if (error == -3) {
+        error_exit( "Output image too large for 8-bit TIFF file (over 4 gigabytes)." );
+    }
+    if (error) {
+        error_exit( "Write error occurred on output .tif file." );
+    }
+
+    if (fileSize>>31) {
+        fprintf( stderr, "*** WARNING: " );
+        fprintf( stderr,
+            "Output TIFF file size exceeds 2 gigabytes.\n" );
+        fprintf( stderr, "***          " );
+        fprintf( stderr,
+            "This may not be readable by some TIFF readers.\n" );
+    }
+}
+
+void write_hdr_for_flt_file(
+    FILE *out_flt_file, // .flt file - should be opened in BINARY mode for update
+    FILE *out_hdr_file, // .hdr file - should be opened in BINARY mode
+    int nrows,          // number of rows in .flt file
+    int ncols,          // number of cols in .flt file
+    double xmin,        // min X coordinate (longitude or easting)
+    double xmax,        // max X coordinate (longitude or easting)
+    double ymin,        // min Y coordinate (latitude  or northing)
+    double ymax,        // max Y coordinate (latitude  or northing)
+    const char *software // software name and version number (optional)
+)
+{
+    float nodata;
+    float min_value = 0.0f;
+    float max_value = 0.0f;
+
+    int i, j;
+    int count;
+    int has_nulls = 0;
+    int has_values = 0;
+
+    long rowbytes = ncols * (long)sizeof( float );
+    float *buffer = (float *)malloc( ncols * sizeof( float ) );
+
+    if (!buffer) {
+        error_exit( "Memory allocation error occurred during file output." );
+    }
+
+    // Reread .flt file and find min/max values:
+
+    if (fflush( out_flt_file ) || fseek( out_flt_file, 0, SEEK_SET )) {
+        error_exit( "Read error occurred on output .flt file." );
+    }
+
+    for (i=0; i<nrows; ++i) {
+        count = fread( buffer, sizeof( float ), ncols, out_flt_file );
+        if (count < ncols) {
+            error_exit( "Read error occurred on output .flt file." );
+        }
+        for (j=0; j<ncols; ++j) {
+            if (flt_isnan( buffer[j] )) {
+                has_nulls = 1;
+                continue;
+            }
+            if (!has_values) {
+                min_value = buffer[j];
+                max_value = buffer[j];
+                has_values = 1;
+            }
+            if (buffer[j] < min_value) {
+                min_value = buffer[j];
+            } else if (buffer[j] > max_value) {
+                max_value = buffer[j];
+            }
+        }
+    }
+
+    // choose NODATA value the same way as write_flt_file(), but below all the data
+    nodata = -1.0e+06;
+    while (min_value < nodata * 0.5) {
+        nodata *= 10.0;
+    }
+
+    // Replace NaNs with the NODATA value, a row at a time in place:
+
+    if (has_nulls) {
+        if (fseek( out_flt_file, 0, SEEK_SET )) {
+            error_exit( "Read error occurred on output .flt file." );
+        }
+        for (i=0; i<nrows; ++i) {
+            count = fread( buffer, sizeof( float ), ncols, out_flt_file );
+            if (count < ncols) {
+                error_exit( "Read error occurred on output .flt file." );
+            }
+            for (j=0, count=0; j<ncols; ++j) {
+                if (flt_isnan( buffer[j] )) {
+                    buffer[j] = nodata;
+                    ++count;
+                }
+            }
+            if (count == 0) {
+                continue;
+            }
+            // switching between reading and writing requires a seek
+            if (fseek( out_flt_file, -rowbytes, SEEK_CUR ) ||
+                (int)fwrite( buffer, sizeof( float ), ncols, out_flt_file ) < ncols ||
+                fseek( out_flt_file, 0, SEEK_CUR ))
+            {
+                error_exit( "Write error occurred on output .flt file." );
+            }
+        }
+        if (fflush( out_flt_file )) {
+            error_exit( "Write error occurred on output .flt file." );
+        }
+    }
+
+    free( buffer );
+
+    // Write .hdr file:
+
+    write_hdr_file(
+        out_hdr_file, nrows, ncols, xmin, xmax, ymin, ymax,
+        nodata, min_value, max_value, 1, software );
+}
+
 static void write_flt_file(
     FILE *out_flt_file, int nrows, int ncols,
     const float *data, float *nodata, float *min_value, float *max_value )
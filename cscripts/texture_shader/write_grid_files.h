@@ -50,6 +50,22 @@ void write_flt_hdr_files(
     const char *software // software name and version number (optional)
 );
 
+// Writes .hdr file for a .flt file of 32-bit floats in native byte order that was
+// written separately (e.g., a block at a time for grids too large to hold in memory).
+// Rereads the .flt file to find min/max values; any NaNs (voids) in the .flt file
+// are replaced there with the NODATA value.
+void write_hdr_for_flt_file(
+    FILE *out_flt_file, // .flt file - should be opened in BINARY mode for update
+    FILE *out_hdr_file, // .hdr file - should be opened in BINARY mode
+    int nrows,          // number of rows in .flt file
+    int ncols,          // number of cols in .flt file
+    double xmin,        // min X coordinate (longitude or easting)
+    double xmax,        // max X coordinate (longitude or easting)
+    double ymin,        // min Y coordinate (latitude  or northing)
+    double ymax,        // max Y coordinate (latitude  or northing)
+    const char *software // software name and version number (optional)
+);
+
 void write_bil_hdr_files(
     FILE *out_bil_file, // .bil file - should be opened in BINARY mode
     FILE *out_hdr_file, // .hdr file - should be opened in BINARY mode
@@ -76,6 +92,22 @@ void write_tif_tfw_files(
     const char *software // software name and version number (optional)
 );
 
+// Writes 8-bit grayscale GeoTIFF file (no .tfw file needed); data values are
+// rounded and clipped to the range 0 to 255. If geographic is nonzero, the
+// coordinates are tagged as WGS 84 longitude/latitude.
+void write_geotiff8_file(
+    FILE *out_tif_file, // .tif file - should be opened in BINARY mode
+    int nrows,          // number of rows in data array
+    int ncols,          // number of cols in data array
+    double xmin,        // min X coordinate (longitude or easting)
+    double xmax,        // max X coordinate (longitude or easting)
+    double ymin,        // min Y coordinate (latitude  or northing)
+    double ymax,        // max Y coordinate (latitude  or northing)
+    int geographic,     // nonzero if coordinates are longitude/latitude
+    const float *data,  // array of data values
+    const char *software // software name and version number (optional)
+);
+
 #ifdef __cplusplus
 }
 #endif
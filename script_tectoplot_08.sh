@@ -9295,13 +9295,15 @@ fi
 if [[ $USAGEFLAG -eq 1 ]]; then
 cat <<-EOF
 -tshad:        add cast shadows to terrain intensity
-Usage: -tshad [[sun_azimuth]] [[sun_elevation]] [[alpha]] [[fast]]
+Usage: -tshad [[sun_azimuth]] [[sun_elevation]] [[alpha]] [[fast]] [[ambient]]
 
   Include cast shadows in shaded relief.
 
   sun_azimuth: angle CW from north, degrees
   sun_elevation: angle up from horizon, degrees
   alpha: transparency of cast shadows
+  fast: use faster, less accurate shadow calculation
+  ambient: sum shadows from 72 azimuths around the horizon (sky occlusion)
 
 Example: Cast shadows
 tectoplot -t -t0 -tshad 45 2 -o example_tshad
@@ -9328,6 +9330,11 @@ fi
       SHADOW_FAST="-fast"
       shift
     fi
+    shadowalldirflag=0
+    if [[ $2 == "ambient" ]]; then
+      shadowalldirflag=1
+      shift
+    fi
     info_msg "[-tshad]: Sun azimuth=${SUN_AZ}; elevation=${SUN_EL}; alpha=${SHADOW_ALPHA}"
     topoctrlstring=${topoctrlstring}"d"
     useowntopoctrlflag=1
@@ -9904,7 +9911,8 @@ fi
   NUM_SVF_DIST=45
   NUM_SVF_SKIP=5
   NUM_SVF_ANGLES=8 
-  NUM_SVF_CORES=8
+  NUM_SVF_CORES=0   # 0 = all processors
+  SVF_MULTISCALE=""
 
 if [[ $USAGEFLAG -eq 1 ]]; then
 cat <<-EOF
@@ -9960,6 +9968,16 @@ fi
           NUM_SVF_CORES=$2
           shift
         ;;
+        multiscale)
+          # sample beyond this many cells from coarser max/min levels (for long dist)
+          shift
+          if ! arg_is_positive_float $2; then
+            echo "[-tsky]: multiscale option requires positive integer argument"
+            exit 1
+          fi
+          SVF_MULTISCALE="-multiscale $2"
+          shift
+        ;;
         fact)
           shift
           if ! arg_is_float $2; then
@@ -21399,45 +21417,36 @@ EOF
 
 
               t)
-                demwidth=$(gmt grdinfo -C ${TOPOGRAPHY_DATA} ${VERBOSE} | gawk '{print $10}')
-                demheight=$(gmt grdinfo -C ${TOPOGRAPHY_DATA} ${VERBOSE} | gawk '{print $11}')
-                demxmin=$(gmt grdinfo -C ${TOPOGRAPHY_DATA} ${VERBOSE} | gawk '{print $2}')
-                demxmax=$(gmt grdinfo -C ${TOPOGRAPHY_DATA} ${VERBOSE} | gawk '{print $3}')
-                demymin=$(gmt grdinfo -C ${TOPOGRAPHY_DATA} ${VERBOSE} | gawk '{print $4}')
-                demymax=$(gmt grdinfo -C ${TOPOGRAPHY_DATA} ${VERBOSE} | gawk '{print $5}')
-
                 info_msg "Calculating and rendering texture map"
 
                 # Calculate the texture shade
-                # Project from WGS1984 to Mercator / HDF format
-                # The -dstnodata option is a kluge to get around unknown NaNs in dem_flt.flt even if ${TOPOGRAPHY_DATA} has NaNs filled.
-
-                [[ ! -e ${F_TOPO}dem_flt.flt ]] && gdalwarp -dstnodata -9999 -t_srs EPSG:3395 -s_srs EPSG:4326 -if GTiff -of EHdr -ot Float32 -ts $demwidth $demheight ${TOPOGRAPHY_DATA} ${F_TOPO}dem_flt.flt -q
-
-                # texture the DEM. Pipe output to /dev/null to silence the program
-                if [[ $(echo "$DEM_MAXLAT >= 90" | bc) -eq 1 ]]; then
-                  MERCMAXLAT=89.999
-                else
-                  MERCMAXLAT=$DEM_MAXLAT
-                fi
-                if [[ $(echo "$DEM_MINLAT <= -90" | bc) -eq 1 ]]; then
-                  MERCMINLAT=-89.999
-                else
-                  MERCMINLAT=$DEM_MINLAT
+                # texture filters the geographic DEM in Mercator internally (-via_mercator)
+                # and writes the contrast-stretched 8-bit GeoTIFF directly (-image).
+                # NODATA and NaN points are filled by texture itself (-fill).
+                # texture reads a Float32/Int16 GeoTIFF DEM directly; other formats (or a
+                # GeoTIFF it reports as not supported) go through an EHdr copy instead.
+                # Other failures (bad option, out of memory, damaged file) would only
+                # fail again, so they are reported rather than retried.
+
+                # texture the DEM and make the image. Pipe output to /dev/null to silence the program
+                texture_fallback=1
+                if [[ ${TOPOGRAPHY_DATA} == *.tif ]]; then
+                  if ${TEXTURE} ${TS_FRAC} ${TOPOGRAPHY_DATA} ${F_TOPO}texture.tif -image ${TS_STRETCH} -via_mercator -fill > /dev/null 2> ${F_TOPO}texture_err.txt; then
+                    texture_fallback=0
+                  elif ! grep -q "Input .tif file is not supported" ${F_TOPO}texture_err.txt; then
+                    texture_fallback=0
+                    cat ${F_TOPO}texture_err.txt > /dev/stderr
+                  fi
+                  [[ -s ${F_TOPO}texture_err.txt ]] && info_msg "texture: $(tr '\n' ' ' < ${F_TOPO}texture_err.txt)"
+                  cleanup ${F_TOPO}texture_err.txt
                 fi
+                if [[ ${texture_fallback} -eq 1 ]]; then
+                  gdalwarp -if GTiff -of EHdr -ot Float32 ${TOPOGRAPHY_DATA} ${F_TOPO}dem_geo.flt -q
 
-                ${TEXTURE} ${TS_FRAC} ${F_TOPO}dem_flt.flt ${F_TOPO}texture.flt -mercator ${MERCMINLAT} ${MERCMAXLAT} > /dev/null
-                # make the image. Pipe output to /dev/null to silence the program
-                ${TEXTURE_IMAGE} +${TS_STRETCH} ${F_TOPO}texture.flt ${F_TOPO}texture_merc.tif > /dev/null
-                # project back to WGS1984
-
-                # Need to convert to NC for some reason
-                gdal_translate -of NetCDF ${F_TOPO}texture_merc.tif ${F_TOPO}texture_merc.nc > /dev/null 2>&1
-                gdalwarp -if NetCDF -of GTiff -s_srs EPSG:3395 -t_srs EPSG:4326 -ts $demwidth $demheight -te $demxmin $demymin $demxmax $demymax ${F_TOPO}texture_merc.nc ${F_TOPO}texture_2byte.tif -q > /dev/null 2>&1
+                  ${TEXTURE} ${TS_FRAC} ${F_TOPO}dem_geo.flt ${F_TOPO}texture.tif -image ${TS_STRETCH} -via_mercator -fill > /dev/null
 
-                # Change to 8 bit unsigned format
-                gdal_translate -of GTiff -ot Byte -scale 0 65535 0 255 ${F_TOPO}texture_2byte.tif ${F_TOPO}texture.tif -q > /dev/null 2>&1
-                cleanup ${F_TOPO}texture_2byte.tif ${F_TOPO}texture_merc.tif ${F_TOPO}dem_flt.flt ${F_TOPO}dem.hdr ${F_TOPO}dem_flt.flt.aux.xml ${F_TOPO}dem.prj ${F_TOPO}texture.flt ${F_TOPO}texture.hdr ${F_TOPO}texture.prj ${F_TOPO}texture_merc.prj ${F_TOPO}texture_merc.tfw
+                  cleanup ${F_TOPO}dem_geo.flt ${F_TOPO}dem_geo.hdr ${F_TOPO}dem_geo.flt.aux.xml ${F_TOPO}dem_geo.prj
+                fi
 
                 # Combine it with the existing intensity
                 weighted_average_combine ${F_TOPO}texture.tif ${F_TOPO}intensity.tif ${TS_FACT} ${F_TOPO}intensity.tif
@@ -21481,31 +21490,19 @@ EOF
 
                 info_msg "Creating sky view factor"
 
-                gdal_fillnodata.py ${TOPOGRAPHY_DATA} fill.tif
-
-
-                [[ ! -e ${F_TOPO}dem_flt.flt ]] && gdalwarp -srcnodata nan -dstnodata -9999 -t_srs EPSG:3395 -s_srs EPSG:4326 -if GTiff -of EHdr -ot Float32 -ts $demwidth $demheight fill.tif ${F_TOPO}dem_flt.flt -q
-
-                # texture the DEM. Pipe output to /dev/null to silence the program
-                if [[ $(echo "$DEM_MAXLAT >= 90" | bc) -eq 1 ]]; then
-                  MERCMAXLAT=89.999
-                else
-                  MERCMAXLAT=$DEM_MAXLAT
-                fi
-                if [[ $(echo "$DEM_MINLAT <= -90" | bc) -eq 1 ]]; then
-                  MERCMINLAT=-89.999
-                else
-                  MERCMINLAT=$DEM_MINLAT
-                fi
+                # NODATA points are filled by svf itself (-fill)
+                # svf works on the geographic DEM directly (per-row east-west pixel size);
+                # -geographic because coarse DEMs (0.02 deg cells or more) are not detected as lat/lon
+                [[ ! -e ${F_TOPO}dem_flt.flt ]] && gdalwarp -dstnodata -9999 -if GTiff -of EHdr -ot Float32 ${TOPOGRAPHY_DATA} ${F_TOPO}dem_flt.flt -q
 
                 # We currently calclate both positive and negative openness and use pos as the sky view factor layer...
 
                 # cp ${F_TOPO}dem_flt.hdr ${F_TOPO}dem_flt_fill.hdr
                 start_time=`date +%s`
-                ${SVF} ${F_TOPO}dem_flt.flt ${F_TOPO}pos.flt ${F_TOPO}neg.flt -dist ${NUM_SVF_DIST} -skip ${NUM_SVF_SKIP} -angles ${NUM_SVF_ANGLES} -cores ${NUM_SVF_CORES} -mercator ${MERCMINLAT} ${MERCMAXLAT} > /dev/null
+                ${SVF} ${F_TOPO}dem_flt.flt ${F_TOPO}pos.flt ${F_TOPO}neg.flt -dist ${NUM_SVF_DIST} -skip ${NUM_SVF_SKIP} -angles ${NUM_SVF_ANGLES} -cores ${NUM_SVF_CORES} ${SVF_MULTISCALE} -fill -geographic > /dev/null
                 echo svf run time is $(expr `date +%s` - $start_time) s
-                # project back to WGS1984
-                gdalwarp -s_srs EPSG:3395 -t_srs EPSG:4326 -ts $demwidth $demheight -te $demxmin $demymin $demxmax $demymax ${F_TOPO}pos.flt ${F_TOPO}svf_back.tif -q
+                # output is on the same grid as the DEM
+                gdal_translate -of GTiff ${F_TOPO}pos.flt ${F_TOPO}svf_back.tif -q
 
                 zrange=($(grid_zrange ${F_TOPO}svf_back.tif -R${F_TOPO}svf_back.tif  -Vn))
                 gdal_translate -of GTiff -ot Byte -a_nodata 255 -scale ${zrange[1]} ${zrange[0]} 1 254 ${F_TOPO}svf_back.tif ${F_TOPO}svf.tif -q
@@ -21579,24 +21576,14 @@ EOF
 
                 # echo filling flt file
                 # gdal_fillnodata.py ${TOPOGRAPHY_DATA} -of GTiff ${F_TOPO}dem_prefill.tif
-                [[ ! -e ${F_TOPO}dem_flt.flt ]] && gdalwarp -r cubic -dstnodata -9999 -t_srs EPSG:3395 -s_srs EPSG:4326 -r bilinear -if GTiff -of EHdr -ot Float32 -ts $demwidth $demheight ${TOPOGRAPHY_DATA} ${F_TOPO}dem_flt.flt -q
+                # shadow works on the geographic DEM directly (per-row east-west pixel size);
+                # -geographic because coarse DEMs (0.02 deg cells or more) are not detected as lat/lon
+                [[ ! -e ${F_TOPO}dem_flt.flt ]] && gdalwarp -dstnodata -9999 -if GTiff -of EHdr -ot Float32 ${TOPOGRAPHY_DATA} ${F_TOPO}dem_flt.flt -q
                 #
                 # gdal_fillnodata [-q] [-md max_distance] [-si smooth_iterations]
                 #   [-o name=value] [-b band]
                 #   srcfile [-nomask] [-mask filename] [-of format] [-co name=value]* [dstfile]
 
-                # texture the DEM. Pipe output to /dev/null to silence the program
-                if [[ $(echo "$MAXLAT >= 90" | bc) -eq 1 ]]; then
-                  MERCMAXLAT=89.999
-                else
-                  MERCMAXLAT=$MAXLAT
-                fi
-                if [[ $(echo "$MINLAT <= -90" | bc) -eq 1 ]]; then
-                  MERCMINLAT=-89.999
-                else
-                  MERCMINLAT=$MINLAT
-                fi
-
                 # echo "DEM"
                 # gdalinfo ${F_TOPO}dem.tif
                 # echo "DEMFLT"
@@ -21608,39 +21595,17 @@ EOF
 
                 SHADOW_START_TIME="$(date -u +%s)"
 
-shadowalldirflag=0
-
                 if [[ $shadowalldirflag -eq 1 ]]; then
-                #  This code creates a kind of 'shadow map from all direction'
-                  for this_az in $(seq 1 5 360); do
-                    echo doing azimuth $this_az
-                    ${SHADOW} ${this_az} ${SUN_EL} ${F_TOPO}dem_flt.flt ${F_TOPO}shadow_360.flt -mercator ${MERCMINLAT} ${MERCMAXLAT} ${SHADOW_FAST} > /dev/null
-                    gdalwarp -s_srs EPSG:3395 -t_srs EPSG:4326  -ts $demwidth $demheight -te $demxmin $demymin $demxmax $demymax ${F_TOPO}shadow_360.flt ${F_TOPO}shadow_360.tif -q
-                    if [[ -s ${F_TOPO}shadow_360_sum.tif ]]; then
-                      gdal_calc.py --overwrite --type=Float32 --format=GTiff --quiet -A ${F_TOPO}shadow_360.tif -B ${F_TOPO}shadow_360_sum.tif --calc="A+B" --outfile=${F_TOPO}shadow_360_sum_2.tif
-                      mv ${F_TOPO}shadow_360_sum_2.tif ${F_TOPO}shadow_360_sum.tif
-                      rm -f ${F_TOPO}shadow_360.tif
-                    else
-                      mv ${F_TOPO}shadow_360.tif ${F_TOPO}shadow_360_sum.tif
-                    fi
-                  done
-                  mv ${F_TOPO}shadow_360_sum.tif ${F_TOPO}shadow_back_add.tif
+                  # This creates a kind of 'shadow map from all directions' (sum over 72 azimuths)
+                  ${SHADOW} 1 ${SUN_EL} ${F_TOPO}dem_flt.flt ${F_TOPO}shadow_360.flt -ambient 72 ${SHADOW_FAST} -geographic > /dev/null
+                  gdal_translate -of GTiff ${F_TOPO}shadow_360.flt ${F_TOPO}shadow_back_add.tif -q
                 else
 
-                  ${SHADOW} ${SUN_AZ_M1} ${SUN_EL} ${F_TOPO}dem_flt.flt ${F_TOPO}shadow_m1.flt -mercator ${MERCMINLAT} ${MERCMAXLAT} ${SHADOW_FAST} > /dev/null
-                  ${SHADOW} ${SUN_AZ_M05} ${SUN_EL} ${F_TOPO}dem_flt.flt ${F_TOPO}shadow_m05.flt -mercator ${MERCMINLAT} ${MERCMAXLAT} ${SHADOW_FAST} > /dev/null
-                  ${SHADOW} ${SUN_AZ} ${SUN_EL} ${F_TOPO}dem_flt.flt ${F_TOPO}shadow.flt -mercator ${MERCMINLAT} ${MERCMAXLAT} ${SHADOW_FAST} > /dev/null
-                  ${SHADOW} ${SUN_AZ_P05} ${SUN_EL} ${F_TOPO}dem_flt.flt ${F_TOPO}shadow_p05.flt -mercator ${MERCMINLAT} ${MERCMAXLAT} ${SHADOW_FAST} > /dev/null
-                  ${SHADOW} ${SUN_AZ_P1} ${SUN_EL} ${F_TOPO}dem_flt.flt ${F_TOPO}shadow_p1.flt -mercator ${MERCMINLAT} ${MERCMAXLAT} ${SHADOW_FAST} > /dev/null
-
-                  # bilinear interpolation was really messing up the output resolution... removed
-                  gdalwarp -s_srs EPSG:3395 -t_srs EPSG:4326  -ts $demwidth $demheight -te $demxmin $demymin $demxmax $demymax ${F_TOPO}shadow_m1.flt ${F_TOPO}shadow_back_m1.tif -q
-                  gdalwarp -s_srs EPSG:3395 -t_srs EPSG:4326  -ts $demwidth $demheight -te $demxmin $demymin $demxmax $demymax ${F_TOPO}shadow_m05.flt ${F_TOPO}shadow_back_m05.tif -q
-                  gdalwarp -s_srs EPSG:3395 -t_srs EPSG:4326  -ts $demwidth $demheight -te $demxmin $demymin $demxmax $demymax ${F_TOPO}shadow.flt ${F_TOPO}shadow_back.tif -q
-                  gdalwarp -s_srs EPSG:3395 -t_srs EPSG:4326  -ts $demwidth $demheight -te $demxmin $demymin $demxmax $demymax ${F_TOPO}shadow_p1.flt ${F_TOPO}shadow_back_p1.tif -q
-                  gdalwarp -s_srs EPSG:3395 -t_srs EPSG:4326  -ts $demwidth $demheight -te $demxmin $demymin $demxmax $demymax ${F_TOPO}shadow_p05.flt ${F_TOPO}shadow_back_p05.tif -q
+                  # Soft shadows: one run combines the azimuths as (all>0)*log(sum of squares+1)
+                  ${SHADOW} ${SUN_AZ_M1},${SUN_AZ_M05},${SUN_AZ},${SUN_AZ_P05},${SUN_AZ_P1} ${SUN_EL} ${F_TOPO}dem_flt.flt ${F_TOPO}shadow.flt ${SHADOW_FAST} -geographic > /dev/null
 
-                  gdal_calc.py --overwrite --type=Float32 --format=GTiff --quiet -A ${F_TOPO}shadow_back.tif -B ${F_TOPO}shadow_back_p1.tif -C ${F_TOPO}shadow_back_m1.tif -D ${F_TOPO}shadow_back_m05.tif -E ${F_TOPO}shadow_back_p05.tif --calc="(((A>0)*1+(B>0)*1+(C>0)*1+(D>0)*1+(E>0)*1)==5)*log(A*A+B*B+C*C+D*D+E*E+1)" --outfile=${F_TOPO}shadow_back_add.tif
+                  # output is on the same grid as the DEM
+                  gdal_translate -of GTiff ${F_TOPO}shadow.flt ${F_TOPO}shadow_back_add.tif -q
 
                 fi
                 MAX_SHADOW=$(gmt grdinfo -C ${F_TOPO}shadow_back_add.tif | gawk '{print $7}')